@@ -0,0 +1,13 @@
+#! /usr/bin/env bash
+
+# Meals per second, with no time spent thinking, eating nor washing,
+# so that only the synchronization is measured; extra options (e.g. -W 4)
+# are passed on to the simulation
+
+make -s
+
+for n in 5 20 100 1000
+do
+    echo -n "$n philosophers: "
+    ./simulation -b -n $n -l $((10000 / n)) -L $((10000 / n)) -f 6 -k 4 -p 10 -s 10 -t 1 -c 50 -e 1 -w 0 "$@"
+done
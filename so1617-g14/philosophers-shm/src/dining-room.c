@@ -1,14 +1,17 @@
 /**
  * \brief Dining room
  *
+ * Meals and cutlery are taken and returned with atomic operations on the
+ * shared counters. A philosopher only blocks when what he wants ran out:
+ * he then asks one of the waiters for more and waits for it.
+ *
  * \author Miguel Oliveira e Silva - 2016
  */
 
 
-#include "semaphore.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/sem.h>
+#include <stdbool.h>
 
 #include "utils.h"
 #include "dining-room.h"
@@ -28,74 +31,104 @@ DiningRoom *dining_room_new(int pizza, int spaghetti, int cleanForks, int cleanK
     d->dirtyKnives = dirtyKnives;
     d->dirtyForksInWaiter = dirtyForksInWaiter;
     d->dirtyKnivesInWaiter = dirtyKnivesInWaiter;
+    d->waitingPizza = 0;
+    d->waitingSpaghetti = 0;
+    d->waitingCutlery = 0;
+    d->meals = 0;
+    d->washed = 0;
     return d;
 }
 
 /**
- * Fetch pizza
+ * Take n units of a counter, if it has that many
  */
-void dining_room_fetch_pizza(Simulation *s)
+static bool take(atomic_int *counter, int n)
 {
-    sem_t *mutex_pizza = semaphore_open("/mutex_pizza", 1);
-    sem_t *mutex_req_pizza = semaphore_open("/mutex_req_pizza", 1);
-
-    sem_t *signal_replenish_pizza = semaphore_open("/signal_replenish_pizza", 0);
-    sem_t *signal_waiter = semaphore_open("/signal_waiter", 0);
+    int value = atomic_load_explicit(counter, memory_order_relaxed);
 
+    while (value >= n)
+        if (atomic_compare_exchange_weak_explicit(counter, &value, value - n, memory_order_acquire, memory_order_relaxed))
+            return true;
+    return false;
+}
 
-    semaphore_wait(mutex_pizza);
-    semaphore_wait(mutex_req_pizza);
-    int piz = s->diningRoom->pizza;
+/**
+ * Give back n units of a counter
+ */
+static void give(atomic_int *counter, int n)
+{
+    atomic_fetch_add_explicit(counter, n, memory_order_release);
+}
 
-    if (piz == 0)
-    {
-        // Set pizza request
-        s->waiter->reqPizza = W_ACTIVE;
+/**
+ * Take a fork and a knife, or none of them
+ */
+static bool take_fork_knife(DiningRoom *d)
+{
+    if (!take(&d->cleanForks, 1))
+        return false;
+    if (take(&d->cleanKnives, 1))
+        return true;
+
+    // No knife: the fork is not kept while waiting for one
+    give(&d->cleanForks, 1);
+    return false;
+}
 
-        // Wake up waiter
-        semaphore_post(signal_waiter);
+static bool take_pizza(DiningRoom *d)
+{
+    return take(&d->pizza, 1);
+}
 
-        // Wait for pizza to be replenished
-        semaphore_wait(signal_replenish_pizza);
-    }
+static bool take_spaghetti(DiningRoom *d)
+{
+    return take(&d->spaghetti, 1);
+}
 
-    s->diningRoom->pizza--;
-    semaphore_post(mutex_pizza);
-    semaphore_post(mutex_req_pizza);
+static bool take_two_forks(DiningRoom *d)
+{
+    return take(&d->cleanForks, 2);
 }
 
 /**
- * Fetch spaghetti
+ * Wait on signal until take succeeds, asking a waiter for request r each time it
+ * fails. Once served, a philosopher wakes up the next one waiting for the same,
+ * which either is served too or asks again, so that several requests of a kind
+ * can be served by different waiters at the same time
  */
- void dining_room_fetch_spaghetti(Simulation *s)
- {
-     sem_t *mutex_spaghetti = semaphore_open("/mutex_spaghetti", 1);
-     sem_t *mutex_req_spaghetti = semaphore_open("/mutex_req_spaghetti", 1);
-
-     sem_t *signal_replenish_spaghetti = semaphore_open("/signal_replenish_spaghetti", 0);
-     sem_t *signal_waiter = semaphore_open("/signal_waiter", 0);
-
-
-     semaphore_wait(mutex_spaghetti);
-     semaphore_wait(mutex_req_spaghetti);
-     int spag = s->diningRoom->spaghetti;
+static void dining_room_wait_for(bool (*take)(DiningRoom *d), int r, atomic_int *waiting, sem_t *signal, Simulation *s)
+{
+    if (take(s->diningRoom))
+        return;
 
-     if (spag == 0)
-     {
-         // Set spaghetti request
-         s->waiter->reqSpaghetti = W_ACTIVE;
+    atomic_fetch_add(waiting, 1);
+    while (!take(s->diningRoom))
+    {
+        // Request it to a waiter
+        waiter_request(r, s);
 
-         // Wake up waiter
-         semaphore_post(signal_waiter);
+        // Wait for it to be replenished
+        semaphore_wait(signal);
+    }
+    if (atomic_fetch_sub(waiting, 1) > 1)
+        semaphore_post(signal);
+}
 
-         // Wait for spaghetti to be replenished
-         semaphore_wait(signal_replenish_spaghetti);
-     }
+/**
+ * Fetch pizza
+ */
+void dining_room_fetch_pizza(Simulation *s)
+{
+    dining_room_wait_for(take_pizza, REQ_PIZZA, &s->diningRoom->waitingPizza, &s->sems->signal_replenish_pizza, s);
+}
 
-     s->diningRoom->spaghetti--;
-     semaphore_post(mutex_spaghetti);
-     semaphore_post(mutex_req_spaghetti);
- }
+/**
+ * Fetch spaghetti
+ */
+void dining_room_fetch_spaghetti(Simulation *s)
+{
+    dining_room_wait_for(take_spaghetti, REQ_SPAGHETTI, &s->diningRoom->waitingSpaghetti, &s->sems->signal_replenish_spaghetti, s);
+}
 
 
 /**
@@ -103,53 +136,7 @@ void dining_room_fetch_pizza(Simulation *s)
  */
 void dining_room_fetch_pizza_cutlery(Simulation *s)
 {
-  sem_t *mutex_clean_forks = semaphore_open("/mutex_clean_forks", 1);
-  sem_t *mutex_clean_knives = semaphore_open("/mutex_clean_knives", 1);
-  sem_t *mutex_req_cutlery = semaphore_open("/mutex_req_cutlery", 1);
-  sem_t *mutex_dirty_forks = semaphore_open("/mutex_dirty_forks",1);
-  sem_t *mutex_dirty_knives = semaphore_open("/mutex_dirty_knives", 1);
-
-
-  sem_t *signal_wash_cutlery = semaphore_open("/signal_wash_cutlery", 0);
-  sem_t *signal_waiter = semaphore_open("/signal_waiter", 0);
-
-
-  // Entering critical zone
-
-  semaphore_wait(mutex_clean_forks);
-  semaphore_wait(mutex_dirty_forks);
-  semaphore_wait(mutex_clean_knives);
-  semaphore_wait(mutex_dirty_knives);
-  semaphore_wait(mutex_req_cutlery);
-
-  // TODO equacionar condição para não lavar desnecessariamente loiça
-  if((s->diningRoom->cleanForks == 0 && s->diningRoom->dirtyForks > 0) || (s->diningRoom->cleanKnives == 0 && s->diningRoom->dirtyKnives > 0))
-  {
-    // Set cutlery request
-    s->waiter->reqCutlery = W_ACTIVE;
-
-    // Wake up waiter
-    semaphore_post(signal_waiter);
-
-    printf("Waiting for clean forks...\n");
-
-    // Wait for cutlery to be washed
-    semaphore_wait(signal_wash_cutlery);
-  }
-  if(s->diningRoom->cleanForks > 0 && s->diningRoom->cleanKnives > 0)
-  {
-    // Philosopher gets his desired cutlery
-    s->diningRoom->cleanForks--;
-    s->diningRoom->cleanKnives--;
-  }
-
-  // Leaving critical zone
-  semaphore_post(mutex_clean_forks);
-  semaphore_post(mutex_dirty_forks);
-  semaphore_post(mutex_clean_knives);
-  semaphore_post(mutex_dirty_knives);
-  semaphore_post(mutex_req_cutlery);
-
+    dining_room_wait_for(take_fork_knife, REQ_CUTLERY, &s->diningRoom->waitingCutlery, &s->sems->signal_wash_cutlery, s);
 }
 
 /**
@@ -157,45 +144,7 @@ void dining_room_fetch_pizza_cutlery(Simulation *s)
  */
 void dining_room_fetch_spaghetti_cutlery(Simulation *s)
 {
-  sem_t *mutex_clean_forks = semaphore_open("/mutex_clean_forks", 1);
-
-  sem_t *mutex_req_cutlery = semaphore_open("/mutex_req_cutlery", 1);
-  sem_t *mutex_dirty_forks = semaphore_open("/mutex_dirty_forks",1);
-
-
-  sem_t *signal_wash_cutlery = semaphore_open("/signal_wash_cutlery", 0);
-  sem_t *signal_waiter = semaphore_open("/signal_waiter", 0);
-
-
-  // Entering critical zone
-  semaphore_wait(mutex_clean_forks);
-  semaphore_wait(mutex_dirty_forks);
-  semaphore_wait(mutex_req_cutlery);
-
-  if(s->diningRoom->dirtyForks + s->diningRoom->cleanForks >= 2)
-  {
-    // Set cutlery request
-    s->waiter->reqCutlery = W_ACTIVE;
-
-    // Wake up waiter
-    semaphore_post(signal_waiter);
-
-    printf("Waiting for clean forks...\n");
-
-    // Wait for cutlery to be washed
-    semaphore_wait(signal_wash_cutlery);
-  }
-  if(s->diningRoom->cleanForks >= 2)
-  {
-    // Philosopher gets his desired cutlery
-    s->diningRoom->cleanForks--;
-    s->diningRoom->cleanForks--;
-  }
-  // Leaving critical zone
-  semaphore_post(mutex_clean_forks);
-  semaphore_post(mutex_dirty_forks);
-  semaphore_post(mutex_req_cutlery);
-
+    dining_room_wait_for(take_two_forks, REQ_CUTLERY, &s->diningRoom->waitingCutlery, &s->sems->signal_wash_cutlery, s);
 }
 
 /**
@@ -203,8 +152,7 @@ void dining_room_fetch_spaghetti_cutlery(Simulation *s)
  */
 void dining_room_replenish_pizza(Simulation *s)
 {
-    printf("Replenishing pizza...\n");
-    s->diningRoom->pizza = s->params->NUM_PIZZA;
+    atomic_store(&s->diningRoom->pizza, s->params->NUM_PIZZA);
 }
 
 /**
@@ -212,93 +160,38 @@ void dining_room_replenish_pizza(Simulation *s)
  */
 void dining_room_replenish_spaghetti(Simulation *s)
 {
-    printf("Replenishing spaghetti...\n");
-    s->diningRoom->spaghetti = s->params->NUM_SPAGHETTI;
-}
-
-/**
- * Moves the dirty cutlery used by philosophers to the waiter
- */
-void dining_room_prepare_wash(Simulation *s)
-{
-    // Prepare forks
-    s->diningRoom->dirtyForksInWaiter = s->diningRoom->dirtyForks;
-    s->diningRoom->dirtyForks = 0;
-
-    // Prepare knives
-    s->diningRoom->dirtyKnivesInWaiter = s->diningRoom->dirtyKnives;
-    s->diningRoom->dirtyKnives = 0;
+    atomic_store(&s->diningRoom->spaghetti, s->params->NUM_SPAGHETTI);
 }
 
 /**
- * Washes the dirty cutlery used by philosophers
+ * Washes the dirty cutlery used by philosophers; that returned meanwhile is
+ * left for the next wash, which another waiter may be doing at the same time
  */
-void dining_room_wash_cutlery(Simulation *s)
+void dining_room_wash(Simulation *s)
 {
-    // Wash forks
-    printf("Washing %d dirty forks in waiter...\n", s->diningRoom->dirtyForksInWaiter);
-    s->diningRoom->cleanForks += s->diningRoom->dirtyForksInWaiter;
-
-    // Wash knives
-    printf("Washing %d dirty knives in waiter...\n", s->diningRoom->dirtyKnivesInWaiter);
-    s->diningRoom->cleanKnives += s->diningRoom->dirtyKnivesInWaiter;
-
-    s->diningRoom->dirtyForksInWaiter = 0;
-    s->diningRoom->dirtyKnivesInWaiter = 0;
+    // Move the dirty cutlery to the waiter
+    int forks = atomic_exchange(&s->diningRoom->dirtyForks, 0);
+    atomic_fetch_add(&s->diningRoom->dirtyForksInWaiter, forks);
+    int knives = atomic_exchange(&s->diningRoom->dirtyKnives, 0);
+    atomic_fetch_add(&s->diningRoom->dirtyKnivesInWaiter, knives);
+
+    msleep(s->params->WASH_TIME);
+
+    // Give it back clean
+    atomic_fetch_sub(&s->diningRoom->dirtyForksInWaiter, forks);
+    atomic_fetch_sub(&s->diningRoom->dirtyKnivesInWaiter, knives);
+    atomic_fetch_add(&s->diningRoom->washed, 1);
+    give(&s->diningRoom->cleanForks, forks);
+    give(&s->diningRoom->cleanKnives, knives);
 }
 
 void dining_room_return_spaghetti_cutlery(Simulation *s)
 {
-    sem_t *mutex_dirty_forks = semaphore_open("/mutex_dirty_forks", 1);
-    sem_t *mutex_clean_forks = semaphore_open("/mutex_clean_forks", 1);
-
-    semaphore_wait(mutex_dirty_forks);
-    semaphore_wait(mutex_clean_forks);
-
-    /* TODO Confirmar se estas condições são realmente necessárias
-       ou é um erro nosso o número de knives/forks ser maior que o inicial
-    */
-    if(s->diningRoom->dirtyForks + s->diningRoom->cleanForks + s->diningRoom->dirtyForksInWaiter < s->params->NUM_FORKS-1)
-    {
-      s->diningRoom->dirtyForks++;
-      s->diningRoom->dirtyForks++;
-
-    }
-    semaphore_post(mutex_dirty_forks);
-    semaphore_post(mutex_clean_forks);
-    printf("Returning dirty forks...\n");
+    give(&s->diningRoom->dirtyForks, 2);
 }
 
 void dining_room_return_pizza_cutlery(Simulation *s)
 {
-    sem_t *mutex_dirty_forks = semaphore_open("/mutex_dirty_forks", 1);
-    sem_t *mutex_clean_forks = semaphore_open("/mutex_clean_forks", 1);
-    sem_t *mutex_dirty_knives = semaphore_open("/mutex_dirty_knives", 1);
-    sem_t *mutex_clean_knives = semaphore_open("/mutex_clean_knives", 1);
-
-    // Entering critical zone
-    semaphore_wait(mutex_dirty_knives);
-    semaphore_wait(mutex_clean_knives);
-    semaphore_wait(mutex_dirty_forks);
-    semaphore_wait(mutex_clean_forks);
-
-    /* TODO Confirmar se estas condições são realmente necessárias
-       ou é um erro nosso o número de knives/forks ser maior que o inicial
-    */
-    if(s->diningRoom->dirtyKnives + s->diningRoom->cleanKnives + s->diningRoom->dirtyKnivesInWaiter < s->params->NUM_KNIVES)
-    {
-      s->diningRoom->dirtyKnives++;
-    }
-    if(s->diningRoom->dirtyForks + s->diningRoom->cleanForks + s->diningRoom->dirtyForksInWaiter < s->params->NUM_FORKS)
-    {
-      s->diningRoom->dirtyForks++;
-    }
-
-    // Leaving critical zone
-    semaphore_post(mutex_dirty_knives);
-    semaphore_post(mutex_clean_knives);
-    semaphore_post(mutex_dirty_forks);
-    semaphore_post(mutex_clean_forks);
-
-    printf("Returning dirty knives...\n");
+    give(&s->diningRoom->dirtyForks, 1);
+    give(&s->diningRoom->dirtyKnives, 1);
 }
@@ -7,17 +7,24 @@
 #ifndef DINING_ROOM_H
 #define DINING_ROOM_H
 
+#include <stdatomic.h>
 #include "simulation.h"
 
+/* The counters are taken and given back with atomic operations on the shared memory, without any lock */
 typedef struct _DiningRoom_ {
-    int pizza;                  // number of pizza meals available in dining room [0;NUM_PIZZA]
-    int spaghetti;              // number of spaghetti meals available in dining room [0;NUM_SPAGHETTI]
-    int cleanForks;             // number of clean forks available in dining room [0;NUM_FORKS]
-    int cleanKnives;            // number of clean knives available in dining room [0;NUM_KNIVES]
-    int dirtyForks;             // number of dirty forks in dining room [0;NUM_FORKS]
-    int dirtyKnives;            // number of dirty knives in dining room [0;NUM_KNIVES]
-    int dirtyForksInWaiter;     // number of dirty forks in waiter (i.e. the dirty forks that are being washed)
-    int dirtyKnivesInWaiter;    // number of dirty knives in waiter (i.e. the dirty knives that are being washed)
+    atomic_int pizza;                  // number of pizza meals available in dining room [0;NUM_PIZZA]
+    atomic_int spaghetti;              // number of spaghetti meals available in dining room [0;NUM_SPAGHETTI]
+    atomic_int cleanForks;             // number of clean forks available in dining room [0;NUM_FORKS]
+    atomic_int cleanKnives;            // number of clean knives available in dining room [0;NUM_KNIVES]
+    atomic_int dirtyForks;             // number of dirty forks in dining room [0;NUM_FORKS]
+    atomic_int dirtyKnives;            // number of dirty knives in dining room [0;NUM_KNIVES]
+    atomic_int dirtyForksInWaiter;     // number of dirty forks in waiters (i.e. the dirty forks that are being washed)
+    atomic_int dirtyKnivesInWaiter;    // number of dirty knives in waiters (i.e. the dirty knives that are being washed)
+    atomic_int waitingPizza;           // number of philosophers waiting for pizza to be replenished
+    atomic_int waitingSpaghetti;       // number of philosophers waiting for spaghetti to be replenished
+    atomic_int waitingCutlery;         // number of philosophers waiting for cutlery to be washed
+    atomic_int meals;                  // number of meals eaten so far
+    atomic_int washed;                 // number of washes whose cutlery has left the waiter (see logger)
 } DiningRoom;
 
 DiningRoom *dining_room_new(int pizza, int spaghetti, int cleanForks, int cleanKnives, int dirtyForks, int dirtyKnives, int dirtyForksInWaiter, int dirtyKnivesInWaiter);
@@ -28,13 +35,12 @@ void dining_room_fetch_spaghetti(Simulation *s);
 void dining_room_replenish_pizza(Simulation *s);
 void dining_room_replenish_spaghetti(Simulation *s);
 
-void dining_room_fetch_clean_fork(Simulation *s);
-void dining_room_fetch_clean_knife(Simulation *s);
+void dining_room_fetch_pizza_cutlery(Simulation *s);
+void dining_room_fetch_spaghetti_cutlery(Simulation *s);
 
-void dining_room_return_dirty_fork(Simulation *s);
-void dining_room_return_dirty_knife(Simulation *s);
+void dining_room_return_pizza_cutlery(Simulation *s);
+void dining_room_return_spaghetti_cutlery(Simulation *s);
 
-void dining_room_prepare_wash(Simulation *s);
-void dining_room_wash_cutlery(Simulation *s);
+void dining_room_wash(Simulation *s);
 
 #endif
@@ -7,23 +7,264 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "logger.h"
 #include "utils.h"
 
 static void unsafe_logger(Simulation* sim);
+static void invariantCheck(Simulation* sim);
+
+/* events a ring holds (a power of 2); a full ring stalls its process, no event is lost */
+#define LOG_RING_SIZE 256
+
+/* The events of one process: only it moves head, only the consumer moves tail */
+typedef struct _LogRing_ {
+    atomic_uint head;                 // events written so far
+    char pad1[60];                    // (head and tail on distinct cache lines)
+    atomic_uint tail;                 // events consumed so far
+    char pad2[60];
+    LogEvent events[LOG_RING_SIZE];
+} LogRing;
+
+/* one ring per philosopher, then one per waiter, then the main process', in shared memory */
+static LogRing *rings;
+static int numRings;
+
+/* who the calling process is */
+static LogAgent selfAgent = LOG_SIMULATION;
+static int selfId = 0;
+
+/* the simulation as the events consumed so far left it */
+static Simulation *mirror;
+
+/* events taken from the rings in one pass, to be sorted by time */
+static LogEvent *batch;
+
+static pthread_t consumerThread;
+static atomic_int stopping = 0;
+
+/* when set, the invariants are still checked, but nothing is printed */
+static bool quiet = false;
+
+/* when set, the events are also written there, in time order */
+static FILE *trace = NULL;
+
+static void *consumer(void *arg);
+
+void logger_quiet(bool q)
+{
+    quiet = q;
+}
+
+void logger_trace(FILE *f)
+{
+    trace = f;
+}
+
+void logger_init(Simulation *s)
+{
+    assert(s != NULL);
+
+    numRings = s->params->NUM_PHILOSOPHERS + s->params->NUM_WAITERS + 1;
+    rings = mmap(NULL, numRings * sizeof(LogRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (rings == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    int i;
+    for (i = 0; i < numRings; i++)
+    {
+        atomic_init(&rings[i].head, 0);
+        atomic_init(&rings[i].tail, 0);
+    }
+    batch = (LogEvent*) memory_allocate(numRings * LOG_RING_SIZE * sizeof(LogEvent));
+
+    // The replayed copy has its own state, but checks the requests of the shared one
+    mirror = simulation_new(s->params);
+    mirror->sems = s->sems;
+    mirror->requests = s->requests;
+}
 
 /**
- * Change this function to get a safe access to shared simulation data!
+ * Not done by logger_init, so that no forked process inherits a copy of a running thread
+ */
+void logger_start()
+{
+    if (pthread_create(&consumerThread, NULL, consumer, NULL) != 0)
+    {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void logger_agent(LogAgent agent, int id)
+{
+    selfAgent = agent;
+    selfId = id;
+}
+
+/**
+ * Records the state of the calling process and the dining room counters
  */
 void logger(Simulation* sim)
 {
     assert(sim != NULL);
 
-    sem_t *mutex_logger = semaphore_open("/mutex_logger", 1);
-    semaphore_wait(mutex_logger);
-    unsafe_logger(sim);
-    semaphore_post(mutex_logger);
+    LogRing *ring;
+    if (selfAgent == LOG_PHILOSOPHER)
+        ring = &rings[selfId];
+    else if (selfAgent == LOG_WAITER)
+        ring = &rings[sim->params->NUM_PHILOSOPHERS + selfId];
+    else
+        ring = &rings[numRings - 1];
+
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == LOG_RING_SIZE)
+        sched_yield();
+
+    LogEvent *e = &ring->events[head % LOG_RING_SIZE];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    e->time = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    e->id = selfId;
+    e->agent = selfAgent;
+    if (selfAgent == LOG_PHILOSOPHER)
+    {
+        Philosopher *p = sim->philosophers[selfId];
+        e->state[0] = p->state;
+        e->state[1] = p->meal;
+        e->state[2] = p->cutlery[0];
+        e->state[3] = p->cutlery[1];
+    }
+    else if (selfAgent == LOG_WAITER)
+    {
+        Waiter *w = sim->waiters[selfId];
+        e->state[0] = w->state;
+        e->state[1] = w->reqCutlery;
+        e->state[2] = w->reqPizza;
+        e->state[3] = w->reqSpaghetti;
+    }
+    DiningRoom *d = sim->diningRoom;
+    e->diningRoom[0] = d->pizza;
+    e->diningRoom[1] = d->spaghetti;
+    e->diningRoom[2] = d->cleanForks;
+    e->diningRoom[3] = d->cleanKnives;
+    // Cutlery is counted in washed as it leaves a waiter, before it can come back dirty;
+    // if that happened meanwhile, the dirty counts are taken again, not to count it twice
+    int washed;
+    do
+    {
+        washed = d->washed;
+        e->diningRoom[6] = d->dirtyForksInWaiter;
+        e->diningRoom[7] = d->dirtyKnivesInWaiter;
+        e->diningRoom[4] = d->dirtyForks;
+        e->diningRoom[5] = d->dirtyKnives;
+    } while (washed != d->washed);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void logger_stop()
+{
+    atomic_store(&stopping, 1);
+    if (pthread_join(consumerThread, NULL) != 0)
+        perror("pthread_join");
+    if (trace != NULL && fclose(trace) != 0)
+        perror("trace");
+
+    if (munmap(rings, numRings * sizeof(LogRing)) != 0)
+    {
+        perror("munmap");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int by_time(const void *a, const void *b)
+{
+    uint64_t ta = ((const LogEvent*) a)->time, tb = ((const LogEvent*) b)->time;
+    return (ta > tb) - (ta < tb);
+}
+
+/**
+ * Sets the state an event records in sim, and logs it
+ */
+void logger_replay(Simulation *sim, LogEvent *e)
+{
+    assert(sim != NULL && e != NULL);
+
+    if (e->agent == LOG_PHILOSOPHER)
+    {
+        Philosopher *p = sim->philosophers[e->id];
+        p->state = e->state[0];
+        p->meal = e->state[1];
+        p->cutlery[0] = e->state[2];
+        p->cutlery[1] = e->state[3];
+    }
+    else if (e->agent == LOG_WAITER)
+    {
+        Waiter *w = sim->waiters[e->id];
+        w->state = e->state[0];
+        w->reqCutlery = e->state[1];
+        w->reqPizza = e->state[2];
+        w->reqSpaghetti = e->state[3];
+    }
+    DiningRoom *d = sim->diningRoom;
+    d->pizza = e->diningRoom[0];
+    d->spaghetti = e->diningRoom[1];
+    d->cleanForks = e->diningRoom[2];
+    d->cleanKnives = e->diningRoom[3];
+    d->dirtyForks = e->diningRoom[4];
+    d->dirtyKnives = e->diningRoom[5];
+    d->dirtyForksInWaiter = e->diningRoom[6];
+    d->dirtyKnivesInWaiter = e->diningRoom[7];
+
+    if (quiet)
+        invariantCheck(sim);
+    else
+        unsafe_logger(sim);
+}
+
+/**
+ * Takes the events of all rings, writes them to the trace, if any, and
+ * replays them in time order, logging each;
+ * the rings are drained once more after stopping is seen, so no event is left
+ */
+static void *consumer(void *arg)
+{
+    (void) arg;
+    int last;
+    do
+    {
+        last = atomic_load(&stopping);
+        int i, n = 0;
+        for (i = 0; i < numRings; i++)
+        {
+            LogRing *ring = &rings[i];
+            unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            for (; tail != head; tail++)
+                batch[n++] = ring->events[tail % LOG_RING_SIZE];
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        }
+        qsort(batch, n, sizeof(LogEvent), by_time);
+        if (trace != NULL && fwrite(batch, sizeof(LogEvent), n, trace) != (size_t) n)
+        {
+            perror("trace");
+            exit(EXIT_FAILURE);
+        }
+        for (i = 0; i < n; i++)
+            logger_replay(mirror, &batch[i]);
+        if (n == 0 && !last)
+            usleep(1000);
+    } while (!last);
+    return NULL;
 }
 
 /*********************************************************************/
@@ -117,11 +358,40 @@ static void invariantCheck(Simulation* sim)
         fprintf(stderr, "INVARIANT ERROR: sim->philosophers not defined!!\n");
         exit(EXIT_FAILURE);
     }
-    if (sim->waiter == NULL)
+    if (sim->waiters == NULL)
     {
-        fprintf(stderr, "INVARIANT ERROR: sim->waiter not defined!!\n");
+        fprintf(stderr, "INVARIANT ERROR: sim->waiters not defined!!\n");
         exit(EXIT_FAILURE);
     }
+    int i, pending = 0;
+    for (i = 0; i < sim->params->NUM_WAITERS; i++)
+    {
+        if (sim->waiters[i] == NULL)
+        {
+            fprintf(stderr, "INVARIANT ERROR: sim->waiters[%d] not defined!!\n", i);
+            exit(EXIT_FAILURE);
+        }
+        if (sim->waiters[i]->state == W_DEAD && !simulation_are_philosophers_dead(sim))
+        {
+            fprintf(stderr, "INVARIANT ERROR: Waiter %d dead with philosophers alive!\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    // A replayed trace has no requests
+    if (sim->requests != NULL)
+    {
+        semaphore_wait(&sim->sems->mutex_requests);
+        for (i = 0; i < sim->params->NUM_WAITERS; i++)
+        {
+            if (pending & sim->requests[i].req & ~REQ_LEAVE)
+            {
+                fprintf(stderr, "INVARIANT ERROR: Request %#x pending in more than one waiter!\n", pending & sim->requests[i].req);
+                exit(EXIT_FAILURE);
+            }
+            pending |= sim->requests[i].req;
+        }
+        semaphore_post(&sim->sems->mutex_requests);
+    }
     if (!(sim->diningRoom->pizza >= 0 && sim->diningRoom->pizza <= sim->params->NUM_PIZZA))
     {
         fprintf(stderr, "INVARIANT ERROR: Invalid buffet number of pizzas: %d!\n", sim->diningRoom->pizza);
@@ -307,7 +577,11 @@ static void unsafe_logger(Simulation* sim)
         printf("%s%s%s", YELLOW," Dirty", END);
         printf("%s%s%s", BLUE, " Clean", END);
         printf("%s%s%s", YELLOW," Dirty", END);
-        printf("%sWaiter:%s", EMPTY_SYMBOL, HEADER_SPACES);
+        if (sim->params->NUM_WAITERS == 1)
+            printf("%sWaiter:%s", EMPTY_SYMBOL, HEADER_SPACES);
+        else
+            for(i = 0; i < sim->params->NUM_WAITERS; i++)
+                printf("%sWt%02d:%s ", EMPTY_SYMBOL, i+1, HEADER_SPACES);
         for(i = 0; i < sim->params->NUM_PHILOSOPHERS; i++)
             printf(" Ph%02d:%s", i+1, HEADER_SPACES);
         printf("\n");
@@ -345,9 +619,12 @@ static void unsafe_logger(Simulation* sim)
     printf("%s",dirtyKnivesInWaiter > 0 ? RED : BLACK);
     printf("%2d ",dirtyKnivesInWaiter);
     printf("%s",END);
-    printf("[");
-    waiterLogger(sim->waiter);
-    printf("]");
+    for(i = 0; i < sim->params->NUM_WAITERS; i++)
+    {
+        printf("[");
+        waiterLogger(sim->waiters[i]);
+        printf("]");
+    }
     for(i = 0; i < sim->params->NUM_PHILOSOPHERS; i++)
     {
         printf("[");
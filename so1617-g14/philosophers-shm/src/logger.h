@@ -1,14 +1,44 @@
 /**
  *  \brief Logging module
  *
+ *  Each state change is recorded as a compact event in a ring of the process
+ *  that made it, in shared memory and with no lock; a thread of the main
+ *  process takes the events of all rings, in time order, replays them over its
+ *  own copy of the simulation, checks the invariants and prints the table.
+ *
  * \author Miguel Oliveira e Silva - 2016
  */
 
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include "simulation.h"
 
+/* who records an event */
+typedef enum {
+    LOG_SIMULATION,                   // the main process: only the dining room counters
+    LOG_PHILOSOPHER,                  // a philosopher: its state and the dining room counters
+    LOG_WAITER                        // a waiter: its state and the dining room counters
+} LogAgent;
+
+/* a state change, as seen by the agent that made it */
+typedef struct _LogEvent_ {
+    uint64_t time;                    // CLOCK_MONOTONIC, in nanoseconds
+    int32_t id;                       // philosopher or waiter number
+    uint8_t agent;                    // LogAgent
+    uint8_t state[4];                 // philosopher: state, meal, cutlery[0..1]; waiter: state, reqCutlery, reqPizza, reqSpaghetti
+    int32_t diningRoom[8];            // DiningRoom counters, pizza to dirtyKnivesInWaiter, in declaration order
+} LogEvent;
+
+void logger_init(Simulation *s);
+void logger_start();
+void logger_agent(LogAgent agent, int id);
 void logger(Simulation* sim);
+void logger_quiet(bool quiet);
+void logger_trace(FILE *f);
+void logger_replay(Simulation *sim, LogEvent *e);
+void logger_stop();
 
 #endif
@@ -55,6 +55,7 @@ void philosopher_hungry(Philosopher *p, Simulation *s)
     if (rand_interval(0, 100) <= s->params->CHOOSE_PIZZA_PROB)
     {
         p->meal = P_GET_PIZZA;
+        logger(s);
         dining_room_fetch_pizza(s);
 
         p->cutlery[0] = P_GET_FORK;
@@ -64,6 +65,7 @@ void philosopher_hungry(Philosopher *p, Simulation *s)
     else
     {
         p->meal = P_GET_SPAGHETTI;
+        logger(s);
         dining_room_fetch_spaghetti(s);
 
         p->cutlery[0] = P_GET_FORK;
@@ -98,21 +100,13 @@ void philosopher_eat(Philosopher *p, Simulation *s)
 
     // Pretend to eat
     msleep(rand_interval(0, s->params->EAT_TIME));
+    atomic_fetch_add(&s->diningRoom->meals, 1);
 
     // Return dirty cutlery
     if (p->meal == P_EAT_PIZZA)
-    {
-        printf("Returning pizza cutlery\n");
         dining_room_return_pizza_cutlery(s);
-        printf("Returned pizza cutlery successfully\n");
-    }
     else
-    {
-        printf("Returning pizza cutlery\n");
         dining_room_return_spaghetti_cutlery(s);
-        printf("Returned spaghetti cutlery successfully\n");
-
-    }
 
     p->state = P_FULL;
     p->meal = P_NONE;
@@ -10,6 +10,7 @@
 #include <getopt.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 #include <sys/wait.h>
 #include <sys/mman.h>
 
@@ -17,6 +18,7 @@
 #include "dining-room.h"
 #include "waiter.h"
 #include "logger.h"
+#include "trace.h"
 #include "utils.h"
 
 /* internal functions */
@@ -24,8 +26,19 @@ static void help(char* prog);
 static void args_parse(Parameters *params, int argc, char* argv[]);
 static void show_params(Parameters *params);
 
+/* set by -b: no prompt nor log lines, only the number of meals per second */
+static bool benchmark = false;
+
+/* set by -T: file the events are written to; by -R: trace replayed instead of running */
+static char *tracePath = NULL;
+static char *replayPath = NULL;
+
+/* set by -S: seed of the random numbers of every process, each on a stream of its own */
+static uint64_t seed;
+static bool seeded = false;
+
 static void simulation_fork_to_philosopher(pid_t *pidp, int i, Simulation *s);
-static void simulation_fork_to_waiter(pid_t *pidp, Waiter *w, Simulation *s);
+static void simulation_fork_to_waiter(pid_t *pidp, int i, Simulation *s);
 
 void simulation_debug(Simulation *s)
 {
@@ -47,6 +60,7 @@ void simulation_debug(Simulation *s)
     printf("\tCHOOSE_PIZZA_PROB: %d\n", s->params->CHOOSE_PIZZA_PROB);
     printf("\tEAT_TIME: %d\n", s->params->EAT_TIME);
     printf("\tWASH_TIME: %d\n", s->params->WASH_TIME);
+    printf("\tNUM_WAITERS: %d\n", s->params->NUM_WAITERS);
 
     printf("Dining Room:\n");
     printf("\tAddress: %p\n", s->diningRoom);
@@ -58,6 +72,7 @@ void simulation_debug(Simulation *s)
     printf("\tdirtyKnives: %d\n", s->diningRoom->dirtyKnives);
     printf("\tdirtyForksInWaiter: %d\n", s->diningRoom->dirtyForksInWaiter);
     printf("\tdirtyKnivesInWaiter: %d\n", s->diningRoom->dirtyKnivesInWaiter);
+    printf("\tmeals: %d\n", s->diningRoom->meals);
 
     printf("Philosophers:\n");
     printf("\tAddress %p\n", s->philosophers);
@@ -72,12 +87,18 @@ void simulation_debug(Simulation *s)
         printf("\t\tcutlery[1]: %d\n", (int) s->philosophers[i]->cutlery[1]);
     }
 
-    printf("Waiter:\n");
-    printf("\tAddress: %p\n", s->waiter);
-    printf("\tstate: %d\n", (int) s->waiter->state);
-    printf("\treqCutlery: %d\n", (int) s->waiter->reqCutlery);
-    printf("\treqPizza: %d\n", (int) s->waiter->reqPizza);
-    printf("\treqSpaghetti: %d\n", (int) s->waiter->reqSpaghetti);
+    printf("Waiters:\n");
+    printf("\tAddress: %p\n", s->waiters);
+    for (i = 0; i < s->params->NUM_WAITERS; i++)
+    {
+        printf("\tWaiter %d:\n", i);
+        printf("\t\tAddress: %p\n", s->waiters[i]);
+        printf("\t\tstate: %d\n", (int) s->waiters[i]->state);
+        printf("\t\treqCutlery: %d\n", (int) s->waiters[i]->reqCutlery);
+        printf("\t\treqPizza: %d\n", (int) s->waiters[i]->reqPizza);
+        printf("\t\treqSpaghetti: %d\n", (int) s->waiters[i]->reqSpaghetti);
+        printf("\t\treq: %#x\n", s->requests[i].req);
+    }
 
     printf("\n\n=====================================\n\n");
 }
@@ -85,21 +106,42 @@ void simulation_debug(Simulation *s)
 int main(int argc, char* argv[])
 {
     // Handle parameters
-    Parameters params = {5,10,100,3,2,10,10,20,50,10,15};
+    Parameters params = {5,10,100,3,2,10,10,20,50,10,15,1};
     args_parse(&params, argc, argv);
-    show_params(&params);
-    printf("<press RETURN>");
-    getchar();
+    if (replayPath != NULL)
+        return trace_replay(replayPath, benchmark);
+    if (!seeded)
+        seed = getpid();
+    if (benchmark)
+        logger_quiet(true);
+    else
+    {
+        show_params(&params);
+        printf("<press RETURN>");
+        getchar();
+    }
 
     // Map simulation in shared memory
     Simulation *s = simulation_share(simulation_new(&params));
 
     // Bootstrap the simulation
-    pid_t *pid = memory_allocate(params.NUM_PHILOSOPHERS + 1);
+    if (tracePath != NULL)
+        logger_trace(trace_create(tracePath, s->params));
+    logger_init(s);
+    pid_t *pid = memory_allocate((params.NUM_PHILOSOPHERS + params.NUM_WAITERS) * sizeof(pid_t));
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
     logger(s);
     simulation_start(s, pid);
+    logger_start();
     simulation_stop(s, pid);
     logger(s);
+    logger_stop();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (benchmark)
+        printf("%d meals in %.3f s: %.1f meals/sec\n", s->diningRoom->meals, elapsed, s->diningRoom->meals / elapsed);
 
     // Unmap simulation in shared memory
     simulation_unshare(s);
@@ -116,6 +158,8 @@ Simulation *simulation_new(Parameters *params)
     s->params = (Parameters*) memory_allocate(sizeof(Parameters));
     memcpy(s->params, params, sizeof(Parameters));
 
+    s->sems = NULL;
+
     s->diningRoom = dining_room_new(params->NUM_PIZZA, params->NUM_SPAGHETTI, params->NUM_FORKS, params->NUM_KNIVES, 0, 0, 0, 0);
 
     s->philosophers = (Philosopher**) memory_allocate(params->NUM_PHILOSOPHERS * sizeof(Philosopher*));
@@ -123,15 +167,31 @@ Simulation *simulation_new(Parameters *params)
     for(i = 0; i < params->NUM_PHILOSOPHERS; i++)
         s->philosophers[i] = philosopher_new();
 
-    s->waiter = waiter_new();
+    s->waiters = (Waiter**) memory_allocate(params->NUM_WAITERS * sizeof(Waiter*));
+    for(i = 0; i < params->NUM_WAITERS; i++)
+        s->waiters[i] = waiter_new();
+
+    s->requests = NULL;
+    s->nextWaiter = 0;
 
     return s;
 }
 
+/**
+ * Size of the shared memory of a simulation
+ */
+static size_t simulation_length(Parameters *params)
+{
+    int n = params->NUM_PHILOSOPHERS;
+    int w = params->NUM_WAITERS;
+    return sizeof(Simulation) + sizeof(Semaphores) + w*sizeof(Requests) + sizeof(Parameters) + sizeof(DiningRoom) + n*sizeof(Philosopher*) + n*sizeof(Philosopher) + w*sizeof(Waiter*) + w*sizeof(Waiter);
+}
+
 Simulation *simulation_share(Simulation *s)
 {
     int n = s->params->NUM_PHILOSOPHERS;
-    size_t length = sizeof(Simulation) + sizeof(Parameters) + sizeof(DiningRoom) + n*sizeof(Philosopher*) + n*sizeof(Philosopher) + sizeof(Waiter);
+    int w = s->params->NUM_WAITERS;
+    size_t length = simulation_length(s->params);
 
     // Get contiguous block of shared memory for the simulation
     Simulation *sm = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
@@ -146,6 +206,26 @@ Simulation *simulation_share(Simulation *s)
     char *p = (char *) sm;
     p += sizeof(Simulation);
 
+    // Semaphores are initialized once, here, and only used through their address
+    sm->sems = (Semaphores*) p;
+    semaphore_init(&sm->sems->mutex_requests, 1);
+    semaphore_init(&sm->sems->signal_replenish_pizza, 0);
+    semaphore_init(&sm->sems->signal_replenish_spaghetti, 0);
+    semaphore_init(&sm->sems->signal_wash_cutlery, 0);
+    p += sizeof(Semaphores);
+
+    int i;
+    sm->requests = (Requests*) p;
+    for (i = 0; i < w; i++)
+    {
+        sm->requests[i].req = 0;
+        sm->requests[i].serving = 0;
+        sm->requests[i].idle = false;
+        semaphore_init(&sm->requests[i].signal, 0);
+    }
+    p += w * sizeof(Requests);
+    sm->nextWaiter = s->nextWaiter;
+
     sm->params = (Parameters*) p;
     memcpy(sm->params, s->params, sizeof(Parameters));
     p += sizeof(Parameters);
@@ -157,7 +237,6 @@ Simulation *simulation_share(Simulation *s)
     sm->philosophers = (Philosopher**) p;
     p += (n * sizeof(Philosopher*));
 
-    int i;
     for (i = 0; i < n; i++)
     {
         sm->philosophers[i] = (Philosopher*) p;
@@ -165,16 +244,31 @@ Simulation *simulation_share(Simulation *s)
         p += sizeof(Philosopher);
     }
 
-    sm->waiter = (Waiter*) p;
-    memcpy(sm->waiter, s->waiter, sizeof(Waiter));
+    sm->waiters = (Waiter**) p;
+    p += (w * sizeof(Waiter*));
+
+    for (i = 0; i < w; i++)
+    {
+        sm->waiters[i] = (Waiter*) p;
+        memcpy(sm->waiters[i], s->waiters[i], sizeof(Waiter));
+        p += sizeof(Waiter);
+    }
 
     return sm;
 }
 
 void simulation_unshare(Simulation *s)
 {
-    int n = s->params->NUM_PHILOSOPHERS;
-    size_t length = sizeof(Simulation) + sizeof(Parameters) + sizeof(DiningRoom) + n*sizeof(Philosopher*) + n*sizeof(Philosopher) + sizeof(Waiter);
+    semaphore_destroy(&s->sems->mutex_requests);
+    semaphore_destroy(&s->sems->signal_replenish_pizza);
+    semaphore_destroy(&s->sems->signal_replenish_spaghetti);
+    semaphore_destroy(&s->sems->signal_wash_cutlery);
+
+    int i;
+    for (i = 0; i < s->params->NUM_WAITERS; i++)
+        semaphore_destroy(&s->requests[i].signal);
+
+    size_t length = simulation_length(s->params);
 
     if (munmap(s, length) != 0)
     {
@@ -194,9 +288,10 @@ static void simulation_fork_to_philosopher(pid_t *pidp, int i, Simulation *s)
             exit(EXIT_FAILURE);
 
         case 0:
-            srand((int) getpid());
+            rand_seed(seed, i);
+            logger_agent(LOG_PHILOSOPHER, i);
             philosopher_lifecycle(s->philosophers[i], s);
-            return;
+            exit(EXIT_SUCCESS);
 
         default:
             *pidp = pid;
@@ -204,7 +299,7 @@ static void simulation_fork_to_philosopher(pid_t *pidp, int i, Simulation *s)
     }
 }
 
-static void simulation_fork_to_waiter(pid_t *pidp, Waiter *w, Simulation *s)
+static void simulation_fork_to_waiter(pid_t *pidp, int i, Simulation *s)
 {
     pid_t pid = fork();
 
@@ -215,9 +310,10 @@ static void simulation_fork_to_waiter(pid_t *pidp, Waiter *w, Simulation *s)
             exit(EXIT_FAILURE);
 
         case 0:
-            srand((int) getpid());
-            waiter_lifecycle(w, s);
-            return;
+            rand_seed(seed, s->params->NUM_PHILOSOPHERS + i);
+            logger_agent(LOG_WAITER, i);
+            waiter_lifecycle(i, s);
+            exit(EXIT_SUCCESS);
 
         default:
             *pidp = pid;
@@ -235,7 +331,7 @@ bool simulation_are_philosophers_dead(Simulation *s)
 }
 
 /**
- * Launch processes for philosophers and waiter
+ * Launch processes for philosophers and waiters
  */
 void simulation_start(Simulation *s, pid_t *pid)
 {
@@ -248,12 +344,13 @@ void simulation_start(Simulation *s, pid_t *pid)
     for (i = 0; i < n; i++)
         simulation_fork_to_philosopher(&pid[i], i, s);
 
-    // Spawn the waiter's process
-    simulation_fork_to_waiter(&pid[i], s->waiter, s);
+    // Spawn the waiters' processes
+    for (i = 0; i < s->params->NUM_WAITERS; i++)
+        simulation_fork_to_waiter(&pid[n + i], i, s);
 }
 
 /**
- * Wait for the death of all philosophers, and request and wait for waiter dead
+ * Wait for the death of all philosophers, and request and wait for waiters dead
  */
 void simulation_stop(Simulation *s, pid_t *pid)
 {
@@ -266,8 +363,10 @@ void simulation_stop(Simulation *s, pid_t *pid)
     for (i = 0; i < n; i++)
         waitpid(pid[i], NULL, 0);
 
-    // Wait for the waiter's process to terminate
-    waitpid(pid[i], NULL, 0);
+    // Ask the waiters to leave, and wait for them to terminate
+    waiter_leave_all(s);
+    for (i = 0; i < s->params->NUM_WAITERS; i++)
+        waitpid(pid[n + i], NULL, 0);
 }
 
 static void help(char* prog)
@@ -291,6 +390,11 @@ static void help(char* prog)
     printf("  -c, --choose-pizza-prob   set probability to choose a pizza meal against a spaghetti meal (default is 50)\n");
     printf("  -e, --eat-time   set maximum milliseconds for eating (default is 10)\n");
     printf("  -w, --wash-time   set maximum milliseconds for washing (default is 15)\n");
+    printf("  -W, --num-waiters   set number of waiters (default is 1)\n");
+    printf("  -b, --benchmark   run without prompt nor log lines, and report the number of meals per second\n");
+    printf("  -T, --trace FILE   also write the events to a binary trace\n");
+    printf("  -R, --replay FILE   replay a trace, instead of running, and report its statistics (only these with -b)\n");
+    printf("  -S, --seed N   set seed of the random numbers, for the same ones in every run (default is the process id)\n");
     printf("\n");
 }
 
@@ -313,6 +417,11 @@ static void args_parse(Parameters *params, int argc, char* argv[])
         {"choose-pizza-prob",required_argument, NULL, 'c' },
         {"eat-time",         required_argument, NULL, 'e' },
         {"wash-time",        required_argument, NULL, 'w' },
+        {"num-waiters",      required_argument, NULL, 'W' },
+        {"benchmark",        no_argument,       NULL, 'b' },
+        {"trace",            required_argument, NULL, 'T' },
+        {"replay",           required_argument, NULL, 'R' },
+        {"seed",             required_argument, NULL, 'S' },
         {0,          0,                 NULL,  0 }
     };
 
@@ -322,7 +431,7 @@ static void args_parse(Parameters *params, int argc, char* argv[])
     {
         int option_index = 0;
 
-        op = getopt_long(argc, argv, "hn:l:L:f:k:p:s:t:c:e:w:", long_options, &option_index);
+        op = getopt_long(argc, argv, "hn:l:L:f:k:p:s:t:c:e:w:W:bT:R:S:", long_options, &option_index);
         int n; // integer number
         switch (op)
         {
@@ -443,6 +552,41 @@ static void args_parse(Parameters *params, int argc, char* argv[])
                 params->WASH_TIME = n;
                 break;
 
+            case 'W':
+                n = atoi(optarg);
+                if (n < 1)
+                {
+                    fprintf(stderr, "ERROR: invalid number of waiters \"%s\"\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                params->NUM_WAITERS = n;
+                break;
+
+            case 'b':
+                benchmark = true;
+                break;
+
+            case 'T':
+                tracePath = optarg;
+                break;
+
+            case 'R':
+                replayPath = optarg;
+                break;
+
+            case 'S':
+            {
+                char *end;
+                seed = strtoull(optarg, &end, 0);
+                if (*optarg == '\0' || *optarg == '-' || *end != '\0')
+                {
+                    fprintf(stderr, "ERROR: invalid seed \"%s\"\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                seeded = true;
+                break;
+            }
+
             default:
                 help(argv[0]);
                 exit(EXIT_FAILURE);
@@ -475,5 +619,7 @@ static void show_params(Parameters *params)
     printf("  --choose-pizza-prob: %d\n", params->CHOOSE_PIZZA_PROB);
     printf("  --eat-time: %d\n", params->EAT_TIME);
     printf("  --wash-time: %d\n", params->WASH_TIME);
+    printf("  --num-waiters: %d\n", params->NUM_WAITERS);
+    printf("  --seed: %llu\n", (unsigned long long) seed);
     printf("\n");
 }
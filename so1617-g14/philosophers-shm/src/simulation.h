@@ -7,16 +7,38 @@
 #ifndef SIMULATION_H
 #define SIMULATION_H
 
+#include <stdbool.h>
+#include <semaphore.h>
+
 struct _Waiter_;
 struct _Parameters_;
 struct _DiningRoom_;
 struct _Philosopher_;
 
+/* Unnamed semaphores, initialized once in the shared memory of the simulation */
+typedef struct _Semaphores_ {
+    sem_t mutex_requests;             // the requests of all waiters
+    sem_t signal_replenish_pizza;     // pizza has been replenished
+    sem_t signal_replenish_spaghetti; // spaghetti has been replenished
+    sem_t signal_wash_cutlery;        // cutlery has been washed
+} Semaphores;
+
+/* The requests made to a waiter, also in the shared memory of the simulation */
+typedef struct _Requests_ {
+    int req;                          // pending requests, served together
+    int serving;                      // requests being served, until philosophers are signaled
+    bool idle;                        // the waiter is waiting for requests
+    sem_t signal;                     // requests were given to the idle waiter
+} Requests;
+
 typedef struct _Simulation_ {
+    Semaphores* sems;
     struct _Parameters_* params;
     struct _DiningRoom_* diningRoom;
     struct _Philosopher_** philosophers;
-    struct _Waiter_* waiter;
+    struct _Waiter_** waiters;
+    Requests* requests;               // one per waiter
+    int nextWaiter;                   // waiter given the next request when none is idle
 } Simulation;
 
 #include "parameters.h"
@@ -0,0 +1,164 @@
+/**
+ *  \brief Trace module
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "trace.h"
+#include "utils.h"
+
+/* events read at once while replaying */
+#define TRACE_CHUNK 256
+
+FILE *trace_create(char *path, Parameters *params)
+{
+    assert(path != NULL && params != NULL);
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "ERROR: %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    TraceHeader h;
+    memset(&h, 0, sizeof(TraceHeader));
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    h.eventSize = sizeof(LogEvent);
+    h.params = *params;
+    // Flushed at once, not to be written again by the processes forked afterwards
+    if (fwrite(&h, sizeof(TraceHeader), 1, f) != 1 || fflush(f) != 0)
+    {
+        fprintf(stderr, "ERROR: %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return f;
+}
+
+/* count, total and maximum of a set of durations, in nanoseconds */
+typedef struct _Stat_ {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} Stat;
+
+static void stat_add(Stat *s, uint64_t t)
+{
+    s->count++;
+    s->sum += t;
+    if (t > s->max)
+        s->max = t;
+}
+
+static void stat_print(char *name, Stat *s)
+{
+    printf("  %-22s %10" PRIu64 " %12.3f %12.3f\n", name, s->count,
+            s->count > 0 ? s->sum / 1e6 / s->count : 0.0, s->max / 1e6);
+}
+
+/**
+ * Replays a trace: prints its table (or only checks the invariants, if quiet),
+ * and then the times philosophers wait and eat, and waiters serve requests.
+ * Only the last state of each philosopher and waiter is kept.
+ */
+int trace_replay(char *path, bool quiet)
+{
+    assert(path != NULL);
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "ERROR: %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    TraceHeader h;
+    if (fread(&h, sizeof(TraceHeader), 1, f) != 1 || memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0)
+    {
+        fprintf(stderr, "ERROR: %s: not a trace of this simulation\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (h.eventSize != sizeof(LogEvent))
+    {
+        fprintf(stderr, "ERROR: %s: events of %u bytes, instead of %zu\n", path, h.eventSize, sizeof(LogEvent));
+        exit(EXIT_FAILURE);
+    }
+
+    int n = h.params.NUM_PHILOSOPHERS, w = h.params.NUM_WAITERS, i;
+    Simulation *sim = simulation_new(&h.params);
+    logger_quiet(quiet);
+
+    /* the last state of each philosopher and waiter, and since when */
+    PhilosopherState *pstate = (PhilosopherState*) memory_allocate(n*sizeof(PhilosopherState));
+    WaiterState *wstate = (WaiterState*) memory_allocate(w*sizeof(WaiterState));
+    uint64_t *psince = (uint64_t*) memory_allocate(n*sizeof(uint64_t));
+    uint64_t *wsince = (uint64_t*) memory_allocate(w*sizeof(uint64_t));
+    for (i = 0; i < n; i++)
+        pstate[i] = P_BIRTH;
+    for (i = 0; i < w; i++)
+        wstate[i] = W_NONE;
+
+    Stat hungry = {0,0,0}, eating = {0,0,0};
+    Stat serving[3] = {{0,0,0},{0,0,0},{0,0,0}}; /* cutlery, pizza, spaghetti, as in WaiterState */
+    uint64_t events = 0, first = 0, last = 0;
+
+    LogEvent *chunk = (LogEvent*) memory_allocate(TRACE_CHUNK*sizeof(LogEvent));
+    size_t got;
+    while ((got = fread(chunk, sizeof(LogEvent), TRACE_CHUNK, f)) > 0)
+    {
+        for (size_t k = 0; k < got; k++)
+        {
+            LogEvent *e = &chunk[k];
+            if ((e->agent == LOG_PHILOSOPHER && (e->id < 0 || e->id >= n)) ||
+                    (e->agent == LOG_WAITER && (e->id < 0 || e->id >= w)))
+            {
+                fprintf(stderr, "ERROR: %s: event of an unknown agent\n", path);
+                exit(EXIT_FAILURE);
+            }
+            logger_replay(sim, e);
+
+            if (events++ == 0)
+                first = e->time;
+            last = e->time;
+            if (e->agent == LOG_PHILOSOPHER && e->state[0] != pstate[e->id])
+            {
+                if (pstate[e->id] == P_HUNGRY)
+                    stat_add(&hungry, e->time - psince[e->id]);
+                else if (pstate[e->id] == P_EATING)
+                    stat_add(&eating, e->time - psince[e->id]);
+                pstate[e->id] = e->state[0];
+                psince[e->id] = e->time;
+            }
+            else if (e->agent == LOG_WAITER && e->state[0] != wstate[e->id])
+            {
+                if (wstate[e->id] >= W_REQUEST_CUTLERY && wstate[e->id] <= W_REQUEST_SPAGHETTI)
+                    stat_add(&serving[wstate[e->id] - W_REQUEST_CUTLERY], e->time - wsince[e->id]);
+                wstate[e->id] = e->state[0];
+                wsince[e->id] = e->time;
+            }
+        }
+    }
+    if (ferror(f))
+    {
+        fprintf(stderr, "ERROR: %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    fclose(f);
+
+    double span = (last - first) / 1e9;
+    uint64_t busy = serving[0].sum + serving[1].sum + serving[2].sum;
+    printf("%" PRIu64 " events in %.3f s, of %d philosophers and %d waiters\n", events, span, n, w);
+    printf("  %-22s %10s %12s %12s\n", "", "count", "mean (ms)", "max (ms)");
+    stat_print("hungry until eating", &hungry);
+    stat_print("eating", &eating);
+    stat_print("serving pizza", &serving[W_REQUEST_PIZZA - W_REQUEST_CUTLERY]);
+    stat_print("serving spaghetti", &serving[W_REQUEST_SPAGHETTI - W_REQUEST_CUTLERY]);
+    stat_print("serving cutlery", &serving[0]);
+    if (last > first)
+        printf("philosophers eating %.1f%% of the time, waiters serving %.1f%%\n",
+                100.0 * eating.sum / n / (last - first), 100.0 * busy / w / (last - first));
+
+    return EXIT_SUCCESS;
+}
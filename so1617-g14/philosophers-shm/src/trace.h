@@ -0,0 +1,28 @@
+/**
+ *  \brief Trace module
+ *
+ *  A trace is a header, with the parameters of the simulation, followed by the
+ *  events of the logger, as they are in memory and in time order. It is
+ *  replayed a few events at a time, so its length is not bounded by memory.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "logger.h"
+
+#define TRACE_MAGIC "PHILSHM1"
+
+typedef struct _TraceHeader_ {
+    char magic[8];                    // TRACE_MAGIC, not terminated
+    uint32_t eventSize;               // sizeof(LogEvent) of the simulation that wrote it
+    uint32_t unused;
+    Parameters params;                // parameters of the simulation that wrote it
+} TraceHeader;
+
+FILE *trace_create(char *path, Parameters *params);
+int trace_replay(char *path, bool quiet);
+
+#endif
@@ -5,12 +5,13 @@
 */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <time.h>
 #include <semaphore.h>
-#include <fcntl.h>
-#include <sys/stat.h>
+
+#include "utils.h"
 
 /**
  * Allocate memory responsibly
@@ -28,28 +29,30 @@ void *memory_allocate(size_t size)
     return result;
 }
 
+// The random numbers of this process (a PCG32), apart from those of any other
+static uint64_t randState = 0;
+static uint64_t randInc = 1;
+
+static uint32_t rand_next()
+{
+    uint64_t old = randState;
+    randState = old * 6364136223846793005ULL + randInc;
+    uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+    uint32_t rot = old >> 59;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
 /**
- * Spawn a new process and run a given routine on the child process
+ * Seed the random numbers of this process: processes given the same seed
+ * and distinct streams draw independent numbers, the same in every run
  */
-void process_fork(pid_t *pidp, void (*routine)(void*, void*), void *arg1, void *arg2)
+void rand_seed(uint64_t seed, uint64_t stream)
 {
-    pid_t pid = fork();
-
-    switch (pid)
-    {
-        case -1:
-            perror("fork");
-            exit(EXIT_FAILURE);
-
-        case 0:
-            srand((int) getpid());
-            routine(arg1, arg2);
-            return;
-
-        default:
-            *pidp = pid;
-            return;
-    }
+    randState = 0;
+    randInc = (stream << 1) | 1;
+    rand_next();
+    randState += seed;
+    rand_next();
 }
 
 /**
@@ -58,7 +61,7 @@ void process_fork(pid_t *pidp, void (*routine)(void*, void*), void *arg1, void *
  */
 int rand_interval(int min, int max)
 {
-    return rand() % max + min;
+    return (max > 0) ? (int) (rand_next() % max) + min : min;
 }
 
 /*
@@ -66,27 +69,23 @@ int rand_interval(int min, int max)
  */
 int msleep(int t)
 {
-    struct timespec t1, t2;
-    t1.tv_sec = 0;
-    t2.tv_nsec = t*1000000L;
-    return nanosleep(&t1, &t2);
+    struct timespec t1;
+    t1.tv_sec = t / 1000;
+    t1.tv_nsec = (t % 1000) * 1000000L;
+    return nanosleep(&t1, NULL);
 }
 
 /**
- * Allocates and initializes a POSIX named semaphore and shares it across forked
- * processes
+ * Initializes an unnamed semaphore, shared by the processes forked afterwards
+ * as long as it lies in memory shared with them
  */
-sem_t *semaphore_open(const char *name, unsigned int value)
+void semaphore_init(sem_t *sem, unsigned int value)
 {
-    sem_t *sem = sem_open(name, O_CREAT, S_IRUSR | S_IWUSR, value);
-
-    if (sem == SEM_FAILED)
+    if (sem_init(sem, 1, value) != 0)
     {
-        perror("sem_open");
+        perror("sem_init");
         exit(EXIT_FAILURE);
     }
-
-    return sem;
 }
 
 /**
@@ -117,25 +116,13 @@ void semaphore_post(sem_t *sem)
 }
 
 /**
- * Closes a named semaphore, while still leaving it in shared memory
- */
-void semaphore_close(sem_t *sem)
-{
-    if (sem_close(sem) != 0)
-    {
-        perror("sem_close");
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * Remove a named semaphore from shared memory, after all references are closed
+ * Destroys an unnamed semaphore, once no process is using it
  */
-void semaphore_unlink(const char *name)
+void semaphore_destroy(sem_t *sem)
 {
-    if (sem_unlink(name) != 0)
+    if (sem_destroy(sem) != 0)
     {
-        perror("sem_unlink");
+        perror("sem_destroy");
         exit(EXIT_FAILURE);
     }
 }
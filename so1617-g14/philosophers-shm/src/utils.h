@@ -8,18 +8,17 @@
 #define UTILS_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <semaphore.h>
 
 void *memory_allocate(size_t size);
-void process_fork(pid_t *pidp, void (*routine)(void*, void*), void *arg1, void *arg2);
+void rand_seed(uint64_t seed, uint64_t stream);
 int rand_interval(int min, int max);
 int msleep(int t);
 
-sem_t *semaphore_open(const char *name, unsigned int value);
+void semaphore_init(sem_t *sem, unsigned int value);
 void semaphore_wait(sem_t *sem);
 void semaphore_post(sem_t *sem);
-void semaphore_close(sem_t *sem);
-void semaphore_unlink(const char *name);
-int semaphore_getvalue(sem_t *sem);
+void semaphore_destroy(sem_t *sem);
 
 #endif
@@ -25,93 +25,204 @@ Waiter *waiter_new()
     return w;
 }
 
-void waiter_lifecycle(Waiter *w, Simulation *s)
+/**
+ * Show the pending requests of waiter i in its info (mutex_requests must be held)
+ */
+static void waiter_show_pending(int i, Simulation *s)
 {
-    sem_t *signal_waiter = semaphore_open("/signal_waiter", 0);
-    while (!simulation_are_philosophers_dead(s))
-    {
-        w->state = W_SLEEP; // Sleep by default when not attending a request
-        logger(s);
-        semaphore_wait(signal_waiter);
+    int req = s->requests[i].req;
 
-        waiter_replenish_pizza(s->waiter, s);
-        waiter_replenish_spaghetti(s->waiter, s);
-        waiter_wash_cutlery(s->waiter, s);
+    s->waiters[i]->reqPizza = (req & REQ_PIZZA) ? W_ACTIVE : W_INACTIVE;
+    s->waiters[i]->reqSpaghetti = (req & REQ_SPAGHETTI) ? W_ACTIVE : W_INACTIVE;
+    s->waiters[i]->reqCutlery = (req & (REQ_CUTLERY | REQ_LEAVE)) ? W_ACTIVE : W_INACTIVE;
+}
 
-        semaphore_post(signal_waiter);
-    }
+/**
+ * Give requests to waiter i, waking it up if idle (mutex_requests must be held)
+ */
+static void waiter_give_requests(int i, int r, Simulation *s)
+{
+    s->requests[i].req |= r;
+    waiter_show_pending(i, s);
 
-    // Leave the dining room clean after death
-    waiter_wash_cutlery(w, s);
-    w->state = W_DEAD;
-    logger(s);
+    if (s->requests[i].idle)
+    {
+        s->requests[i].idle = false;
+        semaphore_post(&s->requests[i].signal);
+    }
 }
 
-void waiter_replenish_pizza(Waiter *w, Simulation *s)
+/**
+ * Make a request to an idle waiter if there is one, or else to the waiters in turn.
+ * The same request made twice before being served is served once; one being
+ * served is not made again unless a waiter is idle, so as not to queue up
+ * behind it a second wash of the little cutlery returned meanwhile: when the
+ * philosophers are signaled, one not served will ask again
+ */
+void waiter_request(int r, Simulation *s)
 {
-    sem_t *signal_replenish_pizza = semaphore_open("/signal_replenish_pizza", 0);
+    semaphore_wait(&s->sems->mutex_requests);
 
+    int i, w = s->nextWaiter, serving = 0;
+    bool idle = false;
+    for (i = 0; i < s->params->NUM_WAITERS; i++)
+    {
+        r &= ~s->requests[i].req;
+        serving |= s->requests[i].serving;
+        idle = idle || s->requests[i].idle;
+    }
+    if (!idle)
+        r &= ~serving;
 
-    if (s->waiter->reqPizza == W_ACTIVE)
+    if (r != 0)
     {
-        s->waiter->state = W_REQUEST_PIZZA;
+        for (i = 0; i < s->params->NUM_WAITERS; i++)
+        {
+            if (s->requests[i].idle)
+            {
+                w = i;
+                break;
+            }
+        }
+        s->nextWaiter = (w + 1) % s->params->NUM_WAITERS;
+        waiter_give_requests(w, r, s);
+    }
+
+    semaphore_post(&s->sems->mutex_requests);
+}
 
-        // Replenish pizza
-        dining_room_replenish_pizza(s);
+/**
+ * Ask every waiter to leave, once all philosophers are dead
+ */
+void waiter_leave_all(Simulation *s)
+{
+    semaphore_wait(&s->sems->mutex_requests);
 
-        // No longer active
-        s->waiter->reqPizza = W_INACTIVE;
+    int i;
+    for (i = 0; i < s->params->NUM_WAITERS; i++)
+        waiter_give_requests(i, REQ_LEAVE, s);
 
-        logger(s);
+    semaphore_post(&s->sems->mutex_requests);
+}
 
-        // Signal that pizza has been replenished
-        semaphore_post(signal_replenish_pizza);
+/**
+ * Wait for a batch of requests for waiter i: all of its own, or else
+ * those still pending in a busy waiter, apart from leaving
+ */
+static int waiter_take_requests(int i, Simulation *s)
+{
+    int n = s->params->NUM_WAITERS;
+    int j, batch;
 
+    semaphore_wait(&s->sems->mutex_requests);
+    while (true)
+    {
+        batch = s->requests[i].req;
+        if (batch != 0)
+        {
+            s->requests[i].req = 0;
+            waiter_show_pending(i, s);
+            break;
+        }
+
+        // Steal from a busy waiter
+        for (j = 1; j < n && batch == 0; j++)
+        {
+            int other = (i + j) % n;
+            batch = s->requests[other].req & ~REQ_LEAVE;
+            if (batch != 0)
+            {
+                s->requests[other].req &= REQ_LEAVE;
+                waiter_show_pending(other, s);
+            }
+        }
+        if (batch != 0)
+            break;
+
+        s->requests[i].idle = true;
+        semaphore_post(&s->sems->mutex_requests);
+        semaphore_wait(&s->requests[i].signal);
+        semaphore_wait(&s->sems->mutex_requests);
     }
+    s->requests[i].serving = batch & ~REQ_LEAVE;
+    semaphore_post(&s->sems->mutex_requests);
+
+    return batch;
 }
 
-void waiter_replenish_spaghetti(Waiter *w, Simulation *s)
+/**
+ * Request r of waiter i has been served, and philosophers are about to be signaled
+ */
+static void waiter_served(int i, int r, Simulation *s)
 {
-    sem_t *signal_replenish_spaghetti = semaphore_open("/signal_replenish_spaghetti", 0);
+    semaphore_wait(&s->sems->mutex_requests);
+    s->requests[i].serving &= ~r;
+    semaphore_post(&s->sems->mutex_requests);
+}
 
+void waiter_lifecycle(int i, Simulation *s)
+{
+    Waiter *w = s->waiters[i];
+    int batch;
 
-    if (s->waiter->reqSpaghetti == W_ACTIVE)
+    do
     {
-        s->waiter->state = W_REQUEST_PIZZA;
-
-        // Replenish spaghetti
-        dining_room_replenish_spaghetti(s);
+        w->state = W_SLEEP; // Sleep by default when not attending a request
+        logger(s);
+        batch = waiter_take_requests(i, s);
+
+        if (batch & REQ_PIZZA)
+            waiter_replenish_pizza(i, s);
+        if (batch & REQ_SPAGHETTI)
+            waiter_replenish_spaghetti(i, s);
+        if (batch & REQ_CUTLERY)
+            waiter_wash_cutlery(i, s);
+    }
+    while (!(batch & REQ_LEAVE));
 
-        // No longer active
-        s->waiter->reqSpaghetti = W_INACTIVE;
+    // Leave the dining room clean after death
+    w->state = W_REQUEST_CUTLERY;
+    logger(s);
+    dining_room_wash(s);
+    w->state = W_DEAD;
+    logger(s);
+}
 
-        logger(s);
+void waiter_replenish_pizza(int i, Simulation *s)
+{
+    s->waiters[i]->state = W_REQUEST_PIZZA;
+    logger(s);
 
-        // Signal that spaghetti has been replenished
-        semaphore_post(signal_replenish_spaghetti);
+    // Replenish pizza
+    dining_room_replenish_pizza(s);
 
-    }
+    // Signal that pizza has been replenished
+    waiter_served(i, REQ_PIZZA, s);
+    semaphore_post(&s->sems->signal_replenish_pizza);
 }
 
-void waiter_wash_cutlery(Waiter *w, Simulation *s)
+void waiter_replenish_spaghetti(int i, Simulation *s)
 {
-    sem_t *signal_wash_cutlery = semaphore_open("/signal_wash_cutlery", 0);
+    s->waiters[i]->state = W_REQUEST_SPAGHETTI;
+    logger(s);
 
-    if (s->waiter->reqCutlery == W_ACTIVE)
-    {
-        s->waiter->state = W_REQUEST_CUTLERY;
+    // Replenish spaghetti
+    dining_room_replenish_spaghetti(s);
 
-        // Wash cutlery
-        dining_room_prepare_wash(s);
-        msleep(s->params->WASH_TIME);
-        dining_room_wash_cutlery(s);
+    // Signal that spaghetti has been replenished
+    waiter_served(i, REQ_SPAGHETTI, s);
+    semaphore_post(&s->sems->signal_replenish_spaghetti);
+}
 
-        // No longer active
-        s->waiter->reqCutlery = W_INACTIVE;
+void waiter_wash_cutlery(int i, Simulation *s)
+{
+    s->waiters[i]->state = W_REQUEST_CUTLERY;
+    logger(s);
 
-        logger(s);
+    // Wash cutlery
+    dining_room_wash(s);
 
-        // Signal that cutlery has been washed
-        semaphore_post(signal_wash_cutlery);
-    }
+    // Signal that cutlery has been washed
+    waiter_served(i, REQ_CUTLERY, s);
+    semaphore_post(&s->sems->signal_wash_cutlery);
 }
@@ -31,10 +31,18 @@ typedef struct _Waiter_ {
 } Waiter;
 
 
+/* requests to the waiters: a set of them can be pending at once */
+#define REQ_PIZZA     0x1             // replenish pizza
+#define REQ_SPAGHETTI 0x2             // replenish spaghetti
+#define REQ_CUTLERY   0x4             // wash cutlery
+#define REQ_LEAVE     0x8             // wash cutlery a last time and leave
+
 Waiter *waiter_new();
-void waiter_lifecycle(Waiter *w, Simulation *s);
-void waiter_replenish_pizza(Waiter *w, Simulation *s);
-void waiter_replenish_spaghetti(Waiter *w, Simulation *s);
-void waiter_wash_cutlery(Waiter *w, Simulation *s);
+void waiter_request(int r, Simulation *s);
+void waiter_leave_all(Simulation *s);
+void waiter_lifecycle(int i, Simulation *s);
+void waiter_replenish_pizza(int i, Simulation *s);
+void waiter_replenish_spaghetti(int i, Simulation *s);
+void waiter_wash_cutlery(int i, Simulation *s);
 
 #endif
@@ -0,0 +1,430 @@
+/**
+ *  \brief Coroutine module
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "coroutine.h"
+#include "simulation.h"
+
+/* stack of each coroutine: only the pages it touches take memory */
+#define COROUTINE_STACK_SIZE (64*1024)
+
+/* what a worker does with a coroutine once it is suspended */
+typedef enum {
+	CO_YIELD,                               // back to the queue
+	CO_WAIT,                                // unlock the mutex of the condition it waits on
+	CO_SLEEP,                               // keep it with the timers until it wakes up
+	CO_DONE                                 // its body returned
+} CoroutineState;
+
+typedef struct _Coroutine_ {
+	ucontext_t context;
+	void (*body)(int);
+	LogAgent agent;                         // who it is, for the logger
+	int id;
+	CoroutineState state;
+	pthread_mutex_t* release;               // CO_WAIT: unlocked by the worker
+	uint64_t wake;                          // CO_SLEEP: CLOCK_MONOTONIC, in nanoseconds
+	struct _Coroutine_* next;               // in a queue or condition
+} Coroutine;
+
+typedef struct _Worker_ {
+	pthread_mutex_t lock;                   // of its queue, taken by others to steal
+	Coroutine* first;                       // coroutines ready to run, in order
+	Coroutine* last;
+	ucontext_t scheduler;                   // where a coroutine returns to when suspended
+	Coroutine* running;
+	unsigned long switches;                 // coroutines resumed
+	pthread_t thread;
+} Worker;
+
+static Worker* workers;
+static int numWorkers;
+
+static Coroutine* coroutines;
+static int numCoroutines, spawned = 0;
+static char* stacks;
+
+/* The sleeping coroutines, in a binary heap by wake up time, and the idle workers wait on the
+ * same lock; earliest is the first wake up time, for the busy workers to check without it */
+static pthread_mutex_t POOL_ACCESS = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work;
+static Coroutine** timers;
+static int numTimers = 0;
+static atomic_uint_fast64_t earliest = UINT64_MAX;
+static atomic_int idle = 0;
+static atomic_int finished = 0;
+
+/* worker of the calling thread, NULL if not one; not inlined, as a coroutine may come back on another thread */
+static __thread Worker* self = NULL;
+
+static __attribute__((noinline)) Worker* this_worker(){
+	return self;
+}
+
+static uint64_t now_ns(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+}
+
+/*********************************************************************/
+// Queues and timers
+
+static void push(Worker* w, Coroutine* c){
+	c->next = NULL;
+	pthread_mutex_lock(&w->lock);
+	if(w->last == NULL)
+		w->first = c;
+	else
+		w->last->next = c;
+	w->last = c;
+	pthread_mutex_unlock(&w->lock);
+}
+
+static Coroutine* pop(Worker* w){
+	pthread_mutex_lock(&w->lock);
+	Coroutine* c = w->first;
+	if(c != NULL){
+		w->first = c->next;
+		if(w->first == NULL)
+			w->last = NULL;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return c;
+}
+
+/* c is ready to run: queued in the calling worker, and an idle worker is woken up to share the work */
+static void ready(Coroutine* c){
+	Worker* w = this_worker();
+
+	push((w != NULL) ? w : &workers[0], c);
+	if(atomic_load(&idle) > 0){
+		pthread_mutex_lock(&POOL_ACCESS);
+		pthread_cond_signal(&work);
+		pthread_mutex_unlock(&POOL_ACCESS);
+	}
+}
+
+/* the first coroutine queued in another worker, starting with the next one */
+static Coroutine* steal(Worker* w){
+	int i;
+	Coroutine* c;
+
+	for(i = 1; i < numWorkers; i++){
+		c = pop(&workers[(w - workers + i) % numWorkers]);
+		if(c != NULL)
+			return c;
+	}
+	return NULL;
+}
+
+/* (POOL_ACCESS must be held) */
+static void add_timer(Coroutine* c){
+	int i = numTimers++;
+
+	while(i > 0 && c->wake < timers[(i - 1) / 2]->wake){
+		timers[i] = timers[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	timers[i] = c;
+	atomic_store(&earliest, timers[0]->wake);
+}
+
+/* queue in w the coroutines whose time to wake up has come (POOL_ACCESS must be held) */
+static int fire_timers(Worker* w){
+	int fired = 0, i, child;
+	uint64_t now = now_ns();
+	Coroutine* last;
+
+	while(numTimers > 0 && timers[0]->wake <= now){
+		push(w, timers[0]);
+		fired++;
+
+		last = timers[--numTimers];
+		i = 0;
+		while((child = 2 * i + 1) < numTimers){
+			if(child + 1 < numTimers && timers[child + 1]->wake < timers[child]->wake)
+				child++;
+			if(last->wake <= timers[child]->wake)
+				break;
+			timers[i] = timers[child];
+			i = child;
+		}
+		timers[i] = last;
+	}
+	atomic_store(&earliest, (numTimers > 0) ? timers[0]->wake : UINT64_MAX);
+	return fired;
+}
+
+/*********************************************************************/
+// Workers
+
+/* suspend the running coroutine, back to its worker's scheduler, which then handles it as state tells */
+static void suspend(CoroutineState state){
+	Worker* w = this_worker();
+	Coroutine* c = w->running;
+
+	c->state = state;
+	swapcontext(&c->context, &w->scheduler);
+}
+
+static void entry(int i){
+	Coroutine* c = &coroutines[i];
+
+	c->body(c->id);
+	suspend(CO_DONE);
+}
+
+static void resume(Worker* w, Coroutine* c){
+	w->running = c;
+	w->switches++;
+	logger_agent(c->agent, c->id);
+	swapcontext(&w->scheduler, &c->context);
+	w->running = NULL;
+
+	switch(c->state){
+		case CO_YIELD:
+			push(w, c);
+			break;
+
+		case CO_WAIT:
+			/* only now can it be signaled, and resumed, by another worker */
+			pthread_mutex_unlock(c->release);
+			break;
+
+		case CO_SLEEP:
+			pthread_mutex_lock(&POOL_ACCESS);
+			add_timer(c);
+			pthread_mutex_unlock(&POOL_ACCESS);
+			break;
+
+		case CO_DONE:
+			if(atomic_fetch_add(&finished, 1) + 1 == numCoroutines){
+				pthread_mutex_lock(&POOL_ACCESS);
+				pthread_cond_broadcast(&work);
+				pthread_mutex_unlock(&POOL_ACCESS);
+			}
+			break;
+	}
+}
+
+static void* worker(void* arg){
+	Worker* w = (Worker*)arg;
+	Coroutine* c;
+	struct timespec until;
+
+	self = w;
+	while(1){
+		if(atomic_load_explicit(&earliest, memory_order_relaxed) <= now_ns()){
+			pthread_mutex_lock(&POOL_ACCESS);
+			fire_timers(w);
+			pthread_mutex_unlock(&POOL_ACCESS);
+		}
+
+		c = pop(w);
+		if(c == NULL)
+			c = steal(w);
+		if(c != NULL){
+			resume(w, c);
+			continue;
+		}
+
+		/* nothing to run: wait for a coroutine to be ready, or to wake up */
+		pthread_mutex_lock(&POOL_ACCESS);
+		if(atomic_load(&finished) == numCoroutines){
+			pthread_mutex_unlock(&POOL_ACCESS);
+			break;
+		}
+		if(fire_timers(w) == 0){
+			atomic_fetch_add(&idle, 1);
+			if(numTimers > 0){
+				until.tv_sec = timers[0]->wake / 1000000000;
+				until.tv_nsec = timers[0]->wake % 1000000000;
+				pthread_cond_timedwait(&work, &POOL_ACCESS, &until);
+			}else
+				pthread_cond_wait(&work, &POOL_ACCESS);
+			atomic_fetch_sub(&idle, 1);
+		}
+		pthread_mutex_unlock(&POOL_ACCESS);
+	}
+	return NULL;
+}
+
+/**
+ * Sets up a pool of the given number of workers, for count coroutines.
+ */
+void coroutine_init(int nw, int count){
+	int i;
+	pthread_condattr_t attr;
+
+	numWorkers = nw;
+	workers = (Worker*)mem_alloc(numWorkers*sizeof(Worker));
+	for(i = 0; i < numWorkers; i++){
+		pthread_mutex_init(&workers[i].lock, NULL);
+		workers[i].first = workers[i].last = workers[i].running = NULL;
+		workers[i].switches = 0;
+	}
+
+	numCoroutines = count;
+	coroutines = (Coroutine*)mem_alloc(numCoroutines*sizeof(Coroutine));
+	timers = (Coroutine**)mem_alloc(numCoroutines*sizeof(Coroutine*));
+	stacks = mmap(NULL, (size_t)numCoroutines*COROUTINE_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(stacks == MAP_FAILED){
+		perror("error on allocating the coroutine stacks\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* timed waits are on the same clock as the timers */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&work, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Creates a coroutine running body(id), queued in the workers in turn.
+ */
+void coroutine_spawn(void (*body)(int), LogAgent agent, int id){
+	assert(spawned < numCoroutines);
+
+	Coroutine* c = &coroutines[spawned];
+	c->body = body;
+	c->agent = agent;
+	c->id = id;
+	getcontext(&c->context);
+	c->context.uc_stack.ss_sp = stacks + (size_t)spawned*COROUTINE_STACK_SIZE;
+	c->context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+	c->context.uc_link = NULL;
+	makecontext(&c->context, (void (*)())entry, 1, spawned);
+
+	push(&workers[spawned % numWorkers], c);
+	spawned++;
+}
+
+/**
+ * Runs the coroutines until all of them end.
+ */
+void coroutine_run(){
+	int i;
+
+	for(i = 0; i < numWorkers; i++){
+		if(pthread_create(&workers[i].thread, NULL, worker, &workers[i]) != 0){
+			perror("error on launching the worker thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for(i = 0; i < numWorkers; i++){
+		if(pthread_join(workers[i].thread, NULL) != 0)
+			perror("error on waiting for the worker thread to conclude\n");
+	}
+}
+
+/**
+ * Bytes of memory per coroutine: the pages of its stack it touched, and its context.
+ */
+double coroutine_memory(){
+	long page = sysconf(_SC_PAGESIZE);
+	size_t length = (size_t)numCoroutines*COROUTINE_STACK_SIZE, pages = (length + page - 1) / page, i, resident = 0;
+	unsigned char* touched = (unsigned char*)mem_alloc(pages);
+
+	if(mincore(stacks, length, touched) == 0){
+		for(i = 0; i < pages; i++)
+			resident += touched[i] & 1;
+	}
+	free(touched);
+	return (double)resident*page / numCoroutines + sizeof(Coroutine);
+}
+
+/**
+ * Number of times a coroutine was resumed.
+ */
+unsigned long coroutine_switches(){
+	unsigned long n = 0;
+	int i;
+
+	for(i = 0; i < numWorkers; i++)
+		n += workers[i].switches;
+	return n;
+}
+
+/*********************************************************************/
+// Blocking operations, for threads and coroutines alike
+
+void coroutine_sleep(int ms){
+	Worker* w = this_worker();
+
+	if(w == NULL || w->running == NULL){
+		usleep(ms*1000);
+		return;
+	}
+	if(ms > 0){
+		w->running->wake = now_ns() + (uint64_t)ms*1000000;
+		suspend(CO_SLEEP);
+	}
+}
+
+void coroutine_yield(){
+	Worker* w = this_worker();
+
+	if(w == NULL || w->running == NULL)
+		sched_yield();
+	else
+		suspend(CO_YIELD);
+}
+
+void condition_init(Condition* c){
+	pthread_cond_init(&c->cond, NULL);
+	c->first = c->last = NULL;
+}
+
+/**
+ * Waits on c, with m held, as pthread_cond_wait.
+ * A coroutine joins the list of c, and its worker unlocks m once it is suspended.
+ */
+void condition_wait(Condition* c, pthread_mutex_t* m){
+	Worker* w = this_worker();
+
+	if(w == NULL || w->running == NULL){
+		pthread_cond_wait(&c->cond, m);
+		return;
+	}
+
+	Coroutine* co = w->running;
+	co->next = NULL;
+	if(c->last == NULL)
+		c->first = co;
+	else
+		c->last->next = co;
+	c->last = co;
+	co->release = m;
+	suspend(CO_WAIT);
+
+	pthread_mutex_lock(m);
+}
+
+/**
+ * Wakes up the first coroutine waiting on c, or else a thread (the mutex of c must be held).
+ */
+void condition_signal(Condition* c){
+	Coroutine* co = c->first;
+
+	if(co == NULL){
+		pthread_cond_signal(&c->cond);
+		return;
+	}
+	c->first = co->next;
+	if(c->first == NULL)
+		c->last = NULL;
+	ready(co);
+}
@@ -0,0 +1,41 @@
+/**
+ *  \brief Coroutine module
+ *
+ *  Philosophers and waiters can run as coroutines, each with a small stack of
+ *  its own, over a few worker threads. Each worker runs the coroutines in its
+ *  queue, and takes one from another worker's queue when its own is empty.
+ *  Waiting on a condition, sleeping and yielding suspend the coroutine, not the
+ *  worker; outside of a coroutine they are the usual thread operations, so the
+ *  same lifecycles run in both modes.
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <pthread.h>
+#include "logger.h"
+
+struct _Coroutine_;
+
+/* a condition variable that threads and coroutines can wait on */
+typedef struct _Condition_ {
+	pthread_cond_t cond;              // threads waiting
+	struct _Coroutine_* first;        // coroutines waiting, in arrival order
+	struct _Coroutine_* last;
+} Condition;
+
+#define CONDITION_INITIALIZER {PTHREAD_COND_INITIALIZER, NULL, NULL}
+
+void condition_init(Condition* c);
+void condition_wait(Condition* c, pthread_mutex_t* m);
+void condition_signal(Condition* c);
+
+void coroutine_init(int workers, int count);
+void coroutine_spawn(void (*body)(int), LogAgent agent, int id);
+void coroutine_run();
+void coroutine_sleep(int ms);
+void coroutine_yield();
+double coroutine_memory();
+unsigned long coroutine_switches();
+
+#endif
@@ -15,198 +15,209 @@
 #include "dining-room.h"
 #include "waiter.h"
 #include "logger.h"
+#include "coroutine.h"
 #include <pthread.h> /* added */
 
 /* put your code here */
 
 extern Simulation * sim;
 
+/* Philosophers only lock the dining room to wait for something that ran out,
+ * and the waiter only locks it to make things available again and wake them up.
+ * Lock order: REQUEST_ACCESS (waiter.c) may be taken while holding DININGROOM_ACCESS, never the reverse */
 static pthread_mutex_t DININGROOM_ACCESS = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t pizza_available = PTHREAD_COND_INITIALIZER, spaghetti_available = PTHREAD_COND_INITIALIZER, cleancutlery_available = PTHREAD_COND_INITIALIZER;
 
+/* philosophers waiting for one kind of thing, woken up one at a time */
+typedef struct Queue {
+	Condition available;
+	int waiting;
+} Queue;
 
-void get_spaghetti(int id){
-	pthread_mutex_lock(&DININGROOM_ACCESS);
+static Queue pizza_queue = {CONDITION_INITIALIZER, 0}, spaghetti_queue = {CONDITION_INITIALIZER, 0}, cutlery_queue = {CONDITION_INITIALIZER, 0};
+static Condition all_cutlery_clean = CONDITION_INITIALIZER; /* for the last philosopher to die */
 
-	while(sim->diningRoom->spaghetti == 0){
-		/* philosopher tries to make a request */
-		if(trylock() == 0)
-			make_request(2);
-		else{
-			pthread_mutex_unlock(&DININGROOM_ACCESS);
-			return get_spaghetti(id);
-		}
+/* number of philosophers waiting for clean cutlery */
+static atomic_int cutlery_waiters = 0;
 
-		/* philosopher waits... */
-		pthread_cond_wait(&spaghetti_available, &DININGROOM_ACCESS);
+/* take n units of a counter, if it has that many */
+static int take(atomic_int *counter, int n){
+	int value = atomic_load_explicit(counter, memory_order_relaxed);
+
+	while(value >= n){
+		if(atomic_compare_exchange_weak_explicit(counter, &value, value - n, memory_order_acquire, memory_order_relaxed))
+			return 1;
 	}
+	return 0;
+}
 
-	sim->diningRoom->spaghetti -= 1;
+/* give back n units of a counter */
+static void give(atomic_int *counter, int n){
+	atomic_fetch_add_explicit(counter, n, memory_order_release);
+}
 
-	pthread_mutex_unlock(&DININGROOM_ACCESS);
+static int take_pizza(){
+	return take(&sim->diningRoom->pizza, 1);
 }
 
-void get_pizza(int id){
+static int take_spaghetti(){
+	return take(&sim->diningRoom->spaghetti, 1);
+}
+
+static int take_two_forks(){
+	return take(&sim->diningRoom->cleanForks, 2);
+}
+
+static int take_fork_knife(){
+	if(!take(&sim->diningRoom->cleanForks, 1))
+		return 0;
+	if(take(&sim->diningRoom->cleanKnives, 1))
+		return 1;
+
+	/* no knife: the fork is not kept while waiting for one */
+	give(&sim->diningRoom->cleanForks, 1);
+	return 0;
+}
+
+/* wait in queue q until take() succeeds, asking the waiter for request req each time it fails.
+ * Only the first in q is woken up; once served, it wakes up the next, which either is served
+ * too or asks the waiter again, so the others do not take the lock just to go back to sleep */
+static void wait_for(int (*take)(), int req, Queue *q){
 	pthread_mutex_lock(&DININGROOM_ACCESS);
 
-	while(sim->diningRoom->pizza == 0){
-		/* philosopher tries to make a request */
-		if(trylock() == 0)
-			make_request(1);
-		else{
-			pthread_mutex_unlock(&DININGROOM_ACCESS);
-			return get_pizza(id);
-		}
+	q->waiting++;
+	while(!take()){
+		/* philosopher makes a request, joining the same one if already pending */
+		make_request(req);
 
 		/* philosopher waits... */
-		pthread_cond_wait(&pizza_available, &DININGROOM_ACCESS);
+		condition_wait(&q->available, &DININGROOM_ACCESS);
 	}
+	q->waiting--;
 
-	sim->diningRoom->pizza -= 1;
+	if(q->waiting > 0)
+		condition_signal(&q->available);
 
 	pthread_mutex_unlock(&DININGROOM_ACCESS);
 }
 
-void get_two_forks(int id){
-	pthread_mutex_lock(&DININGROOM_ACCESS);
+void get_spaghetti(int id){
+	if(!take_spaghetti())
+		wait_for(take_spaghetti, REQ_SPAGHETTI, &spaghetti_queue);
+}
 
-	while(sim->diningRoom->cleanForks < 2){
-		/* philosopher tries to make a request */
-		if(trylock() == 0)
-			make_request(3);
-		else{
-			pthread_mutex_unlock(&DININGROOM_ACCESS);
-			return get_two_forks(id);
-		}
+void get_pizza(int id){
+	if(!take_pizza())
+		wait_for(take_pizza, REQ_PIZZA, &pizza_queue);
+}
 
-		/* philosopher waits... */
-		pthread_cond_wait(&cleancutlery_available, &DININGROOM_ACCESS);
+void get_two_forks(int id){
+	if(!take_two_forks()){
+		atomic_fetch_add(&cutlery_waiters, 1);
+		wait_for(take_two_forks, REQ_CUTLERY, &cutlery_queue);
+		atomic_fetch_sub(&cutlery_waiters, 1);
 	}
 
-	sim->diningRoom->cleanForks -= 2;
-
 	/* update philosopher info */
 	sim->philosophers[id]->cutlery[0] = P_FORK;
 	sim->philosophers[id]->cutlery[1] = P_FORK;
-
-	pthread_mutex_unlock(&DININGROOM_ACCESS);
 }
 
 void get_fork_knife(int id){
-	pthread_mutex_lock(&DININGROOM_ACCESS);
-
-	while(sim->diningRoom->cleanForks == 0 || sim->diningRoom->cleanKnives == 0){
-		/* philosopher tries to make a request */
-		if(trylock() == 0)
-			make_request(3);
-		else{
-			pthread_mutex_unlock(&DININGROOM_ACCESS);
-			return get_fork_knife(id);
-		}
-
-		/* philosopher waits... */
-		pthread_cond_wait(&cleancutlery_available, &DININGROOM_ACCESS);
+	if(!take_fork_knife()){
+		atomic_fetch_add(&cutlery_waiters, 1);
+		wait_for(take_fork_knife, REQ_CUTLERY, &cutlery_queue);
+		atomic_fetch_sub(&cutlery_waiters, 1);
 	}
 
-	sim->diningRoom->cleanForks -= 1;
-	sim->diningRoom->cleanKnives -= 1;
-
 	/* update philosopher info */
 	sim->philosophers[id]->cutlery[0] = P_FORK;
 	sim->philosophers[id]->cutlery[1] = P_KNIFE;
-
-	pthread_mutex_unlock(&DININGROOM_ACCESS);
 }
 
 void drop_two_forks(int id){
-	pthread_mutex_lock(&DININGROOM_ACCESS);
-
-	sim->diningRoom->dirtyForks += 2;
+	give(&sim->diningRoom->dirtyForks, 2);
 
 	/* update philosopher info */
 	sim->philosophers[id]->cutlery[0] = P_PUT_FORK;
 	sim->philosophers[id]->cutlery[1] = P_PUT_FORK;
-
-	pthread_mutex_unlock(&DININGROOM_ACCESS);
 }
 
 void drop_fork_knife(int id){
-	pthread_mutex_lock(&DININGROOM_ACCESS);
-
-	sim->diningRoom->dirtyForks += 1;
-	sim->diningRoom->dirtyKnives += 1;
+	give(&sim->diningRoom->dirtyForks, 1);
+	give(&sim->diningRoom->dirtyKnives, 1);
 
 	/* update philosopher info */
 	sim->philosophers[id]->cutlery[0] = P_PUT_FORK;
 	sim->philosophers[id]->cutlery[1] = P_PUT_KNIFE;
-
-	pthread_mutex_unlock(&DININGROOM_ACCESS);
 }
 
 void replenish_pizza(){
 	pthread_mutex_lock(&DININGROOM_ACCESS);
 
-  	sim->diningRoom->pizza = sim->params->NUM_PIZZA;
+	atomic_store(&sim->diningRoom->pizza, sim->params->NUM_PIZZA);
 
-  	/* Signal to philosopher to stop waiting... */
-  	pthread_cond_signal(&pizza_available);
+	/* Signal to philosophers to stop waiting... */
+	condition_signal(&pizza_queue.available);
 
-  	pthread_mutex_unlock(&DININGROOM_ACCESS);
+	pthread_mutex_unlock(&DININGROOM_ACCESS);
 }
 
 void replenish_spaghetti(){
 	pthread_mutex_lock(&DININGROOM_ACCESS);
 
-	sim->diningRoom->spaghetti = sim->params->NUM_SPAGHETTI;
+	atomic_store(&sim->diningRoom->spaghetti, sim->params->NUM_SPAGHETTI);
 
-	/* Signal to philosopher to stop waiting... */
-  	pthread_cond_signal(&spaghetti_available);
+	/* Signal to philosophers to stop waiting... */
+	condition_signal(&spaghetti_queue.available);
 
-  	pthread_mutex_unlock(&DININGROOM_ACCESS);
+	pthread_mutex_unlock(&DININGROOM_ACCESS);
 }
 
 void replenish_cutlery(){
-	pthread_mutex_lock(&DININGROOM_ACCESS);
+	int forks, knives;
 
-	/* dirty forks and knives in waiter */
-	sim->diningRoom->dirtyKnivesInWaiter = sim->diningRoom->dirtyKnives;
-	sim->diningRoom->dirtyForksInWaiter = sim->diningRoom->dirtyForks;
+	do{
+		/* dirty forks and knives in waiter; those returned from now on are left for the next batch,
+		 * which another waiter may wash at the same time */
+		knives = atomic_exchange(&sim->diningRoom->dirtyKnives, 0);
+		atomic_fetch_add(&sim->diningRoom->dirtyKnivesInWaiter, knives);
+		forks = atomic_exchange(&sim->diningRoom->dirtyForks, 0);
+		atomic_fetch_add(&sim->diningRoom->dirtyForksInWaiter, forks);
 
-	sim->diningRoom->dirtyForks = 0;
-	sim->diningRoom->dirtyKnives = 0;
+		logger(sim);
 
-	logger(sim);
+		/* washing holds no lock */
+		coroutine_sleep(sim->params->WASH_TIME);
 
-	usleep(sim->params->WASH_TIME*1000);
+		/* forks and knives are clean */
+		pthread_mutex_lock(&DININGROOM_ACCESS);
 
-	/* forks and knives are clean */
-	sim->diningRoom->cleanKnives +=  sim->diningRoom->dirtyKnivesInWaiter;
-	sim->diningRoom->cleanForks += sim->diningRoom->dirtyForksInWaiter;
+		atomic_fetch_sub(&sim->diningRoom->dirtyKnivesInWaiter, knives);
+		atomic_fetch_sub(&sim->diningRoom->dirtyForksInWaiter, forks);
+		atomic_fetch_add(&sim->diningRoom->washed, 1);
+		give(&sim->diningRoom->cleanKnives, knives);
+		give(&sim->diningRoom->cleanForks, forks);
 
-	sim->diningRoom->dirtyForksInWaiter = 0;
-	sim->diningRoom->dirtyKnivesInWaiter = 0;
+		/* Signal to philosophers to stop waiting... */
+		condition_signal(&cutlery_queue.available);
+		condition_signal(&all_cutlery_clean);
 
-	/* Signal to philosopher to stop waiting... */
-  	pthread_cond_signal(&cleancutlery_available);
+		pthread_mutex_unlock(&DININGROOM_ACCESS);
 
-	pthread_mutex_unlock(&DININGROOM_ACCESS);
+		/* the cutlery returned while washing is washed at once, if someone is still waiting for cutlery */
+	}while(atomic_load(&cutlery_waiters) > 0 && (sim->diningRoom->dirtyForks > 0 || sim->diningRoom->dirtyKnives > 0));
 }
 
 void kill_philosopher(int id){
-	pthread_mutex_lock(&DININGROOM_ACCESS);
-
-	sim->diningRoom->philosophersAlive--;
-	//printf("Philosopher %d is dead (%d left)\n", id, sim->diningRoom->philosophersAlive);
+	/* the last one to die asks the waiter to wash everything and leave;
+	 * the request is made before locking the dining room, which the waiter locks to give the cutlery back */
+	if(atomic_fetch_sub(&sim->diningRoom->philosophersAlive, 1) != 1)
+		return;
 
-	if(sim->diningRoom->philosophersAlive == 0){
-		if(sim->diningRoom->cleanForks != sim->params->NUM_FORKS || sim->diningRoom->cleanKnives != sim->params->NUM_KNIVES){
-			//printf("All philosophers are dead\n");
-			make_request(4);
-
-			while(sim->diningRoom->cleanForks != sim->params->NUM_FORKS || sim->diningRoom->cleanKnives != sim->params->NUM_KNIVES)
-				pthread_cond_wait(&cleancutlery_available, &DININGROOM_ACCESS);
-		}
-	}
+	make_request(REQ_LEAVE);
 
+	pthread_mutex_lock(&DININGROOM_ACCESS);
+	while(sim->diningRoom->cleanForks != sim->params->NUM_FORKS || sim->diningRoom->cleanKnives != sim->params->NUM_KNIVES)
+		condition_wait(&all_cutlery_clean, &DININGROOM_ACCESS);
 	pthread_mutex_unlock(&DININGROOM_ACCESS);
 }
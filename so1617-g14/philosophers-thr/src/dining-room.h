@@ -7,18 +7,22 @@
 #ifndef DINING_ROOM_H
 #define DINING_ROOM_H
 
+#include <stdatomic.h>
 #include "simulation.h"
 
+/* The counters are taken and given back with atomic operations, without any lock */
 typedef struct _DiningRoom_ {
-   int pizza;                  // number of pizza meals available in dining room [0;NUM_PIZZA]
-   int spaghetti;              // number of spaghetti meals available in dining room [0;NUM_SPAGHETTI]
-   int cleanForks;             // number of clean forks available in dining room [0;NUM_FORKS]
-   int cleanKnives;            // number of clean knives available in dining room [0;NUM_KNIVES]
-   int dirtyForks;             // number of dirty forks in dining room [0;NUM_FORKS]
-   int dirtyKnives;            // number of dirty knives in dining room [0;NUM_KNIVES]
-   int dirtyForksInWaiter;     // number of dirty forks in waiter (i.e. the dirty forks that are being washed)
-   int dirtyKnivesInWaiter;    // number of dirty knives in waiter (i.e. the dirty knives that are being washed)
-   int philosophersAlive;      // number of philosophers alive
+   atomic_int pizza;                  // number of pizza meals available in dining room [0;NUM_PIZZA]
+   atomic_int spaghetti;              // number of spaghetti meals available in dining room [0;NUM_SPAGHETTI]
+   atomic_int cleanForks;             // number of clean forks available in dining room [0;NUM_FORKS]
+   atomic_int cleanKnives;            // number of clean knives available in dining room [0;NUM_KNIVES]
+   atomic_int dirtyForks;             // number of dirty forks in dining room [0;NUM_FORKS]
+   atomic_int dirtyKnives;            // number of dirty knives in dining room [0;NUM_KNIVES]
+   atomic_int dirtyForksInWaiter;     // number of dirty forks in waiters (i.e. the dirty forks that are being washed)
+   atomic_int dirtyKnivesInWaiter;    // number of dirty knives in waiters (i.e. the dirty knives that are being washed)
+   atomic_int philosophersAlive;      // number of philosophers alive
+   atomic_int meals;                  // number of meals eaten so far
+   atomic_int washed;                 // number of washes whose cutlery has left the waiter (see logger)
 } DiningRoom;
 
 
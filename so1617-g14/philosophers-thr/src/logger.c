@@ -8,22 +8,270 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "logger.h"
+#include "coroutine.h"
 #include <pthread.h> /* added */
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
 
 
 static void unsafe_logger(Simulation* sim);
-static pthread_mutex_t LOGGER_ACCESS = PTHREAD_MUTEX_INITIALIZER;
+static void invariantCheck(Simulation* sim);
+
+/* events a ring holds (a power of 2); a full ring stalls its thread, no event is lost */
+#define LOG_RING_SIZE 256
+
+/* events all rings hold together: with many agents, the rings are smaller */
+#define LOG_EVENTS_MAX (1 << 22)
+
+/* The events of one thread: only it moves head, only the consumer moves tail */
+typedef struct _LogRing_ {
+	atomic_uint head;                 // events written so far
+	char pad1[60];                    // (head and tail on distinct cache lines)
+	atomic_uint tail;                 // events consumed so far
+	char pad2[60];
+} LogRing;
+
+/* one ring per philosopher, then one per waiter, then the main thread's;
+ * the events of ring i are events[i*ringSize .. (i+1)*ringSize-1] */
+static LogRing* rings;
+static int numRings;
+static unsigned ringSize;
+static LogEvent* events;
+
+/* who the calling thread is */
+static __thread LogAgent selfAgent = LOG_SIMULATION;
+static __thread int selfId = 0;
+
+/* the simulation as the events consumed so far left it */
+static Simulation* mirror;
+
+/* events taken from the rings in one pass, to be sorted by time */
+static LogEvent* batch;
+
+static pthread_t consumerThread;
+static atomic_int stopping = 0;
+
+/* when set, the invariants are still checked, but nothing is printed */
+static int quiet = 0;
+
+/* when set, the events are also written there, in time order */
+static FILE* trace = NULL;
+
+static void* consumer(void* arg);
+
+void logger_quiet(int q)
+{
+	quiet = q;
+}
+
+void logger_trace(FILE* f)
+{
+	trace = f;
+}
+
+void logger_init(Simulation* sim)
+{
+	assert(sim != NULL);
+
+	numRings = sim->params->NUM_PHILOSOPHERS + sim->params->NUM_WAITERS + 1;
+	for(ringSize = LOG_RING_SIZE; ringSize > 8 && (size_t)numRings*ringSize > LOG_EVENTS_MAX; ringSize /= 2)
+		;
+	rings = (LogRing*)mem_alloc(numRings*sizeof(LogRing));
+	for(int i = 0; i < numRings; i++)
+	{
+		atomic_init(&rings[i].head, 0);
+		atomic_init(&rings[i].tail, 0);
+	}
+	events = (LogEvent*)mem_alloc(numRings*ringSize*sizeof(LogEvent));
+	batch = (LogEvent*)mem_alloc(numRings*ringSize*sizeof(LogEvent));
+	mirror = initSimulation(NULL, sim->params);
+
+	if(pthread_create(&consumerThread, NULL, consumer, NULL) != 0){
+		perror("error on launching the logger thread\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void logger_agent(LogAgent agent, int id)
+{
+	selfAgent = agent;
+	selfId = id;
+}
+
+/**
+ * Fills e with the state of an agent and the dining room counters, at the given time.
+ */
+void logger_snapshot(Simulation* sim, LogAgent agent, int id, uint64_t time, LogEvent* e)
+{
+	assert(sim != NULL && e != NULL);
+
+	e->time = time;
+	e->id = id;
+	e->agent = agent;
+	if (agent == LOG_PHILOSOPHER)
+	{
+		Philosopher* p = sim->philosophers[id];
+		e->state[0] = p->state;
+		e->state[1] = p->meal;
+		e->state[2] = p->cutlery[0];
+		e->state[3] = p->cutlery[1];
+	}
+	else if (agent == LOG_WAITER)
+	{
+		Waiter* w = sim->waiters[id];
+		e->state[0] = w->state;
+		e->state[1] = w->reqCutlery;
+		e->state[2] = w->reqPizza;
+		e->state[3] = w->reqSpaghetti;
+	}
+	DiningRoom* d = sim->diningRoom;
+	e->diningRoom[0] = d->pizza;
+	e->diningRoom[1] = d->spaghetti;
+	e->diningRoom[2] = d->cleanForks;
+	e->diningRoom[3] = d->cleanKnives;
+	/* cutlery is counted in washed as it leaves a waiter, before it can come back dirty;
+	 * if that happened meanwhile, the dirty counts are taken again, not to count it twice */
+	int washed;
+	do
+	{
+		washed = d->washed;
+		e->diningRoom[6] = d->dirtyForksInWaiter;
+		e->diningRoom[7] = d->dirtyKnivesInWaiter;
+		e->diningRoom[4] = d->dirtyForks;
+		e->diningRoom[5] = d->dirtyKnives;
+	} while (washed != d->washed);
+	e->diningRoom[8] = d->philosophersAlive;
+}
 
 /**
- * Change this function to get a safe access to shared simulation data!
+ * Records the state of the calling thread and the dining room counters.
  */
 void logger(Simulation* sim)
 {
 	assert(sim != NULL);
 
-	pthread_mutex_lock(&LOGGER_ACCESS);
-	unsafe_logger(sim);
-	pthread_mutex_unlock(&LOGGER_ACCESS);
+	int r;
+	if (selfAgent == LOG_PHILOSOPHER)
+		r = selfId;
+	else if (selfAgent == LOG_WAITER)
+		r = sim->params->NUM_PHILOSOPHERS + selfId;
+	else
+		r = numRings - 1;
+	LogRing* ring = &rings[r];
+
+	unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == ringSize)
+		coroutine_yield();
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	logger_snapshot(sim, selfAgent, selfId, (uint64_t)now.tv_sec*1000000000 + now.tv_nsec, &events[r*ringSize + head % ringSize]);
+
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * Consumes the events still in the rings and waits for the consumer to end.
+ * To be called once every other thread stopped logging.
+ */
+void logger_stop()
+{
+	atomic_store(&stopping, 1);
+	if(pthread_join(consumerThread, NULL) != 0)
+		perror("error on waiting for the logger thread to conclude\n");
+	if (trace != NULL && fclose(trace) != 0)
+		perror("error on writing the trace\n");
+}
+
+static int by_time(const void* a, const void* b)
+{
+	uint64_t ta = ((const LogEvent*)a)->time, tb = ((const LogEvent*)b)->time;
+	return (ta > tb) - (ta < tb);
+}
+
+/**
+ * Sets the state an event records in sim, and logs it.
+ */
+void logger_replay(Simulation* sim, LogEvent* e)
+{
+	assert(sim != NULL && e != NULL);
+
+	if (e->agent == LOG_PHILOSOPHER)
+	{
+		Philosopher* p = sim->philosophers[e->id];
+		p->state = e->state[0];
+		p->meal = e->state[1];
+		p->cutlery[0] = e->state[2];
+		p->cutlery[1] = e->state[3];
+	}
+	else if (e->agent == LOG_WAITER)
+	{
+		Waiter* w = sim->waiters[e->id];
+		w->state = e->state[0];
+		w->reqCutlery = e->state[1];
+		w->reqPizza = e->state[2];
+		w->reqSpaghetti = e->state[3];
+	}
+	DiningRoom* d = sim->diningRoom;
+	d->pizza = e->diningRoom[0];
+	d->spaghetti = e->diningRoom[1];
+	d->cleanForks = e->diningRoom[2];
+	d->cleanKnives = e->diningRoom[3];
+	d->dirtyForks = e->diningRoom[4];
+	d->dirtyKnives = e->diningRoom[5];
+	d->dirtyForksInWaiter = e->diningRoom[6];
+	d->dirtyKnivesInWaiter = e->diningRoom[7];
+	d->philosophersAlive = e->diningRoom[8];
+
+	logger_show(sim);
+}
+
+/**
+ * Logs the state of the simulation as it is, or only checks it, if quiet.
+ * The caller must be the only one changing it.
+ */
+void logger_show(Simulation* sim)
+{
+	if (quiet)
+		invariantCheck(sim);
+	else
+		unsafe_logger(sim);
+}
+
+/**
+ * Takes the events of all rings, replays them in time order and logs each,
+ * after writing them to the trace, if any.
+ * The rings are drained once more after stopping is seen, so no event is left.
+ */
+static void* consumer(void* arg)
+{
+	int last;
+	do
+	{
+		last = atomic_load(&stopping);
+		int n = 0;
+		for(int i = 0; i < numRings; i++)
+		{
+			LogRing* ring = &rings[i];
+			unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+			unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+			for(; tail != head; tail++)
+				batch[n++] = events[i*ringSize + tail % ringSize];
+			atomic_store_explicit(&ring->tail, tail, memory_order_release);
+		}
+		qsort(batch, n, sizeof(LogEvent), by_time);
+		if (trace != NULL && fwrite(batch, sizeof(LogEvent), n, trace) != (size_t)n)
+		{
+			perror("error on writing the trace\n");
+			exit(EXIT_FAILURE);
+		}
+		for(int i = 0; i < n; i++)
+			logger_replay(mirror, &batch[i]);
+		if (n == 0 && !last)
+			usleep(1000);
+	} while(!last);
+	return NULL;
 }
 
 /*********************************************************************/
@@ -117,11 +365,24 @@ static void invariantCheck(Simulation* sim)
 	  fprintf(stderr, "INVARIANT ERROR: sim->philosophers not defined!!\n");
 	  exit(EXIT_FAILURE);
 	}
-	if (sim->waiter == NULL)
+	if (sim->waiters == NULL)
 	{
-	  fprintf(stderr, "INVARIANT ERROR: sim->waiter not defined!!\n");
+	  fprintf(stderr, "INVARIANT ERROR: sim->waiters not defined!!\n");
 	  exit(EXIT_FAILURE);
 	}
+	for(int i = 0; i < sim->params->NUM_WAITERS; i++)
+	{
+	  if (sim->waiters[i] == NULL)
+	  {
+	    fprintf(stderr, "INVARIANT ERROR: sim->waiters[%d] not defined!!\n", i);
+	    exit(EXIT_FAILURE);
+	  }
+	  if (sim->waiters[i]->state == W_DEAD && sim->diningRoom->philosophersAlive > 0)
+	  {
+	    fprintf(stderr, "INVARIANT ERROR: Waiter %d dead with %d philosophers alive!\n", i, sim->diningRoom->philosophersAlive);
+	    exit(EXIT_FAILURE);
+	  }
+	}
 	if (!(sim->diningRoom->pizza >= 0 && sim->diningRoom->pizza <= sim->params->NUM_PIZZA))
 	{
 	  fprintf(stderr, "INVARIANT ERROR: Invalid buffet number of pizzas: %d!\n", sim->diningRoom->pizza);
@@ -305,7 +566,11 @@ static void unsafe_logger(Simulation* sim)
 	  printf("%s%s%s", YELLOW," Dirty", END);
 	  printf("%s%s%s", BLUE, " Clean", END);
 	  printf("%s%s%s", YELLOW," Dirty", END);
-	  printf("%sWaiter:%s", EMPTY_SYMBOL, HEADER_SPACES);
+	  if (sim->params->NUM_WAITERS == 1)
+		 printf("%sWaiter:%s", EMPTY_SYMBOL, HEADER_SPACES);
+	  else
+		 for(i = 0; i < sim->params->NUM_WAITERS; i++)
+			printf("%sWt%02d:%s ", EMPTY_SYMBOL, i+1, HEADER_SPACES);
 	  for(i = 0; i < sim->params->NUM_PHILOSOPHERS; i++)
 		 printf(" Ph%02d:%s", i+1, HEADER_SPACES);
 	  printf("\n");
@@ -335,9 +600,12 @@ static void unsafe_logger(Simulation* sim)
 	printf("%s", dirtyKnives > 0 ? RED : BLACK);
 	printf("%2d ",dirtyKnives);
 	printf("%s", END);
-	printf("[");
-	waiterLogger(sim->waiter);
-	printf("]");
+	for(i = 0; i < sim->params->NUM_WAITERS; i++)
+	{
+	  printf("[");
+	  waiterLogger(sim->waiters[i]);
+	  printf("]");
+	}
 	for(i = 0; i < sim->params->NUM_PHILOSOPHERS; i++)
 	{
 	  printf("[");
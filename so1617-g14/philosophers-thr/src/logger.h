@@ -1,14 +1,45 @@
 /**
  *  \brief Logging module
  *  
+ *  Each state change is recorded as a compact event in a ring of the thread
+ *  that made it, with no lock; a consumer thread takes the events of all rings,
+ *  in time order, replays them over its own copy of the simulation, checks the
+ *  invariants and prints the table, away from the philosophers and waiters.
+ *
  * \author Miguel Oliveira e Silva - 2016
  */
 
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include "simulation.h"
 
+/* who records an event */
+typedef enum {
+	LOG_SIMULATION,                   // the main thread: only the dining room counters
+	LOG_PHILOSOPHER,                  // a philosopher: its state and the dining room counters
+	LOG_WAITER                        // a waiter: its state and the dining room counters
+} LogAgent;
+
+/* a state change, as seen by the agent that made it */
+typedef struct _LogEvent_ {
+	uint64_t time;                    // CLOCK_MONOTONIC, in nanoseconds
+	int32_t id;                       // philosopher or waiter number
+	uint8_t agent;                    // LogAgent
+	uint8_t state[4];                 // philosopher: state, meal, cutlery[0..1]; waiter: state, reqCutlery, reqPizza, reqSpaghetti
+	int32_t diningRoom[9];            // DiningRoom counters, pizza to philosophersAlive, in declaration order
+} LogEvent;
+
+void logger_init(Simulation* sim);
+void logger_agent(LogAgent agent, int id);
 void logger(Simulation* sim);
+void logger_snapshot(Simulation* sim, LogAgent agent, int id, uint64_t time, LogEvent* e);
+void logger_quiet(int quiet);
+void logger_trace(FILE* f);
+void logger_replay(Simulation* sim, LogEvent* e);
+void logger_show(Simulation* sim);
+void logger_stop();
 
 #endif
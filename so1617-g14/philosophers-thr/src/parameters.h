@@ -20,6 +20,7 @@ typedef struct _Parameters_
 	int CHOOSE_PIZZA_PROB;    // probability to choose a pizza meal against a spaghetti meal
 	int EAT_TIME;             // maximum milliseconds for eating (the actual time should be a random value in interval [0;EAT_TIME])
 	int WASH_TIME;            // maximum milliseconds for washing (the actual time should be a random value in interval [0;WASH_TIME])
+	int NUM_WAITERS;          // number of waiters
 } Parameters;
 
 #endif
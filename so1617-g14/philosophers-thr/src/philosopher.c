@@ -13,6 +13,8 @@
 #include "dining-room.h"
 #include "simulation.h"
 #include "logger.h"
+#include "coroutine.h"
+#include "prng.h"
 
 /* put your code here */
 
@@ -23,21 +25,25 @@ void philosopher_lifecycle(int id){
 	int st;
 	int life_time, meal;
 	int i = 0;
+	Prng rng;
+
+	/* random numbers of its own, not shared with the other philosophers */
+	prng_init(&rng, id);
 
 	/* Get random life time based on the given parameters */
-	life_time = (rand() % (sim->params->PHILOSOPHER_MAX_LIVE - sim->params->PHILOSOPHER_MIN_LIVE)) + sim->params->PHILOSOPHER_MIN_LIVE;
+	life_time = prng_below(&rng, sim->params->PHILOSOPHER_MAX_LIVE - sim->params->PHILOSOPHER_MIN_LIVE) + sim->params->PHILOSOPHER_MIN_LIVE;
 	//printf("Philosopher %d living for %d iterations\n", id, life_time);
 
 	while(life_time > i){
 		/* Think for a random time */
-		st = rand() % sim->params->THINK_TIME;
+		st = prng_below(&rng, sim->params->THINK_TIME);
 		sim->philosophers[id]->state = P_THINKING; /* Philosopher is thinking */
 		//printf("Philosopher %d thinking for %d milliseconds\n", id, st);
 		logger(sim);
-		usleep(st * 1000); /* millisecond to microseconds */
+		coroutine_sleep(st);
 
 		/* Choose meal */
-		meal = rand() % 100;
+		meal = prng_below(&rng, 100);
 		sim->philosophers[id]->state = P_HUNGRY; /* Philosopher is hungry */
 		if(meal <= sim->params->CHOOSE_PIZZA_PROB){
 			//printf("Philosopher %d is hungry and has chosen pizza\n", id);
@@ -71,11 +77,12 @@ void philosopher_lifecycle(int id){
 		logger(sim);
 
 		/* Eat for a random time */
-		st = rand() % sim->params->EAT_TIME;
+		st = prng_below(&rng, sim->params->EAT_TIME);
 		sim->philosophers[id]->state = P_EATING; /* Philosopher is eating */
 		//printf("Philosopher %d eating for %d milliseconds\n", id, st);
 		logger(sim);
-		usleep(st * 1000); /* millisecond to microseconds */
+		coroutine_sleep(st);
+		atomic_fetch_add(&sim->diningRoom->meals, 1);
 
 		/* Return dirty cutlery */
 		if(meal <= sim->params->CHOOSE_PIZZA_PROB){
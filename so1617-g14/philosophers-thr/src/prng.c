@@ -0,0 +1,44 @@
+/**
+ *  \brief Pseudo-random number generator
+ */
+
+#include "prng.h"
+
+/* seed all generators derive from (set before any is initialized) */
+static uint64_t seed = 0;
+
+void prng_seed(uint64_t s){
+	seed = s;
+}
+
+uint64_t prng_get_seed(){
+	return seed;
+}
+
+/**
+ * Initializes g with the seed, on the given stream.
+ */
+void prng_init(Prng* g, uint64_t stream){
+	g->state = 0;
+	g->inc = (stream << 1) | 1;
+	prng_next(g);
+	g->state += seed;
+	prng_next(g);
+}
+
+uint32_t prng_next(Prng* g){
+	uint64_t old = g->state;
+	uint32_t xorshifted, rot;
+
+	g->state = old * 6364136223846793005ULL + g->inc;
+	xorshifted = ((old >> 18) ^ old) >> 27;
+	rot = old >> 59;
+	return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+/**
+ * A number in [0;n[, or 0 if n is not positive.
+ */
+int prng_below(Prng* g, int n){
+	return (n > 0) ? prng_next(g) % n : 0;
+}
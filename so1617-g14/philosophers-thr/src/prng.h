@@ -0,0 +1,26 @@
+/**
+ *  \brief Pseudo-random number generator
+ *
+ *  Each philosopher draws its random numbers from a generator of its own (a
+ *  PCG32), with no state shared with the others. All generators derive from
+ *  one seed, each on a stream of its own, so a philosopher draws the same
+ *  numbers for the same seed, however the threads are scheduled.
+ */
+
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <stdint.h>
+
+typedef struct _Prng_ {
+	uint64_t state;
+	uint64_t inc;                     // selects the stream (always odd)
+} Prng;
+
+void prng_seed(uint64_t seed);
+uint64_t prng_get_seed();
+void prng_init(Prng* g, uint64_t stream);
+uint32_t prng_next(Prng* g);
+int prng_below(Prng* g, int n);
+
+#endif
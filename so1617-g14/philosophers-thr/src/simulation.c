@@ -12,9 +12,14 @@
 #include <getopt.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 #include "parameters.h"
 #include "dining-room.h"
 #include "logger.h"
+#include "trace.h"
+#include "virtual-time.h"
+#include "coroutine.h"
+#include "prng.h"
 #include <pthread.h> /* added */
 
 /* Global variable */
@@ -25,33 +30,103 @@ static void help(char* prog);
 static void processArgs(Parameters *params, int argc, char* argv[]);
 static void showParams(Parameters *params);
 static void *philosopher(void *pid); /* added */
-static void *waiter(); /* added */
+static void *waiter(void *wid); /* added */
+static void run_threads();
+
+/* set by -b: no prompt nor log lines, only the number of meals per second */
+static int benchmark = 0;
+
+/* set by -T: file the events are written to; by -R: trace replayed instead of running */
+static char* tracePath = NULL;
+static char* replayPath = NULL;
+
+/* set by -V: run on a virtual clock, in this thread */
+static int virtualTime = 0;
+
+/* set by -C: number of worker threads running the philosophers and waiters as coroutines */
+static int coroutineWorkers = 0;
+
+/* set by -S: seed of the random numbers of the philosophers, taken from the process id if not */
+static int seeded = 0;
+static uint64_t seed;
 
 int main(int argc, char* argv[])
 {
 	// default parameter values:
-	Parameters params = {5,10,100,3,2,10,10,20,50,10,15};
+	Parameters params = {5,10,100,3,2,10,10,20,50,10,15,1};
 	processArgs(&params, argc, argv);
-	showParams(&params);
-	printf("<press RETURN>");
-	getchar();
+	if (replayPath != NULL)
+		return trace_replay(replayPath, benchmark);
+	prng_seed(seeded ? seed : (uint64_t)getpid());
+	if (benchmark)
+		logger_quiet(1);
+	else
+	{
+		showParams(&params);
+		printf("<press RETURN>");
+		getchar();
+	}
 
 	sim = initSimulation(NULL, &params);
+	if (virtualTime)
+		return run_virtual_time(tracePath != NULL ? trace_create(tracePath, sim->params) : NULL, benchmark);
+	init_waiters();
+	if (tracePath != NULL)
+		logger_trace(trace_create(tracePath, sim->params));
+	logger_init(sim);
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 	logger(sim);
 
+	int i;
+	if (coroutineWorkers > 0)
+	{
+		coroutine_init(coroutineWorkers, sim->params->NUM_WAITERS + sim->params->NUM_PHILOSOPHERS);
+		for(i = 0; i < sim->params->NUM_WAITERS; i++)
+			coroutine_spawn(waiter_lifecycle, LOG_WAITER, i);
+		for(i = 0; i < sim->params->NUM_PHILOSOPHERS; i++)
+			coroutine_spawn(philosopher_lifecycle, LOG_PHILOSOPHER, i);
+		coroutine_run();
+	}
+	else
+		run_threads();
+	logger(sim);
+	logger_stop();
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	if (benchmark)
+	{
+		printf("%d meals in %.3f s: %.1f meals/sec\n", sim->diningRoom->meals, elapsed, sim->diningRoom->meals / elapsed);
+		if (coroutineWorkers > 0)
+			printf("%d coroutines on %d threads: %.1f KiB per philosopher, %.2f context switches per meal\n",
+				sim->params->NUM_WAITERS + sim->params->NUM_PHILOSOPHERS, coroutineWorkers,
+				coroutine_memory() / 1024, (double)coroutine_switches() / sim->diningRoom->meals);
+	}
+
+	return 0;
+}
+
+/**
+ * One thread per philosopher and per waiter, waited for until all end.
+ */
+static void run_threads()
+{
 	/**
- 	* launch threads/processes for philosophers and waiter
+ 	* launch threads/processes for philosophers and waiters
  	*/
- 	pthread_t pthr[sim->params->NUM_PHILOSOPHERS], wthr[1];
-	int i, ids[sim->params->NUM_PHILOSOPHERS];
-	srand((int)getpid());
+ 	pthread_t pthr[sim->params->NUM_PHILOSOPHERS], wthr[sim->params->NUM_WAITERS];
+	int i, ids[sim->params->NUM_PHILOSOPHERS], wids[sim->params->NUM_WAITERS];
 
-	/* launching the waiter */
-	//printf("Launching 1 waiter thread\n");
+	/* launching the waiters */
+	//printf("Launching %d waiter threads\n", sim->params->NUM_WAITERS);
 
-	if(pthread_create(&wthr[0], NULL, waiter, NULL) != 0){
-		fprintf(stderr, "waiter\n");
-		perror("error on launching the waiter thread\n");
+	for(i = 0; i < sim->params->NUM_WAITERS; i++){
+		wids[i] = i;
+		if(pthread_create(&wthr[i], NULL, waiter, &wids[i]) != 0){
+			fprintf(stderr, "Waiter %d\n", i);
+			perror("error on launching the waiter thread\n");
+		}
 	}
 	
 	/* launching the philosophers */
@@ -68,7 +143,7 @@ int main(int argc, char* argv[])
 	/* end */
 	
 	/**
-	 * Wait for the death of all philosophers, and request and wait for waiter dead.
+	 * Wait for the death of all philosophers, and request and wait for waiters dead.
 	 */
 	for(i = 0; i < sim->params->NUM_PHILOSOPHERS; i++){
 		if(pthread_join(pthr[i], NULL) != 0){
@@ -77,24 +152,26 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	if(pthread_join(wthr[0], NULL) != 0){
-		fprintf(stderr, "Waiter\n");
-		perror("error on waiting for the waiter thread to conclude\n");
+	for(i = 0; i < sim->params->NUM_WAITERS; i++){
+		if(pthread_join(wthr[i], NULL) != 0){
+			fprintf(stderr, "Waiter %d\n", i);
+			perror("error on waiting for the waiter thread to conclude\n");
+		}
 	}
-	logger(sim);
 	/* end */
-
-	return 0;
 }
 
 static void *philosopher(void *pid){
 	int id = *((int *)pid);
+	logger_agent(LOG_PHILOSOPHER, id);
 	philosopher_lifecycle(id);
 	return NULL;
 }
 
-static void *waiter(){
-	waiter_lifecycle();
+static void *waiter(void *wid){
+	int id = *((int *)wid);
+	logger_agent(LOG_WAITER, id);
+	waiter_lifecycle(id);
 	return NULL;
 }
 
@@ -113,7 +190,7 @@ Simulation* initSimulation(Simulation* sim, Parameters* params)
 
 	// default DiningRoom values:
 	result->diningRoom = (DiningRoom*)mem_alloc(sizeof(DiningRoom));
-	DiningRoom s = {params->NUM_PIZZA, params->NUM_SPAGHETTI, params->NUM_FORKS, params->NUM_KNIVES, 0, 0, 0, 0, params->NUM_PHILOSOPHERS};
+	DiningRoom s = {params->NUM_PIZZA, params->NUM_SPAGHETTI, params->NUM_FORKS, params->NUM_KNIVES, 0, 0, 0, 0, params->NUM_PHILOSOPHERS, 0, 0};
 	memcpy(result->diningRoom, &s, sizeof(DiningRoom));
 
 	// Philosopher:
@@ -125,10 +202,14 @@ Simulation* initSimulation(Simulation* sim, Parameters* params)
 		memcpy(result->philosophers[i], &p, sizeof(Philosopher));
 	}
 
-	// Waiter:
+	// Waiters:
 	Waiter w = {W_NONE,W_INACTIVE,W_INACTIVE,W_INACTIVE};
-	result->waiter = (Waiter*)mem_alloc(sizeof(Waiter));
-	memcpy(result->waiter, &w, sizeof(Waiter));
+	result->waiters = (Waiter**)mem_alloc(params->NUM_WAITERS*sizeof(Waiter*));
+	for(i = 0; i < params->NUM_WAITERS; i++)
+	{
+		result->waiters[i] = (Waiter*)mem_alloc(sizeof(Waiter));
+		memcpy(result->waiters[i], &w, sizeof(Waiter));
+	}
 
 	return result;
 }
@@ -157,6 +238,13 @@ static void help(char* prog)
 	printf("  -c, --choose-pizza-prob   set probability to choose a pizza meal against a spaghetti meal (default is 50)\n");
 	printf("  -e, --eat-time   set maximum milliseconds for eating (default is 10)\n");
 	printf("  -w, --wash-time   set maximum milliseconds for washing (default is 15)\n");
+	printf("  -W, --num-waiters   set number of waiters (default is 1)\n");
+	printf("  -b, --benchmark   run without prompt nor log lines, and report the number of meals per second\n");
+	printf("  -T, --trace FILE   also write the events to a binary trace\n");
+	printf("  -R, --replay FILE   replay a trace, instead of running, and report its statistics (only these with -b)\n");
+	printf("  -V, --virtual-time   run in a single thread, on a virtual clock, and report the statistics\n");
+	printf("  -C, --coroutines N   run philosophers and waiters as coroutines over N threads (default is one thread each)\n");
+	printf("  -S, --seed N   set seed of the random numbers, for the same ones in every run (default is the process id)\n");
 	printf("\n");
 }
 
@@ -179,6 +267,13 @@ static void processArgs(Parameters *params, int argc, char* argv[])
 		{"choose-pizza-prob",required_argument, NULL, 'c' },
 		{"eat-time",         required_argument, NULL, 'e' },
 		{"wash-time",        required_argument, NULL, 'w' },
+		{"num-waiters",      required_argument, NULL, 'W' },
+		{"benchmark",        no_argument,       NULL, 'b' },
+		{"trace",            required_argument, NULL, 'T' },
+		{"replay",           required_argument, NULL, 'R' },
+		{"virtual-time",     no_argument,       NULL, 'V' },
+		{"coroutines",       required_argument, NULL, 'C' },
+		{"seed",             required_argument, NULL, 'S' },
 		{0,          0,                 NULL,  0 }
 	};
 	int op=0;
@@ -187,7 +282,7 @@ static void processArgs(Parameters *params, int argc, char* argv[])
 	{
 		int option_index = 0;
 
-		op = getopt_long(argc, argv, "hn:l:L:f:k:p:s:t:c:e:w:", long_options, &option_index);
+		op = getopt_long(argc, argv, "hn:l:L:f:k:p:s:t:c:e:w:W:bT:R:VC:S:", long_options, &option_index);
 		int n; // integer number
 		switch (op)
 		{
@@ -308,6 +403,55 @@ static void processArgs(Parameters *params, int argc, char* argv[])
 				params->WASH_TIME = n;
 				break;
 
+			case 'W':
+				n = atoi(optarg);
+				if (n < 1)
+				{
+					fprintf(stderr, "ERROR: invalid number of waiters \"%s\"\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				params->NUM_WAITERS = n;
+				break;
+
+			case 'b':
+				benchmark = 1;
+				break;
+
+			case 'T':
+				tracePath = optarg;
+				break;
+
+			case 'R':
+				replayPath = optarg;
+				break;
+
+			case 'V':
+				virtualTime = 1;
+				break;
+
+			case 'C':
+				n = atoi(optarg);
+				if (n < 1)
+				{
+					fprintf(stderr, "ERROR: invalid number of coroutine threads \"%s\"\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				coroutineWorkers = n;
+				break;
+
+			case 'S':
+			{
+				char* end;
+				seed = strtoull(optarg, &end, 0);
+				if (*optarg == '\0' || *optarg == '-' || *end != '\0')
+				{
+					fprintf(stderr, "ERROR: invalid seed \"%s\"\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				seeded = 1;
+				break;
+			}
+
 			default:
 				help(argv[0]);
 				exit(EXIT_FAILURE);
@@ -340,6 +484,8 @@ static void showParams(Parameters *params)
 	printf("  --choose-pizza-prob: %d\n", params->CHOOSE_PIZZA_PROB);
 	printf("  --eat-time: %d\n", params->EAT_TIME);
 	printf("  --wash-time: %d\n", params->WASH_TIME);
+	printf("  --num-waiters: %d\n", params->NUM_WAITERS);
+	printf("  --seed: %llu\n", (unsigned long long)prng_get_seed());
 	printf("\n");
 }
 
@@ -16,7 +16,7 @@ typedef struct _Simulation_ {
    struct _Parameters_* params;
    struct _DiningRoom_* diningRoom;
    struct _Philosopher_** philosophers;
-   struct _Waiter_* waiter;
+   struct _Waiter_** waiters;
 } Simulation;
 
 #include "parameters.h"
@@ -0,0 +1,195 @@
+/**
+ *  \brief Trace module
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "trace.h"
+
+/* events read at once while replaying */
+#define TRACE_CHUNK 256
+
+FILE* trace_create(char* path, Parameters* params)
+{
+	assert(path != NULL && params != NULL);
+
+	FILE* f = fopen(path, "w");
+	if (f == NULL)
+	{
+		fprintf(stderr, "ERROR: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	TraceHeader h;
+	memset(&h, 0, sizeof(TraceHeader));
+	memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+	h.eventSize = sizeof(LogEvent);
+	h.params = *params;
+	/* flushed at once, not to be written again by the processes forked afterwards */
+	if (fwrite(&h, sizeof(TraceHeader), 1, f) != 1 || fflush(f) != 0)
+	{
+		fprintf(stderr, "ERROR: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return f;
+}
+
+/* count, total and maximum of a set of durations, in nanoseconds */
+typedef struct _Stat_ {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+} Stat;
+
+/* the statistics of a run, and the last state of each philosopher and waiter, and since when */
+struct _TraceStats_ {
+	int n, w;
+	PhilosopherState* pstate;
+	WaiterState* wstate;
+	uint64_t* psince;
+	uint64_t* wsince;
+	Stat hungry, eating;
+	Stat serving[3];                  // cutlery, pizza, spaghetti, as in WaiterState
+	uint64_t events, first, last;
+};
+
+static void stat_add(Stat* s, uint64_t t)
+{
+	s->count++;
+	s->sum += t;
+	if (t > s->max)
+		s->max = t;
+}
+
+static void stat_print(char* name, Stat* s)
+{
+	printf("  %-22s %10" PRIu64 " %12.3f %12.3f\n", name, s->count,
+			s->count > 0 ? s->sum / 1e6 / s->count : 0.0, s->max / 1e6);
+}
+
+TraceStats* trace_stats_new(Parameters* params)
+{
+	assert(params != NULL);
+
+	TraceStats* st = (TraceStats*)mem_alloc(sizeof(TraceStats));
+	memset(st, 0, sizeof(TraceStats));
+	st->n = params->NUM_PHILOSOPHERS;
+	st->w = params->NUM_WAITERS;
+	st->pstate = (PhilosopherState*)mem_alloc(st->n*sizeof(PhilosopherState));
+	st->wstate = (WaiterState*)mem_alloc(st->w*sizeof(WaiterState));
+	st->psince = (uint64_t*)mem_alloc(st->n*sizeof(uint64_t));
+	st->wsince = (uint64_t*)mem_alloc(st->w*sizeof(uint64_t));
+	for(int i = 0; i < st->n; i++)
+		st->pstate[i] = P_BIRTH;
+	for(int i = 0; i < st->w; i++)
+		st->wstate[i] = W_NONE;
+	return st;
+}
+
+/**
+ * Accounts for the time the agent of an event spent in its previous state.
+ */
+void trace_stats_add(TraceStats* st, LogEvent* e)
+{
+	assert(st != NULL && e != NULL);
+
+	if (st->events++ == 0)
+		st->first = e->time;
+	st->last = e->time;
+	if (e->agent == LOG_PHILOSOPHER && e->state[0] != st->pstate[e->id])
+	{
+		if (st->pstate[e->id] == P_HUNGRY)
+			stat_add(&st->hungry, e->time - st->psince[e->id]);
+		else if (st->pstate[e->id] == P_EATING)
+			stat_add(&st->eating, e->time - st->psince[e->id]);
+		st->pstate[e->id] = e->state[0];
+		st->psince[e->id] = e->time;
+	}
+	else if (e->agent == LOG_WAITER && e->state[0] != st->wstate[e->id])
+	{
+		if (st->wstate[e->id] >= W_REQUEST_CUTLERY && st->wstate[e->id] <= W_REQUEST_SPAGHETTI)
+			stat_add(&st->serving[st->wstate[e->id] - W_REQUEST_CUTLERY], e->time - st->wsince[e->id]);
+		st->wstate[e->id] = e->state[0];
+		st->wsince[e->id] = e->time;
+	}
+}
+
+void trace_stats_print(TraceStats* st)
+{
+	assert(st != NULL);
+
+	uint64_t span = st->last - st->first;
+	uint64_t busy = st->serving[0].sum + st->serving[1].sum + st->serving[2].sum;
+	printf("%" PRIu64 " events in %.3f s, of %d philosophers and %d waiters\n", st->events, span / 1e9, st->n, st->w);
+	printf("  %-22s %10s %12s %12s\n", "", "count", "mean (ms)", "max (ms)");
+	stat_print("hungry until eating", &st->hungry);
+	stat_print("eating", &st->eating);
+	stat_print("serving pizza", &st->serving[W_REQUEST_PIZZA - W_REQUEST_CUTLERY]);
+	stat_print("serving spaghetti", &st->serving[W_REQUEST_SPAGHETTI - W_REQUEST_CUTLERY]);
+	stat_print("serving cutlery", &st->serving[0]);
+	if (span > 0)
+		printf("philosophers eating %.1f%% of the time, waiters serving %.1f%%\n",
+				100.0 * st->eating.sum / st->n / span, 100.0 * busy / st->w / span);
+}
+
+/**
+ * Replays a trace: prints its table (or only checks the invariants, if quiet),
+ * and then its statistics. It is read a chunk at a time.
+ */
+int trace_replay(char* path, int quiet)
+{
+	assert(path != NULL);
+
+	FILE* f = fopen(path, "r");
+	if (f == NULL)
+	{
+		fprintf(stderr, "ERROR: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	TraceHeader h;
+	if (fread(&h, sizeof(TraceHeader), 1, f) != 1 || memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0)
+	{
+		fprintf(stderr, "ERROR: %s: not a trace of this simulation\n", path);
+		exit(EXIT_FAILURE);
+	}
+	if (h.eventSize != sizeof(LogEvent))
+	{
+		fprintf(stderr, "ERROR: %s: events of %u bytes, instead of %zu\n", path, h.eventSize, sizeof(LogEvent));
+		exit(EXIT_FAILURE);
+	}
+
+	int n = h.params.NUM_PHILOSOPHERS, w = h.params.NUM_WAITERS;
+	Simulation* sim = initSimulation(NULL, &h.params);
+	TraceStats* st = trace_stats_new(&h.params);
+	logger_quiet(quiet);
+
+	LogEvent* chunk = (LogEvent*)mem_alloc(TRACE_CHUNK*sizeof(LogEvent));
+	size_t got;
+	while ((got = fread(chunk, sizeof(LogEvent), TRACE_CHUNK, f)) > 0)
+	{
+		for(size_t k = 0; k < got; k++)
+		{
+			LogEvent* e = &chunk[k];
+			if ((e->agent == LOG_PHILOSOPHER && (e->id < 0 || e->id >= n)) ||
+					(e->agent == LOG_WAITER && (e->id < 0 || e->id >= w)))
+			{
+				fprintf(stderr, "ERROR: %s: event of an unknown agent\n", path);
+				exit(EXIT_FAILURE);
+			}
+			logger_replay(sim, e);
+			trace_stats_add(st, e);
+		}
+	}
+	if (ferror(f))
+	{
+		fprintf(stderr, "ERROR: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	fclose(f);
+
+	trace_stats_print(st);
+	return EXIT_SUCCESS;
+}
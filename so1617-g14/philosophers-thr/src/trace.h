@@ -0,0 +1,34 @@
+/**
+ *  \brief Trace module
+ *
+ *  A trace is a header, with the parameters of the simulation, followed by the
+ *  events of the logger, as they are in memory and in time order. It is
+ *  replayed a few events at a time, so its length is not bounded by memory.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "logger.h"
+
+#define TRACE_MAGIC "PHILTHR1"
+
+typedef struct _TraceHeader_ {
+	char magic[8];                    // TRACE_MAGIC, not terminated
+	uint32_t eventSize;               // sizeof(LogEvent) of the simulation that wrote it
+	uint32_t unused;
+	Parameters params;                // parameters of the simulation that wrote it
+} TraceHeader;
+
+/* times philosophers wait and eat, and waiters serve requests, in a run */
+typedef struct _TraceStats_ TraceStats;
+
+FILE* trace_create(char* path, Parameters* params);
+int trace_replay(char* path, int quiet);
+TraceStats* trace_stats_new(Parameters* params);
+void trace_stats_add(TraceStats* st, LogEvent* e);
+void trace_stats_print(TraceStats* st);
+
+#endif
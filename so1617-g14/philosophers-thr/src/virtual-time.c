@@ -0,0 +1,487 @@
+/**
+ *  \brief Virtual time engine
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "virtual-time.h"
+#include "simulation.h"
+#include "logger.h"
+#include "trace.h"
+#include "prng.h"
+
+extern Simulation* sim;
+
+/* nanoseconds in a millisecond, the unit of the times in the parameters */
+#define MS 1000000ULL
+
+/* an agent to be resumed at some time */
+typedef struct _VirtualEvent_ {
+	uint64_t time;
+	uint64_t seq;                           // order it was scheduled in, among those at the same time
+	LogAgent agent;                         // LOG_PHILOSOPHER or LOG_WAITER
+	int id;
+} VirtualEvent;
+
+/* where a philosopher is resumed */
+typedef enum {
+	V_THINK,                                // done with a meal (or born): think, or die
+	V_HUNGRY,                               // done thinking
+	V_FOOD,                                 // waiting for its meal
+	V_CUTLERY,                              // waiting for cutlery
+	V_FULL,                                 // done eating
+	V_GONE                                  // dead
+} PhilosopherStep;
+
+typedef struct _VirtualPhilosopher_ {
+	PhilosopherStep step;
+	int lifeTime;                           // iterations of its life cycle
+	int iteration;
+	int pizza;                              // chose pizza for the current meal
+	Prng rng;                               // as in philosopher_lifecycle, for the same numbers
+} VirtualPhilosopher;
+
+/* where a waiter is resumed */
+typedef enum {
+	V_TAKE,                                 // take a batch of requests, or wait for one
+	V_WASHED                                // done washing
+} WaiterStep;
+
+typedef struct _VirtualWaiter_ {
+	WaiterStep step;
+	int req;                                // requests given to it, not taken yet
+	int idle;                               // waiting for requests
+	int batch;                              // requests being served
+	int forks, knives;                      // being washed
+} VirtualWaiter;
+
+/* philosophers waiting for one kind of thing, in arrival order; only the first is woken up */
+typedef struct _VirtualQueue_ {
+	int* ids;
+	int head, length;
+	int woken;                              // the first one is already scheduled to try again
+} VirtualQueue;
+
+static uint64_t now = 0;
+
+/* events to come, in a binary heap: at most one per philosopher and one per waiter */
+static VirtualEvent* heap;
+static int heapLength = 0;
+static uint64_t seq = 0;
+
+static VirtualPhilosopher* philosophers;
+static VirtualWaiter* waiters;
+static VirtualQueue pizzaQueue, spaghettiQueue, cutleryQueue;
+static int next = 0; /* waiter given the next request when none is idle */
+
+/* statistics of the events recorded so far, and where they are written to, if anywhere */
+static TraceStats* stats;
+static FILE* trace;
+
+static int earlier(VirtualEvent* a, VirtualEvent* b){
+	return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void schedule(LogAgent agent, int id, uint64_t delay){
+	int i = heapLength++;
+	VirtualEvent e = {now + delay, seq++, agent, id};
+
+	while(i > 0 && earlier(&e, &heap[(i - 1) / 2])){
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = e;
+}
+
+static VirtualEvent unschedule(){
+	VirtualEvent first = heap[0], last = heap[--heapLength];
+	int i = 0, child;
+
+	while((child = 2 * i + 1) < heapLength){
+		if(child + 1 < heapLength && earlier(&heap[child + 1], &heap[child]))
+			child++;
+		if(!earlier(&heap[child], &last))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+	return first;
+}
+
+/* the state of an agent changed: show it, and account for it, as the logger does for threads */
+static void record(LogAgent agent, int id){
+	LogEvent e;
+
+	logger_snapshot(sim, agent, id, now, &e);
+	if(trace != NULL && fwrite(&e, sizeof(LogEvent), 1, trace) != 1){
+		perror("error on writing the trace\n");
+		exit(EXIT_FAILURE);
+	}
+	logger_show(sim);
+	trace_stats_add(stats, &e);
+}
+
+static void queue_init(VirtualQueue* q){
+	q->ids = (int*)mem_alloc(sim->params->NUM_PHILOSOPHERS*sizeof(int));
+	q->head = q->length = q->woken = 0;
+}
+
+/* the first philosopher waiting in q, if any, tries again */
+static void wake(VirtualQueue* q){
+	if(q->length > 0 && !q->woken){
+		q->woken = 1;
+		schedule(LOG_PHILOSOPHER, q->ids[q->head], 0);
+	}
+}
+
+/*********************************************************************/
+// Waiters, as in waiter.c
+
+static void virtual_show_pending(int id){
+	int req = waiters[id].req;
+
+	sim->waiters[id]->reqPizza = (req & REQ_PIZZA) ? W_ACTIVE : W_INACTIVE;
+	sim->waiters[id]->reqSpaghetti = (req & REQ_SPAGHETTI) ? W_ACTIVE : W_INACTIVE;
+	sim->waiters[id]->reqCutlery = (req & (REQ_CUTLERY | REQ_LEAVE)) ? W_ACTIVE : W_INACTIVE;
+}
+
+/* a batch of requests for waiter id: all of its own, or else those still pending in another, apart from leaving */
+static int virtual_take_requests(int id){
+	int i, other, batch;
+
+	batch = waiters[id].req;
+	if(batch != 0){
+		waiters[id].req = 0;
+		virtual_show_pending(id);
+		return batch;
+	}
+
+	for(i = 1; i < sim->params->NUM_WAITERS; i++){
+		other = (id + i) % sim->params->NUM_WAITERS;
+		batch = waiters[other].req & ~REQ_LEAVE;
+		if(batch != 0){
+			waiters[other].req &= REQ_LEAVE;
+			virtual_show_pending(other);
+			return batch;
+		}
+	}
+	return 0;
+}
+
+static void virtual_give_requests(int id, int r){
+	waiters[id].req |= r;
+	virtual_show_pending(id);
+	if(waiters[id].idle){
+		waiters[id].idle = 0;
+		schedule(LOG_WAITER, id, 0);
+	}
+}
+
+static void virtual_request(int r){
+	int i, pending = 0, id;
+
+	if(r & REQ_LEAVE){
+		for(i = 0; i < sim->params->NUM_WAITERS; i++)
+			virtual_give_requests(i, REQ_LEAVE);
+		r &= ~REQ_LEAVE;
+	}
+
+	for(i = 0; i < sim->params->NUM_WAITERS; i++)
+		pending |= waiters[i].req;
+	r &= ~pending;
+
+	if(r != 0){
+		id = next;
+		for(i = 0; i < sim->params->NUM_WAITERS; i++){
+			if(waiters[i].idle){
+				id = i;
+				break;
+			}
+		}
+		next = (id + 1) % sim->params->NUM_WAITERS;
+		virtual_give_requests(id, r);
+	}
+}
+
+/* move the dirty cutlery to waiter id, and wash it */
+static void start_wash(int id){
+	DiningRoom* d = sim->diningRoom;
+
+	waiters[id].knives = d->dirtyKnives;
+	d->dirtyKnivesInWaiter += d->dirtyKnives;
+	d->dirtyKnives = 0;
+	waiters[id].forks = d->dirtyForks;
+	d->dirtyForksInWaiter += d->dirtyForks;
+	d->dirtyForks = 0;
+
+	record(LOG_WAITER, id);
+
+	waiters[id].step = V_WASHED;
+	schedule(LOG_WAITER, id, sim->params->WASH_TIME*MS);
+}
+
+static void waiter_step(int id){
+	VirtualWaiter* vw = &waiters[id];
+	Waiter* w = sim->waiters[id];
+	DiningRoom* d = sim->diningRoom;
+
+	while(1){
+		switch(vw->step){
+			case V_TAKE:
+				w->state = W_SLEEP;
+				vw->batch = virtual_take_requests(id);
+				if(vw->batch == 0){
+					vw->idle = 1;
+					return;
+				}
+
+				if(vw->batch & REQ_PIZZA){
+					w->state = W_REQUEST_PIZZA;
+					record(LOG_WAITER, id);
+					d->pizza = sim->params->NUM_PIZZA;
+					wake(&pizzaQueue);
+					w->state = W_SLEEP;
+				}
+				if(vw->batch & REQ_SPAGHETTI){
+					w->state = W_REQUEST_SPAGHETTI;
+					record(LOG_WAITER, id);
+					d->spaghetti = sim->params->NUM_SPAGHETTI;
+					wake(&spaghettiQueue);
+					w->state = W_SLEEP;
+				}
+				if(vw->batch & (REQ_CUTLERY | REQ_LEAVE)){
+					w->state = W_REQUEST_CUTLERY;
+					record(LOG_WAITER, id);
+					start_wash(id);
+					return;
+				}
+				record(LOG_WAITER, id);
+				break;
+
+			case V_WASHED:
+				d->dirtyKnivesInWaiter -= vw->knives;
+				d->dirtyForksInWaiter -= vw->forks;
+				d->washed++;
+				d->cleanKnives += vw->knives;
+				d->cleanForks += vw->forks;
+
+				/* a philosopher woken up by a wash that found nothing dirty would only ask for another
+				 * at once, and so on, all at the same time; instead, it waits for cutlery to be returned */
+				if(vw->forks > 0 || vw->knives > 0)
+					wake(&cutleryQueue);
+
+				if(cutleryQueue.length > 0 && (d->dirtyForks > 0 || d->dirtyKnives > 0)){
+					start_wash(id);
+					return;
+				}
+
+				w->state = W_SLEEP;
+				record(LOG_WAITER, id);
+				vw->step = V_TAKE;
+				if(vw->batch & REQ_LEAVE){
+					w->state = W_DEAD;
+					record(LOG_WAITER, id);
+					return;
+				}
+				break;
+		}
+	}
+}
+
+/*********************************************************************/
+// Philosophers, as in philosopher.c and dining-room.c
+
+static int take(atomic_int* counter, int n){
+	if(*counter < n)
+		return 0;
+	*counter -= n;
+	return 1;
+}
+
+static int take_pizza(){
+	return take(&sim->diningRoom->pizza, 1);
+}
+
+static int take_spaghetti(){
+	return take(&sim->diningRoom->spaghetti, 1);
+}
+
+static int take_two_forks(){
+	return take(&sim->diningRoom->cleanForks, 2);
+}
+
+static int take_fork_knife(){
+	if(sim->diningRoom->cleanForks < 1 || sim->diningRoom->cleanKnives < 1)
+		return 0;
+	sim->diningRoom->cleanForks--;
+	sim->diningRoom->cleanKnives--;
+	return 1;
+}
+
+/* philosopher id takes something, or else asks the waiter for request req and waits in queue q,
+ * to be resumed when first in q and woken up; once served, it wakes up the next one */
+static int take_or_wait(int id, int (*take)(), int req, VirtualQueue* q){
+	int first = q->length > 0 && q->ids[q->head] == id;
+
+	if(first)
+		q->woken = 0;
+	if(take()){
+		if(first){
+			q->head = (q->head + 1) % sim->params->NUM_PHILOSOPHERS;
+			q->length--;
+			wake(q);
+		}
+		return 1;
+	}
+
+	if(!first){
+		q->ids[(q->head + q->length) % sim->params->NUM_PHILOSOPHERS] = id;
+		q->length++;
+	}
+	virtual_request(req);
+	return 0;
+}
+
+static void philosopher_step(int id){
+	VirtualPhilosopher* vp = &philosophers[id];
+	Philosopher* p = sim->philosophers[id];
+	DiningRoom* d = sim->diningRoom;
+
+	while(1){
+		switch(vp->step){
+			case V_THINK:
+				if(vp->iteration == vp->lifeTime){
+					p->state = P_DEAD;
+					record(LOG_PHILOSOPHER, id);
+					vp->step = V_GONE;
+					/* the last one to die asks the waiters to wash everything and leave */
+					if(--d->philosophersAlive == 0)
+						virtual_request(REQ_LEAVE);
+					return;
+				}
+				p->state = P_THINKING;
+				record(LOG_PHILOSOPHER, id);
+				vp->step = V_HUNGRY;
+				schedule(LOG_PHILOSOPHER, id, prng_below(&vp->rng, sim->params->THINK_TIME)*MS);
+				return;
+
+			case V_HUNGRY:
+				vp->pizza = prng_below(&vp->rng, 100) <= sim->params->CHOOSE_PIZZA_PROB;
+				p->state = P_HUNGRY;
+				p->meal = vp->pizza ? P_GET_PIZZA : P_GET_SPAGHETTI;
+				record(LOG_PHILOSOPHER, id);
+				vp->step = V_FOOD;
+				break;
+
+			case V_FOOD:
+				if(vp->pizza ? !take_or_wait(id, take_pizza, REQ_PIZZA, &pizzaQueue)
+						: !take_or_wait(id, take_spaghetti, REQ_SPAGHETTI, &spaghettiQueue))
+					return;
+				p->meal = vp->pizza ? P_EAT_PIZZA : P_EAT_SPAGHETTI;
+				p->cutlery[0] = P_GET_FORK;
+				p->cutlery[1] = vp->pizza ? P_GET_KNIFE : P_GET_FORK;
+				record(LOG_PHILOSOPHER, id);
+				vp->step = V_CUTLERY;
+				break;
+
+			case V_CUTLERY:
+				if(!take_or_wait(id, vp->pizza ? take_fork_knife : take_two_forks, REQ_CUTLERY, &cutleryQueue))
+					return;
+				p->cutlery[0] = P_FORK;
+				p->cutlery[1] = vp->pizza ? P_KNIFE : P_FORK;
+				record(LOG_PHILOSOPHER, id);
+				p->state = P_EATING;
+				record(LOG_PHILOSOPHER, id);
+				vp->step = V_FULL;
+				schedule(LOG_PHILOSOPHER, id, prng_below(&vp->rng, sim->params->EAT_TIME)*MS);
+				return;
+
+			case V_FULL:
+				d->meals++;
+				d->dirtyForks += vp->pizza ? 1 : 2;
+				d->dirtyKnives += vp->pizza ? 1 : 0;
+				p->cutlery[0] = P_PUT_FORK;
+				p->cutlery[1] = vp->pizza ? P_PUT_KNIFE : P_PUT_FORK;
+				record(LOG_PHILOSOPHER, id);
+				/* see the washing of nothing above */
+				if(cutleryQueue.length > 0)
+					virtual_request(REQ_CUTLERY);
+
+				p->cutlery[0] = P_NOTHING;
+				p->cutlery[1] = P_NOTHING;
+				p->state = P_FULL;
+				p->meal = P_NONE;
+				record(LOG_PHILOSOPHER, id);
+				vp->iteration++;
+				vp->step = V_THINK;
+				break;
+
+			case V_GONE:
+				return;
+		}
+	}
+}
+
+/*********************************************************************/
+
+/**
+ * Runs the simulation, writing its events to trace, if not NULL, and then
+ * prints their statistics; with benchmark, also the number of meals per
+ * second of real time.
+ */
+int run_virtual_time(FILE* t, int benchmark){
+	int i, n = sim->params->NUM_PHILOSOPHERS, w = sim->params->NUM_WAITERS;
+	struct timespec t0, t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	trace = t;
+	stats = trace_stats_new(sim->params);
+	heap = (VirtualEvent*)mem_alloc((n + w)*sizeof(VirtualEvent));
+	queue_init(&pizzaQueue);
+	queue_init(&spaghettiQueue);
+	queue_init(&cutleryQueue);
+
+	waiters = (VirtualWaiter*)mem_alloc(w*sizeof(VirtualWaiter));
+	memset(waiters, 0, w*sizeof(VirtualWaiter));
+	for(i = 0; i < w; i++){
+		waiters[i].step = V_TAKE;
+		schedule(LOG_WAITER, i, 0);
+	}
+	philosophers = (VirtualPhilosopher*)mem_alloc(n*sizeof(VirtualPhilosopher));
+	for(i = 0; i < n; i++){
+		philosophers[i].step = V_THINK;
+		prng_init(&philosophers[i].rng, i);
+		philosophers[i].lifeTime = prng_below(&philosophers[i].rng, sim->params->PHILOSOPHER_MAX_LIVE - sim->params->PHILOSOPHER_MIN_LIVE) + sim->params->PHILOSOPHER_MIN_LIVE;
+		philosophers[i].iteration = 0;
+		schedule(LOG_PHILOSOPHER, i, 0);
+	}
+
+	record(LOG_SIMULATION, 0);
+	while(heapLength > 0){
+		VirtualEvent e = unschedule();
+		now = e.time;
+		if(e.agent == LOG_PHILOSOPHER)
+			philosopher_step(e.id);
+		else
+			waiter_step(e.id);
+	}
+	record(LOG_SIMULATION, 0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if(trace != NULL && fclose(trace) != 0)
+		perror("error on writing the trace\n");
+	if(sim->diningRoom->philosophersAlive > 0){
+		fprintf(stderr, "ERROR: no more events, with %d philosophers alive\n", (int)sim->diningRoom->philosophersAlive);
+		exit(EXIT_FAILURE);
+	}
+
+	double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	if (benchmark)
+		printf("%d meals in %.3f s: %.1f meals/sec\n", sim->diningRoom->meals, elapsed, sim->diningRoom->meals / elapsed);
+	trace_stats_print(stats);
+	return EXIT_SUCCESS;
+}
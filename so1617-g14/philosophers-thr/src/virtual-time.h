@@ -0,0 +1,18 @@
+/**
+ *  \brief Virtual time engine
+ *
+ *  Runs the philosophers and waiters, with the rules of their threads, in a
+ *  single thread and on a virtual clock: each one is resumed by an event, taken
+ *  from a priority queue by time, so thinking, eating and washing take no real
+ *  time. Events at the same time are taken in the order they were scheduled,
+ *  so a run depends only on the parameters and on the random numbers.
+ */
+
+#ifndef VIRTUAL_TIME_H
+#define VIRTUAL_TIME_H
+
+#include <stdio.h>
+
+int run_virtual_time(FILE* trace, int benchmark);
+
+#endif
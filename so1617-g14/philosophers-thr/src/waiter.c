@@ -13,102 +13,168 @@
 #include "logger.h"
 #include "simulation.h"
 #include "waiter.h"
+#include "coroutine.h"
 #include <pthread.h> /* added */
 
 /* put your code here */
 
 extern Simulation* sim;
 
-static int req = 0; /* request flag */
-static int kill = 0;
+/* the requests made to a waiter */
+typedef struct RequestQueue {
+	int req;                                // pending requests, served together
+	int idle;                               // the waiter is waiting for requests
+	Condition request_available;
+} RequestQueue;
 
+static RequestQueue* queues; /* one per waiter */
+static int next = 0; /* waiter given the next request when none is idle */
+
+/* held only while requests are made or taken, never while serving them: philosophers make
+ * requests holding DININGROOM_ACCESS, which the waiter takes to give back what it served */
 static pthread_mutex_t REQUEST_ACCESS = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t request_available = PTHREAD_COND_INITIALIZER;
 
+/* show the pending requests of waiter id in its info (REQUEST_ACCESS must be held) */
+static void show_pending(int id){
+	int req = queues[id].req;
+
+	sim->waiters[id]->reqPizza = (req & REQ_PIZZA) ? W_ACTIVE : W_INACTIVE;
+	sim->waiters[id]->reqSpaghetti = (req & REQ_SPAGHETTI) ? W_ACTIVE : W_INACTIVE;
+	sim->waiters[id]->reqCutlery = (req & (REQ_CUTLERY | REQ_LEAVE)) ? W_ACTIVE : W_INACTIVE;
+}
 
-void waiter_lifecycle(){
-	while(1) {
-		sim->waiter->state = W_SLEEP; /* Sleep by default when not attending a request */
+void init_waiters(){
+	int i;
 
-		pthread_mutex_lock(&REQUEST_ACCESS);
-		while(req == 0)
-			pthread_cond_wait(&request_available, &REQUEST_ACCESS);
-		//printf("Waiter will make the request\n");
-		if(req == 1){
-			request_pizza();
-		}else if(req == 2){
-			request_spaghetti();
-		}else if(req == 3){
-			request_washed_cutlery();
-		}else if(req == 4){
-			request_washed_cutlery();
-			kill = 1;
+	queues = (RequestQueue*)mem_alloc(sim->params->NUM_WAITERS*sizeof(RequestQueue));
+	for(i = 0; i < sim->params->NUM_WAITERS; i++){
+		queues[i].req = 0;
+		queues[i].idle = 0;
+		condition_init(&queues[i].request_available);
+	}
+}
+
+/* wait for a batch of requests for waiter id: all of its own, or else those still pending
+ * in a busy waiter, apart from leaving (REQUEST_ACCESS must be held) */
+static int take_requests(int id){
+	int i, other, batch;
+
+	while(1){
+		batch = queues[id].req;
+		if(batch != 0){
+			queues[id].req = 0;
+			show_pending(id);
+			return batch;
 		}
-		//printf("Waiter has done the request\n");
-		req = 0;
-		pthread_mutex_unlock(&REQUEST_ACCESS);
-		if(kill == 1)
-			break;
-		logger(sim);
+
+		for(i = 1; i < sim->params->NUM_WAITERS; i++){
+			other = (id + i) % sim->params->NUM_WAITERS;
+			batch = queues[other].req & ~REQ_LEAVE;
+			if(batch != 0){
+				queues[other].req &= REQ_LEAVE;
+				show_pending(other);
+				return batch;
+			}
+		}
+
+		queues[id].idle = 1;
+		condition_wait(&queues[id].request_available, &REQUEST_ACCESS);
+		queues[id].idle = 0;
 	}
-	kill_waiter();
 }
 
-int trylock(){
-	/* Avoid deadlock:
-		- If REQUEST_ACCESS is being used or REQUEST_ACCESS isn't being used but there is a peding request, it means the waiter can't accept a new request and it will unlock DININGROOM_ACCESS (because the waiter may need it) and try again
-	*/
-	int value;
-	if(pthread_mutex_trylock(&REQUEST_ACCESS) == 0){
-		value = req;
+void waiter_lifecycle(int id){
+	int batch;
+
+	do {
+		sim->waiters[id]->state = W_SLEEP; /* Sleep by default when not attending a request */
+
+		/* take pending requests at once; new ones can be made while these are served */
+		pthread_mutex_lock(&REQUEST_ACCESS);
+		batch = take_requests(id);
 		pthread_mutex_unlock(&REQUEST_ACCESS);
-		return value;
-	}
-	return 1;
+
+		if(batch & REQ_PIZZA)
+			request_pizza(id);
+		if(batch & REQ_SPAGHETTI)
+			request_spaghetti(id);
+		if(batch & (REQ_CUTLERY | REQ_LEAVE))
+			request_washed_cutlery(id);
+
+		logger(sim);
+	} while(!(batch & REQ_LEAVE));
+
+	kill_waiter(id);
+}
+
+/* give requests to waiter id and wake it up (REQUEST_ACCESS must be held) */
+static void give_requests(int id, int r){
+	queues[id].req |= r;
+	queues[id].idle = 0;
+	show_pending(id);
+	condition_signal(&queues[id].request_available);
 }
 
-void make_request(int n){
+/* add requests to the pending ones, given to an idle waiter if there is one, or else to the
+ * waiters in turn; the same request made twice before being served is served once */
+void make_request(int r){
+	int i, pending = 0, id;
+
 	pthread_mutex_lock(&REQUEST_ACCESS);
-	req = n;
-	//printf("Waiter has a new request\n");
-	pthread_cond_signal(&request_available);
+
+	if(r & REQ_LEAVE){
+		for(i = 0; i < sim->params->NUM_WAITERS; i++)
+			give_requests(i, REQ_LEAVE);
+		r &= ~REQ_LEAVE;
+	}
+
+	for(i = 0; i < sim->params->NUM_WAITERS; i++)
+		pending |= queues[i].req;
+	r &= ~pending;
+
+	if(r != 0){
+		id = next;
+		for(i = 0; i < sim->params->NUM_WAITERS; i++){
+			if(queues[i].idle){
+				id = i;
+				break;
+			}
+		}
+		next = (id + 1) % sim->params->NUM_WAITERS;
+		give_requests(id, r);
+	}
+
 	pthread_mutex_unlock(&REQUEST_ACCESS);
 }
 
-void request_pizza(){
-	sim->waiter->state = W_REQUEST_PIZZA;
-	sim->waiter->reqPizza = W_ACTIVE;
+void request_pizza(int id){
+	sim->waiters[id]->state = W_REQUEST_PIZZA;
 	logger(sim);
 
 	replenish_pizza();
 
-	sim->waiter->state = W_SLEEP;
-	sim->waiter->reqPizza = W_INACTIVE;
+	sim->waiters[id]->state = W_SLEEP;
 }
 
-void request_spaghetti(){
-	sim->waiter->state = W_REQUEST_SPAGHETTI;
-	sim->waiter->reqSpaghetti = W_ACTIVE;
+void request_spaghetti(int id){
+	sim->waiters[id]->state = W_REQUEST_SPAGHETTI;
 	logger(sim);
 
 	replenish_spaghetti();
 
-	sim->waiter->state = W_SLEEP;
-	sim->waiter->reqSpaghetti = W_INACTIVE;
+	sim->waiters[id]->state = W_SLEEP;
 }
 
-void request_washed_cutlery(){
-	sim->waiter->state = W_REQUEST_CUTLERY;
-	sim->waiter->reqCutlery = W_ACTIVE;
+void request_washed_cutlery(int id){
+	sim->waiters[id]->state = W_REQUEST_CUTLERY;
 	logger(sim);
 
 	replenish_cutlery();
 
-	sim->waiter->state = W_SLEEP;
-	sim->waiter->reqCutlery = W_INACTIVE;
+	sim->waiters[id]->state = W_SLEEP;
 }
 
-void kill_waiter(){
-	sim->waiter->state = W_DEAD;
+void kill_waiter(int id){
+	sim->waiters[id]->state = W_DEAD;
 	logger(sim);
 }
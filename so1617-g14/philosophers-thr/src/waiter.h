@@ -30,11 +30,18 @@ typedef struct _Waiter_ {
 
 
 /* put your code here */
-void waiter_lifecycle();
-int trylock();
-void make_request(int n);
-void request_pizza();
-void request_spaghetti();
-void request_washed_cutlery();
-void kill_waiter();
+
+/* requests to the waiter: a set of them can be pending at once */
+#define REQ_PIZZA     0x1             // replenish pizza
+#define REQ_SPAGHETTI 0x2             // replenish spaghetti
+#define REQ_CUTLERY   0x4             // wash cutlery
+#define REQ_LEAVE     0x8             // wash cutlery a last time and leave (made to every waiter)
+
+void init_waiters();
+void waiter_lifecycle(int id);
+void make_request(int r);
+void request_pizza(int id);
+void request_spaghetti(int id);
+void request_washed_cutlery(int id);
+void kill_waiter(int id);
 #endif
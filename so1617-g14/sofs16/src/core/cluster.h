@@ -15,7 +15,10 @@
 
 #include "rawdisk.h"
 
-/** \brief number of references per block */
-#define RPB (BLOCK_SIZE / sizeof (uint32_t))
+/** \brief largest cluster size (in bytes) */
+#define MAX_CLUSTER_SIZE 65536U
+
+/** \brief number of references per block (depends on the block size of the mounted volume) */
+#define RPB (soGetRawBlockSize() / sizeof (uint32_t))
 
 #endif                          /* __SOFS16_CLUSTER__ */
@@ -12,8 +12,8 @@
 
 #include "rawdisk.h"
 
-/** \brief number of direntries per block */
-#define DPB     (BLOCK_SIZE / sizeof(SODirEntry))
+/** \brief number of direntries per block (depends on the block size of the mounted volume) */
+#define DPB     (soGetRawBlockSize() / sizeof(SODirEntry))
 
 /** \brief maximum length of a file name (in characters) */
 #define SOFS16_MAX_NAME 59
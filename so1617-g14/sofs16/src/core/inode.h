@@ -14,14 +14,14 @@
 
 #include <stdint.h>
 
-/** \brief number of inodes per block */
-#define IPB (BLOCK_SIZE / sizeof(SOInode))
+/** \brief number of inodes per block (depends on the block size of the mounted volume) */
+#define IPB (soGetRawBlockSize() / sizeof(SOInode))
 
 /** \brief flag signaling inode is free (it uses the sticky bit) */
 #define INODE_FREE (0001000)
 
 /** \brief number of direct references in the inode */
-#define N_DIRECT 5
+#define N_DIRECT 4
 
 /** \brief number of indirect references in the inode */
 #define N_INDIRECT 2
@@ -39,17 +39,17 @@ struct SOInode
     uint32_t owner;
     /** \brief group ID of the file owner */
     uint32_t group;
-    /** \brief file size in bytes: */
-    uint32_t size;
     /** \brief cluster count: total number of clusters used by the file */
     uint32_t csize;
+    /** \brief file size in bytes */
+    uint64_t size;
 
     /* \brief usage depends on state */
     union
     {
         /** \brief time of last access to file information (only used when inode is in use) */
         uint32_t atime;
-        /** \brief next free inode (only used when inode is free) */
+        /** \brief next free inode (only used when inode is free; unused since version 0x2019, always NULL_REFERENCE) */
         uint32_t next;
     };
     /** \brief time of last change to inode information */
@@ -0,0 +1,43 @@
+/**
+ *  \file journal.h
+ *  \brief Definition of the metadata journal
+ *
+ *  The journal is a region of the device, between the inode table and the
+ *  cluster zone, holding the last committed transaction: a descriptor,
+ *  made of a header followed by the physical numbers of the logged blocks,
+ *  and then the new contents of those blocks, in the same order.
+ *  The descriptor takes as many blocks as needed.
+ */
+
+#ifndef __SOFS16_JOURNAL__
+#define __SOFS16_JOURNAL__
+
+#include <stdint.h>
+
+/** \brief journal magic number, set in the header when it holds a committed transaction */
+#define JOURNAL_MAGIC 0x4A4F524E
+
+/** \brief smallest journal, in clusters, a volume is formatted with (besides its descriptor);
+ *  it must hold the most a single system call, or step, reserves */
+#define JOURNAL_MIN_CLUSTERS 24
+
+/** \brief largest journal, in blocks, mksofs sets by default */
+#define JOURNAL_DEFAULT_MAX 1024
+
+/** \brief Definition of the journal header, at the start of the journal's first block */
+struct SOJournalHeader
+{
+    /** \brief JOURNAL_MAGIC if a committed transaction follows, anything else otherwise */
+    uint32_t magic;
+
+    /** \brief sequence number of the transaction */
+    uint32_t sequence;
+
+    /** \brief number of logged blocks; a NULL_BLOCK reference is a block that must not be replayed */
+    uint32_t nblocks;
+
+    /** \brief checksum of the references and of the contents of the logged blocks */
+    uint32_t checksum;
+};
+
+#endif                          /* __SOFS16_JOURNAL__ */
@@ -15,11 +15,19 @@
 /** \brief sofs15 magic number */
 #define MAGIC_NUMBER 0x50F5
 
-/** \brief sofs15 version number */
-#define VERSION_NUMBER 0x2016
+/** \brief sofs16 version number
+ *
+ *  0x2016 - original layout, with 32-bit file sizes
+ *  0x2017 - 64-bit file sizes (SOInode::size), one direct reference less
+ *  0x2018 - block size recorded in the superblock (SOSuperBlock::bsize)
+ *  0x2019 - free inodes no longer linked in a list, found by their INODE_FREE bit
+ *  0x201A - metadata journal between the inode table and the cluster zone (SOSuperBlock::jstart, jsize)
+ *  0x201B - inode table initialized on demand, up to SOSuperBlock::iinit (which replaces ihead)
+ */
+#define VERSION_NUMBER 0x201B
 
-/** \brief maximum length of volume name */
-#define PARTITION_NAME_SIZE 29
+/** \brief maximum length of volume name (shortened from 29 to make room for the block size and the journal) */
+#define PARTITION_NAME_SIZE 17
 
 /** \brief constant signaling the file system was properly unmounted the last time it was mounted */
 #define PRU 0
@@ -82,6 +90,16 @@ struct SOSuperBlock
     /** \brief total number of blocks in the device */
     uint32_t ntotal;
 
+    /** \brief block size in bytes (a power of 2, between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE) */
+    uint32_t bsize;
+
+    /* Journal metadata */
+
+    /** \brief physical number of the block where the journal starts */
+    uint32_t jstart;
+    /** \brief number of blocks that the journal comprises (0 if the volume has no journal) */
+    uint32_t jsize;
+
     /* Inode table metadata */
 
     /** \brief physical number of the block where the table of inodes starts */
@@ -94,9 +112,10 @@ struct SOSuperBlock
     /** \brief number of free inodes */
     uint32_t ifree;
 
-    /** \brief head of linked list of free inodes */
-    uint32_t ihead;
-    /** \brief tail of linked list of free inodes */
+    /** \brief number of blocks of the table of inodes already initialized;
+     *     the others hold garbage and all their inodes are free */
+    uint32_t iinit;
+    /** \brief tail of linked list of free inodes (unused since version 0x2019, always NULL_REFERENCE) */
     uint32_t itail;
 
     /* Cluster zone metadata */
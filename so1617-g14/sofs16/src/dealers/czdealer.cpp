@@ -9,58 +9,84 @@
 #include "superblock.h"
 #include "inode.h"
 #include "sbdealer.h"
+#include "jdealer.h"
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 #include "core.h"
 
 #include <errno.h>
 
-static SOSuperBlock *sbp = sbGetPointer();
-static bool isOpen = false;
+/* pointer to the superblock, fetched when the dealer is open */
+static SOSuperBlock *sbp = NULL;
 
 void soOpenClusterZoneDealer()
 {
-	if(!isOpen)
-		isOpen = true;
+    sbp = sbGetPointer();
 }
 
 void soCloseClusterZoneDealer()
 {
-	if(isOpen)
-		isOpen = false;
-
+    sbp = NULL;
 }
 
 void soReadCluster(uint32_t n, void *buf)
 {
-	if(isOpen)
-    	soReadRawCluster(n, buf, sbp->csize);
+    soTime(T_READ_CLUSTER);
+
+    if (sbp == NULL)
+        throw SOException(EBADF, __FUNCTION__);
+    if (n >= sbp->ctotal)
+        throw SOException(EINVAL, __FUNCTION__);
 
+    /* logical cluster n starts at physical block czstart + n * csize */
+    jReadBlocks(sbp->czstart + n * sbp->csize, buf, sbp->csize);
 }
 
 void soWriteCluster(uint32_t n, void *buf)
 {
-	if(isOpen)
-    	soWriteRawCluster(n, buf, sbp->csize);
+    soTime(T_WRITE_CLUSTER);
+
+    if (sbp == NULL)
+        throw SOException(EBADF, __FUNCTION__);
+    if (n >= sbp->ctotal)
+        throw SOException(EINVAL, __FUNCTION__);
+
+    /* logical cluster n starts at physical block czstart + n * csize */
+    jWriteBlocks(sbp->czstart + n * sbp->csize, buf, sbp->csize);
+}
+
+void soWriteClusters(uint32_t n, void *buf, uint32_t count)
+{
+    soTime(T_WRITE_CLUSTERS);
+
+    if (sbp == NULL)
+        throw SOException(EBADF, __FUNCTION__);
+    if (count == 0 || n >= sbp->ctotal || count > sbp->ctotal - n)
+        throw SOException(EINVAL, __FUNCTION__);
+
+    /* clusters n..n+count-1 are physically adjacent in the cluster zone;
+     * file data is not journaled */
+    jWriteData(sbp->czstart + n * sbp->csize, buf, count * sbp->csize);
 }
 
 uint32_t soGetBPC()
 {
-    return BLOCK_SIZE * sbp->csize;
+    return soGetRawBlockSize() * sbGetPointer()->csize;
 }
 
 uint32_t soGetRPC()
 {
-    return RPB * sbp->csize;
+    return RPB * sbGetPointer()->csize;
 }
 
 uint32_t soGetDPC()
 {
-    return DPB * sbp->csize;
+    return DPB * sbGetPointer()->csize;
 }
 
-uint32_t soGetMaxFileSize()
+uint64_t soGetMaxFileSize()
 {
-    uint32_t RPC = soGetRPC();
-    return (N_DIRECT + (N_INDIRECT*RPC) + (RPC*RPC)) * sbp->csize * BLOCK_SIZE;
-}
\ No newline at end of file
+    uint64_t RPC = soGetRPC();
+    return (N_DIRECT + (N_INDIRECT*RPC) + (RPC*RPC)) * soGetBPC();
+}
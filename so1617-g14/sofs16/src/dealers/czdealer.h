@@ -54,6 +54,20 @@ void soWriteCluster(uint32_t n, void *buf);
 
 /* ***************************************** */
 
+/**
+ *  \brief Write a run of consecutive clusters of file data to the storage device
+ *      in a single transfer.
+ *
+ *  Unlike soWriteCluster, the data is not logged in the journal.
+ *
+ *  \param n the logical number of the first cluster to be written into
+ *  \param buf pointer to the buffer containing the data to be written from
+ *  \param count number of clusters in the run
+ */
+void soWriteClusters(uint32_t n, void *buf, uint32_t count);
+
+/* ***************************************** */
+
 /**
  * \brief retrieve the number of bytes per cluster
  */
@@ -78,7 +92,7 @@ uint32_t soGetDPC();
 /**
  * \brief retrieve the maximum number of bytes a file can comprise
  */
-uint32_t soGetMaxFileSize();
+uint64_t soGetMaxFileSize();
 
 /* ***************************************** */
 
@@ -7,16 +7,28 @@
 
 void soOpenDealersDisk(const char *devname, uint32_t * ntp)
 {
-    soOpenRawDisk(devname, ntp);
+    soOpenRawDisk(devname);
     soOpenSuperblockDealer();
+
+    /* the superblock dealer sets the block size, so the device size is only known now */
+    if (ntp != NULL)
+        *ntp = sbGetPointer()->ntotal;
+
+    soOpenJournalDealer();
     soOpenClusterZoneDealer();
     soOpenInodeTableDealer();
 }
 
 void soCloseDealersDisk()
 {
-    soCloseSuperblockDealer();
-    soCloseClusterZoneDealer();
+    /* the commit hook may change the free lists, so it runs while every dealer is open */
+    jCommit();
+
+    /* reverse order of opening, as inodes are saved using the superblock
+     * and everything is saved through the journal */
     soCloseInodeTableDealer();
+    soCloseClusterZoneDealer();
+    soCloseSuperblockDealer();
+    soCloseJournalDealer();
     soCloseRawDisk();
 }
@@ -11,6 +11,7 @@
 /* ***************************************** */
 
 #include "sbdealer.h"
+#include "jdealer.h"
 #include "itdealer.h"
 #include "czdealer.h"
 
@@ -0,0 +1,419 @@
+#include "itdealer.h"
+#include "sbdealer.h"
+#include "jdealer.h"
+#include "superblock.h"
+#include "inode.h"
+#include "rawdisk.h"
+#include "probing.h"
+#include "metrics.h"
+#include "exception.h"
+#include "core.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* maximum number of simultaneously open inodes */
+#define IT_TABLE_SIZE 100
+
+/* an entry of the table of open inodes */
+struct ITSlot
+{
+    uint32_t in;            /* inode number */
+    uint32_t usecount;      /* number of iOpen's not yet iClose'd; 0 means free slot */
+    SOInode inode;          /* in-memory copy of the inode */
+};
+
+static ITSlot table[IT_TABLE_SIZE];
+static bool isOpen = false;
+
+/* map of free inodes, one bit per inode, set if the inode is free */
+static uint8_t *freeMap = NULL;
+
+/* where the search for a free inode with no preferred block resumes */
+static uint32_t freeCursor = 0;
+
+static inline bool isFree(uint32_t in)
+{
+    return (freeMap[in / 8] >> (in % 8)) & 1;
+}
+
+static inline void setFree(uint32_t in, bool free)
+{
+    if (free)
+        freeMap[in / 8] |= 1 << (in % 8);
+    else
+        freeMap[in / 8] &= ~(1 << (in % 8));
+}
+
+/* initialize the blocks of the inode table up to the one holding inode in,
+ * at least a chunk of them at a time, if not yet done */
+static void initUpTo(uint32_t in)
+{
+    SOSuperBlock *sbp = sbGetPointer();
+    uint32_t bpr = MAX_BLOCK_SIZE / soGetRawBlockSize();
+    SOInode chunk[bpr * IPB];
+
+    SOInode empty;
+    memset(&empty, 0x00, sizeof(SOInode));
+    empty.mode = INODE_FREE;
+    empty.next = NULL_REFERENCE;
+    memset(empty.d, NULL_REFERENCE, sizeof(empty.d));
+    memset(empty.i1, NULL_REFERENCE, sizeof(empty.i1));
+    empty.i2 = NULL_REFERENCE;
+    for (uint32_t i = 0; i < bpr * IPB; i++)
+        chunk[i] = empty;
+
+    while (in / IPB >= sbp->iinit)
+    {
+        uint32_t nb = (sbp->itsize - sbp->iinit < bpr) ? sbp->itsize - sbp->iinit : bpr;
+
+        /* blocks beyond iinit are referred by nothing, so they need not be journaled */
+        jWriteData(sbp->itstart + sbp->iinit, chunk, nb);
+        sbp->iinit += nb;
+        sbSave();
+    }
+}
+
+/* check an inode, in use or free, for consistency */
+static void checkInode(const SOInode *ip, const SOSuperBlock *sbp)
+{
+    /* free inodes are not linked to each other */
+    if (ip->mode & INODE_FREE)
+    {
+        if (ip->next != NULL_REFERENCE)
+            throw SOException(ELIBBAD, __FUNCTION__);
+        return;
+    }
+
+    /* inodes in use must be of a known type */
+    if (!S_ISREG(ip->mode) && !S_ISDIR(ip->mode) && !S_ISLNK(ip->mode))
+        throw SOException(ELIBBAD, __FUNCTION__);
+
+    /* all references must be null or point into the cluster zone */
+    for (int i = 0; i < N_DIRECT; i++)
+        if (ip->d[i] != NULL_REFERENCE && ip->d[i] >= sbp->ctotal)
+            throw SOException(ELIBBAD, __FUNCTION__);
+    for (int i = 0; i < N_INDIRECT; i++)
+        if (ip->i1[i] != NULL_REFERENCE && ip->i1[i] >= sbp->ctotal)
+            throw SOException(ELIBBAD, __FUNCTION__);
+    if (ip->i2 != NULL_REFERENCE && ip->i2 >= sbp->ctotal)
+        throw SOException(ELIBBAD, __FUNCTION__);
+
+    /* a file cannot use more clusters than there are */
+    if (ip->csize > sbp->ctotal)
+        throw SOException(ELIBBAD, __FUNCTION__);
+}
+
+/* build the map of free inodes, reading the initialized part of the inode table
+ * in large chunks, and checking every inode on the way if asked;
+ * inodes of blocks not yet initialized are all free */
+static void scanTable(bool check)
+{
+    SOSuperBlock *sbp = sbGetPointer();
+    uint8_t *map = (uint8_t *) calloc((sbp->itotal + 7) / 8, 1);
+    if (map == NULL)
+        throw SOException(ENOMEM, __FUNCTION__);
+    free(freeMap);
+    freeMap = map;
+
+    uint32_t bpr = MAX_BLOCK_SIZE / soGetRawBlockSize();
+    SOInode chunk[bpr * IPB];
+    for (uint32_t b = 0; b < sbp->iinit; b += bpr)
+    {
+        uint32_t nb = (sbp->iinit - b < bpr) ? sbp->iinit - b : bpr;
+        jReadBlocks(sbp->itstart + b, chunk, nb);
+        for (uint32_t i = 0; i < nb * IPB; i++)
+        {
+            if (check)
+                checkInode(&chunk[i], sbp);
+            if (chunk[i].mode & INODE_FREE)
+                setFree(b * IPB + i, true);
+        }
+    }
+    for (uint32_t in = sbp->iinit * IPB; in < sbp->itotal; in++)
+        setFree(in, true);
+}
+
+/* ***************************************** */
+
+/* check the handler and return the slot it refers to */
+static ITSlot *checkHandler(int ih)
+{
+    if (!isOpen)
+        throw SOException(EBADF, __FUNCTION__);
+    if (ih < 0 || ih >= IT_TABLE_SIZE || table[ih].usecount == 0)
+        throw SOException(EINVAL, __FUNCTION__);
+    return &table[ih];
+}
+
+/* ***************************************** */
+
+void soOpenInodeTableDealer()
+{
+    soProbe(800, "soOpenInodeTableDealer()\n");
+
+    memset(table, 0, sizeof(table));
+
+    /* the map of free inodes is only built when first needed */
+    free(freeMap);
+    freeMap = NULL;
+    freeCursor = 0;
+
+    isOpen = true;
+}
+
+/* ***************************************** */
+
+void soCloseInodeTableDealer()
+{
+    soProbe(800, "soCloseInodeTableDealer()\n");
+
+    if (!isOpen)
+        return;
+
+    for (int ih = 0; ih < IT_TABLE_SIZE; ih++)
+        if (table[ih].usecount != 0)
+            iSave(ih);
+
+    free(freeMap);
+    freeMap = NULL;
+    isOpen = false;
+}
+
+/* ***************************************** */
+
+int iOpen(uint32_t in)
+{
+    soProbe(800, "iOpen(%u)\n", in);
+    soTime(T_IOPEN);
+
+    if (!isOpen)
+        throw SOException(EBADF, __FUNCTION__);
+
+    SOSuperBlock *sbp = sbGetPointer();
+    if (in >= sbp->itotal)
+        throw SOException(EINVAL, __FUNCTION__);
+
+    /* already open: just share the slot */
+    int freeSlot = -1;
+    for (int ih = 0; ih < IT_TABLE_SIZE; ih++)
+    {
+        if (table[ih].usecount == 0)
+        {
+            if (freeSlot == -1)
+                freeSlot = ih;
+        }
+        else if (table[ih].in == in)
+        {
+            table[ih].usecount++;
+            soCount(C_INODE_HITS);
+            return ih;
+        }
+    }
+
+    if (freeSlot == -1)
+        throw SOException(ENFILE, __FUNCTION__);
+
+    /* transfer the inode from disk, once its block is initialized */
+    soCount(C_INODE_MISSES);
+    initUpTo(in);
+    SOInode block[IPB];
+    jReadBlocks(sbp->itstart + in / IPB, block, 1);
+
+    table[freeSlot].in = in;
+    table[freeSlot].usecount = 1;
+    table[freeSlot].inode = block[in % IPB];
+
+    return freeSlot;
+}
+
+/* ***************************************** */
+
+SOInode *iGetPointer(int ih)
+{
+    soProbe(800, "iGetPointer(%d)\n", ih);
+
+    return &checkHandler(ih)->inode;
+}
+
+/* ***************************************** */
+
+void iSave(int ih)
+{
+    soProbe(800, "iSave(%d)\n", ih);
+    soTime(T_ISAVE);
+
+    ITSlot *slot = checkHandler(ih);
+    SOSuperBlock *sbp = sbGetPointer();
+
+    /* read-modify-write the block containing the inode */
+    SOInode block[IPB];
+    uint32_t bn = sbp->itstart + slot->in / IPB;
+    jReadBlocks(bn, block, 1);
+    block[slot->in % IPB] = slot->inode;
+    jWriteBlocks(bn, block, 1);
+
+    if (freeMap != NULL)
+        setFree(slot->in, slot->inode.mode & INODE_FREE);
+}
+
+/* ***************************************** */
+
+void iClose(int ih)
+{
+    soProbe(800, "iClose(%d)\n", ih);
+
+    checkHandler(ih)->usecount--;
+}
+
+/* ***************************************** */
+
+uint32_t iGetFreeInode(uint32_t near)
+{
+    soProbe(800, "iGetFreeInode(%u)\n", near);
+    soTime(T_IGET_FREE_INODE);
+
+    if (!isOpen)
+        throw SOException(EBADF, __FUNCTION__);
+
+    SOSuperBlock *sbp = sbGetPointer();
+    if (freeMap == NULL)
+        scanTable(false);
+
+    /* prefer the block of the given inode */
+    if (near != NULL_REFERENCE && near < sbp->itotal)
+    {
+        uint32_t first = near - near % IPB;
+        for (uint32_t in = first; in < first + IPB; in++)
+            if (isFree(in))
+                return in;
+    }
+
+    /* otherwise, go on from where the last search stopped, skipping full bytes of the map */
+    uint32_t nbytes = (sbp->itotal + 7) / 8;
+    for (uint32_t k = 0; k <= nbytes; k++)
+    {
+        uint32_t byte = (freeCursor / 8 + k) % nbytes;
+        if (freeMap[byte] == 0)
+            continue;
+        for (uint32_t in = byte * 8; in < byte * 8 + 8 && in < sbp->itotal; in++)
+        {
+            if (isFree(in))
+            {
+                freeCursor = in;
+                return in;
+            }
+        }
+    }
+
+    throw SOException(ENOSPC, __FUNCTION__);
+}
+
+/* ***************************************** */
+
+uint32_t iGetNumber(int ih)
+{
+    soProbe(800, "iGetNumber(%d)\n", ih);
+
+    return checkHandler(ih)->in;
+}
+
+/* ***************************************** */
+
+void iCheckConsistency(int ih)
+{
+    soProbe(800, "iCheckConsistency(%d)\n", ih);
+
+    checkInode(&checkHandler(ih)->inode, sbGetPointer());
+}
+
+/* ***************************************** */
+
+void iCheckTableConsistency()
+{
+    soProbe(800, "iCheckTableConsistency()\n");
+
+    if (!isOpen)
+        throw SOException(EBADF, __FUNCTION__);
+
+    scanTable(true);
+}
+
+/* ***************************************** */
+
+uint32_t iIncRefcount(int ih)
+{
+    soProbe(800, "iIncRefcount(%d)\n", ih);
+
+    SOInode *ip = &checkHandler(ih)->inode;
+    if (ip->refcount == UINT16_MAX)
+        throw SOException(EMLINK, __FUNCTION__);
+
+    return ++ip->refcount;
+}
+
+/* ***************************************** */
+
+uint32_t iDecRefcount(int ih)
+{
+    soProbe(800, "iDecRefcount(%d)\n", ih);
+
+    SOInode *ip = &checkHandler(ih)->inode;
+    if (ip->refcount == 0)
+        throw SOException(EINVAL, __FUNCTION__);
+
+    return --ip->refcount;
+}
+
+/* ***************************************** */
+
+void iSetAccess(int ih, uint16_t perm)
+{
+    soProbe(800, "iSetAccess(%d, %o)\n", ih, perm);
+
+    SOInode *ip = &checkHandler(ih)->inode;
+    ip->mode = (ip->mode & S_IFMT) | (perm & (S_IRWXU | S_IRWXG | S_IRWXO));
+}
+
+/* ***************************************** */
+
+uint16_t iGetAccess(int ih)
+{
+    soProbe(800, "iGetAccess(%d)\n", ih);
+
+    return checkHandler(ih)->inode.mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+}
+
+/* ***************************************** */
+
+bool iCheckAccess(int ih, int access)
+{
+    soProbe(800, "iCheckAccess(%d, %o)\n", ih, access);
+
+    SOInode *ip = &checkHandler(ih)->inode;
+    access &= (R_OK | W_OK | X_OK);
+
+    /* root can read and write anything, and execute if anyone can */
+    if (getuid() == 0)
+    {
+        if ((access & X_OK) && !S_ISDIR(ip->mode))
+            return (ip->mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0;
+        return true;
+    }
+
+    /* pick the owner, group or other permission bits, which are in R_OK|W_OK|X_OK order */
+    uint16_t bits;
+    if (getuid() == ip->owner)
+        bits = (ip->mode >> 6) & 07;
+    else if (getgid() == ip->group)
+        bits = (ip->mode >> 3) & 07;
+    else
+        bits = ip->mode & 07;
+
+    return (bits & access) == access;
+}
+
+/* ***************************************** */
@@ -22,7 +22,9 @@
 
 /** \brief Open inode table dealer
  *
- * Prepare the internal data structure for the inode table dealer
+ * Prepare the internal data structure for the inode table dealer, without reading the inode table:
+ * the map of free inodes is built when first needed, and the part of the table
+ * not yet initialized is initialized on demand, when one of its inodes is first opened
  */
 void soOpenInodeTableDealer();
 
@@ -87,6 +89,21 @@ void iClose(int ih);
 
 /* ***************************************** */
 
+/**
+ * \brief Get a free inode, without reading the inode table
+ *
+ * Free inodes are kept in an in-memory map, built from the inode table
+ * the first time a free inode is asked for, and kept up to date by iSave.
+ * The inode is not allocated: it stays free until it is saved in use.
+ *
+ * \param near number of an inode whose block of the inode table is to be
+ *      preferred, or NULL_REFERENCE for no preference
+ * \return the number of a free inode
+ */
+uint32_t iGetFreeInode(uint32_t near);
+
+/* ***************************************** */
+
 /**
  * \brief Return the number of the inode associated to the given handler
  * \param ih inode handler
@@ -98,13 +115,24 @@ uint32_t iGetNumber(int ih);
 
 /**
  * \brief check inode for consistency
+ *
+ * An inconsistent inode makes it throw a SOException with ELIBBAD
  * \param ih inode handler
- * \remark to be implemented
  */
 void iCheckConsistency(int ih);
 
 /* ***************************************** */
 
+/**
+ * \brief check every inode of the initialized part of the inode table for consistency
+ *
+ * The table is read in large chunks, and the map of free inodes is built on the way.
+ * An inconsistent inode makes it throw a SOException with ELIBBAD
+ */
+void iCheckTableConsistency();
+
+/* ***************************************** */
+
 /**
  * \brief increment, if possible, reference count of an open inode.
  *
@@ -0,0 +1,398 @@
+#include "jdealer.h"
+#include "sbdealer.h"
+#include "superblock.h"
+#include "journal.h"
+#include "rawdisk.h"
+#include "probing.h"
+#include "metrics.h"
+#include "exception.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static bool isOpen = false;
+
+/* location of the journal and size of its blocks */
+static uint32_t jstart = 0;
+static uint32_t jsize = 0;
+static uint32_t bsize = 0;
+
+/* maximum number of blocks of a transaction, 0 if the volume has no journal */
+static uint32_t cap = 0;
+
+/* number of blocks per cluster */
+static uint32_t csize = 0;
+
+/* blocks reserved for the descriptor of a full transaction */
+static uint32_t dmax = 0;
+
+/* the running transaction: room for the descriptor, followed by the contents
+ * of the logged blocks, and the references of the logged blocks */
+static uint8_t *area = NULL;
+static uint32_t *refs = NULL;
+static uint32_t n = 0;
+
+/* blocks held in the running transaction for the commit hook */
+static uint32_t held = 0;
+
+/* sequence number of the last committed transaction */
+static uint32_t sequence = 0;
+
+/* set if something was written since the device was last synchronized */
+static bool unsynced = false;
+
+/* run before each commit; set while it runs, so a commit it causes does not run it again */
+static void (*commitHook)() = NULL;
+static bool hooking = false;
+
+/* number of blocks taken by the descriptor of a k-blocks transaction */
+static uint32_t descBlocks(uint32_t k)
+{
+    return (sizeof(SOJournalHeader) + k * sizeof(uint32_t) + bsize - 1) / bsize;
+}
+
+static uint8_t *image(uint32_t i)
+{
+    return area + (dmax + i) * bsize;
+}
+
+/* FNV-1a, continuing from h */
+static uint32_t checksum(uint32_t h, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) buf;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619U;
+    return h;
+}
+
+static void syncDisk()
+{
+    if (fdatasync(soGetRawDiskFd()) != 0)
+        throw SOException(errno, __FUNCTION__);
+    unsynced = false;
+}
+
+/* ***************************************** */
+
+uint8_t *soLoadJournal(uint32_t js, uint32_t jn, uint32_t *nbp, uint32_t **refsp, uint8_t **imagesp)
+{
+    soProbe(800, "soLoadJournal(%u, %u, %p, %p, %p)\n", js, jn, nbp, refsp, imagesp);
+
+    *nbp = 0;
+    if (jn == 0)
+        return NULL;
+
+    bsize = soGetRawBlockSize();
+    uint8_t first[bsize];
+    soReadRawBlock(js, first);
+
+    /* an empty journal, or one whose transaction never got to be committed */
+    SOJournalHeader *hp = (SOJournalHeader *) first;
+    if (hp->magic != JOURNAL_MAGIC || hp->nblocks == 0 || hp->nblocks >= jn)
+        return NULL;
+    uint32_t nb = hp->nblocks;
+    uint32_t d = descBlocks(nb);
+    if (d + nb > jn)
+        return NULL;
+
+    uint8_t *buf = (uint8_t *) malloc((d + nb) * bsize);
+    if (buf == NULL)
+        throw SOException(ENOMEM, __FUNCTION__);
+    try
+    {
+        soReadRawCluster(js, buf, d + nb);
+    }
+    catch (...)
+    {
+        free(buf);
+        throw;
+    }
+
+    uint32_t *dref = (uint32_t *) (buf + sizeof(SOJournalHeader));
+    uint32_t sum = checksum(2166136261U, dref, nb * sizeof(uint32_t));
+    sum = checksum(sum, buf + d * bsize, nb * bsize);
+    if (sum != ((SOJournalHeader *) buf)->checksum)
+    {
+        free(buf);
+        return NULL;
+    }
+
+    *nbp = nb;
+    *refsp = dref;
+    *imagesp = buf + d * bsize;
+    return buf;
+}
+
+/* ***************************************** */
+
+bool soReplayJournal(uint32_t js, uint32_t jn)
+{
+    soProbe(800, "soReplayJournal(%u, %u)\n", js, jn);
+
+    uint32_t nb;
+    uint32_t *dref;
+    uint8_t *images;
+    uint8_t *buf = soLoadJournal(js, jn, &nb, &dref, &images);
+    if (buf == NULL)
+        return false;
+
+    try
+    {
+        for (uint32_t i = 0; i < nb; i++)
+            if (dref[i] != NULL_BLOCK)
+                soWriteRawBlock(dref[i], images + i * bsize);
+        syncDisk();
+        sequence = ((SOJournalHeader *) buf)->sequence;
+
+        /* the transaction is in place, so the journal can be emptied */
+        memset(buf, 0, bsize);
+        soWriteRawBlock(js, buf);
+        syncDisk();
+    }
+    catch (...)
+    {
+        free(buf);
+        throw;
+    }
+    free(buf);
+
+    return true;
+}
+
+/* ***************************************** */
+
+void soOpenJournalDealer()
+{
+    soProbe(800, "soOpenJournalDealer()\n");
+
+    SOSuperBlock *sbp = sbGetPointer();
+    jstart = sbp->jstart;
+    jsize = sbp->jsize;
+    bsize = soGetRawBlockSize();
+    csize = sbp->csize;
+    n = 0;
+    held = 0;
+    unsynced = false;
+
+    /* the largest transaction whose descriptor and blocks fit in the journal */
+    cap = (jsize > 0) ? jsize - 1 : 0;
+    while (cap > 0 && cap + descBlocks(cap) > jsize)
+        cap--;
+
+    if (cap > 0)
+    {
+        dmax = descBlocks(cap);
+        free(area);
+        free(refs);
+        area = (uint8_t *) malloc((dmax + cap) * bsize);
+        refs = (uint32_t *) malloc(cap * sizeof(uint32_t));
+        if (area == NULL || refs == NULL)
+            throw SOException(ENOMEM, __FUNCTION__);
+    }
+
+    isOpen = true;
+}
+
+/* ***************************************** */
+
+void soCloseJournalDealer()
+{
+    soProbe(800, "soCloseJournalDealer()\n");
+
+    if (!isOpen)
+        return;
+
+    if (cap > 0)
+    {
+        jCommit();
+        syncDisk();
+
+        /* every transaction is in place: leave the journal empty */
+        memset(area, 0, bsize);
+        soWriteRawBlock(jstart, area);
+        syncDisk();
+    }
+
+    free(area);
+    free(refs);
+    area = NULL;
+    refs = NULL;
+    cap = 0;
+    isOpen = false;
+}
+
+/* ***************************************** */
+
+void jReadBlocks(uint32_t bn, void *buf, uint32_t count)
+{
+    soProbe(800, "jReadBlocks(%u, %p, %u)\n", bn, buf, count);
+    soTime(T_JREAD_BLOCKS);
+
+    soReadRawCluster(bn, buf, count);
+
+    /* blocks logged in the running transaction are newer than their place */
+    if (isOpen)
+        for (uint32_t i = 0; i < n; i++)
+            if (refs[i] != NULL_BLOCK && refs[i] >= bn && refs[i] - bn < count)
+                memcpy((uint8_t *) buf + (refs[i] - bn) * bsize, image(i), bsize);
+}
+
+/* ***************************************** */
+
+void jWriteBlocks(uint32_t bn, void *buf, uint32_t count)
+{
+    soProbe(800, "jWriteBlocks(%u, %p, %u)\n", bn, buf, count);
+    soTime(T_JWRITE_BLOCKS);
+
+    if (!isOpen || cap == 0)
+    {
+        soWriteRawCluster(bn, buf, count);
+        return;
+    }
+
+    for (uint32_t k = 0; k < count; k++)
+    {
+        uint8_t *p = (uint8_t *) buf + k * bsize;
+
+        /* a block logged again just gets its new contents */
+        uint32_t i;
+        for (i = 0; i < n && refs[i] != bn + k; i++)
+            ;
+        if (i == n)
+        {
+            /* only an operation logging more than it made room for fills the
+             * transaction: committing it, half done, is the last resort */
+            if (n == cap)
+            {
+                soCount(C_JOURNAL_OVERFLOWS);
+                jCommit();
+                i = 0;
+            }
+            refs[i] = bn + k;
+            n++;
+        }
+        memcpy(image(i), p, bsize);
+    }
+}
+
+/* ***************************************** */
+
+void jWriteData(uint32_t bn, void *buf, uint32_t count)
+{
+    soProbe(800, "jWriteData(%u, %p, %u)\n", bn, buf, count);
+    soTime(T_JWRITE_DATA);
+
+    soWriteRawCluster(bn, buf, count);
+    unsynced = true;
+
+    /* the blocks may have held metadata earlier in the transaction,
+     * whose logged contents must not overwrite the data when committed */
+    if (isOpen)
+        for (uint32_t i = 0; i < n; i++)
+            if (refs[i] != NULL_BLOCK && refs[i] >= bn && refs[i] - bn < count)
+                refs[i] = NULL_BLOCK;
+}
+
+/* ***************************************** */
+
+void jReserve(uint32_t clusters, uint32_t blocks)
+{
+    soProbe(800, "jReserve(%u, %u)\n", clusters, blocks);
+
+    if (!isOpen || cap == 0)
+        return;
+
+    /* an operation needing more than a whole transaction gets an empty one */
+    if (n + held > 0 && n + held + clusters * csize + blocks > cap)
+        jCommit();
+}
+
+/* ***************************************** */
+
+void jHold(uint32_t clusters, uint32_t blocks)
+{
+    soProbe(800, "jHold(%u, %u)\n", clusters, blocks);
+
+    if (!isOpen || cap == 0)
+        return;
+
+    held += clusters * csize + blocks;
+}
+
+/* ***************************************** */
+
+bool jHasJournal()
+{
+    soProbe(800, "jHasJournal()\n");
+
+    return isOpen && cap > 0;
+}
+
+/* ***************************************** */
+
+void jSetCommitHook(void (*hook)())
+{
+    soProbe(800, "jSetCommitHook(%p)\n", hook);
+
+    commitHook = hook;
+}
+
+/* ***************************************** */
+
+void jCommit()
+{
+    soProbe(800, "jCommit()\n");
+    soTime(T_JCOMMIT);
+
+    if (!isOpen)
+        throw SOException(EBADF, __FUNCTION__);
+
+    if (commitHook != NULL && !hooking)
+    {
+        hooking = true;
+        try
+        {
+            commitHook();
+        }
+        catch (...)
+        {
+            hooking = false;
+            throw;
+        }
+        hooking = false;
+    }
+    held = 0;
+
+    if (n == 0)
+        return;
+
+    /* file data written so far, and the blocks put in place by the previous
+     * commit, must be on the disk before the journal is overwritten */
+    if (unsynced)
+        syncDisk();
+
+    /* the descriptor goes right before the contents, so both go in one transfer */
+    uint32_t d = descBlocks(n);
+    uint8_t *desc = area + (dmax - d) * bsize;
+    memset(desc, 0, d * bsize);
+    SOJournalHeader *hp = (SOJournalHeader *) desc;
+    uint32_t *dref = (uint32_t *) (desc + sizeof(SOJournalHeader));
+    memcpy(dref, refs, n * sizeof(uint32_t));
+    hp->magic = JOURNAL_MAGIC;
+    hp->sequence = ++sequence;
+    hp->nblocks = n;
+    hp->checksum = checksum(checksum(2166136261U, dref, n * sizeof(uint32_t)), image(0), n * bsize);
+
+    soWriteRawCluster(jstart, desc, d + n);
+    syncDisk();
+    soCount(C_JOURNAL_BLOCKS, d + n);
+
+    /* the transaction is durable: put its blocks in place */
+    for (uint32_t i = 0; i < n; i++)
+        if (refs[i] != NULL_BLOCK)
+            soWriteRawBlock(refs[i], image(i));
+    unsynced = true;
+    n = 0;
+}
@@ -0,0 +1,180 @@
+/**
+ *  \file jdealer.h
+ *  \brief journal dealer: mediates the writing of metadata to the disk
+ *
+ *  The superblock, inode table and cluster zone dealers do their disk
+ *  transfers through this module.
+ *  Written blocks are not sent to their place in the disk right away:
+ *  they are logged, in memory, in the running transaction, and reads
+ *  see the logged contents.
+ *  When the transaction is committed, the logged blocks are written to
+ *  the journal, in a single transfer, the device is synchronized and
+ *  only then are the blocks written to their place.
+ *  A transaction committed but not fully written to its place is
+ *  replayed from the journal the next time the volume is open.
+ *
+ *  Transactions are only committed when asked, so all the metadata
+ *  changes of a system call, and of several system calls in a row,
+ *  go to disk together or not at all.
+ *  A transaction must never fill the journal in the middle of an operation:
+ *  before changing anything, each operation, or each step of a long one,
+ *  makes room for the most it may log, through jReserve, which commits
+ *  the running transaction first if that room is not left in it.
+ *
+ *  File data is not logged: it is written straight to its place,
+ *  through jWriteData.
+ *  So a cluster freed in a transaction must not be given to a file before
+ *  the transaction is committed, or a crash would bring back the old owner
+ *  of the cluster with the data of the new one: the free lists hold such
+ *  clusters back, and release them through a hook run on commit.
+ *
+ *  If the volume has no journal, every write goes straight to its place.
+ *
+ *  \remarks In case an error occurs, every function throws a SOException
+ */
+
+#ifndef __SOFS16_JDEALER__
+#define __SOFS16_JDEALER__
+
+#include <stdint.h>
+
+/* ***************************************** */
+
+/**
+ * \brief Load the transaction found in a journal, if it is a committed one, without replaying it
+ *
+ *  Used by tools that must see the volume as the next mount will, without writing to it.
+ *
+ *  \param jstart physical number of the first block of the journal
+ *  \param jsize number of blocks of the journal
+ *  \param nbp pointer to where the number of logged blocks is stored (0 if there is no transaction)
+ *  \param refsp pointer to where the address of the physical numbers of the logged blocks is stored
+ *  \param imagesp pointer to where the address of the contents of the logged blocks is stored
+ *  \return the buffer holding the transaction, to be freed by the caller, or NULL if there is none
+ */
+uint8_t *soLoadJournal(uint32_t jstart, uint32_t jsize, uint32_t *nbp, uint32_t **refsp, uint8_t **imagesp);
+
+/* ***************************************** */
+
+/**
+ * \brief Replay the transaction found in a journal, if it is a committed one
+ *
+ *  Called by the superblock dealer, before the superblock is trusted.
+ *
+ *  \param jstart physical number of the first block of the journal
+ *  \param jsize number of blocks of the journal
+ *  \return true if a transaction was replayed
+ */
+bool soReplayJournal(uint32_t jstart, uint32_t jsize);
+
+/* ***************************************** */
+
+/** \brief Open the journal dealer
+ *
+ * Prepare the running transaction, using the journal described in the superblock
+ */
+void soOpenJournalDealer();
+
+/* ***************************************** */
+
+/**
+ * \brief Close the journal dealer
+ *
+ * Commit the running transaction and mark the journal as empty
+ */
+void soCloseJournalDealer();
+
+/* ***************************************** */
+
+/**
+ *  \brief Read consecutive blocks, as changed by the running transaction
+ *
+ *  \param n physical number of the first block
+ *  \param buf pointer to the buffer where the data must be read into
+ *  \param count number of blocks
+ */
+void jReadBlocks(uint32_t n, void *buf, uint32_t count);
+
+/* ***************************************** */
+
+/**
+ *  \brief Log consecutive metadata blocks in the running transaction
+ *
+ *  \param n physical number of the first block
+ *  \param buf pointer to the buffer containing the data to be written from
+ *  \param count number of blocks
+ */
+void jWriteBlocks(uint32_t n, void *buf, uint32_t count);
+
+/* ***************************************** */
+
+/**
+ *  \brief Write consecutive data blocks straight to the disk
+ *
+ *  Any copy of these blocks logged in the running transaction is dropped.
+ *
+ *  \param n physical number of the first block
+ *  \param buf pointer to the buffer containing the data to be written from
+ *  \param count number of blocks
+ */
+void jWriteData(uint32_t n, void *buf, uint32_t count);
+
+/* ***************************************** */
+
+/**
+ * \brief Tell whether metadata writes are logged
+ *
+ *  \return false if the volume has no journal, or the dealer is not open
+ */
+bool jHasJournal();
+
+/* ***************************************** */
+
+/**
+ * \brief Set the function run each time a transaction is about to be committed
+ *
+ *  Whatever it logs goes in the transaction being committed.
+ *
+ *  \param hook the function, or NULL for none
+ */
+void jSetCommitHook(void (*hook)());
+
+/* ***************************************** */
+
+/**
+ * \brief Make room in the running transaction for what an operation may log
+ *
+ *  If the room left in the running transaction, besides what is held for
+ *  the commit hook, is not enough, the transaction is committed first.
+ *  So it must be called where the metadata logged so far is consistent.
+ *
+ *  \param clusters the most clusters the operation may log
+ *  \param blocks the most single blocks (superblock, inode table) it may log
+ */
+void jReserve(uint32_t clusters, uint32_t blocks);
+
+/* ***************************************** */
+
+/**
+ * \brief Hold room in the running transaction for what the commit hook will log
+ *
+ *  The room is held until the transaction is committed.
+ *
+ *  \param clusters number of clusters
+ *  \param blocks number of single blocks
+ */
+void jHold(uint32_t clusters, uint32_t blocks);
+
+/* ***************************************** */
+
+/**
+ * \brief Commit the running transaction
+ *
+ *  The commit hook is run first.
+ *  On return, the transaction is durable.
+ */
+void jCommit();
+
+/* ***************************************** */
+
+#endif                          /* __SOFS16_JDEALER__ */
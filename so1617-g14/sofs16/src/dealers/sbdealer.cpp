@@ -6,19 +6,43 @@
 #include "rawdisk.h"
 
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 #include "core.h"
 #include "dealers.h"
+#include "journal.h"
+#include "superblock.h"
+#include "inode.h"
+#include "cluster.h"
 
 #include <errno.h>
 
-static SOSuperBlock sb;
+/* the superblock is at the start of block 0, whose size is only known once it is read */
+static union
+{
+    SOSuperBlock sb;
+    uint8_t block[MAX_BLOCK_SIZE];
+} b0;
+static SOSuperBlock &sb = b0.sb;
 static bool isOpen = false;
 
 void soOpenSuperblockDealer()
 {
+    soReadRawBlock(0, b0.block);
+
+    /* refuse devices not formatted with this version of the file system */
+    if (sb.magic != MAGIC_NUMBER || sb.version != VERSION_NUMBER)
+        throw SOException(EMEDIUMTYPE, __FUNCTION__);
+
+    /* from now on, the device is accessed in blocks of the volume's size */
+    soSetRawBlockSize(sb.bsize);
+    soReadRawBlock(0, b0.block);
+
+    /* a transaction interrupted by a crash may have changed the superblock itself */
+    if (soReplayJournal(sb.jstart, sb.jsize))
+        soReadRawBlock(0, b0.block);
+
     isOpen = true;
-    soReadRawBlock(0, &sb);
 }
 
 void soCloseSuperblockDealer()
@@ -37,6 +61,56 @@ SOSuperBlock *sbGetPointer()
 
 void sbSave()
 {
+    soTime(T_SB_SAVE);
+
     if (isOpen)
-        soWriteRawBlock(0, &sb);
+        jWriteBlocks(0, b0.block, 1);
+}
+
+void sbCheckConsistency()
+{
+    if (!isOpen)
+        throw SOException(EBADF, __FUNCTION__);
+
+    sbCheckConsistency(&sb);
+}
+
+void sbCheckConsistency(const SOSuperBlock *sbp)
+{
+    const SOSuperBlock &sb = *sbp;
+
+    /* header */
+    if (sb.magic != MAGIC_NUMBER || sb.version != VERSION_NUMBER)
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if (sb.mstat != PRU && sb.mstat != NPRU)
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if (sb.bsize != soGetRawBlockSize())
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if (sb.csize == 0 || sb.csize * sb.bsize > MAX_CLUSTER_SIZE)
+        throw SOException(ELIBBAD, __FUNCTION__);
+
+    /* inode table metadata */
+    if (sb.itstart != 1 || sb.itsize * IPB != sb.itotal)
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if (sb.ifree >= sb.itotal)
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if (sb.iinit == 0 || sb.iinit > sb.itsize || sb.itail != NULL_REFERENCE)
+        throw SOException(ELIBBAD, __FUNCTION__);
+
+    /* journal metadata */
+    if (sb.jstart != sb.itstart + sb.itsize)
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if (sb.jsize != 0 && sb.jsize < (JOURNAL_MIN_CLUSTERS + 1) * sb.csize)
+        throw SOException(ELIBBAD, __FUNCTION__);
+
+    /* cluster zone metadata */
+    if (sb.czstart != sb.jstart + sb.jsize)
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if ((uint64_t) sb.czstart + (uint64_t) sb.ctotal * sb.csize > sb.ntotal)
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if (sb.cfree >= sb.ctotal || sb.crefs >= sb.ctotal)
+        throw SOException(ELIBBAD, __FUNCTION__);
+    if (sb.chead.cache.in >= FCT_CACHE_SIZE || sb.chead.cache.out >= FCT_CACHE_SIZE ||
+            sb.ctail.cache.in >= FCT_CACHE_SIZE || sb.ctail.cache.out >= FCT_CACHE_SIZE)
+        throw SOException(ELIBBAD, __FUNCTION__);
 }
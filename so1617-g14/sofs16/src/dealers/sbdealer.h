@@ -56,10 +56,21 @@ void sbSave();
 /**
  * \brief Check superblock consistency 
  *
- * \remark To be implemented
+ * An inconsistent superblock makes it throw a SOException with ELIBBAD
  */
 void sbCheckConsistency();
 
 /* ***************************************** */
 
+/**
+ * \brief Check the consistency of a copy of the superblock
+ *
+ * The device must already be accessed in blocks of the volume's size
+ *
+ * \param sbp pointer to the copy
+ */
+void sbCheckConsistency(const SOSuperBlock *sbp);
+
+/* ***************************************** */
+
 #endif /*__SOFS16_SBDEALER___ */
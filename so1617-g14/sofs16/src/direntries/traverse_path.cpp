@@ -11,6 +11,7 @@
 #include "sys/stat.h"
 #include "errno.h"
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 
 #include <errno.h>
@@ -33,6 +34,7 @@ void soTraversePath(char *path, uint32_t * inp)
 
     /* Recursion base case */
     if(strcmp(path, "/") == 0) {
+        soCount(C_TRAVERSALS);
         *inp = 0;
         return;
     }
@@ -48,6 +50,7 @@ void soTraversePath(char *path, uint32_t * inp)
     }
 
     /* Get the component's inode number */
+    soCount(C_TRAVERSAL_STEPS);
     soGetDirEntry(ih, bn, inp);
     if(*inp == NULL_REFERENCE) {
         iClose(ih);
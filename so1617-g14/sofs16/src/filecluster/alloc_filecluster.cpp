@@ -16,8 +16,8 @@
 #include <errno.h>
 #include <stdint.h>
 
-static void soAllocIndirectFileCluster(SOInode * ip, uint32_t fcn, uint32_t * cnp);
-static void soAllocDoubleIndirectFileCluster(SOInode * ip, uint32_t fcn, uint32_t * cnp);
+static void soAllocIndirectFileCluster(SOInode * ip, uint32_t fcn, uint32_t * cnp, uint32_t goal);
+static void soAllocDoubleIndirectFileCluster(SOInode * ip, uint32_t fcn, uint32_t * cnp, uint32_t goal);
 
 /* ********************************************************* */
 
@@ -37,24 +37,33 @@ void soAllocFileCluster(int ih, uint32_t fcn, uint32_t * cnp)
     //i-node corresponding to our file
     SOInode *ip = iGetPointer(ih);
 
+    //aim for the cluster following the previous one of the file, so that it is laid out contiguously
+    uint32_t goal = NULL_REFERENCE;
+    if(fcn > 0){
+        uint32_t prev;
+        soGetFileCluster(ih, fcn - 1, &prev);
+        if(prev != NULL_REFERENCE)
+            goal = prev + 1;
+    }
+
     //decision where the desired cluster is (d,i1 or i2)
     if(fcn < N_DIRECT){
         //Trabalha-se diretamente com d[fcn]
         if(ip->d[fcn] != NULL_REFERENCE)
             soFreeCluster(ip->d[fcn]);
-        soAllocCluster(cnp);
+        soAllocCluster(cnp, goal);
         ip->d[fcn] = *cnp;
         ip->csize++;
     }
     else if(fcn - N_DIRECT < (N_INDIRECT*RPC)){
         //Trabalha-se na i1 Indirect 
         uint32_t afcn = fcn - N_DIRECT;
-        soAllocIndirectFileCluster(ip,afcn,cnp);
+        soAllocIndirectFileCluster(ip,afcn,cnp,goal);
     }
     else{ 
         //Trabalha-se na i2 Double Indirect
         uint32_t afcn = (fcn - N_DIRECT - (N_INDIRECT*RPC));
-        soAllocDoubleIndirectFileCluster(ip,afcn,cnp);
+        soAllocDoubleIndirectFileCluster(ip,afcn,cnp,goal);
     }
     iSave(ih);
 }
@@ -63,9 +72,9 @@ void soAllocFileCluster(int ih, uint32_t fcn, uint32_t * cnp)
 /* ********************************************************* */
 
 
-static void soAllocIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32_t * cnp)
+static void soAllocIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32_t * cnp, uint32_t goal)
 {
-    soProbe(600, "soAllocIndirectFileCluster(%p, %u, %p)\n", ip, afcn, cnp);
+    soProbe(600, "soAllocIndirectFileCluster(%p, %u, %p, %u)\n", ip, afcn, cnp, goal);
     uint32_t RPC = soGetRPC();
     // i1x represents the index in the first layer. In this case, it's either 0 or 1
     uint32_t i1x = (int) afcn/RPC;
@@ -74,10 +83,11 @@ static void soAllocIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32_t * c
     uint32_t cluster_buffer[RPC];
 
     if(ip->i1[i1x] == NULL_REFERENCE){
-        //Alloc the cluster
-        soAllocCluster(cnp);
+        //Alloc the cluster, in line with the data ones
+        soAllocCluster(cnp, goal);
         ip->i1[i1x] = *cnp;
         ip->csize  ++;
+        goal = *cnp + 1;
 
         //Format the cluster
         soReadCluster(ip->i1[i1x],cluster_buffer);
@@ -92,7 +102,7 @@ static void soAllocIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32_t * c
         //printf("Cluster already has info, trying to free cluster # %d\n",cluster_buffer[i1y]);
         soFreeCluster(cluster_buffer[i1y]);
     }
-    soAllocCluster(cnp);
+    soAllocCluster(cnp, goal);
     cluster_buffer[i1y] = *cnp;
     soWriteCluster(ip->i1[i1x],cluster_buffer);
 
@@ -104,9 +114,9 @@ static void soAllocIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32_t * c
 /* ********************************************************* */
 
 
-static void soAllocDoubleIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32_t * cnp)
+static void soAllocDoubleIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32_t * cnp, uint32_t goal)
 {
-    soProbe(600, "soAllocDoubleIndirectFileCluster(%p, %u, %p)\n", ip, afcn, cnp);
+    soProbe(600, "soAllocDoubleIndirectFileCluster(%p, %u, %p, %u)\n", ip, afcn, cnp, goal);
     uint32_t RPC = soGetRPC();
     // i2x represents the index in the second layer (first layer is a cluster). It's an integer between 0 and RPC-1 (i2[i2x])
     int i2x = (int) afcn / RPC;
@@ -116,10 +126,11 @@ static void soAllocDoubleIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32
     // Deal with first cluster containing refs
     uint32_t first_cluster_buffer[RPC];
     if(ip->i2 == NULL_REFERENCE){ 
-        //Alloc the cluster
-        soAllocCluster(cnp);
+        //Alloc the cluster, in line with the data ones
+        soAllocCluster(cnp, goal);
         ip->i2 = *cnp;
         ip->csize ++;
+        goal = *cnp + 1;
 
         //Format the cluster
         soReadCluster(ip->i2,first_cluster_buffer);
@@ -134,9 +145,11 @@ static void soAllocDoubleIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32
     // Deal with second cluster containing refs
     uint32_t second_cluster_buffer[RPC];
     if(first_cluster_buffer[i2x] == NULL_REFERENCE){
-        //Alloc the cluster
-        soAllocCluster(cnp);
+        //Alloc the cluster, in line with the data ones
+        soAllocCluster(cnp, goal);
         first_cluster_buffer[i2x] = *cnp;
+        ip->csize++;
+        goal = *cnp + 1;
         soWriteCluster(ip->i2,first_cluster_buffer);
 
         //Format it 
@@ -151,7 +164,7 @@ static void soAllocDoubleIndirectFileCluster(SOInode * ip, uint32_t afcn, uint32
     if(second_cluster_buffer[i2y]!= NULL_REFERENCE)
         soFreeCluster(second_cluster_buffer[i2y]);
     
-    soAllocCluster(cnp);
+    soAllocCluster(cnp, goal);
     second_cluster_buffer[i2y] = *cnp;
     soWriteCluster(first_cluster_buffer[i2x],second_cluster_buffer);
 
@@ -16,8 +16,9 @@
 #include <stdint.h>
 
 #if 1
-static void soFreeIndirectFileClusters(SOInode * ip, uint32_t ffcn, uint32_t * n_clusters, uint32_t * finished);
-static void soFreeDoubleIndirectFileClusters(SOInode * ip, uint32_t ffcn, uint32_t * n_clusters);
+static bool soFreeReferencedClusters(SOInode * ip, uint32_t cn, uint32_t idx);
+static void soFreeIndirectFileClusters(SOInode * ip, uint32_t ffcn);
+static void soFreeDoubleIndirectFileClusters(SOInode * ip, uint32_t ffcn);
 #endif
 
 /* ********************************************************* */
@@ -28,189 +29,137 @@ void soFreeFileClusters(int ih, uint32_t ffcn)
 
     SOInode *p_inode = iGetPointer(ih);
     uint32_t RPC = soGetRPC();
-    uint32_t n_clusters = p_inode->csize; /* Variable that counts the number of clusters left */
-    uint32_t finished; /* Variable that indicates if soFreeDoubleIndirectFileClusters has to be used */
-    
 
     /* Check if ffcn is in range */
 	if((ffcn < 0) || (ffcn >= (N_DIRECT + (N_INDIRECT * RPC) + (RPC * RPC))))
 		throw SOException(EINVAL, __FUNCTION__);
 
-	/* Direct */
-	for(uint32_t i = 0; i < N_DIRECT; i++){
-		/* Check if there are no more clusters */
-		if(n_clusters == 0) return;
+	/* Only the references from ffcn on are visited, so cutting the end of
+	 * a large file costs no more than that end */
 
+	/* Direct */
+	for(uint32_t i = ffcn; i < N_DIRECT; i++){
 		if(p_inode->d[i] != NULL_REFERENCE){
-			/* Check if index is equal or above ffcn */
-			if(i >= ffcn){
-				/* Free cluster */
-				soFreeCluster(p_inode->d[i]);
-				p_inode->d[i] = NULL_REFERENCE;
-				p_inode->csize--;
-			}
-
-			n_clusters--; /* Decrement number of clusters left */
+			/* Free cluster */
+			soFreeCluster(p_inode->d[i]);
+			p_inode->d[i] = NULL_REFERENCE;
+			p_inode->csize--;
 		}
 	}
 
-	/* Check if there are no more clusters */
-	if(n_clusters == 0) return;
-
 	/* Single Indirect */
 	if(ffcn < N_INDIRECT * RPC + N_DIRECT)
-		soFreeIndirectFileClusters(p_inode, ffcn, &n_clusters, &finished);
+		soFreeIndirectFileClusters(p_inode, ffcn);
 
 	/* Double Indirect */
-	if(!finished)
-		soFreeDoubleIndirectFileClusters(p_inode, ffcn, &n_clusters);
-
+	soFreeDoubleIndirectFileClusters(p_inode, ffcn);
 }
 
 #if 1
 /* ********************************************************* */
 
-/* only a hint to decompose the solution */
-static void soFreeIndirectFileClusters(SOInode * ip, uint32_t ffcn, uint32_t * n_clusters, uint32_t * finished)
+/* Free the clusters referenced from position idx on of references cluster cn,
+ * and cn itself if no reference is left in it; return true if it was freed */
+static bool soFreeReferencedClusters(SOInode * ip, uint32_t cn, uint32_t idx)
 {
-    soProbe(600, "soFreeIndirectFileClusters(%p, %u, %u, %u)\n", ip, ffcn, n_clusters, finished);
+	uint32_t RPC = soGetRPC();
+	uint32_t ref[RPC];
+	bool changed = false; /* Variable that indicates if cluster has to be written back */
+	bool empty = true; /* Variable that indicates if cluster has to be erased */
+
+	soReadCluster(cn, ref);
+
+	for(uint32_t j = 0; j < RPC; j++){
+		if(ref[j] == NULL_REFERENCE)
+			continue;
+
+		if(j >= idx){
+			soFreeCluster(ref[j]);
+			ref[j] = NULL_REFERENCE;
+			ip->csize--;
+			changed = true;
+		}else{
+			empty = false;
+		}
+	}
 
-    //throw SOException(ENOSYS, __FUNCTION__);
+	if(empty){
+		soFreeCluster(cn);
+		ip->csize--;
+		return true;
+	}
+
+	/* A cluster of references kept is only written back if it changed */
+	if(changed)
+		soWriteCluster(cn, ref);
+
+	return false;
+}
+
+/* ********************************************************* */
+
+/* only a hint to decompose the solution */
+static void soFreeIndirectFileClusters(SOInode * ip, uint32_t ffcn)
+{
+    soProbe(600, "soFreeIndirectFileClusters(%p, %u)\n", ip, ffcn);
 
 	uint32_t RPC = soGetRPC();
-	uint32_t ref[RPC];
-	uint32_t free; /* Variable that indicates if cluster has to be erased */
+	uint32_t afcn = (ffcn > N_DIRECT) ? ffcn - N_DIRECT : 0; /* Position of ffcn in the single indirect zone */
 
-	for(uint32_t i = 0; i < N_INDIRECT; i++){
+	for(uint32_t i = afcn / RPC; i < N_INDIRECT; i++){
 		if(ip->i1[i] != NULL_REFERENCE){
-			free = 1;
-
-			soReadCluster(ip->i1[i], ref);
-
-			for(uint32_t j = 0; j < RPC; j++){
-				/* Checks if is only itself */
-				if((*n_clusters) <= 1){
-					if(free){
-						soFreeCluster(ip->i1[i]);
-						ip->i1[i] = NULL_REFERENCE;
-						ip->csize--;
-						(*n_clusters)--; /* Decrement number of clusters left */
-					}
-
-					soWriteCluster(ip->i1[i], ref);
-					(*finished) = 1;
-					return;
-				}
-
-				if(ref[j] != NULL_REFERENCE){
-					/* Check if cluster is to be freed */
-					if(ffcn <= N_DIRECT || j >= (ffcn - N_DIRECT) - (RPC * i)){
-						soFreeCluster(ref[j]);
-						ref[j] = NULL_REFERENCE;
-						ip->csize--;
-					}else{
-						free = 0;
-					}
-
-					(*n_clusters)--; /* Decrement number of clusters left */
-				}
-			}
+			/* Only the first cluster of references is cut in the middle */
+			uint32_t idx = (i == afcn / RPC) ? afcn % RPC : 0;
 
-			soWriteCluster(ip->i1[i], ref);
-			
-			if(free){
-				soFreeCluster(ip->i1[i]);
+			if(soFreeReferencedClusters(ip, ip->i1[i], idx))
 				ip->i1[i] = NULL_REFERENCE;
-				ip->csize--;
-				(*n_clusters)--; /* Decrement number of clusters left */
-				return;
-			}
 		}
 	}
-	
-	(*finished) = 0;
 }
 
 /* ********************************************************* */
 
 /* only a hint to decompose the solution */
-static void soFreeDoubleIndirectFileClusters(SOInode * ip, uint32_t ffcn, uint32_t * n_clusters)
+static void soFreeDoubleIndirectFileClusters(SOInode * ip, uint32_t ffcn)
 {
-    soProbe(600, "soFreeDoubleIndirectFileClusters(%p, %u, %u)\n", ip, ffcn, n_clusters);
-
-    //throw SOException(ENOSYS, __FUNCTION__);
+    soProbe(600, "soFreeDoubleIndirectFileClusters(%p, %u)\n", ip, ffcn);
 
     uint32_t RPC = soGetRPC();
-	uint32_t ref[RPC], ref_in[RPC];
-	uint32_t free, free_in;
+	uint32_t ref[RPC];
+	uint32_t base = N_DIRECT + N_INDIRECT * RPC;
+	uint32_t afcn = (ffcn > base) ? ffcn - base : 0; /* Position of ffcn in the double indirect zone */
+	bool changed = false; /* Variable that indicates if cluster has to be written back */
+	bool empty = true; /* Variable that indicates if cluster has to be erased */
 
 	if(ip->i2 == NULL_REFERENCE)
 		return;
 
-	free = 1;
 	soReadCluster(ip->i2, ref);
 
 	for(uint32_t i = 0; i < RPC; i++){
-		if(ref[i] != NULL_REFERENCE){
-			free_in = 1;
-
-			soReadCluster(ref[i], ref_in);
-
-			for(uint32_t j = 0; j < RPC; j++){
-				/* Checks if is only itself and his parent */
-				if((*n_clusters) <= 2){
-					if(free_in){
-						soFreeCluster(ref[i]);
-						ref[i] = NULL_REFERENCE;
-						ip->csize--;
-						(*n_clusters)--; /* Decrement number of clusters left */
-						if(free){
-							soFreeCluster(ip->i2);
-							ip->i2 = NULL_REFERENCE;
-							ip->csize--;
-							(*n_clusters)--; /* Decrement number of clusters left */
-						}
-					}
-
-					soWriteCluster(ref[i], ref_in);
-					soWriteCluster(ip->i2, ref);
-					return;
-				}
-
-				if(ref_in[j] != NULL_REFERENCE){
-					/* Check if cluster is to be freed */
-					if(ffcn <= N_DIRECT + N_DIRECT || j >= (ffcn - N_DIRECT - (N_INDIRECT * RPC)) - (RPC * i)){
-						soFreeCluster(ref_in[j]);
-						ref_in[j] = NULL_REFERENCE;
-						ip->csize--;
-					}else{
-						free_in = 0;
-					}
-
-					(*n_clusters)--; /* Decrement number of clusters left */
-				}
-			}
+		if(ref[i] == NULL_REFERENCE)
+			continue;
+
+		if(i >= afcn / RPC){
+			/* Only the first cluster of references is cut in the middle */
+			uint32_t idx = (i == afcn / RPC) ? afcn % RPC : 0;
 
-			soWriteCluster(ref[i], ref_in);
-			
-			if(free_in){
-				soFreeCluster(ref[i]);
+			if(soFreeReferencedClusters(ip, ref[i], idx)){
 				ref[i] = NULL_REFERENCE;
-				ip->csize--;
-				(*n_clusters)--; /* Decrement number of clusters left */
-			}else{
-				free = 0;
+				changed = true;
+				continue;
 			}
 		}
+
+		empty = false;
 	}
 
-	soWriteCluster(ip->i2, ref);
-			
-	if(free){
+	if(empty){
 		soFreeCluster(ip->i2);
 		ip->i2 = NULL_REFERENCE;
 		ip->csize--;
-		(*n_clusters)--; /* Decrement number of clusters left */
+	}else if(changed){
+		soWriteCluster(ip->i2, ref);
 	}
 }
 #endif
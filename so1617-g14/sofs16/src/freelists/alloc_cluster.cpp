@@ -6,10 +6,76 @@
 #include "freelists.h"
 
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 #include "sbdealer.h"
 #include "core.h"
 #include <errno.h>
+#include <stdlib.h>
+
+/* A reference to a free cluster held in the head or in the tail cache */
+struct CachedRef
+{
+    uint32_t cn;        /* cluster number */
+    bool inHead;        /* true if in the head cache, false if in the tail cache */
+    uint32_t idx;       /* position in the cache */
+};
+
+static int compareCachedRefs(const void *a, const void *b)
+{
+    uint32_t x = ((const CachedRef *) a)->cn, y = ((const CachedRef *) b)->cn;
+    return (x > y) - (x < y);
+}
+
+/* Gather the references of a cache, from its first filled position on */
+static uint32_t gatherCache(FCTRecord *rec, bool inHead, CachedRef *refs, uint32_t n)
+{
+    for(uint32_t k = 0, i = rec->cache.out; k < FCT_CACHE_SIZE && rec->cache.ref[i] != NULL_REFERENCE;
+            k++, i = (i + 1) % FCT_CACHE_SIZE)
+    {
+        refs[n].cn = rec->cache.ref[i];
+        refs[n].inHead = inHead;
+        refs[n].idx = i;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Choose, among the free clusters referenced in both caches, the one to allocate:
+ * the goal itself if it is there; otherwise, the middle of the longest run of
+ * consecutive free clusters, so that the first half of the run is left for the
+ * file that may end just before it, and files growing at the same time do not
+ * interleave their clusters.
+ */
+static CachedRef chooseCluster(SOSuperBlock *sbp, uint32_t goal)
+{
+    CachedRef refs[2 * FCT_CACHE_SIZE];
+    uint32_t n = gatherCache(&sbp->chead, true, refs, 0);
+    n = gatherCache(&sbp->ctail, false, refs, n);
+    qsort(refs, n, sizeof(CachedRef), compareCachedRefs);
+
+    uint32_t best = 0, bestLength = 0;
+    for(uint32_t i = 0; i < n; )
+    {
+        if(refs[i].cn == goal)
+            return refs[i];
+        uint32_t j = i + 1;
+        while(j < n && refs[j].cn == refs[j - 1].cn + 1)
+        {
+            if(refs[j].cn == goal)
+                return refs[j];
+            j++;
+        }
+        if(j - i > bestLength)
+        {
+            best = i;
+            bestLength = j - i;
+        }
+        i = j;
+    }
+    return refs[best + bestLength / 2];
+}
 
 /*
  * Dictates to be obeyed by the implementation:
@@ -17,9 +83,10 @@
  * - after the reference is removed,
  *      its location should be filled with NULL_REFERENCE
  */
-void soAllocCluster(uint32_t * cnp)
+void soAllocCluster(uint32_t * cnp, uint32_t goal)
 {
-    soProbe(713, "soAllocCluster(%u)\n", cnp);
+    soProbe(713, "soAllocCluster(%p, %u)\n", cnp, goal);
+    soTime(T_ALLOC_CLUSTER);
 
     SOSuperBlock *sbp = sbGetPointer();
 
@@ -31,6 +98,29 @@ void soAllocCluster(uint32_t * cnp)
     if(sbp->chead.cache.ref[sbp->chead.cache.out] == NULL_REFERENCE)
         soReplenish();
 
+    /* with a goal, choose the cluster to allocate and bring it to the front of the head cache */
+    if(goal != NULL_REFERENCE)
+    {
+        CachedRef chosen = chooseCluster(sbp, goal);
+        if(chosen.inHead)
+        {
+            uint32_t tmp = sbp->chead.cache.ref[chosen.idx];
+            sbp->chead.cache.ref[chosen.idx] = sbp->chead.cache.ref[sbp->chead.cache.out];
+            sbp->chead.cache.ref[sbp->chead.cache.out] = tmp;
+        }
+        else
+        {
+            /* take it from the tail cache, filling its place with the first one there */
+            *cnp = chosen.cn;
+            sbp->ctail.cache.ref[chosen.idx] = sbp->ctail.cache.ref[sbp->ctail.cache.out];
+            sbp->ctail.cache.ref[sbp->ctail.cache.out] = NULL_REFERENCE;
+            sbp->ctail.cache.out = (sbp->ctail.cache.out + 1) % FCT_CACHE_SIZE;
+            sbp->cfree--;
+            sbSave();
+            return;
+        }
+    }
+
     /* alloc the first free cluster and change its reference in the head cache to null */
     *cnp = sbp->chead.cache.ref[sbp->chead.cache.out];
     sbp->chead.cache.ref[sbp->chead.cache.out] = NULL_REFERENCE;
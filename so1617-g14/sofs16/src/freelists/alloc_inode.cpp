@@ -7,6 +7,7 @@
 
 #include "core.h"
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 
 #include "itdealer.h"
@@ -24,9 +25,10 @@
  * - error ENOSPC should be thrown if there is no free inodes
  * - the allocated inode must be properly initialized
  */
-void soAllocInode(uint32_t type, uint32_t * inp)
+void soAllocInode(uint32_t type, uint32_t * inp, uint32_t pin)
 {
-    soProbe(711, "soAllocInode(%u, %p)\n", type, inp);
+    soProbe(711, "soAllocInode(%u, %p, %u)\n", type, inp, pin);
+    soTime(T_ALLOC_INODE);
 
     SOSuperBlock *sbp = sbGetPointer();
 
@@ -34,17 +36,14 @@ void soAllocInode(uint32_t type, uint32_t * inp)
     if (sbp->ifree == 0)
         throw SOException(ENOSPC, __FUNCTION__);
 
-    /* The number of the allocated inode is the head of the list of free inodes */
-    if(inp) *inp = sbp->ihead;
-
-    /* Open head inode */
-    int ih = iOpen(sbp->ihead);
+    /* Pick a free inode, close to the parent directory if possible, and open it */
+    uint32_t in = iGetFreeInode(pin);
+    if(inp) *inp = in;
+    int ih = iOpen(in);
     SOInode *inode = iGetPointer(ih);
 
-    /* Update the number of free inodes and the head and tail on the superblock */
+    /* Update the number of free inodes on the superblock */
     sbp->ifree--;
-    if(sbp->ifree == 0) sbp->ihead = sbp->itail = NULL_REFERENCE;
-    else sbp->ihead = inode->next;
     sbSave();
 
     /* Initialize inode */
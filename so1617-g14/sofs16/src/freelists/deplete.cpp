@@ -7,6 +7,7 @@
 #include "czdealer.h"
 
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 #include "core.h"
 #include "superblock.h"
@@ -23,6 +24,7 @@
 void soDeplete(void)
 {
     soProbe(722, "soDeplete()\n");
+    soTime(T_DEPLETE);
 
     SOSuperBlock *sbp = sbGetPointer();
     uint32_t RPC = soGetRPC();
@@ -77,11 +79,16 @@ void soDeplete(void)
         /* Transfer while tail cache is not empty */
         while (sbp->ctail.cache.ref[sbp->ctail.cache.out] != NULL_REFERENCE)
         {
-            /* Check if we need to allocate a new tail cluster */
+            /* Check if we need to allocate a new tail cluster; it is taken from
+             * the tail cache itself, as soAllocCluster could replenish the head
+             * cache from the very tail cluster held here */
             if (sbp->ctail.cluster_idx == RPC-1)
             {
                 uint32_t oldTailClusterNumber = sbp->ctail.cluster_number;
-                soAllocCluster(&sbp->ctail.cluster_number);
+                sbp->ctail.cluster_number = sbp->ctail.cache.ref[sbp->ctail.cache.out];
+                sbp->ctail.cache.ref[sbp->ctail.cache.out] = NULL_REFERENCE;
+                sbp->ctail.cache.out = (sbp->ctail.cache.out + 1) % FCT_CACHE_SIZE;
+                sbp->cfree--;
                 sbp->crefs++;
                 tailCluster[RPC-1] = sbp->ctail.cluster_number;
                 soWriteCluster(oldTailClusterNumber, tailCluster);
@@ -6,12 +6,43 @@
 #include "freelists.h"
 
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 #include "sbdealer.h" /* added */
+#include "jdealer.h"
+#include "czdealer.h"
 #include "core.h" /* added */
 
 #include <errno.h>
 #include <inttypes.h>
+#include <stdlib.h>
+
+/* clusters freed in the running transaction, held back until it is committed */
+static uint32_t *pending = NULL;
+static uint32_t npending = 0;
+static uint32_t maxpending = 0;
+
+/* insert a cluster into the tail cache */
+static void release(uint32_t cn)
+{
+    SOSuperBlock *p_sb = sbGetPointer();
+    /* if it's full, deplete it */
+    if(p_sb->ctail.cache.ref[p_sb->ctail.cache.in] != NULL_REFERENCE)
+    	soDeplete();
+    p_sb->ctail.cache.ref[p_sb->ctail.cache.in] = cn;
+    p_sb->ctail.cache.in = (p_sb->ctail.cache.in + 1) % FCT_CACHE_SIZE;
+    p_sb->cfree++;
+    /* save modifications */
+    sbSave();
+}
+
+/* commit hook: release the held clusters; releasing them may free one more
+ * (a references cluster emptied by a replenish), which is released too */
+static void releasePending()
+{
+    while(npending > 0)
+        release(pending[--npending]);
+}
 
 /*
  * Dictates to be obeyed by the implementation:
@@ -21,6 +52,7 @@
 void soFreeCluster(uint32_t cn)
 {
     soProbe(732, "soFreeCluster (%u)\n", cn);
+    soTime(T_FREE_CLUSTER);
 
     SOSuperBlock *p_sb;
 
@@ -31,14 +63,29 @@ void soFreeCluster(uint32_t cn)
     if(cn < 0 || cn >= p_sb->ctotal)
     	throw SOException(EINVAL, __FUNCTION__);
 
-    /* if it's full, deplete it */
-    if(p_sb->ctail.cache.ref[p_sb->ctail.cache.in] != NULL_REFERENCE)
-    	soDeplete();
+    /* without a journal there is nothing to wait for */
+    if(!jHasJournal())
+    {
+        release(cn);
+        return;
+    }
 
-    p_sb->ctail.cache.ref[p_sb->ctail.cache.in] = cn;
-    p_sb->ctail.cache.in = (p_sb->ctail.cache.in + 1) % FCT_CACHE_SIZE;
-    p_sb->cfree++;
-
-    /* save modifications */
-    sbSave();
+    if(npending == maxpending)
+    {
+        uint32_t max = (maxpending == 0) ? FCT_CACHE_SIZE : 2 * maxpending;
+        uint32_t *p = (uint32_t *) realloc(pending, max * sizeof(uint32_t));
+        if(p == NULL)
+            throw SOException(ENOMEM, __FUNCTION__);
+        pending = p;
+        maxpending = max;
+    }
+    /* room for releasing them on commit: the superblock and up to three
+     * references clusters for the first ones, as a deplete may move on to
+     * a new tail references cluster, and one more every time they may fill one */
+    if(npending == 0)
+        jHold(3, 1);
+    else if(npending % (soGetRPC() - 1) == 0)
+        jHold(1, 0);
+    pending[npending++] = cn;
+    jSetCommitHook(releasePending);
 }
\ No newline at end of file
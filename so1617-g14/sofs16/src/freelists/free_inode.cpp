@@ -6,6 +6,7 @@
 #include "freelists.h"
 
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 
 #include "core.h"
@@ -27,11 +28,12 @@
 void soFreeInode(uint32_t in)
 {
     soProbe(712, "soFreeInode (%u)\n", in);
+    soTime(T_FREE_INODE);
 
     SOSuperBlock *sbp = sbGetPointer();
 
     /* Check if the inode number is out of range */
-    if(in > sbp->itotal || in == 0)
+    if(in >= sbp->itotal || in == 0)
         throw SOException(EINVAL, __FUNCTION__);
 
     /* Open freed inode */
@@ -45,31 +47,9 @@ void soFreeInode(uint32_t in)
         return;
     }
 
-    /* Check if we need to consider a tail inode or not */
-    if (sbp->ifree == 0)
-    {
-        /* Adjust links when there isn't a tail inode */
-        sbp->ihead = sbp->itail = in;
-        freedInode->next = NULL_REFERENCE;
-    }
-    else
-    {
-        /* Open tail inode */
-        int tih = iOpen(sbp->itail);
-        SOInode *tailInode = iGetPointer(tih);
-
-        /* Adjust links when there's a tail inode */
-        sbp->itail = in;
-        tailInode->next = in;
-        freedInode->next = NULL_REFERENCE;
-
-        /* Save and close tail inode */
-        iSave(tih);
-        iClose(tih);
-    }
-
-    /* Mark freed inode as free */
+    /* Mark freed inode as free; saving it puts it back in the map of free inodes */
     freedInode->mode |= INODE_FREE;
+    freedInode->next = NULL_REFERENCE;
     sbp->ifree++;
 
     /* Save and close freed inode */
@@ -19,6 +19,8 @@
 #ifndef __SOFS16_FREELISTS__
 #define __SOFS16_FREELISTS__
 
+#include "core.h"
+
 #include <stdint.h>
 
 /* *************************************************** */
@@ -30,21 +32,24 @@
 /**
  *  \brief Allocate a free inode.
  *
- *  An inode is retrieved from the list of free inodes, marked in use, 
+ *  A free inode is retrieved from the inode table dealer's map of free inodes, marked in use,
  *  associated to the legal file type passed as
  *  a parameter and is generally initialized. 
+ *  Only the allocated inode is read and written.
  *
  *  \param type the inode type (it must represent either a file, or a directory, or a symbolic link)
  *  \param inp pointer to the location where the number of the just allocated inode is to be stored
+ *  \param pin number of the parent directory's inode, whose block of the inode table is preferred,
+ *      or NULL_REFERENCE for no preference
  */
-void soAllocInode(uint32_t type, uint32_t * inp);
+void soAllocInode(uint32_t type, uint32_t * inp, uint32_t pin = NULL_REFERENCE);
 
 /* *************************************************** */
 
 /**
  *  \brief Free the referenced inode.
  *
- *  The inode is inserted into the list of free inodes.
+ *  The inode is marked free, which puts it back in the inode table dealer's map of free inodes.
  *
  *  \param in number of the inode to be freed
  */
@@ -56,10 +61,15 @@ void soFreeInode(uint32_t in);
  *  \brief Allocate a free cluster.
  *
  *  A cluster is retrieved from the list of free clusters. 
+ *  If a goal is given, the free cluster closest after it, among those
+ *  referenced in the head and tail caches, is retrieved instead of the
+ *  first one in the head cache.
  *
  *  \param cnp pointer to the location where the number of the allocated cluster is to be stored
+ *  \param goal number of the cluster wished for, usually the one following the previous
+ *      cluster of the same file, or NULL_REFERENCE for no preference
  */
-void soAllocCluster(uint32_t * cnp);
+void soAllocCluster(uint32_t * cnp, uint32_t goal = NULL_REFERENCE);
 
 /* *************************************************** */
 
@@ -67,6 +77,10 @@ void soAllocCluster(uint32_t * cnp);
  *  \brief Free the referenced cluster.
  *
  *  The cluster is inserted into the list of free clusters.
+ *  If the volume has a journal, that only happens when the running transaction
+ *  is committed: until then, the cluster is neither counted as free nor
+ *  allocated again, as data written to it in place would end up in
+ *  the file that owned it, were a crash to undo the transaction.
  *
  *  \param cn number of the cluster to be freed
  */
@@ -5,6 +5,7 @@
 
 #include "freelists.h"
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 #include "sbdealer.h" // getSuperblock
 #include "czdealer.h" // soWriteCluster / read
@@ -29,6 +30,7 @@
 void soReplenish(void)
 {   
     soProbe(733, "soReplenish()\n");
+    soTime(T_REPLENISH);
     SOSuperBlock* spb =  sbGetPointer();
     uint32_t ref_per_cluster = soGetRPC();
     /*Chead cache is not empty, nothing to do*/
@@ -0,0 +1,618 @@
+/**
+ *  \brief File system benchmark
+ *
+ *  It runs a fixed set of workloads on a sofs16 volume and prints, in JSON,
+ *  the throughput and the latency percentiles of each one, so that runs on
+ *  different versions of the code can be compared.
+ *
+ *  The volume is used either through the system calls layer, linked into
+ *  this program and accessing the support file directly, or, already
+ *  mounted, through the kernel and FUSE.
+ *  Every workload works in its own directory, removed before the next one,
+ *  and random offsets come from a seeded generator, so runs on freshly
+ *  formatted volumes of the same size do the same operations.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "syscalls.h"
+#include "direntry.h"
+
+/* ******************************************** */
+
+/*
+ *  Access to the volume, either through the system calls layer or through the kernel:
+ *  paths are relative to the root of the volume, and errors are returned as -errno
+ */
+struct Backend
+{
+    const char *name;
+    int (*mknod)(const char *path);
+    int (*mkdir)(const char *path);
+    int (*unlink)(const char *path);
+    int (*rmdir)(const char *path);
+    int (*stat)(const char *path);
+    int (*open)(const char *path);                          /* returns a handle */
+    int (*pwrite)(int h, const char *path, void *buf, size_t count, off_t pos);
+    int (*pread)(int h, const char *path, void *buf, size_t count, off_t pos);
+    int (*fsync)(int h, const char *path);
+    int (*close)(int h, const char *path);
+    int (*list)(const char *path);                          /* returns the number of entries */
+};
+
+/* system calls layer */
+
+static int dMknod(const char *path)
+{
+    return soMknod(path, S_IFREG | 0644);
+}
+
+static int dMkdir(const char *path)
+{
+    return soMkdir(path, 0755);
+}
+
+static int dStat(const char *path)
+{
+    struct stat st;
+    return soStat(path, &st);
+}
+
+static int dOpen(const char *path)
+{
+    return soOpen(path, O_RDWR);
+}
+
+static int dPwrite(int h, const char *path, void *buf, size_t count, off_t pos)
+{
+    return soWrite(path, buf, count, pos);
+}
+
+static int dPread(int h, const char *path, void *buf, size_t count, off_t pos)
+{
+    return soRead(path, buf, count, pos);
+}
+
+static int dFsync(int h, const char *path)
+{
+    return soFsync(path);
+}
+
+static int dClose(int h, const char *path)
+{
+    return soClose(path);
+}
+
+static int dList(const char *path)
+{
+    char name[SOFS16_MAX_NAME + 1];
+    int n = 0, stat;
+    for (int32_t pos = 0; (stat = soReaddir(path, name, pos)) > 0; pos += stat)
+        n++;
+    return (stat < 0) ? stat : n;
+}
+
+static const Backend direct = {
+    "direct", dMknod, dMkdir, soUnlink, soRmdir, dStat,
+    dOpen, dPwrite, dPread, dFsync, dClose, dList
+};
+
+/* kernel, on a mounted volume */
+
+static const char *mountPoint = NULL;
+
+static const char *full(const char *path)
+{
+    static __thread char buf[PATH_MAX];
+    snprintf(buf, sizeof(buf), "%s%s", mountPoint, path);
+    return buf;
+}
+
+static int ret(int stat)
+{
+    return (stat < 0) ? -errno : stat;
+}
+
+static int kMknod(const char *path)
+{
+    return ret(mknod(full(path), S_IFREG | 0644, 0));
+}
+
+static int kMkdir(const char *path)
+{
+    return ret(mkdir(full(path), 0755));
+}
+
+static int kUnlink(const char *path)
+{
+    return ret(unlink(full(path)));
+}
+
+static int kRmdir(const char *path)
+{
+    return ret(rmdir(full(path)));
+}
+
+static int kStat(const char *path)
+{
+    struct stat st;
+    return ret(stat(full(path), &st));
+}
+
+static int kOpen(const char *path)
+{
+    return ret(open(full(path), O_RDWR));
+}
+
+static int kPwrite(int h, const char *path, void *buf, size_t count, off_t pos)
+{
+    return ret(pwrite(h, buf, count, pos));
+}
+
+static int kPread(int h, const char *path, void *buf, size_t count, off_t pos)
+{
+    return ret(pread(h, buf, count, pos));
+}
+
+static int kFsync(int h, const char *path)
+{
+    return ret(fsync(h));
+}
+
+static int kClose(int h, const char *path)
+{
+    return ret(close(h));
+}
+
+static int kList(const char *path)
+{
+    DIR *dp = opendir(full(path));
+    if (dp == NULL)
+        return -errno;
+    int n = 0;
+    while (readdir(dp) != NULL)
+        n++;
+    closedir(dp);
+    return n;
+}
+
+static const Backend kernel = {
+    "mounted", kMknod, kMkdir, kUnlink, kRmdir, kStat,
+    kOpen, kPwrite, kPread, kFsync, kClose, kList
+};
+
+static const Backend *be = &direct;
+
+/* ******************************************** */
+
+/* parameters */
+static uint32_t fileMiB = 64;       /* size of the files of the data workloads */
+static uint32_t nfiles = 2000;      /* number of files of the metadata workloads */
+static uint32_t depth = 32;         /* depth of the deep path */
+static uint32_t seed = 1;           /* seed of the random offsets */
+static const char *label = "";      /* label recorded in the output */
+
+static const uint32_t sizes[] = { 4096, 65536, 1048576 };
+static const uint32_t randSizes[] = { 4096, 65536 };
+#define NSIZES(a) (sizeof(a) / sizeof(a[0]))
+
+/* latencies of the operations of the running workload */
+static uint64_t *lat = NULL;
+static uint32_t nlat = 0, maxlat = 0;
+static uint64_t tstart = 0;
+
+static bool firstResult = true;
+
+static uint64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void fail(const char *what, const char *path, int stat)
+{
+    fprintf(stderr, "fsbench: %s %s: %s\n", what, path, strerror(-stat));
+    exit(EXIT_FAILURE);
+}
+
+/* run an operation, recording its latency */
+#define TIMED(what, path, call) \
+    do \
+    { \
+        uint64_t t0 = now(); \
+        int stat = (call); \
+        if (stat < 0) \
+            fail(what, path, stat); \
+        if (nlat < maxlat) \
+            lat[nlat++] = now() - t0; \
+    } while (0)
+
+/* run an operation, not timed */
+#define CHECKED(what, path, call) \
+    do \
+    { \
+        int stat = (call); \
+        if (stat < 0) \
+            fail(what, path, stat); \
+    } while (0)
+
+static void begin(uint32_t nops)
+{
+    if (nops > maxlat)
+    {
+        free(lat);
+        if ((lat = (uint64_t *) malloc(nops * sizeof(uint64_t))) == NULL)
+            fail("malloc", "", -ENOMEM);
+        maxlat = nops;
+    }
+    nlat = 0;
+    tstart = now();
+}
+
+static int byValue(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x < y) ? -1 : (x > y);
+}
+
+static uint64_t pct(double q)
+{
+    uint32_t i = (uint32_t) (q * nlat);
+    return (nlat == 0) ? 0 : lat[(i < nlat) ? i : nlat - 1];
+}
+
+/* print the result of the workload just run */
+static void end(const char *workload, uint32_t size, uint64_t bytes)
+{
+    double secs = (now() - tstart) / 1e9;
+    qsort(lat, nlat, sizeof(uint64_t), byValue);
+
+    printf("%s\n    {\"workload\": \"%s\", \"size\": %u, \"ops\": %u, \"bytes\": %" PRIu64
+           ", \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"mib_per_sec\": %.2f"
+           ", \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}",
+           firstResult ? "" : ",", workload, size, nlat, bytes, secs,
+           (secs > 0) ? nlat / secs : 0.0, (secs > 0) ? bytes / secs / (1 << 20) : 0.0,
+           pct(0.5) / 1e3, pct(0.9) / 1e3, pct(0.99) / 1e3, pct(1.0) / 1e3);
+    firstResult = false;
+    fflush(stdout);
+}
+
+/* 32-bit xorshift, so offsets are the same on every run with the same seed */
+static uint32_t rnd(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* ******************************************** */
+
+static char *buf = NULL;
+
+/* write a file of fileMiB MiB, in units of the given size, not timed */
+static void fill(const char *path, uint32_t size)
+{
+    uint64_t total = (uint64_t) fileMiB << 20;
+    CHECKED("mknod", path, be->mknod(path));
+    int h = be->open(path);
+    if (h < 0)
+        fail("open", path, h);
+    for (uint64_t pos = 0; pos < total; pos += size)
+        CHECKED("write", path, be->pwrite(h, path, buf, size, pos));
+    CHECKED("fsync", path, be->fsync(h, path));
+    CHECKED("close", path, be->close(h, path));
+}
+
+static void sequential()
+{
+    uint64_t total = (uint64_t) fileMiB << 20;
+    const char *path = "/bench/seq";
+    CHECKED("mkdir", "/bench", be->mkdir("/bench"));
+
+    for (uint32_t i = 0; i < NSIZES(sizes); i++)
+    {
+        uint32_t size = sizes[i];
+
+        /* writing, the data being on the device at the end */
+        CHECKED("mknod", path, be->mknod(path));
+        int h = be->open(path);
+        if (h < 0)
+            fail("open", path, h);
+        begin(total / size);
+        for (uint64_t pos = 0; pos < total; pos += size)
+            TIMED("write", path, be->pwrite(h, path, buf, size, pos));
+        CHECKED("fsync", path, be->fsync(h, path));
+        end("seq_write", size, total);
+
+        begin(total / size);
+        for (uint64_t pos = 0; pos < total; pos += size)
+            TIMED("read", path, be->pread(h, path, buf, size, pos));
+        end("seq_read", size, total);
+
+        CHECKED("close", path, be->close(h, path));
+        CHECKED("unlink", path, be->unlink(path));
+    }
+
+    CHECKED("rmdir", "/bench", be->rmdir("/bench"));
+}
+
+static void randomIO()
+{
+    uint64_t total = (uint64_t) fileMiB << 20;
+    const char *path = "/bench/rand";
+    CHECKED("mkdir", "/bench", be->mkdir("/bench"));
+    fill(path, sizes[NSIZES(sizes) - 1]);
+
+    int h = be->open(path);
+    if (h < 0)
+        fail("open", path, h);
+    for (uint32_t i = 0; i < NSIZES(randSizes); i++)
+    {
+        /* a quarter of the file, at aligned offsets */
+        uint32_t size = randSizes[i];
+        uint32_t nops = total / size / 4;
+        uint32_t state = seed;
+
+        begin(nops);
+        for (uint32_t k = 0; k < nops; k++)
+        {
+            off_t pos = (off_t) (rnd(&state) % (total / size)) * size;
+            TIMED("write", path, be->pwrite(h, path, buf, size, pos));
+        }
+        CHECKED("fsync", path, be->fsync(h, path));
+        end("rand_write", size, (uint64_t) nops * size);
+
+        state = seed + 1;
+        begin(nops);
+        for (uint32_t k = 0; k < nops; k++)
+        {
+            off_t pos = (off_t) (rnd(&state) % (total / size)) * size;
+            TIMED("read", path, be->pread(h, path, buf, size, pos));
+        }
+        end("rand_read", size, (uint64_t) nops * size);
+    }
+    CHECKED("close", path, be->close(h, path));
+
+    CHECKED("unlink", path, be->unlink(path));
+    CHECKED("rmdir", "/bench", be->rmdir("/bench"));
+}
+
+/* create, stat, list and unlink the files of a large directory */
+static void metadata()
+{
+    char path[64];
+    CHECKED("mkdir", "/bench", be->mkdir("/bench"));
+
+    begin(nfiles);
+    for (uint32_t i = 0; i < nfiles; i++)
+    {
+        sprintf(path, "/bench/file%06u", i);
+        TIMED("mknod", path, be->mknod(path));
+    }
+    end("create", 0, 0);
+
+    begin(nfiles);
+    for (uint32_t i = 0; i < nfiles; i++)
+    {
+        sprintf(path, "/bench/file%06u", (i * 7919) % nfiles);
+        TIMED("stat", path, be->stat(path));
+    }
+    end("stat", 0, 0);
+
+    begin(10);
+    for (uint32_t i = 0; i < 10; i++)
+        TIMED("readdir", "/bench", be->list("/bench"));
+    end("readdir", nfiles, 0);
+
+    begin(nfiles);
+    for (uint32_t i = 0; i < nfiles; i++)
+    {
+        sprintf(path, "/bench/file%06u", i);
+        TIMED("unlink", path, be->unlink(path));
+    }
+    end("unlink", 0, 0);
+
+    CHECKED("rmdir", "/bench", be->rmdir("/bench"));
+}
+
+/* stat a file at the bottom of a deep chain of directories */
+static void deepPath()
+{
+    char path[16 + 2 * depth];
+    strcpy(path, "/bench");
+    CHECKED("mkdir", path, be->mkdir(path));
+    for (uint32_t i = 0; i < depth; i++)
+    {
+        strcat(path, "/d");
+        CHECKED("mkdir", path, be->mkdir(path));
+    }
+    strcat(path, "/f");
+    CHECKED("mknod", path, be->mknod(path));
+
+    begin(nfiles);
+    for (uint32_t i = 0; i < nfiles; i++)
+        TIMED("stat", path, be->stat(path));
+    end("deep_path", depth, 0);
+
+    CHECKED("unlink", path, be->unlink(path));
+    for (uint32_t i = 0; i <= depth; i++)
+    {
+        *strrchr(path, '/') = '\0';
+        CHECKED("rmdir", path, be->rmdir(path));
+    }
+}
+
+static void largeDelete()
+{
+    const char *path = "/bench/large";
+    CHECKED("mkdir", "/bench", be->mkdir("/bench"));
+    fill(path, sizes[NSIZES(sizes) - 1]);
+
+    begin(1);
+    TIMED("unlink", path, be->unlink(path));
+    end("large_delete", fileMiB, (uint64_t) fileMiB << 20);
+
+    CHECKED("rmdir", "/bench", be->rmdir("/bench"));
+}
+
+/* ******************************************** */
+
+struct Workload
+{
+    const char *name;
+    void (*run)();
+};
+
+static const Workload workloads[] = {
+    { "seq", sequential },
+    { "rand", randomIO },
+    { "meta", metadata },
+    { "deep", deepPath },
+    { "delete", largeDelete }
+};
+#define NWORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/* print help message */
+static void printUsage(char *cmd_name)
+{
+    printf("Sinopsis: %s [OPTIONS] supp-file\n"
+           "          %s [OPTIONS] -m mount-point\n"
+           "  OPTIONS:\n"
+           "  -m dir   --- run on a volume mounted at dir (default: access supp-file directly)\n"
+           "  -s MiB   --- size of the files of the data workloads (default: 64)\n"
+           "  -n count --- number of files of the metadata workloads (default: 2000)\n"
+           "  -d depth --- depth of the deep path (default: 32)\n"
+           "  -w list  --- workloads to run, comma separated, among seq, rand, meta, deep, delete\n"
+           "               (default: all)\n"
+           "  -S seed  --- seed of the random offsets (default: 1)\n"
+           "  -t label --- label recorded in the output, such as a commit id\n"
+           "  -h       --- print this help\n", cmd_name, cmd_name);
+}
+
+/* The main function */
+int main(int argc, char *argv[])
+{
+    char *progName = basename(argv[0]);
+    const char *list = "seq,rand,meta,deep,delete";
+
+    /* process command line options */
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s:n:d:w:S:t:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':          /* mounted volume */
+            {
+                mountPoint = optarg;
+                be = &kernel;
+                break;
+            }
+            case 's':          /* file size */
+            {
+                fileMiB = atoi(optarg);
+                break;
+            }
+            case 'n':          /* number of files */
+            {
+                nfiles = atoi(optarg);
+                break;
+            }
+            case 'd':          /* depth */
+            {
+                depth = atoi(optarg);
+                break;
+            }
+            case 'w':          /* workloads */
+            {
+                list = optarg;
+                break;
+            }
+            case 'S':          /* seed */
+            {
+                seed = atoi(optarg);
+                break;
+            }
+            case 't':          /* label */
+            {
+                label = optarg;
+                break;
+            }
+            case 'h':          /* help mode */
+            {
+                printUsage(progName);
+                return EXIT_SUCCESS;
+            }
+            default:
+            {
+                fprintf(stderr, "%s: Wrong option.\n", progName);
+                printUsage(progName);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    /* check arguments */
+    if ((argc - optind) != (mountPoint == NULL ? 1 : 0))
+    {
+        fprintf(stderr, "%s: Wrong number of mandatory arguments.\n", progName);
+        printUsage(progName);
+        return EXIT_FAILURE;
+    }
+    if (fileMiB == 0 || nfiles == 0 || depth == 0 || seed == 0)
+    {
+        fprintf(stderr, "%s: Sizes, counts and seed must be positive.\n", progName);
+        printUsage(progName);
+        return EXIT_FAILURE;
+    }
+    bool selected[NWORKLOADS] = { false };
+    char *names = strdupa(list);
+    for (char *w = strtok(names, ","); w != NULL; w = strtok(NULL, ","))
+    {
+        uint32_t i;
+        for (i = 0; i < NWORKLOADS && strcmp(w, workloads[i].name) != 0; i++)
+            ;
+        if (i == NWORKLOADS)
+        {
+            fprintf(stderr, "%s: Unknown workload \"%s\".\n", progName, w);
+            printUsage(progName);
+            return EXIT_FAILURE;
+        }
+        selected[i] = true;
+    }
+
+    if ((buf = (char *) malloc(sizes[NSIZES(sizes) - 1])) == NULL)
+        fail("malloc", "", -ENOMEM);
+    memset(buf, 0x5A, sizes[NSIZES(sizes) - 1]);
+
+    const char *target = (mountPoint != NULL) ? mountPoint : argv[optind];
+    if (be == &direct)
+        CHECKED("open", target, soOpenFileSystem(target));
+
+    printf("{\n  \"label\": \"%s\",\n  \"mode\": \"%s\",\n  \"target\": \"%s\",\n"
+           "  \"file_mib\": %u,\n  \"files\": %u,\n  \"depth\": %u,\n  \"seed\": %u,\n  \"results\": [",
+           label, be->name, target, fileMiB, nfiles, depth, seed);
+    for (uint32_t i = 0; i < NWORKLOADS; i++)
+        if (selected[i])
+            workloads[i].run();
+    printf("\n  ]\n}\n");
+
+    if (be == &direct)
+        CHECKED("close", target, soCloseFileSystem());
+
+    return EXIT_SUCCESS;
+}
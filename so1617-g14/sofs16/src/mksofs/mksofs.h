@@ -11,11 +11,28 @@
 
 #include "superblock.h"
 
+#include <stdint.h>
+
+/* size of the chunks in which regions are written */
+#define WRITE_CHUNK_SIZE (4U << 20)
+
+/* maximum number of threads writing a region */
+#define MAX_WRITERS 8
+
+/* fill in buf with count blocks, starting at block first of a region */
+typedef void (*ChunkFiller)(SOSuperBlock * sbp, uint32_t first, uint32_t count, uint8_t * buf);
+
+void writeRegion(SOSuperBlock * sbp, uint32_t start, uint32_t nblocks, uint32_t unit, ChunkFiller fill);
+
+void zeroRegion(SOSuperBlock * sbp, uint32_t start, uint32_t nblocks);
+
 void fillInSuperBlock(SOSuperBlock * sbp, const char *name,
-                      uint32_t ntotal, uint32_t itotal, uint32_t bpc);
+                      uint32_t ntotal, uint32_t itotal, uint32_t bpc, uint32_t jsize, bool lazy);
 
 void fillInInodeTable(SOSuperBlock * sbp);
 
+void fillInJournal(SOSuperBlock * sbp);
+
 void fillInRootDir(SOSuperBlock * sbp);
 
 void fillInFreeClusterList(SOSuperBlock * sbp);
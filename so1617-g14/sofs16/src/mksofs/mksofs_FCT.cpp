@@ -1,10 +1,29 @@
 	#include "mksofs.h"
 	#include "superblock.h"
 	#include "exception.h"
-	#include "rawdisk.h"    // Included rawdisk to have access to BLOCK_SIZE and soWriteRawCluster
+	#include "rawdisk.h"    // Included rawdisk to have access to the block size and soWriteRawCluster
 	#include "core.h"
 	#include <errno.h>
 
+	/* fill in FCT clusters, cluster first/csize+1 being the first one */
+	static void fctClusters(SOSuperBlock * p_sb, uint32_t first, uint32_t count, uint8_t * buf)
+	{
+		uint32_t RPC = p_sb->csize * soGetRawBlockSize() / sizeof(uint32_t);
+		uint32_t *arrayRefs = (uint32_t *) buf;
+		for(uint32_t I = first / p_sb->csize + 1; I <= (first + count) / p_sb->csize; I++){
+			/* the indexes of this array follow those of the I-1 arrays before it */
+			uint32_t already_filled = (I - 1) * (RPC - 1);
+			for(uint32_t J = 0; J < RPC - 1; J++, already_filled++){
+				if(already_filled < p_sb->cfree)
+					arrayRefs[J] = p_sb->crefs + 1 + already_filled;
+				else
+					arrayRefs[J] = NULL_REFERENCE;
+			}
+			arrayRefs[RPC-1] = (I == p_sb->crefs) ? NULL_REFERENCE : I + 1;
+			arrayRefs += RPC;
+		}
+	}
+
 	/*
 	 * create the table of references to free data clusters 
 	 */
@@ -17,49 +36,12 @@
 		* 	-Each array has N indexes where:
 		*		-N * sizeOf(uint32_t) = C (size in bytes of a cluster)
 		*		(=)N = C/4
-		*		-C = csize * BLOCK_SIZE
+		*		-C = csize * block size
 		*	-The first N-1 integers are indexes of free clusters
 		*	-The last integer is the number of the next cluster containing another array
 		*	-cref is both the number of clusters used by this table and the number of arrays in the table
+		*
+		* The arrays are computed independently, so they are written in large chunks, in parallel
 		*/
-		uint32_t RPC,C,I,J; 
-		C = p_sb->csize * BLOCK_SIZE;
-		RPC = C/sizeof(uint32_t);
-		uint32_t physical_index = p_sb -> czstart + p_sb -> csize;
-		uint32_t already_filled = 0; /* Variable that  keeps how many indexes have been saved */
- 
-		if(p_sb->cfree == 0 && p_sb -> crefs == 0)
-			return;
-		I = 1;
-		if(p_sb->cfree == 0 && p_sb -> crefs > 0){
-			for(I = 1;I<= p_sb-> crefs;I++){
-				uint32_t arrayRefs_I[RPC];
-				for(J = 0;J < RPC; J++){
-					arrayRefs_I[J] = NULL_REFERENCE;
-				}
-				soWriteRawCluster(physical_index,arrayRefs_I,p_sb-> csize);
-				physical_index += p_sb -> csize;
-			}
-		}
-		else{
-			for(I = 1;I<= p_sb-> crefs;I++){
-				uint32_t arrayRefs_I[RPC];
-				for(J = 0;J < RPC -1 ; J++){
-					if(already_filled < p_sb -> cfree){
-						arrayRefs_I[J] = p_sb -> crefs + 1 + already_filled; // already_filled pode ser I * (RPC-1)
-						already_filled++;
-					}
-					else
-						arrayRefs_I[J] = NULL_REFERENCE;
-				}
-				if(I == p_sb->crefs){
-					arrayRefs_I[RPC-1] = NULL_REFERENCE;
-				}
-				else{
-					arrayRefs_I[RPC-1] = I+1;
-				}
-				soWriteRawCluster(physical_index,arrayRefs_I,p_sb-> csize);
-				physical_index += p_sb -> csize;
-			}
-		}
-	}
\ No newline at end of file
+		writeRegion(p_sb, p_sb->czstart + p_sb->csize, p_sb->crefs * p_sb->csize, p_sb->csize, fctClusters);
+	}
@@ -0,0 +1,123 @@
+#include "mksofs.h"
+
+#include "superblock.h"
+#include "exception.h"
+#include "rawdisk.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+/* a region being written, shared by the writer threads */
+struct Region
+{
+    SOSuperBlock *sbp;
+    uint32_t start;         /* first block */
+    uint32_t nblocks;       /* number of blocks */
+    uint32_t cblocks;       /* blocks per chunk */
+    uint32_t nchunks;       /* number of chunks */
+    ChunkFiller fill;
+    uint32_t next;          /* next chunk to be taken */
+    int en;                 /* error of the first writer that failed, 0 if none */
+};
+
+/* each writer takes the next chunk, fills it in and writes it, until none is left */
+static void *writer(void *arg)
+{
+    Region *r = (Region *) arg;
+    uint8_t *buf = (uint8_t *) malloc((size_t) r->cblocks * soGetRawBlockSize());
+    if (buf == NULL)
+    {
+        __sync_bool_compare_and_swap(&r->en, 0, ENOMEM);
+        return NULL;
+    }
+
+    try
+    {
+        uint32_t c;
+        while (r->en == 0 && (c = __sync_fetch_and_add(&r->next, 1)) < r->nchunks)
+        {
+            uint32_t first = c * r->cblocks;
+            uint32_t count = (r->nblocks - first < r->cblocks) ? r->nblocks - first : r->cblocks;
+            r->fill(r->sbp, first, count, buf);
+            soWriteRawCluster(r->start + first, buf, count);
+        }
+    }
+    catch (SOException & err)
+    {
+        __sync_bool_compare_and_swap(&r->en, 0, err.en);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/*
+ * write a region of the disk in chunks of up to WRITE_CHUNK_SIZE bytes,
+ *   made of whole units of the given number of blocks,
+ *   with as many writer threads as there are processors, up to MAX_WRITERS
+ */
+void writeRegion(SOSuperBlock *sbp, uint32_t start, uint32_t nblocks, uint32_t unit, ChunkFiller fill)
+{
+    if (nblocks == 0)
+        return;
+
+    Region r;
+    r.sbp = sbp;
+    r.start = start;
+    r.nblocks = nblocks;
+    r.cblocks = WRITE_CHUNK_SIZE / soGetRawBlockSize() / unit * unit;
+    if (r.cblocks == 0)
+        r.cblocks = unit;
+    r.nchunks = (nblocks + r.cblocks - 1) / r.cblocks;
+    r.fill = fill;
+    r.next = 0;
+    r.en = 0;
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t nw = (ncpu < 1) ? 1 : (ncpu > MAX_WRITERS) ? MAX_WRITERS : ncpu;
+    if (nw > r.nchunks)
+        nw = r.nchunks;
+
+    /* the calling thread is one of the writers */
+    pthread_t thr[nw];
+    uint32_t started = 1;
+    for (; started < nw; started++)
+        if (pthread_create(&thr[started], NULL, writer, &r) != 0)
+            break;
+    writer(&r);
+    for (uint32_t i = 1; i < started; i++)
+        pthread_join(thr[i], NULL);
+
+    if (r.en != 0)
+        throw SOException(r.en, __FUNCTION__);
+}
+
+static void zeros(SOSuperBlock *sbp, uint32_t first, uint32_t count, uint8_t *buf)
+{
+    memset(buf, 0x00, (size_t) count * soGetRawBlockSize());
+}
+
+/*
+ * make a region of the disk read as zeros, without writing it if possible:
+ *   the device is asked to zero the range, or else to punch a hole in it,
+ *   and only if it supports neither are zeros written
+ */
+void zeroRegion(SOSuperBlock *sbp, uint32_t start, uint32_t nblocks)
+{
+    if (nblocks == 0)
+        return;
+
+    int fd = soGetRawDiskFd();
+    off_t pos = (off_t) start * soGetRawBlockSize();
+    off_t len = (off_t) nblocks * soGetRawBlockSize();
+    if (fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, pos, len) == 0)
+        return;
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, len) == 0)
+        return;
+
+    writeRegion(sbp, start, nblocks, 1, zeros);
+}
@@ -12,26 +12,39 @@
 #include <time.h> /* added */
 
 
+/* the inodes every block of the table is made of, and the root dir's */
+static SOInode emptyInode, rootDirInode;
+
+/* fill in blocks of inodes, all free except the root dir's */
+static void inodeBlocks(SOSuperBlock * p_sb, uint32_t first, uint32_t count, uint8_t * buf)
+{
+	SOInode *inodes = (SOInode *) buf;
+	for (uint32_t inode = 0; inode < count * IPB; inode++){
+		inodes[inode] = emptyInode;
+	}
+	if (first == 0){
+		inodes[0] = rootDirInode;
+	}
+}
+
 /*
  * filling in the inode table:
  *   only inode 0 is in use (it describes the root directory)
+ *   the table is written in large chunks, in parallel,
+ *   up to the blocks marked as initialized (all of them, unless in lazy mode)
  */
 void fillInInodeTable(SOSuperBlock * p_sb)
 {
-	/* Prepare an empty block of inodes to be written on each block of the inode table */
-	SOInode blockOfInodes[IPB];
-	uint32_t inodeCounter = 2;
-
 	/* Initialize generic empty inode */
-	SOInode emptyInode;
 	memset(&emptyInode, 0x00, sizeof(SOInode));
 	emptyInode.mode = INODE_FREE;
+	emptyInode.next = NULL_REFERENCE;
 	memset(emptyInode.d, NULL_REFERENCE, N_DIRECT*sizeof(uint32_t));
 	memset(emptyInode.i1, NULL_REFERENCE, N_INDIRECT*sizeof(uint32_t));
 	emptyInode.i2 = NULL_REFERENCE;
 
 	/* Initialize root dir inode */
-	SOInode rootDirInode = emptyInode;
+	rootDirInode = emptyInode;
 	rootDirInode.mode = S_IFDIR | S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH;
 	rootDirInode.refcount = 2;
 	rootDirInode.owner = getuid();
@@ -44,20 +57,5 @@ void fillInInodeTable(SOSuperBlock * p_sb)
 	memset(rootDirInode.i1, NULL_REFERENCE, N_INDIRECT*sizeof(uint32_t));
 	rootDirInode.i2 = NULL_REFERENCE;
 
-	/* Write the first block of inodes */
-	blockOfInodes[0] = rootDirInode;
-	for (uint32_t inode = 1; inode < IPB; inode++){
-		blockOfInodes[inode] = emptyInode;
-		blockOfInodes[inode].next = (inodeCounter == p_sb->itotal) ? NULL_REFERENCE : inodeCounter++;
-	}
-	soWriteRawBlock(p_sb->itstart, blockOfInodes);
-
-	/* Write the remaining blocks of inodes */
-	blockOfInodes[0] = emptyInode;
-	for (uint32_t block = 1; block < p_sb->itsize; block++){
-		for (uint32_t inode = 0; inode < IPB; inode++){
-			blockOfInodes[inode].next = (inodeCounter == p_sb->itotal) ? NULL_REFERENCE : inodeCounter++;
-		}
-		soWriteRawBlock(p_sb->itstart+block, blockOfInodes);
-	}
-}
\ No newline at end of file
+	writeRegion(p_sb, p_sb->itstart, p_sb->iinit, 1, inodeBlocks);
+}
@@ -0,0 +1,21 @@
+#include "mksofs.h"
+
+#include "superblock.h"
+#include "journal.h"
+#include "rawdisk.h"
+
+#include <string.h>
+
+/*
+ * filling in the journal:
+ *   only the header matters, an empty journal has no magic number
+ */
+void fillInJournal(SOSuperBlock * sbp)
+{
+    if (sbp->jsize == 0)
+        return;
+
+    uint8_t block[soGetRawBlockSize()];
+    memset(block, 0, sizeof(block));
+    soWriteRawBlock(sbp->jstart, block);
+}
@@ -27,7 +27,8 @@ int ceil_integer_division(int x, int y)
    *   this enables that if something goes wrong during formating, the
    *   device can never be mounted later on
    */
-void fillInSuperBlock(SOSuperBlock *sbp, const char *name, uint32_t ntotal, uint32_t itotal, uint32_t bpc)
+void fillInSuperBlock(SOSuperBlock *sbp, const char *name, uint32_t ntotal, uint32_t itotal, uint32_t bpc,
+                      uint32_t jsize, bool lazy)
 {
     // General metadata
 
@@ -38,22 +39,28 @@ void fillInSuperBlock(SOSuperBlock *sbp, const char *name, uint32_t ntotal, uint
     sbp->mstat = PRU; // PRoperly Unmounted by default
     sbp->csize = bpc; // Blocks per cluster
     sbp->ntotal = (ntotal > 3 ) ? ntotal : 4; // Total number of blocks
+    sbp->bsize = soGetRawBlockSize(); // Block size, as set on the device
 
 
     // Inode table
 
     sbp->itstart = 1; // inode table starts at block 1
     sbp->itotal = nearest_multiple(itotal, IPB); // starting number of inodes
-    sbp->itotal += IPB*((sbp->ntotal - 1 - ceil_integer_division(sbp->itotal, IPB)) % sbp->csize); // add cluster orphan block(s) to inode table
+    sbp->itotal += IPB*((sbp->ntotal - 1 - jsize - ceil_integer_division(sbp->itotal, IPB)) % sbp->csize); // add cluster orphan block(s) to inode table
     sbp->itsize = ceil_integer_division(sbp->itotal, IPB);
     sbp->ifree = sbp->itotal-1; // all inodes are free except the root dir
-    sbp->ihead = 1; // head is inode 1, root dir is presumably filled in
-    sbp->itail = sbp->ifree; // tail is the last free inode
+    sbp->iinit = lazy ? 1 : sbp->itsize; // with lazy init, only the root dir's block of inodes is written
+    sbp->itail = NULL_REFERENCE; // free inodes are not linked, see VERSION_NUMBER
+
+    // Journal
+
+    sbp->jstart = sbp->itsize + 1; // journal starts after inode table
+    sbp->jsize = jsize;
 
     // Cluster zone
 
-    sbp->czstart = sbp->itsize + 1; // cluster zone starts after inode table
-    sbp->ctotal = (sbp->ntotal - 1 - sbp->itsize) / sbp->csize;
+    sbp->czstart = sbp->jstart + sbp->jsize; // cluster zone starts after journal
+    sbp->ctotal = (sbp->ntotal - 1 - sbp->itsize - sbp->jsize) / sbp->csize;
     sbp->cfree = (sbp-> ctotal > 1 ) ? sbp->ctotal - 1 : 0; // initial cfree
     sbp->crefs = ceil_integer_division(sbp->cfree, RPB*sbp->csize); // solve for crefs: (n-1)*crefs >= cfree-crefs
     sbp->cfree = (sbp -> ctotal > 1) ? sbp->ctotal - 1 - sbp->crefs : 0; // final cfree
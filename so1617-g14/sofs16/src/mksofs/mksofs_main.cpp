@@ -10,6 +10,8 @@
 #include "exception.h"
 #include "core.h"
 #include "superblock.h"
+#include "cluster.h"
+#include "journal.h"
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -17,6 +19,7 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* print help message */
 static void printUsage(char *cmd_name)
@@ -25,7 +28,11 @@ static void printUsage(char *cmd_name)
            "  OPTIONS:\n"
            "  -n name --- set volume name (default: \"SOFS15\")\n"
            "  -i num  --- set number of inodes (default: N/8, where N = number of blocks)\n"
-           "  -c num  --- set number of blocks per cluster (default: 2, min: 1, max: 8)\n"
+           "  -b num  --- set block size in bytes (default: 512, a power of 2 between 512 and 65536)\n"
+           "  -c num  --- set number of blocks per cluster (default: 2, min: 1, max: 65536 / block size)\n"
+           "  -j num  --- set number of blocks of the journal (default: N/32, max 1024,\n"
+           "              no journal if that holds less than 25 clusters; 0: no journal)\n"
+           "  -l      --- set lazy mode: inode table initialized on demand (default: not lazy)\n"
            "  -z      --- set zero mode (default: not zero)\n"
            "  -q      --- set quiet mode (default: not quiet)\n"
            "  -h      --- print this help\n", cmd_name);
@@ -55,14 +62,17 @@ int main(int argc, char *argv[])
 {
     const char *volname = "SOFS16"; /* volume name */
     uint32_t itotal = 0;        /* total number of inodes, if kept, set value automatically */
+    uint32_t bsize = MIN_BLOCK_SIZE;
     uint32_t csize = 2;
+    int64_t jsize = -1;         /* journal size, if kept, set value automatically */
     bool quiet = false;         /* quiet mode */
     bool zero = false;          /* zero mode */
+    bool lazy = false;          /* lazy mode */
 
     /* process command line options */
 
     int opt;
-    while ((opt = getopt(argc, argv, "n:i:c:qzh")) != -1)
+    while ((opt = getopt(argc, argv, "n:i:b:c:j:lqzh")) != -1)
     {
         switch (opt)
         {
@@ -83,11 +93,24 @@ int main(int argc, char *argv[])
                 }
                 break;
             }
+            case 'b':          /* block size */
+            {
+                uint32_t n = 0;
+                sscanf(optarg, "%u%n", &bsize, &n);
+                if (n != strlen(optarg) || bsize < MIN_BLOCK_SIZE || bsize > MAX_BLOCK_SIZE
+                        || (bsize & (bsize - 1)) != 0)
+                {
+                    fprintf(stderr, "%s: Wrong block size value.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
             case 'c':          /* number of blocks per cluster */
             {
                 uint32_t n = 0;
                 sscanf(optarg, "%u%n", &csize, &n);
-                if (n != strlen(optarg) || csize < 1 || csize > 8)
+                if (n != strlen(optarg) || csize < 1)
                 {
                     fprintf(stderr, "%s: Wrong number of blocks per cluster value.\n",
                             basename(argv[0]));
@@ -96,11 +119,29 @@ int main(int argc, char *argv[])
                 }
                 break;
             }
+            case 'j':          /* number of blocks of the journal */
+            {
+                uint32_t n = 0, j;
+                sscanf(optarg, "%u%n", &j, &n);
+                if (n != strlen(optarg))
+                {
+                    fprintf(stderr, "%s: Wrong journal size value.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                jsize = j;
+                break;
+            }
             case 'q':          /* quiet mode */
             {
                 quiet = true;
                 break;
             }
+            case 'l':          /* lazy mode */
+            {
+                lazy = true;
+                break;
+            }
             case 'z':          /* zero mode */
             {
                 zero = true;
@@ -129,16 +170,46 @@ int main(int argc, char *argv[])
     }
     const char *devname = argv[optind];
 
+    /* clusters are limited in size, whatever the block size */
+    if (csize * bsize > MAX_CLUSTER_SIZE)
+    {
+        fprintf(stderr, "%s: Wrong number of blocks per cluster value.\n", basename(argv[0]));
+        printUsage(basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+
+    /* a journal must hold a few clusters, besides its descriptor */
+    if (jsize > 0 && jsize < (JOURNAL_MIN_CLUSTERS + 1) * csize)
+    {
+        fprintf(stderr, "%s: Wrong journal size value.\n", basename(argv[0]));
+        printUsage(basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+
     try
     {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
         /* open the storage device */
         uint32_t ntotal;
-        soOpenRawDisk(devname, &ntotal);
+        soOpenRawDisk(devname);
+        soSetRawBlockSize(bsize, &ntotal);
 
         /* if itotal not set, apply default value */
         if (itotal == 0)
             itotal = ntotal / 8;
 
+        /* if jsize not set, apply default value, leaving small devices without a journal */
+        if (jsize == -1)
+        {
+            jsize = (ntotal / 32 < JOURNAL_DEFAULT_MAX) ? ntotal / 32 : JOURNAL_DEFAULT_MAX;
+            if (jsize < (JOURNAL_MIN_CLUSTERS + 1) * csize)
+                jsize = 0;
+        }
+        if (jsize >= ntotal / 2)
+            throw SOException(ENOSPC, "journal");
+
         if (!quiet)
             infoMsg("Trying to install a %ld-inodes SOFS16 file system in %s.\n", itotal,
                     argv[optind]);
@@ -147,7 +218,7 @@ int main(int argc, char *argv[])
         if (!quiet)
             infoMsg("  Filling in the superblock fields... ");
         SOSuperBlock sb;
-        fillInSuperBlock(&sb, volname, ntotal, itotal, csize);
+        fillInSuperBlock(&sb, volname, ntotal, itotal, csize, jsize, lazy);
         if (!quiet)
             infoMsg("done.\n");
 
@@ -158,6 +229,13 @@ int main(int argc, char *argv[])
         if (!quiet)
             infoMsg("done.\n");
 
+        /* filling in the journal: */
+        if (!quiet)
+            infoMsg("  Filling in the journal... ");
+        fillInJournal(&sb);
+        if (!quiet)
+            infoMsg("done.\n");
+
         /* filling in the root directory: */
         if (!quiet)
             infoMsg("  Filling in the root directory... ");
@@ -182,15 +260,24 @@ int main(int argc, char *argv[])
                 infoMsg("done\n");
         }
 
-        /* set magic number and save superblock */
+        /* set magic number and save superblock, at the start of an otherwise empty block */
         sb.magic = MAGIC_NUMBER;
-        soWriteRawBlock(0, &sb);
+        uint8_t block[bsize];
+        memset(block, 0, bsize);
+        memcpy(block, &sb, sizeof(sb));
+        soWriteRawBlock(0, block);
 
         /* close device and quit */
         soCloseRawDisk();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
         if (!quiet)
+        {
             infoMsg("A %ld-inodes SOFS16 file system was successfully installed in %s.\n",
                     sb.itotal, argv[optind]);
+            double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+            double gib = (double) sb.ntotal * bsize / (1 << 30);
+            infoMsg("Formatted in %.3f s (%.3f s/GiB).\n", secs, secs / gib);
+        }
     }
     catch(SOException & err)
     {
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "metrics.h"
+
+/* *************************************** */
+
+/* values up to 2^MAX_SHIFT nanoseconds are told apart, larger ones go in the last bucket */
+#define MAX_SHIFT 40
+
+/* buckets: 8 for values under 8, then 8 for each power of 2, then one for larger values */
+#define SUB_BITS 3
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define NBUCKETS ((MAX_SHIFT - SUB_BITS + 2) * SUB_BUCKETS + 1)
+
+struct Histogram
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t bucket[NBUCKETS];
+};
+
+/* the metrics of a thread */
+struct Metrics
+{
+    Metrics *next;          /* next in the list of all threads */
+    uint64_t counter[C_NCOUNTERS];
+    Histogram timer[T_NTIMERS];
+};
+
+static const char *counterNames[] = {
+    "raw_bytes_read", "raw_bytes_written", "journal_blocks", "journal_overflows",
+    "inode_hits", "inode_misses", "wbuffer_hits", "wbuffer_misses",
+    "traversals", "traversal_steps"
+};
+
+static const char *timerNames[] = {
+    "getattr", "access", "mknod", "mkdir", "unlink", "rmdir", "rename", "link",
+    "chmod", "chown", "truncate", "utime", "statfs", "open", "read", "read_buf",
+    "write", "flush", "release", "fsync", "opendir", "readdir", "releasedir",
+    "fsyncdir", "symlink", "readlink", "setxattr", "getxattr", "listxattr",
+    "removexattr", "getdir",
+    "soReadRawBlock", "soWriteRawBlock", "soReadRawCluster", "soWriteRawCluster",
+    "sbSave", "iOpen", "iSave", "iGetFreeInode",
+    "soReadCluster", "soWriteCluster", "soWriteClusters",
+    "jReadBlocks", "jWriteBlocks", "jWriteData", "jCommit",
+    "soAllocInode", "soFreeInode", "soAllocCluster", "soFreeCluster", "soReplenish", "soDeplete"
+};
+
+static_assert(sizeof(counterNames) / sizeof(counterNames[0]) == C_NCOUNTERS, "a counter has no name");
+static_assert(sizeof(timerNames) / sizeof(timerNames[0]) == T_NTIMERS, "a timer has no name");
+
+bool soMetricsEnabled = false;
+
+/* metrics of all threads that ever used them */
+static Metrics *volatile all = NULL;
+
+/* metrics of the calling thread */
+static __thread Metrics *mine = NULL;
+
+/* *************************************** */
+
+void soEnableMetrics(bool on)
+{
+    soMetricsEnabled = on;
+}
+
+/* *************************************** */
+
+static Metrics *getMetrics()
+{
+    if (mine != NULL)
+        return mine;
+
+    Metrics *m = (Metrics *) calloc(1, sizeof(Metrics));
+    if (m == NULL)
+        return NULL;
+    for (uint32_t i = 0; i < T_NTIMERS; i++)
+        m->timer[i].min = UINT64_MAX;
+    do
+        m->next = all;
+    while (!__sync_bool_compare_and_swap(&all, m->next, m));
+
+    mine = m;
+    return m;
+}
+
+/* *************************************** */
+
+void soAddCount(uint32_t id, uint64_t n)
+{
+    Metrics *m = getMetrics();
+    if (m != NULL)
+        m->counter[id] += n;
+}
+
+/* *************************************** */
+
+uint64_t soClockNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* *************************************** */
+
+/* bucket of a value: the power of 2 it is in, and the next SUB_BITS bits below its leading one */
+static uint32_t bucketOf(uint64_t v)
+{
+    if (v < SUB_BUCKETS)
+        return v;
+    uint32_t e = 63 - __builtin_clzll(v);
+    if (e > MAX_SHIFT)
+        return NBUCKETS - 1;
+    return (e - SUB_BITS + 1) * SUB_BUCKETS + ((v >> (e - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* largest value falling in bucket b */
+static uint64_t bucketLimit(uint32_t b)
+{
+    if (b < SUB_BUCKETS)
+        return b;
+    if (b == NBUCKETS - 1)
+        return UINT64_MAX;
+    uint32_t e = b / SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t base = (uint64_t) (SUB_BUCKETS + b % SUB_BUCKETS) << (e - SUB_BITS);
+    return base + ((uint64_t) 1 << (e - SUB_BITS)) - 1;
+}
+
+void soRecordTime(uint32_t id, uint64_t ns)
+{
+    Metrics *m = getMetrics();
+    if (m == NULL)
+        return;
+
+    /* only this thread writes here; a snapshot may see one update half done, not a torn value */
+    Histogram *h = &m->timer[id];
+    h->count++;
+    h->sum += ns;
+    if (ns < h->min)
+        h->min = ns;
+    if (ns > h->max)
+        h->max = ns;
+    h->bucket[bucketOf(ns)]++;
+}
+
+/* *************************************** */
+
+/* smallest bucket limit under which lie at least the given fraction of the values */
+static uint64_t percentile(const Histogram *h, double q)
+{
+    uint64_t want = (uint64_t) (q * h->count + 0.5);
+    if (want == 0)
+        want = 1;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < NBUCKETS; b++)
+        if ((seen += h->bucket[b]) >= want)
+            return (bucketLimit(b) < h->max) ? bucketLimit(b) : h->max;
+    return h->max;
+}
+
+void soPrintMetrics(FILE *fp)
+{
+    /* the sum of the metrics of every thread */
+    Metrics *sum = (Metrics *) calloc(1, sizeof(Metrics));
+    if (sum == NULL)
+        return;
+    for (uint32_t i = 0; i < T_NTIMERS; i++)
+        sum->timer[i].min = UINT64_MAX;
+    for (Metrics *m = all; m != NULL; m = m->next)
+    {
+        for (uint32_t i = 0; i < C_NCOUNTERS; i++)
+            sum->counter[i] += m->counter[i];
+        for (uint32_t i = 0; i < T_NTIMERS; i++)
+        {
+            Histogram *s = &sum->timer[i], *h = &m->timer[i];
+            s->count += h->count;
+            s->sum += h->sum;
+            if (h->min < s->min)
+                s->min = h->min;
+            if (h->max > s->max)
+                s->max = h->max;
+            for (uint32_t b = 0; b < NBUCKETS; b++)
+                s->bucket[b] += h->bucket[b];
+        }
+    }
+
+    fprintf(fp, "{\n  \"counters\": {");
+    for (uint32_t i = 0; i < C_NCOUNTERS; i++)
+        fprintf(fp, "%s\n    \"%s\": %" PRIu64, (i == 0) ? "" : ",", counterNames[i], sum->counter[i]);
+    fprintf(fp, "\n  },\n  \"latency_ns\": {");
+    bool first = true;
+    for (uint32_t i = 0; i < T_NTIMERS; i++)
+    {
+        Histogram *h = &sum->timer[i];
+        if (h->count == 0)
+            continue;
+        fprintf(fp, "%s\n    \"%s\": {\"count\": %" PRIu64 ", \"sum\": %" PRIu64
+                ", \"min\": %" PRIu64 ", \"max\": %" PRIu64 ", \"p50\": %" PRIu64
+                ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"p999\": %" PRIu64 ", \"buckets\": [",
+                first ? "" : ",", timerNames[i], h->count, h->sum, h->min, h->max,
+                percentile(h, 0.5), percentile(h, 0.9), percentile(h, 0.99), percentile(h, 0.999));
+        bool firstBucket = true;
+        for (uint32_t b = 0; b < NBUCKETS; b++)
+        {
+            if (h->bucket[b] == 0)
+                continue;
+            uint64_t limit = (bucketLimit(b) < h->max) ? bucketLimit(b) : h->max;
+            fprintf(fp, "%s[%" PRIu64 ", %" PRIu64 "]", firstBucket ? "" : ", ", limit, h->bucket[b]);
+            firstBucket = false;
+        }
+        fprintf(fp, "]}");
+        first = false;
+    }
+    fprintf(fp, "\n  }\n}\n");
+
+    free(sum);
+}
+
+/* *************************************** */
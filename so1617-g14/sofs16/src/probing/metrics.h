@@ -0,0 +1,115 @@
+/**
+ *  \file metrics.h
+ *  \brief Run-time counters and latency histograms.
+ *
+ *  Every thread updates its own copy of the counters and histograms, with
+ *  no lock nor atomic instruction; a snapshot adds up the copies of all
+ *  threads, including those that have already ended.
+ *  A histogram keeps the number of values falling in each of a set of
+ *  buckets, 8 per power of 2, so percentiles are known within 1/8.
+ *
+ *  Collection is off until enabled: the cost of a disabled metric is a test.
+ */
+
+#ifndef __SOFS16_METRICS__
+#define __SOFS16_METRICS__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/** \brief counters */
+enum SOCounter
+{
+    C_RAW_BYTES_READ,       ///< bytes read from the device
+    C_RAW_BYTES_WRITTEN,    ///< bytes written to the device
+    C_JOURNAL_BLOCKS,       ///< blocks written to the journal
+    C_JOURNAL_OVERFLOWS,    ///< transactions filled, and committed, in the middle of an operation
+    C_INODE_HITS,           ///< iOpen's of inodes already open
+    C_INODE_MISSES,         ///< iOpen's that read the inode from the table
+    C_WBUFFER_HITS,         ///< lookups of clusters found in the write buffer
+    C_WBUFFER_MISSES,       ///< lookups of clusters not in the write buffer
+    C_TRAVERSALS,           ///< paths traversed
+    C_TRAVERSAL_STEPS,      ///< components looked up while traversing paths
+    C_NCOUNTERS
+};
+
+/** \brief latency histograms, in nanoseconds */
+enum SOTimer
+{
+    /* FUSE operations */
+    T_GETATTR, T_ACCESS, T_MKNOD, T_MKDIR, T_UNLINK, T_RMDIR, T_RENAME, T_LINK,
+    T_CHMOD, T_CHOWN, T_TRUNCATE, T_UTIME, T_STATFS, T_OPEN, T_READ, T_READ_BUF,
+    T_WRITE, T_FLUSH, T_RELEASE, T_FSYNC, T_OPENDIR, T_READDIR, T_RELEASEDIR,
+    T_FSYNCDIR, T_SYMLINK, T_READLINK, T_SETXATTR, T_GETXATTR, T_LISTXATTR,
+    T_REMOVEXATTR, T_GETDIR,
+
+    /* dealers */
+    T_READ_RAW_BLOCK, T_WRITE_RAW_BLOCK, T_READ_RAW_CLUSTER, T_WRITE_RAW_CLUSTER,
+    T_SB_SAVE, T_IOPEN, T_ISAVE, T_IGET_FREE_INODE,
+    T_READ_CLUSTER, T_WRITE_CLUSTER, T_WRITE_CLUSTERS,
+    T_JREAD_BLOCKS, T_JWRITE_BLOCKS, T_JWRITE_DATA, T_JCOMMIT,
+
+    /* free lists */
+    T_ALLOC_INODE, T_FREE_INODE, T_ALLOC_CLUSTER, T_FREE_CLUSTER, T_REPLENISH, T_DEPLETE,
+
+    T_NTIMERS
+};
+
+/** \brief set if metrics are being collected (only to be used by the inline functions below) */
+extern bool soMetricsEnabled;
+
+/**
+ *  \brief Start, or stop, collecting metrics.
+ */
+void soEnableMetrics(bool on);
+
+/* per-thread metrics, set up on first use */
+void soAddCount(uint32_t id, uint64_t n);
+uint64_t soClockNs(void);
+void soRecordTime(uint32_t id, uint64_t ns);
+
+/**
+ *  \brief Add to a counter.
+ *
+ *  \param id the counter
+ *  \param n the amount to add
+ */
+static inline void soCount(uint32_t id, uint64_t n = 1)
+{
+    if (__builtin_expect(soMetricsEnabled, 0))
+        soAddCount(id, n);
+}
+
+/**
+ *  \brief Times the scope it is declared in, recording it in a latency histogram when left.
+ */
+class SOMetricTimer
+{
+  public:
+    SOMetricTimer(uint32_t id) : id(id), t0(__builtin_expect(soMetricsEnabled, 0) ? soClockNs() : 0) {}
+    ~SOMetricTimer()
+    {
+        if (t0 != 0)
+            soRecordTime(id, soClockNs() - t0);
+    }
+
+  private:
+    uint32_t id;
+    uint64_t t0;
+};
+
+/** \brief time the rest of the enclosing scope with the given histogram */
+#define soTime(id) SOMetricTimer __metricTimer(id)
+
+/**
+ *  \brief Print a snapshot of all metrics, as a JSON object.
+ *
+ *  For each counter its value is given; for each histogram with values, their
+ *  number, sum, minimum, maximum, some percentiles and the non-empty buckets,
+ *  each as a pair of its upper limit and number of values.
+ *
+ *  \param fp the output stream
+ */
+void soPrintMetrics(FILE *fp);
+
+#endif /* __SOFS16_METRICS__ */
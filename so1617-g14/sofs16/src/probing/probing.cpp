@@ -5,10 +5,16 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <errno.h>
+#include <time.h>
+#include <sched.h>
 
 #include "probing.h"
+#include "trace.h"
 #include "exception.h"
 
 /* *************************************** */
@@ -19,10 +25,56 @@
 static FILE *fp = stderr;
 
 /* lower limit of probe */
-static uint32_t lowerDepth = 0;
+uint32_t soProbeLowerDepth = 0;
 
 /* upper limit of probe */
-static uint32_t upperDepth = 0;
+uint32_t soProbeUpperDepth = 0;
+
+/* the events recorded by a thread, the last \e size ones kept */
+struct Ring
+{
+    Ring *next;             /* next in the list of rings */
+    uint32_t tid;           /* number of the thread */
+    uint32_t size;          /* number of events kept */
+    volatile uint64_t head; /* number of events ever recorded */
+    SOTraceEvent ev[];
+};
+
+/* set while a trace is open */
+static volatile bool tracing = false;
+
+
+/* file the trace goes to */
+static FILE *tfp = NULL;
+
+/* number of events kept per thread */
+static uint32_t ringEvents = TRACE_RING_EVENTS;
+
+/* rings of the threads that recorded events in the open trace */
+static Ring *volatile rings = NULL;
+
+/* number of threads that recorded events, and of events lost by them */
+static uint32_t nthreads = 0;
+static uint64_t nlost = 0;
+
+/* each trace opened gets a new generation, so threads take new rings */
+static uint32_t generation = 0;
+
+/* what a thread records through: one per thread that ever recorded an event, never freed, so that
+ * closing the trace can always look at it; each in a cache line of its own, as only its thread writes it */
+struct Recorder
+{
+    Recorder *next;         /* next in the list of recorders */
+    volatile bool busy;     /* set while recording an event; the rings are not freed while any is */
+    uint32_t generation;    /* the ring is valid if this is the current generation */
+    Ring *ring;             /* ring of the thread */
+} __attribute__((aligned(64)));
+
+/* recorders of all threads that ever recorded */
+static Recorder *volatile recorders = NULL;
+
+/* recorder of the calling thread */
+static __thread Recorder *myRecorder = NULL;
 
 /* *************************************** */
 
@@ -63,39 +115,564 @@ void soSetProbeDepths(uint32_t lower, uint32_t upper)
         throw SOException(EINVAL, __FUNCTION__);
 
     /* set depths */
-    lowerDepth = lower;
-    upperDepth = upper;
+    soProbeLowerDepth = lower;
+    soProbeUpperDepth = upper;
+}
+
+/* *************************************** */
+
+/* ring of the calling thread, set up on its first event in the open trace */
+static Ring *getRing()
+{
+    Recorder *rec = myRecorder;
+    if (rec->generation == generation)
+        return rec->ring;
+
+    Ring *r = (Ring *) malloc(offsetof(Ring, ev) + (size_t) ringEvents * sizeof(SOTraceEvent));
+    if (r == NULL)
+        return NULL;
+    r->tid = __sync_add_and_fetch(&nthreads, 1);
+    r->size = ringEvents;
+    r->head = 0;
+    do
+        r->next = rings;
+    while (!__sync_bool_compare_and_swap(&rings, r->next, r));
+
+    rec->ring = r;
+    rec->generation = generation;
+    return r;
+}
+
+/* store a word of arguments, if there is room for it */
+static bool putWord(SOTraceEvent *ep, uint64_t w)
+{
+    if (ep->size + sizeof(uint64_t) > TRACE_ARGS_SIZE)
+    {
+        ep->flags |= TRACE_TRUNCATED;
+        return false;
+    }
+    memcpy(ep->args + ep->size, &w, sizeof(uint64_t));
+    ep->size += sizeof(uint64_t);
+    return true;
+}
+
+/* store a string, cut short if there is no room for all of it */
+static bool putString(SOTraceEvent *ep, const char *str)
+{
+    if (str == NULL)
+        str = "(null)";
+
+    uint32_t room = TRACE_ARGS_SIZE - ep->size;
+    if (room == 0)
+    {
+        ep->flags |= TRACE_TRUNCATED;
+        return false;
+    }
+    uint32_t len = strnlen(str, room - 1);
+    if (str[len] != '\0')
+        ep->flags |= TRACE_TRUNCATED;
+    memcpy(ep->args + ep->size, str, len);
+    memset(ep->args + ep->size + len, 0, ((len + 8) & ~7U) - len);
+    ep->size += (len + 8) & ~7U;
+    return true;
+}
+
+/*
+ * Parse the next conversion of a format string:
+ *   on return, *flenp holds the length modifier, and the conversion character is returned,
+ *   with *pp pointing past it; the width and precision are skipped, and *nstarp is the
+ *   number of them given as arguments
+ */
+static char parseConversion(const char **pp, char *flenp, int *nstarp)
+{
+    const char *p = *pp;
+    *nstarp = 0;
+    *flenp = '\0';
+
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL)
+        p++;
+    if (*p == '*')
+        (*nstarp)++, p++;
+    else
+        while (*p >= '0' && *p <= '9')
+            p++;
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+            (*nstarp)++, p++;
+        else
+            while (*p >= '0' && *p <= '9')
+                p++;
+    }
+
+    /* length modifiers: H and Q stand for hh and ll */
+    if (*p == 'h')
+        *flenp = (*++p == 'h') ? (p++, 'H') : 'h';
+    else if (*p == 'l')
+        *flenp = (*++p == 'l') ? (p++, 'Q') : 'l';
+    else if (*p != '\0' && strchr("qLjzt", *p) != NULL)
+        *flenp = (*p == 'q') ? (p++, 'Q') : *p++;
+
+    *pp = (*p == '\0') ? p : p + 1;
+    return *p;
+}
+
+/* start recording an event, if a trace is open; leaveRecording must follow if so */
+static bool enterRecording()
+{
+    Recorder *rec = myRecorder;
+    if (rec == NULL)
+    {
+        if (posix_memalign((void **) &rec, __alignof__(Recorder), sizeof(Recorder)) != 0)
+            return false;
+        rec->busy = false;
+        rec->generation = 0;
+        rec->ring = NULL;
+        do
+            rec->next = recorders;
+        while (!__sync_bool_compare_and_swap(&recorders, rec->next, rec));
+        myRecorder = rec;
+    }
+
+    /* either the closing thread sees the recorder busy, or this one sees the trace closed */
+    rec->busy = true;
+    __sync_synchronize();
+    if (tracing)
+        return true;
+
+    rec->busy = false;
+    return false;
+}
+
+static void leaveRecording()
+{
+    /* the event is complete before the rings can be freed */
+    __atomic_store_n(&myRecorder->busy, false, __ATOMIC_RELEASE);
+}
+
+/* record a message in the ring of the calling thread */
+static void record(uint32_t depth, const char *color, const char *fmt, va_list ap)
+{
+    Ring *r = getRing();
+    if (r == NULL)
+    {
+        __sync_fetch_and_add(&nlost, 1);
+        return;
+    }
+
+    uint64_t h = r->head;
+    SOTraceEvent *ep = &r->ev[h % r->size];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ep->ts = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    ep->fmt = (uintptr_t) fmt;
+    ep->color = (uintptr_t) color;
+    ep->depth = depth;
+    ep->tid = r->tid;
+    ep->size = 0;
+    ep->flags = (color != NULL) ? TRACE_COLORED : 0;
+
+    /* the arguments are taken as the conversions ask for them */
+    for (const char *p = fmt; (p = strchr(p, '%')) != NULL; )
+    {
+        p++;
+        char flen;
+        int nstar;
+        char conv = parseConversion(&p, &flen, &nstar);
+        bool room = true;
+        for (int i = 0; i < nstar; i++)
+            room = room && putWord(ep, (int64_t) va_arg(ap, int));
+        if (!room)
+            break;
+
+        int64_t sv;
+        uint64_t uv;
+        double dv;
+        switch (conv)
+        {
+            case 'd': case 'i':
+                switch (flen)
+                {
+                    case 'H': sv = (signed char) va_arg(ap, int); break;
+                    case 'h': sv = (short) va_arg(ap, int); break;
+                    case 'l': sv = va_arg(ap, long); break;
+                    case 'Q': sv = va_arg(ap, long long); break;
+                    case 'j': sv = va_arg(ap, intmax_t); break;
+                    case 'z': sv = va_arg(ap, ssize_t); break;
+                    case 't': sv = va_arg(ap, ptrdiff_t); break;
+                    default: sv = va_arg(ap, int); break;
+                }
+                room = putWord(ep, sv);
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                switch (flen)
+                {
+                    case 'H': uv = (unsigned char) va_arg(ap, unsigned int); break;
+                    case 'h': uv = (unsigned short) va_arg(ap, unsigned int); break;
+                    case 'l': uv = va_arg(ap, unsigned long); break;
+                    case 'Q': uv = va_arg(ap, unsigned long long); break;
+                    case 'j': uv = va_arg(ap, uintmax_t); break;
+                    case 'z': uv = va_arg(ap, size_t); break;
+                    case 't': uv = va_arg(ap, ptrdiff_t); break;
+                    default: uv = va_arg(ap, unsigned int); break;
+                }
+                room = putWord(ep, uv);
+                break;
+            case 'c':
+                room = putWord(ep, (unsigned char) va_arg(ap, int));
+                break;
+            case 'p':
+                room = putWord(ep, (uintptr_t) va_arg(ap, void *));
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                dv = (flen == 'L') ? (double) va_arg(ap, long double) : va_arg(ap, double);
+                memcpy(&uv, &dv, sizeof(uint64_t));
+                room = putWord(ep, uv);
+                break;
+            case 's':
+                room = putString(ep, va_arg(ap, const char *));
+                break;
+            case 'n':
+                (void) va_arg(ap, void *);
+                break;
+        }
+        if (!room)
+            break;
+    }
+
+    /* the event is complete before the ring says so */
+    __sync_synchronize();
+    r->head = h + 1;
 }
 
 /* *************************************** */
 
-void soProbe(uint32_t depth, const char *fmt, ...)
+/* Print a recorded message, one conversion at a time */
+int soPrintTraceEvent(FILE *fp, const char *fmt, const SOTraceEvent *ep)
+{
+    int n = 0;
+    uint32_t pos = 0;
+    const char *p = fmt;
+
+    while (*p != '\0')
+    {
+        /* plain text up to the next conversion */
+        const char *q = strchr(p, '%');
+        if (q == NULL)
+            q = p + strlen(p);
+        n += fprintf(fp, "%.*s", (int) (q - p), p);
+        if (*q == '\0')
+            break;
+
+        /* the conversion, without its length modifier */
+        const char *start = q;
+        q++;
+        char flen;
+        int nstar;
+        char conv = parseConversion(&q, &flen, &nstar);
+        if (conv == '%')
+        {
+            n += fprintf(fp, "%%");
+            p = q;
+            continue;
+        }
+        char spec[32];
+        uint32_t len = 0;
+        for (const char *s = start; s < q - 1 && len < sizeof(spec) - 4; s++)
+            if (strchr("hlqLjzt", *s) == NULL)
+                spec[len++] = *s;
+        spec[len] = '\0';
+        p = q;
+
+        /* the values it took */
+        int star[2] = { 0, 0 };
+        uint64_t w = 0;
+        bool missing = false;
+        for (int i = 0; i < nstar && !missing; i++, pos += sizeof(uint64_t))
+        {
+            if (pos + sizeof(uint64_t) > ep->size)
+                missing = true;
+            else
+                memcpy(&w, ep->args + pos, sizeof(uint64_t)), star[i] = (int) w;
+        }
+        if (conv == 'n')
+            continue;
+        if (conv != '\0' && strchr("diuoxXcpfFeEgGaA", conv) != NULL && !missing)
+        {
+            if (pos + sizeof(uint64_t) > ep->size)
+                missing = true;
+            else
+                memcpy(&w, ep->args + pos, sizeof(uint64_t)), pos += sizeof(uint64_t);
+        }
+        if (missing || (conv == 's' && pos >= ep->size))
+        {
+            /* the rest did not fit in the event */
+            n += fprintf(fp, "...\n");
+            break;
+        }
+
+        double dv;
+        const char *sv;
+        switch (conv)
+        {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+                strcat(spec, "ll");
+                spec[len + 2] = conv;
+                spec[len + 3] = '\0';
+                if (nstar == 2)
+                    n += fprintf(fp, spec, star[0], star[1], w);
+                else if (nstar == 1)
+                    n += fprintf(fp, spec, star[0], w);
+                else
+                    n += fprintf(fp, spec, w);
+                break;
+            case 'c': case 'p': case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec[len] = conv;
+                spec[len + 1] = '\0';
+                memcpy(&dv, &w, sizeof(double));
+                if (strchr("cp", conv) == NULL)
+                    n += (nstar == 2) ? fprintf(fp, spec, star[0], star[1], dv)
+                        : (nstar == 1) ? fprintf(fp, spec, star[0], dv) : fprintf(fp, spec, dv);
+                else if (conv == 'c')
+                    n += (nstar == 1) ? fprintf(fp, spec, star[0], (int) w) : fprintf(fp, spec, (int) w);
+                else
+                    n += (nstar == 1) ? fprintf(fp, spec, star[0], (void *) (uintptr_t) w)
+                        : fprintf(fp, spec, (void *) (uintptr_t) w);
+                break;
+            case 's':
+                spec[len] = conv;
+                spec[len + 1] = '\0';
+                sv = (const char *) ep->args + pos;
+                pos += (strnlen(sv, ep->size - pos) + 8) & ~7U;
+                if (nstar == 2)
+                    n += fprintf(fp, spec, star[0], star[1], sv);
+                else if (nstar == 1)
+                    n += fprintf(fp, spec, star[0], sv);
+                else
+                    n += fprintf(fp, spec, sv);
+                break;
+            default:
+                n += fprintf(fp, "%s%c", spec, conv);
+                break;
+        }
+    }
+
+    return n;
+}
+
+/* *************************************** */
+
+static int byTime(const void *a, const void *b)
+{
+    const SOTraceEvent *x = (const SOTraceEvent *) a;
+    const SOTraceEvent *y = (const SOTraceEvent *) b;
+    return (x->ts < y->ts) ? -1 : (x->ts > y->ts) ? 1 : (int) x->tid - (int) y->tid;
+}
+
+static int byKey(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x < y) ? -1 : (x > y);
+}
+
+/* write the events of all rings, sorted by time, after the strings they refer to */
+static void writeTrace(FILE *fs)
+{
+    uint64_t total = 0;
+    uint64_t lost = nlost;
+    for (Ring *r = rings; r != NULL; r = r->next)
+    {
+        uint64_t h = r->head;
+        total += (h < r->size) ? h : r->size;
+        lost += (h < r->size) ? 0 : h - r->size;
+    }
+
+    SOTraceEvent *ev = (SOTraceEvent *) malloc((total + 1) * sizeof(SOTraceEvent));
+    uint64_t *keys = (uint64_t *) malloc((2 * total + 1) * sizeof(uint64_t));
+    if (ev == NULL || keys == NULL)
+    {
+        free(ev);
+        free(keys);
+        throw SOException(ENOMEM, __FUNCTION__);
+    }
+
+    uint64_t n = 0;
+    for (Ring *r = rings; r != NULL; r = r->next)
+    {
+        uint64_t h = r->head;
+        __sync_synchronize();
+        for (uint64_t i = (h < r->size) ? 0 : h - r->size; i < h; i++)
+            ev[n++] = r->ev[i % r->size];
+    }
+    qsort(ev, n, sizeof(SOTraceEvent), byTime);
+
+    /* the strings, each once */
+    uint32_t nkeys = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        keys[nkeys++] = ev[i].fmt;
+        if (ev[i].flags & TRACE_COLORED)
+            keys[nkeys++] = ev[i].color;
+    }
+    qsort(keys, nkeys, sizeof(uint64_t), byKey);
+    uint32_t nf = 0;
+    for (uint32_t i = 0; i < nkeys; i++)
+        if (nf == 0 || keys[i] != keys[nf - 1])
+            keys[nf++] = keys[i];
+
+    SOTraceHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.nformats = nf;
+    hdr.nthreads = nthreads;
+    hdr.nevents = n;
+    hdr.lost = lost;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fs) == 1;
+    for (uint32_t i = 0; i < nf && ok; i++)
+    {
+        const char *str = (const char *) (uintptr_t) keys[i];
+        SOTraceFormat f;
+        f.key = keys[i];
+        f.len = strlen(str) + 1;
+        f.flags = 0;
+        ok = fwrite(&f, sizeof(f), 1, fs) == 1 && fwrite(str, f.len, 1, fs) == 1;
+    }
+    if (ok && n > 0)
+        ok = fwrite(ev, sizeof(SOTraceEvent), n, fs) == n;
+
+    free(ev);
+    free(keys);
+    if (!ok)
+        throw SOException(EIO, __FUNCTION__);
+}
+
+/* *************************************** */
+
+/* a trace still open is written when the program ends */
+static void closeAtExit(void)
+{
+    try
+    {
+        soCloseTrace();
+    }
+    catch (SOException & err)
+    {
+        fprintf(stderr, "%s: %s\n", err.msg, strerror(err.en));
+    }
+}
+
+void soOpenTrace(const char *path, uint32_t nevents)
+{
+    static bool registered = false;
+
+    /* check arguments */
+    if (path == NULL || nevents == 0)
+        throw SOException(EINVAL, __FUNCTION__);
+
+    soCloseTrace();
+    if ((tfp = fopen(path, "w")) == NULL)
+        throw SOException(errno, __FUNCTION__);
+    if (!registered)
+    {
+        atexit(closeAtExit);
+        registered = true;
+    }
+
+    ringEvents = nevents;
+    rings = NULL;
+    nthreads = 0;
+    nlost = 0;
+    generation++;
+    __sync_synchronize();
+    tracing = true;
+}
+
+/* *************************************** */
+
+void soCloseTrace(void)
+{
+    if (!tracing)
+        return;
+
+    /* threads probing from now on go back to printing; those already recording are waited for,
+     * as their rings are written and freed next */
+    tracing = false;
+    __sync_synchronize();
+    for (Recorder *rec = recorders; rec != NULL; rec = rec->next)
+        while (rec->busy)
+            sched_yield();
+
+    FILE *fs = tfp;
+    tfp = NULL;
+    try
+    {
+        writeTrace(fs);
+    }
+    catch (...)
+    {
+        fclose(fs);
+        throw;
+    }
+    if (fclose(fs) != 0)
+        throw SOException(errno, __FUNCTION__);
+
+    while (rings != NULL)
+    {
+        Ring *r = rings;
+        rings = r->next;
+        free(r);
+    }
+}
+
+/* *************************************** */
+
+void (soProbe)(uint32_t depth, const char *fmt, ...)
 {
     /* do nothing, if out of active range */
-    if ((depth < lowerDepth) || (depth > upperDepth))
+    if ((depth < soProbeLowerDepth) || (depth > soProbeUpperDepth))
         return;
 
-    /* print the message */
-    fprintf(fp, "\e[01;34m(%d)-->\e[0m ", depth);
     va_list ap;
     va_start(ap, fmt);
-    vfprintf(fp, fmt, ap);
+    if (tracing && enterRecording())
+    {
+        /* record the message */
+        record(depth, NULL, fmt, ap);
+        leaveRecording();
+    }
+    else
+    {
+        /* print the message */
+        fprintf(fp, "\e[01;34m(%d)-->\e[0m ", depth);
+        vfprintf(fp, fmt, ap);
+    }
     va_end(ap);
 }
 
 /* *************************************** */
 
-void soColorProbe(uint32_t depth, const char *color, const char *fmt, ...)
+void (soColorProbe)(uint32_t depth, const char *color, const char *fmt, ...)
 {
     /* do nothing, if out of active range */
-    if ((depth < lowerDepth) || (depth > upperDepth))
+    if ((depth < soProbeLowerDepth) || (depth > soProbeUpperDepth))
         return;
 
-    /* print the message */
-    fprintf(fp, "\e[%sm(%d)-->\e[0m ", color, depth);
     va_list ap;
     va_start(ap, fmt);
-    vfprintf(fp, fmt, ap);
+    if (tracing && enterRecording())
+    {
+        /* record the message */
+        record(depth, color, fmt, ap);
+        leaveRecording();
+    }
+    else
+    {
+        /* print the message */
+        fprintf(fp, "\e[%sm(%d)-->\e[0m ", color, depth);
+        vfprintf(fp, fmt, ap);
+    }
     va_end(ap);
 }
 
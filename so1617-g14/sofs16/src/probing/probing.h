@@ -10,6 +10,12 @@
  *  Upon writing the code, one should assign a depth to every probing message.
  *  Upon activating the probing system, one sets the range of depths that must be logged or displayed.
  *
+ *  Messages are either printed as they come or, once a trace is open, recorded
+ *  as binary events in a ring buffer of the calling thread, with a timestamp,
+ *  and written to the trace file when it is closed; the showtrace tool prints them.
+ *  Only the depth range is checked, inline, for messages out of it: their
+ *  arguments are not even evaluated.
+ *
  *  \author Artur Carneiro Pereira - 2008-2009, 2016
  *  \author Miguel Oliveira e Silva - 2009
  *  \author António Rui Borges - 2010-2015
@@ -23,6 +29,9 @@
 #include <stdio.h>
 #include <stdint.h>
 
+/** \brief default number of events kept per thread in a binary trace */
+#define TRACE_RING_EVENTS 16384
+
 /**
  *  \brief Opening of the probing system.
  *
@@ -44,15 +53,62 @@ void soCloseProbe(void);
 void soSetProbeDepths(uint32_t lower, uint32_t upper);
 
 /**
- *  \brief Print a probing message with the given depth.
+ *  \brief Open a binary trace: from now on, probing messages are recorded instead of printed.
+ *
+ *  The trace is a flight recorder: every thread keeps its last \e nevents events in memory,
+ *  overwriting older ones, and they are only written to the file when the trace is closed, or
+ *  when the program exits.  A long run thus keeps just its last events; the number of those
+ *  overwritten is stored in the trace, for showtrace to report.
+ *
+ *  \param path name of the trace file
+ *  \param nevents number of events kept per thread; older ones are overwritten
+ */
+void soOpenTrace(const char *path, uint32_t nevents = TRACE_RING_EVENTS);
+
+/**
+ *  \brief Write the binary trace to its file and go back to printing probing messages.
+ *
+ *  Threads in the middle of recording an event are waited for; the next ones print theirs.
+ */
+void soCloseTrace(void);
+
+/** \brief lower and upper probing depths (only to be used by the soProbe macro) */
+extern uint32_t soProbeLowerDepth, soProbeUpperDepth;
+
+/**
+ *  \brief Tell if messages with the given depth are to be printed or recorded.
+ *
+ *  \param depth the probing depth
+ */
+static inline bool soProbeActive(uint32_t depth)
+{
+    return __builtin_expect(depth >= soProbeLowerDepth && depth <= soProbeUpperDepth, 0);
+}
+
+/**
+ *  \brief Print, or record, a probing message with the given depth.
  *
  *  Apart from the \e depth argument it works like the \e fprintf function.
+ *  Only %d, %i, %u, %x, %X, %o, %c, %p, %s, %f, %e and %g conversions, with their
+ *  length modifiers, can be recorded in a trace.
  *
  *  \param depth the probing depth of the message
  *  \param fmt the format string (as in \e fprintf)
  */
 void soProbe(uint32_t depth, const char *fmt, ...);
 
+/**
+ *  \brief Print, or record, a probing message with the given depth, if it is in the active range.
+ *
+ *  The function above remains for code that calls it directly.
+ */
+#define soProbe(depth, ...) \
+    do \
+    { \
+        if (soProbeActive(depth)) \
+            (soProbe)(depth, __VA_ARGS__); \
+    } while (0)
+
 /**
  *  \brief Print a probing message with the given depth and color.
  *
@@ -66,4 +122,14 @@ void soProbe(uint32_t depth, const char *fmt, ...);
  */
 void soColorProbe(uint32_t depth, const char *color, const char *fmt, ...);
 
+/**
+ *  \brief Print, or record, a colored probing message, if its depth is in the active range.
+ */
+#define soColorProbe(depth, color, ...) \
+    do \
+    { \
+        if (soProbeActive(depth)) \
+            (soColorProbe)(depth, color, __VA_ARGS__); \
+    } while (0)
+
 #endif                          /* __SOFS16_PROBING__ */
@@ -0,0 +1,77 @@
+/**
+ *  \file trace.h
+ *  \brief Layout of the binary trace files written by the probing system.
+ *
+ *  A trace file has a header, followed by the table of the format strings
+ *  used by the events, followed by the events themselves, sorted by time.
+ *  Events refer to their format string through the key it has in the table,
+ *  and carry the values of its conversions, each in a 64-bit word, except
+ *  strings, which are copied, null terminated and padded to a whole word.
+ */
+
+#ifndef __SOFS16_TRACE__
+#define __SOFS16_TRACE__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/** \brief magic string at the start of a trace file */
+#define TRACE_MAGIC "SOTRACE1"
+
+/** \brief number of bytes of the arguments of an event */
+#define TRACE_ARGS_SIZE 96
+
+/** \brief the event is to be printed with a color other than the default */
+#define TRACE_COLORED 0x1
+
+/** \brief not all the arguments fitted in the event */
+#define TRACE_TRUNCATED 0x2
+
+/**
+ *  \brief Header of a trace file.
+ */
+struct SOTraceHeader
+{
+    char magic[8];          ///< TRACE_MAGIC
+    uint32_t nformats;      ///< number of format strings that follow
+    uint32_t nthreads;      ///< number of threads that recorded events
+    uint64_t nevents;       ///< number of events that follow the format strings
+    uint64_t lost;          ///< number of events overwritten before the trace was written, or not recorded
+};
+
+/**
+ *  \brief Entry of the table of format strings, followed by the \e len bytes of the string
+ */
+struct SOTraceFormat
+{
+    uint64_t key;           ///< key by which events refer to the string
+    uint32_t len;           ///< length of the string, including the terminating null
+    uint32_t flags;         ///< unused
+};
+
+/**
+ *  \brief A probing message, as recorded in the ring of its thread
+ */
+struct SOTraceEvent
+{
+    uint64_t ts;            ///< monotonic time in nanoseconds
+    uint64_t fmt;           ///< key of the format string
+    uint64_t color;         ///< key of the color string, if TRACE_COLORED
+    uint32_t depth;         ///< probing depth
+    uint32_t tid;           ///< number of the recording thread, from 1
+    uint32_t size;          ///< number of bytes used in \e args
+    uint32_t flags;         ///< TRACE_COLORED, TRACE_TRUNCATED
+    uint8_t args[TRACE_ARGS_SIZE];  ///< values of the conversions
+};
+
+/**
+ *  \brief Print a recorded message as \e fprintf would have printed it.
+ *
+ *  \param fp the output stream
+ *  \param fmt the format string of the event
+ *  \param ep the event
+ *  \return the number of characters printed
+ */
+int soPrintTraceEvent(FILE *fp, const char *fmt, const SOTraceEvent *ep);
+
+#endif /* __SOFS16_TRACE__ */
@@ -7,6 +7,7 @@
 #include "rawdisk.h"
 
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
 
 #include <sys/stat.h>
@@ -23,6 +24,12 @@
 /* File descriptor of the Linux file that simulates the disk */
 static int fd = -1;
 
+/* Size in bytes of the storage device */
+static off_t dsize = 0;
+
+/* Block size in use */
+static uint32_t bsize = MIN_BLOCK_SIZE;
+
 /* Total number of blocks of the storage device */
 static uint32_t ntotal = 0;
 
@@ -48,15 +55,10 @@ void soOpenRawDisk(const char *devname, uint32_t * np)
     struct stat st;
     if (stat(devname, &st) == -1)
         throw SOException(errno, __FUNCTION__);
-    if ((st.st_size % BLOCK_SIZE) != 0)
-        throw SOException(EMEDIUMTYPE, __FUNCTION__);
+    dsize = st.st_size;
 
-    /* get number of blocks of the device */
-    ntotal = st.st_size / BLOCK_SIZE;
-
-    /* return number of blocks, if requested */
-    if (np != NULL)
-        *np = ntotal;
+    /* get number of blocks of the device, in blocks of the smallest size */
+    soSetRawBlockSize(MIN_BLOCK_SIZE, np);
 }
 
 /* ********************************************* */
@@ -71,6 +73,8 @@ void soCloseRawDisk(void)
 
     /* close the device */
     close(fd);
+    dsize = 0;
+    bsize = MIN_BLOCK_SIZE;
     ntotal = 0;
     fd = -1;
 }
@@ -80,6 +84,7 @@ void soCloseRawDisk(void)
 void soReadRawBlock(uint32_t n, void *buf)
 {
     soProbe(951, "soReadRawBlock(%u, %p)\n", n, buf);
+    soTime(T_READ_RAW_BLOCK);
 
     /* checking arguments */
     if (buf == NULL)
@@ -92,11 +97,9 @@ void soReadRawBlock(uint32_t n, void *buf)
         throw SOException(EBADF, __FUNCTION__);
 
     /* transfer block data */
-    if (lseek(fd, BLOCK_SIZE * n, SEEK_SET) == -1)
-        throw SOException(errno, __FUNCTION__);
-
-    if (read(fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+    if (pread(fd, buf, bsize, (off_t) n * bsize) != (ssize_t) bsize)
         throw SOException(EIO, __FUNCTION__);
+    soCount(C_RAW_BYTES_READ, bsize);
 }
 
 /* ********************************************* */
@@ -104,6 +107,7 @@ void soReadRawBlock(uint32_t n, void *buf)
 void soWriteRawBlock(uint32_t n, void *buf)
 {
     soProbe(961, "soWriteRawBlock(%u, %p)\n", n, buf);
+    soTime(T_WRITE_RAW_BLOCK);
 
     /* checking arguments */
     if (buf == NULL)
@@ -116,10 +120,9 @@ void soWriteRawBlock(uint32_t n, void *buf)
         throw SOException(EBADF, __FUNCTION__);
 
     /* transfer block data */
-    if (lseek(fd, BLOCK_SIZE * n, SEEK_SET) == -1)
-        throw SOException(errno, __FUNCTION__);
-    if (write(fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+    if (pwrite(fd, buf, bsize, (off_t) n * bsize) != (ssize_t) bsize)
         throw SOException(EIO, __FUNCTION__);
+    soCount(C_RAW_BYTES_WRITTEN, bsize);
 }
 
 /* ********************************************* */
@@ -127,6 +130,7 @@ void soWriteRawBlock(uint32_t n, void *buf)
 void soReadRawCluster(uint32_t n, void *buf, uint32_t csize)
 {
     soProbe(855, "soReadRawCluster(%u, %p, %u)\n", n, buf, csize);
+    soTime(T_READ_RAW_CLUSTER);
 
     /* checking arguments */
     if (buf == NULL)
@@ -139,10 +143,9 @@ void soReadRawCluster(uint32_t n, void *buf, uint32_t csize)
         throw SOException(EBADF, __FUNCTION__);
 
     /* transfer cluster data */
-    if (lseek(fd, BLOCK_SIZE * n, SEEK_SET) == -1)
-        throw SOException(errno, __FUNCTION__);
-    if (read(fd, buf, csize * BLOCK_SIZE) != (ssize_t)(csize * BLOCK_SIZE))
+    if (pread(fd, buf, csize * bsize, (off_t) n * bsize) != (ssize_t)(csize * bsize))
         throw SOException(EIO, __FUNCTION__);
+    soCount(C_RAW_BYTES_READ, csize * bsize);
 }
 
 /* ********************************************* */
@@ -150,6 +153,7 @@ void soReadRawCluster(uint32_t n, void *buf, uint32_t csize)
 void soWriteRawCluster(uint32_t n, void *buf, uint32_t csize)
 {
     soProbe(856, "soWriteRawCluster(%u, %p, %u)\n", n, buf, csize);
+    soTime(T_WRITE_RAW_CLUSTER);
 
     /* checking arguments */
     if (buf == NULL)
@@ -162,10 +166,59 @@ void soWriteRawCluster(uint32_t n, void *buf, uint32_t csize)
         throw SOException(EBADF, __FUNCTION__);
 
     /* transfer cluster data */
-    if (lseek(fd, BLOCK_SIZE * n, SEEK_SET) == -1)
-        throw SOException(errno, __FUNCTION__);
-    if (write(fd, buf, csize * BLOCK_SIZE) != (ssize_t)(csize * BLOCK_SIZE))
+    if (pwrite(fd, buf, csize * bsize, (off_t) n * bsize) != (ssize_t)(csize * bsize))
         throw SOException(EIO, __FUNCTION__);
+    soCount(C_RAW_BYTES_WRITTEN, csize * bsize);
+}
+
+/* ********************************************* */
+
+void soSetRawBlockSize(uint32_t size, uint32_t * np)
+{
+    soProbe(981, "soSetRawBlockSize(%u, %p)\n", size, np);
+
+    /* checking for device open state */
+    if (fd == -1)
+        throw SOException(EBADF, __FUNCTION__);
+
+    /* checking arguments */
+    if (size < MIN_BLOCK_SIZE || size > MAX_BLOCK_SIZE || (size & (size - 1)) != 0)
+        throw SOException(EINVAL, __FUNCTION__);
+
+    /* checking device for conformity */
+    if ((dsize % size) != 0)
+        throw SOException(EMEDIUMTYPE, __FUNCTION__);
+
+    /* block numbers are 32 bits wide */
+    if ((uint64_t) dsize / size > UINT32_MAX)
+        throw SOException(EFBIG, __FUNCTION__);
+
+    bsize = size;
+    ntotal = dsize / size;
+
+    /* return number of blocks, if requested */
+    if (np != NULL)
+        *np = ntotal;
+}
+
+/* ********************************************* */
+
+uint32_t soGetRawBlockSize(void)
+{
+    return bsize;
+}
+
+/* ********************************************* */
+
+int soGetRawDiskFd(void)
+{
+    soProbe(971, "soGetRawDiskFd()\n");
+
+    /* checking for device open state */
+    if (fd == -1)
+        throw SOException(EBADF, __FUNCTION__);
+
+    return fd;
 }
 
 /* ********************************************* */
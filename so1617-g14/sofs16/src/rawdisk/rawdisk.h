@@ -9,7 +9,9 @@
  *    \li read a block of data from the storage device
  *    \li write a block of data to the storage device
  *    \li read a cluster of data from the storage device
- *    \li write a cluster of data to the storage device.
+ *    \li write a cluster of data to the storage device
+ *    \li set and get the block size of the storage device
+ *    \li get the file descriptor of the storage device.
  *
  *  \author Artur Carneiro Pereira - 2007-2009, 2016
  *  \author Miguel Oliveira e Silva - 2009
@@ -26,8 +28,11 @@
 
 /* ***************************************** */
 
-/** \brief block size (in bytes) */
-#define BLOCK_SIZE 512U
+/** \brief smallest block size (in bytes), the one in use right after opening the device */
+#define MIN_BLOCK_SIZE 512U
+
+/** \brief largest block size (in bytes) */
+#define MAX_BLOCK_SIZE 65536U
 
 /* ***************************************** */
 
@@ -37,7 +42,8 @@
  *  A communication channel is established with the storage device.
  *  It is supposed that no communication channel was previously established.
  *  The Linux file that simulates the storage device must exist and
- *  have a size multiple of the block size.
+ *  have a size multiple of the smallest block size, which is the block size in use
+ *  until soSetRawBlockSize is called.
  *
  *  \param devname absolute path to the Linux file that simulates the storage device
  *  \param np if not null, 
@@ -99,4 +105,40 @@ void soWriteRawCluster(uint32_t n, void *buf, uint32_t csize);
 
 /* ***************************************** */
 
+/**
+ *  \brief Set the block size of the storage device.
+ *
+ *  Every subsequent block and cluster transfer, and every block number, is expressed
+ *  in blocks of the given size. The size of the device must be a multiple of it.
+ *
+ *  \param bsize block size in bytes: a power of 2, between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE
+ *  \param np if not null,
+ *      pointer to a location where the number of blocks of the device is to be stored
+ */
+void soSetRawBlockSize(uint32_t bsize, uint32_t * np = NULL);
+
+/* ***************************************** */
+
+/**
+ *  \brief Get the block size of the storage device.
+ *
+ *  \return the block size in bytes
+ */
+uint32_t soGetRawBlockSize(void);
+
+/* ***************************************** */
+
+/**
+ *  \brief Get the file descriptor of the storage device.
+ *
+ *  Meant for data paths that read whole (offset, length) ranges of the storage device
+ *  at once, instead of one cluster at a time.
+ *  The descriptor must not be closed nor have its offset relied upon by the caller.
+ *
+ *  \return the file descriptor of the storage device
+ */
+int soGetRawDiskFd(void);
+
+/* ***************************************** */
+
 #endif                          /* __SOFS16_RAWDISK__ */
@@ -14,11 +14,15 @@
 #include <pthread.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
 #include <fuse.h>
 #include <fuse/fuse.h>
 
 #include "probing.h"
+#include "metrics.h"
 #include "exception.h"
+#include "rawdisk.h"
 #include "direntry.h"
 #include "syscalls.h"
 
@@ -31,9 +35,69 @@ static pthread_mutex_t accessCR = PTHREAD_MUTEX_INITIALIZER;    /* locking flag
 
 /* ***************************************************** */
 
+/*
+ *  Periodic commit of the metadata journal, so the changes of every operation
+ *  done in an interval are grouped in a single transaction
+ */
+#define COMMIT_INTERVAL 5                                           /* in seconds */
+
+static pthread_t committer;
+static pthread_cond_t committerStop = PTHREAD_COND_INITIALIZER;
+static bool mounted = false;
+
+static void *sofs_committer(void *arg)
+{
+    pthread_mutex_lock(&accessCR);
+    while (mounted)
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += COMMIT_INTERVAL;
+
+        /* operations are serialized by accessCR, so none is half done here */
+        if (pthread_cond_timedwait(&committerStop, &accessCR, &t) == ETIMEDOUT && mounted)
+            soSync();
+    }
+    pthread_mutex_unlock(&accessCR);
+    return NULL;
+}
+
+/* ***************************************************** */
+
 /* SOFS16 support filename (should be the absolute path) */
 static char *sofs_supp_file = NULL;
 
+/* ***************************************************** */
+
+/*
+ *  Virtual read-only file, in the root directory, whose contents are a snapshot
+ *  of the metrics (see metrics.h), in JSON, taken when it is opened.
+ *  It is not listed, and hides a file of the same name.
+ */
+#define STATS_PATH "/.sofs-stats"
+
+/* a snapshot, pointed to by the fh field of the fuse file information while open */
+struct StatsSnapshot
+{
+    char *text;
+    size_t size;
+};
+
+static bool isStats(const char *path)
+{
+    return strcmp(path, STATS_PATH) == 0;
+}
+
+/* the part of the snapshot to be returned by a read */
+static size_t statsSlice(struct fuse_file_info *fi, size_t count, off_t pos, const char **startp)
+{
+    StatsSnapshot *snap = (StatsSnapshot *) (uintptr_t) fi->fh;
+    if (pos < 0 || (size_t) pos >= snap->size)
+        return 0;
+    *startp = snap->text + pos;
+    return (count < snap->size - pos) ? count : snap->size - pos;
+}
+
 
 /* ***************************************************** */
 
@@ -56,6 +120,9 @@ static void *sofs_mount(struct fuse_conn_info *fci)
     int stat;
     if ((stat = soOpenFileSystem(sofs_supp_file)) != 0)
         return NULL;
+
+    mounted = true;
+    pthread_create(&committer, NULL, sofs_committer, NULL);
     return sofs_supp_file;
 }
 
@@ -74,6 +141,14 @@ static void sofs_unmount(void *path)
 {
     soProbe(112, "sofs_unmount(\"%s\")\n", (char *)path);
 
+    pthread_mutex_lock(&accessCR);
+    bool wasMounted = mounted;
+    mounted = false;
+    pthread_cond_signal(&committerStop);
+    pthread_mutex_unlock(&accessCR);
+    if (wasMounted)
+        pthread_join(committer, NULL);
+
     pthread_mutex_lock(&accessCR);
     soCloseFileSystem();
     pthread_mutex_unlock(&accessCR);
@@ -97,6 +172,18 @@ static void sofs_unmount(void *path)
 static int sofs_getattr(const char *path, struct stat *st)
 {
     soProbe(113, "sofs_getattr(\"%s\", %p)\n", path, st);
+    soTime(T_GETATTR);
+
+    if (isStats(path))
+    {
+        memset(st, 0, sizeof(struct stat));
+        st->st_mode = S_IFREG | 0444;
+        st->st_nlink = 1;
+        st->st_uid = getuid();
+        st->st_gid = getgid();
+        st->st_atime = st->st_mtime = st->st_ctime = time(NULL);
+        return 0;
+    }
 
     pthread_mutex_lock(&accessCR);
     int ret = soStat(path, st);
@@ -121,6 +208,10 @@ static int sofs_getattr(const char *path, struct stat *st)
 static int sofs_access(const char *path, int opRequested)
 {
     soProbe(114, "sofs_access(\"%s\", %x)\n", path, opRequested);
+    soTime(T_ACCESS);
+
+    if (isStats(path))
+        return (opRequested & (W_OK | X_OK)) ? -EACCES : 0;
 
     pthread_mutex_lock(&accessCR);
     int ret = soAccess(path, opRequested);
@@ -148,6 +239,7 @@ static int sofs_mknod(const char *path, mode_t mode, dev_t rdev)
 {
     soProbe(115, "sofs_mknod(\"%s\", %x, %x)\n", path, (uint32_t) mode,
                  (uint32_t) rdev);
+    soTime(T_MKNOD);
 
     pthread_mutex_lock(&accessCR);
     int ret = soMknod(path, mode);
@@ -170,6 +262,7 @@ static int sofs_mknod(const char *path, mode_t mode, dev_t rdev)
 static int sofs_mkdir(const char *path, mode_t mode)
 {
     soProbe(116, "sofs_mkdir(\"%s\", %x)\n", path, (uint32_t) mode);
+    soTime(T_MKDIR);
 
     pthread_mutex_lock(&accessCR);
     int ret = soMkdir(path, mode);
@@ -191,6 +284,7 @@ static int sofs_mkdir(const char *path, mode_t mode)
 static int sofs_unlink(const char *path)
 {
     soProbe(117, "sofs_unlink(\"%s\")\n", path);
+    soTime(T_UNLINK);
 
     pthread_mutex_lock(&accessCR);
     int ret = soUnlink(path);
@@ -212,6 +306,7 @@ static int sofs_unlink(const char *path)
 static int sofs_rmdir(const char *path)
 {
     soProbe(118, "sofs_rmdir(\"%s\")\n", path);
+    soTime(T_RMDIR);
 
     pthread_mutex_lock(&accessCR);
     int ret = soRmdir(path);
@@ -234,6 +329,7 @@ static int sofs_rmdir(const char *path)
 static int sofs_rename(const char *path, const char *newPath)
 {
     soProbe(119, "sofs_rename(\"%s\", \"%s\")\n", path, newPath);
+    soTime(T_RENAME);
 
     pthread_mutex_lock(&accessCR);
     int ret = soRename(path, newPath);
@@ -255,6 +351,7 @@ static int sofs_rename(const char *path, const char *newPath)
 static int sofs_link(const char *path, const char *newPath)
 {
     soProbe(120, "sofs_link(\"%s\", \"%s\")\n", path, newPath);
+    soTime(T_LINK);
 
     pthread_mutex_lock(&accessCR);
     int ret = soLink(path, newPath);
@@ -276,6 +373,7 @@ static int sofs_link(const char *path, const char *newPath)
 static int sofs_chmod(const char *path, mode_t mode)
 {
     soProbe(121, "sofs_chmod(\"%s\", 0%o)\n", path, (uint32_t) mode);
+    soTime(T_CHMOD);
 
     pthread_mutex_lock(&accessCR);
     int ret = soChmod(path, mode);
@@ -299,6 +397,7 @@ static int sofs_chown(const char *path, uid_t owner, gid_t group)
 {
     soProbe(122, "sofs_chown(\"%s\", %" PRIu32 ", %" PRIu32 ")\n", path,
                  (uint32_t) owner, (uint32_t) group);
+    soTime(T_CHOWN);
 
     pthread_mutex_lock(&accessCR);
     int ret = soChown(path, owner, group);
@@ -320,6 +419,7 @@ static int sofs_chown(const char *path, uid_t owner, gid_t group)
 static int sofs_truncate(const char *path, off_t length)
 {
     soProbe(123, "sofs_truncate(\"%s\", %u)\n", path, (uint32_t) length);
+    soTime(T_TRUNCATE);
 
     pthread_mutex_lock(&accessCR);
     int ret = soTruncate(path, length);
@@ -344,6 +444,7 @@ static int sofs_truncate(const char *path, off_t length)
 static int sofs_utime(const char *path, struct utimbuf *times)
 {
     soProbe(124, "sofs_utime(\"%s\", %p)\n", path, times);
+    soTime(T_UTIME);
 
     pthread_mutex_lock(&accessCR);
     int ret = soUtime(path, times);
@@ -368,6 +469,7 @@ static int sofs_utime(const char *path, struct utimbuf *times)
 static int sofs_statfs(const char *path, struct statvfs *st)
 {
     soProbe(125, "sofs_statfs(\"%s\", %p)\n", path, st);
+    soTime(T_STATFS);
 
     pthread_mutex_lock(&accessCR);
     int ret = soStatFS(path, st);
@@ -396,6 +498,26 @@ static int sofs_statfs(const char *path, struct statvfs *st)
 static int sofs_open(const char *path, struct fuse_file_info *fi)
 {
     soProbe(126, "sofs_open(\"%s\", %p)\n", path, fi);
+    soTime(T_OPEN);
+
+    /* the metrics are taken now; direct_io makes reads ignore the size of 0 */
+    if (isStats(path))
+    {
+        if ((fi->flags & O_ACCMODE) != O_RDONLY)
+            return -EACCES;
+        StatsSnapshot *snap = (StatsSnapshot *) malloc(sizeof(StatsSnapshot));
+        FILE *fs;
+        if (snap == NULL || (fs = open_memstream(&snap->text, &snap->size)) == NULL)
+        {
+            free(snap);
+            return -ENOMEM;
+        }
+        soPrintMetrics(fs);
+        fclose(fs);
+        fi->fh = (uint64_t) (uintptr_t) snap;
+        fi->direct_io = 1;
+        return 0;
+    }
 
     pthread_mutex_lock(&accessCR);
     int ret = soOpen(path, fi->flags);
@@ -428,17 +550,126 @@ static int sofs_open(const char *path, struct fuse_file_info *fi)
 static int sofs_read(const char *path, char *buff, size_t count, off_t pos,
                      struct fuse_file_info *fi)
 {
-    soProbe(127, "sofs_read(\"%s\", %p, %" PRIu32 ", %" PRId32 ", %p)\n", path,
-                 buff, (uint32_t) count, (int32_t) pos, fi);
+    soProbe(127, "sofs_read(\"%s\", %p, %zu, %" PRId64 ", %p)\n", path,
+                 buff, count, (int64_t) pos, fi);
+    soTime(T_READ);
+
+    if (isStats(path))
+    {
+        const char *start = NULL;
+        size_t n = statsSlice(fi, count, pos, &start);
+        if (n > 0)
+            memcpy(buff, start, n);
+        return n;
+    }
 
     pthread_mutex_lock(&accessCR);
-    int n = soRead(path, buff, (uint32_t) count, (int32_t) pos);
+    int n = soRead(path, buff, count, pos);
     pthread_mutex_unlock(&accessCR);
     return n;
 }
 
 /* ***************************************************** */
 
+/**
+ *  \brief Read data from an open file into a buffer vector.
+ *
+ *  Like read(), but the data is returned as a buffer vector, of a single memory buffer of the size of the
+ *  request.  Every physically contiguous run of the file is read from the storage device with a single
+ *  pread, instead of one cluster at a time; data still in the write buffer is copied from it, and holes
+ *  are zeroed.  The storage device is not handed to FUSE to read from later: by then, its clusters may
+ *  belong to another file.
+ *
+ *  The buffer vector and its memory buffer are freed by FUSE.
+ *
+ *  \remarks Introduced in version 2.9.
+ *
+ *  \param path path to the file
+ *  \param bufp pointer to the location where the pointer to the buffer vector is to be stored
+ *  \param count number of bytes to be read
+ *  \param pos starting [byte] position in the file data continuum where data is to be read from
+ *  \param fi pointer to fuse file information
+ *
+ *  \return 0, on success, and a negative value, on error
+ */
+static int sofs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t count, off_t pos,
+                         struct fuse_file_info *fi)
+{
+    soProbe(143, "sofs_read_buf(\"%s\", %p, %zu, %" PRId64 ", %p)\n", path,
+                 bufp, count, (int64_t) pos, fi);
+    soTime(T_READ_BUF);
+
+    if (isStats(path))
+    {
+        const char *start = NULL;
+        size_t n = statsSlice(fi, count, pos, &start);
+        void *mem = NULL;
+        struct fuse_bufvec *bv = (struct fuse_bufvec *) malloc(sizeof(struct fuse_bufvec));
+        if (bv == NULL || (n > 0 && (mem = malloc(n)) == NULL))
+        {
+            free(bv);
+            return -ENOMEM;
+        }
+        *bv = FUSE_BUFVEC_INIT(n);
+        bv->buf[0].mem = mem;
+        if (n > 0)
+            memcpy(mem, start, n);
+        *bufp = bv;
+        return 0;
+    }
+
+    /* a cluster has at least one block of the smallest size, so this is enough even if no cluster is contiguous */
+    uint32_t max = count / MIN_BLOCK_SIZE + 2;
+    SOExtent ext[max];
+    char *mem = NULL;
+    size_t total = 0;
+
+    /* The data is copied before leaving the critical region: once out of it, a truncate followed by
+     * a write to another file could reuse the clusters, so they cannot be handed to FUSE to read later */
+    pthread_mutex_lock(&accessCR);
+    int n = soReadExtents(path, count, pos, ext, max);
+    for (int i = 0; i < n; i++)
+        total += ext[i].size;
+    if (n > 0 && (mem = (char *) malloc(total)) == NULL)
+        n = -ENOMEM;
+    int fd = (n > 0) ? soGetRawDiskFd() : -1;
+    size_t done = 0;
+    for (int i = 0; i < n; i++)
+    {
+        /* each contiguous run of the file is read at once, a hole is zeros */
+        if (ext[i].mem != NULL)
+            memcpy(mem + done, ext[i].mem, ext[i].size);
+        else if (ext[i].pos == -1)
+            memset(mem + done, 0, ext[i].size);
+        else if (pread(fd, mem + done, ext[i].size, ext[i].pos) != (ssize_t) ext[i].size)
+        {
+            n = -EIO;
+            break;
+        }
+        done += ext[i].size;
+    }
+    pthread_mutex_unlock(&accessCR);
+    if (n < 0)
+    {
+        free(mem);
+        return n;
+    }
+
+    struct fuse_bufvec *bv = (struct fuse_bufvec *) malloc(sizeof(struct fuse_bufvec));
+    if (bv == NULL)
+    {
+        free(mem);
+        return -ENOMEM;
+    }
+    *bv = FUSE_BUFVEC_INIT(total);
+    bv->buf[0].mem = mem;
+
+    *bufp = bv;
+    return 0;
+}
+
+/* ***************************************************** */
+
 /**
  *  \brief Write data to an open file.
  *
@@ -460,11 +691,12 @@ static int sofs_read(const char *path, char *buff, size_t count, off_t pos,
 static int sofs_write(const char *path, const char *buff, size_t count, off_t pos,
                       struct fuse_file_info *fi)
 {
-    soProbe(128, "sofs_write(\"%s\", %p, %" PRIu32 ", %" PRId32 ", %p)\n", path,
-                 buff, (uint32_t) count, (int32_t) pos, fi);
+    soProbe(128, "sofs_write(\"%s\", %p, %zu, %" PRId64 ", %p)\n", path,
+                 buff, count, (int64_t) pos, fi);
+    soTime(T_WRITE);
 
     pthread_mutex_lock(&accessCR);
-    int n = soWrite(path, (void *)buff, (uint32_t) count, (int32_t) pos);
+    int n = soWrite(path, (void *)buff, count, pos);
     pthread_mutex_unlock(&accessCR);
     return n;
 }
@@ -499,10 +731,15 @@ static int sofs_write(const char *path, const char *buff, size_t count, off_t po
 static int sofs_flush(const char *path, struct fuse_file_info *fi)
 {
     soProbe(129, "sofs_flush(\"%s\", %p)\n", path, fi);
+    soTime(T_FLUSH);
+
+    if (isStats(path))
+        return 0;
 
     pthread_mutex_lock(&accessCR);
+    int ret = soFlush(path);
     pthread_mutex_unlock(&accessCR);
-    return 0;
+    return ret;
 }
 
 /* ***************************************************** */
@@ -527,6 +764,15 @@ static int sofs_flush(const char *path, struct fuse_file_info *fi)
 static int sofs_release(const char *path, struct fuse_file_info *fi)
 {
     soProbe(130, "sofs_release(\"%s\", %p)\n", path, fi);
+    soTime(T_RELEASE);
+
+    if (isStats(path))
+    {
+        StatsSnapshot *snap = (StatsSnapshot *) (uintptr_t) fi->fh;
+        free(snap->text);
+        free(snap);
+        return 0;
+    }
 
     pthread_mutex_lock(&accessCR);
     int ret = soClose(path);
@@ -554,6 +800,7 @@ static int sofs_release(const char *path, struct fuse_file_info *fi)
 static int sofs_fsync(const char *path, int isdatasync, struct fuse_file_info *fi)
 {
     soProbe(131, "sofs_fsync(\"%s\", %d, %p)\n", path, isdatasync, fi);
+    soTime(T_FSYNC);
 
     pthread_mutex_lock(&accessCR);
     int ret = soFsync(path);
@@ -580,6 +827,7 @@ static int sofs_fsync(const char *path, int isdatasync, struct fuse_file_info *f
 static int sofs_opendir(const char *path, struct fuse_file_info *fi)
 {
     soProbe(132, "sofs_opendir(\"%s\", %p)\n", path, fi);
+    soTime(T_OPENDIR);
 
     pthread_mutex_lock(&accessCR);
     int ret = soOpendir(path);
@@ -622,6 +870,7 @@ static int sofs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
 {
     soProbe(133, "sofs_readdir(\"%s\", %p, %p, %" PRId32 ", %p)\n", path, buf,
                  filler, (int32_t) offset, fi);
+    soTime(T_READDIR);
 
     pthread_mutex_lock(&accessCR);
 
@@ -654,6 +903,7 @@ static int sofs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
 static int sofs_releasedir(const char *path, struct fuse_file_info *fi)
 {
     soProbe(134, "sofs_releasedir(\"%s\", %p)\n", path, fi);
+    soTime(T_RELEASEDIR);
 
     pthread_mutex_lock(&accessCR);
     int ret = soClosedir(path);
@@ -679,6 +929,7 @@ static int sofs_releasedir(const char *path, struct fuse_file_info *fi)
 static int sofs_fsyncdir(const char *path, int isdatasync, struct fuse_file_info *fi)
 {
     soProbe(135, "sofs_fsyncdir(\"%s\", %d, %p)\n", path, isdatasync, fi);
+    soTime(T_FSYNCDIR);
 
     pthread_mutex_lock(&accessCR);
     int ret = soFsync(path);
@@ -701,6 +952,7 @@ static int sofs_fsyncdir(const char *path, int isdatasync, struct fuse_file_info
 static int sofs_symlink(const char *effPath, const char *path)
 {
     soProbe(136, "sofs_symlink(\"%s\", \"%s\")\n", effPath, path);
+    soTime(T_SYMLINK);
 
     pthread_mutex_lock(&accessCR);
     int ret = soSymlink(effPath, path);
@@ -729,6 +981,7 @@ static int sofs_readlink(const char *path, char *buf, size_t size)
 {
     soProbe(137, "sofs_readlink(\"%s\", %p, %" PRIu32 ")\n", path, buf,
                  (uint32_t) size);
+    soTime(T_READLINK);
 
     pthread_mutex_lock(&accessCR);
     /*int ret = */ soReadlink(path, buf, size);
@@ -752,6 +1005,7 @@ static int sofs_setxattr(const char *path, const char *name, const char *value,
 {
     soProbe(138, "sofs_setxattr(\"%s\", \"%s\", %p, %" PRIu32 ", %d)\n", path,
                  name, value, (uint32_t) size, flags);
+    soTime(T_SETXATTR);
 
     return -ENOSYS;
 }
@@ -770,6 +1024,7 @@ static int sofs_getxattr(const char *path, const char *name, char *value, size_t
 {
     soProbe(139, "sofs_getxattr(\"%s\", \"%s\", %p, %" PRIu32 ")\n", path, name,
                  value, (uint32_t) size);
+    soTime(T_GETXATTR);
 
     return -ENOSYS;
 }
@@ -786,6 +1041,7 @@ static int sofs_listxattr(const char *path, char *list, size_t size)
 {
     soProbe(140, "sofs_listxattr(\"%s\", \"%s\", %" PRIu32 ")\n", path, list,
                  (uint32_t) size);
+    soTime(T_LISTXATTR);
 
     return -ENOSYS;
 }
@@ -803,6 +1059,7 @@ static int sofs_listxattr(const char *path, char *list, size_t size)
 int sofs_removexattr(const char *path, const char *name)
 {
     soProbe(141, "sofs_removexattr(\"%s\", \"%s\")\n", path, name);
+    soTime(T_REMOVEXATTR);
 
     return -ENOSYS;
 }
@@ -818,6 +1075,7 @@ int sofs_removexattr(const char *path, const char *name)
 static int sofs_getdir(const char *path, fuse_dirh_t handle, fuse_dirfil_t filler)
 {
     soProbe(142, "sofs_getdir(\"%s\", ...)\n", path);
+    soTime(T_GETDIR);
 
     return -ENOSYS;
 }
@@ -871,7 +1129,11 @@ const struct fuse_operations sofs16_fuse_operations = {
     flag_utime_omit_ok:0,
     flag_reserved:0,
     ioctl:NULL,
-    poll:NULL
+    poll:NULL,
+    write_buf:NULL,
+    read_buf:sofs_read_buf,
+    flock:NULL,
+    fallocate:NULL
 };
 
 /* The main function */
@@ -888,7 +1150,9 @@ static void printUsage(char *cmd_name)
            "  -d       --- set debugging mode (default: no debugging)\n"
            "  -l depth --- set log depth (default: 0,0)\n"
            "  -L file  --- log file (default: stdout)\n"
-           "  -h       --- print this help\n", cmd_name);
+           "  -T file  --- record the log in a binary trace file, to be read with showtrace\n"
+           "               (only the last %u events of each thread are kept)\n"
+           "  -h       --- print this help\n", cmd_name, TRACE_RING_EVENTS);
 }
 
 /* ***************************************************** */
@@ -900,7 +1164,7 @@ int main(int argc, char *argv[])
 
     /* process command line options */
     int opt;
-    while ((opt = getopt(argc, argv, "l:L:dh")) != -1)
+    while ((opt = getopt(argc, argv, "l:L:T:dh")) != -1)
     {
         switch (opt)
         {
@@ -927,6 +1191,20 @@ int main(int argc, char *argv[])
                 soOpenProbe(flog);
                 break;
             }
+            case 'T':          /* trace file */
+            {
+                try
+                {
+                    soOpenTrace(optarg);
+                }
+                catch (SOException & err)
+                {
+                    fprintf(stderr, "%s: Can't open trace file \"%s\".\n", basename(argv[0]), optarg);
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
             case 'd':          /* debugging mode */
             {
                 debug_mode = true;
@@ -962,6 +1240,9 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    /* metrics are collected while mounted, to be read through STATS_PATH */
+    soEnableMetrics(true);
+
     /* set the log file */
     if (flog == NULL)
         flog = stdout;          /* if the switch -L was not used, set output to stdout */
@@ -974,13 +1255,14 @@ int main(int argc, char *argv[])
     char s3[] = "nonempty";
     char s4[] = "fsname=sofs16";
     char s5[] = "subtype=ext-like";
+    char s6[] = "big_writes,max_write=1048576,max_read=1048576,splice_read,splice_write";
     char *fargv[] = {
         argv[0],
         argv[optind + 1],
-        s2, s3, s2, s4, s2, s5, s1,
+        s2, s3, s2, s4, s2, s5, s2, s6, s1,
         NULL
     };
-    int fargc = debug_mode ? 9 : 8;
+    int fargc = debug_mode ? 11 : 10;
     return fuse_main(fargc, fargv, &sofs16_fuse_operations, NULL);
 }
 
@@ -19,6 +19,7 @@
 #include <inode.h>
 #include <dealers.h>
 #include <core.h>
+#include "reserve.h"
 
 #include "syscalls.h"
 
@@ -143,6 +144,14 @@ int soLink(const char *path, const char *newPath)
         
         
         /* Updates*/
+
+        /* The name is checked before the reference count is incremented */
+        uint32_t ein; soGetDirEntry(icopy_handler, bn, &ein);
+        if(ein != NULL_REFERENCE)
+          throw SOException(EEXIST,__FUNCTION__);
+
+        /* Make room for both inodes and the entry */
+        jReserve(RESERVE_ENTRY + RESERVE_LISTS, 4);
         
         /* Update number of links from original file i-node */
         iIncRefcount(ioriginal_handler);
@@ -150,6 +159,11 @@ int soLink(const char *path, const char *newPath)
         iSave(ioriginal_handler);
         /* Add DirEntry in newpath i-node */
         soAddDirEntry(icopy_handler,bn,path_inp);
+        iSave(icopy_handler);
+
+        /* Release handlers */
+        iClose(ioriginal_handler);
+        iClose(icopy_handler);
 
         return 0;
     }
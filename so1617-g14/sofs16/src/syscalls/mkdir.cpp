@@ -20,6 +20,7 @@
 #include "dealers.h"
 #include "direntries.h"
 #include "freelists.h"
+#include "reserve.h"
 
 #include "syscalls.h"
 #include "probing.h"
@@ -80,8 +81,18 @@ int soMkdir(const char *path, mode_t mode)
         if(!iCheckAccess(pih, W_OK))
         	throw SOException(EACCES, __FUNCTION__);
 
-        /* Allocate a new inode for the directory */
-        uint32_t cin; soAllocInode(mode | S_IFDIR, &cin);
+        /* The name is checked before the inode is allocated, so nothing is
+         * left behind when it is taken */
+        uint32_t ein; soGetDirEntry(pih, bn, &ein);
+        if (ein != NULL_REFERENCE)
+            throw SOException(EEXIST, __FUNCTION__);
+
+        /* Make room for the new inode, the entry, the parent and the
+         * directory's own cluster */
+        jReserve(RESERVE_ENTRY + 1 + RESERVE_LISTS, 4);
+
+        /* Allocate a new inode for the directory, close to its parent */
+        uint32_t cin; soAllocInode(mode | S_IFDIR, &cin, pin);
         int cih = iOpen(cin);
 
         /* Add dir entries to parent */
@@ -91,9 +102,15 @@ int soMkdir(const char *path, mode_t mode)
         /* Add dir entries to child */
         soAddDirEntry(cih, ".", cin);
         iIncRefcount(cih);
-        soAddDirEntry(cih, "..", cin);
+        soAddDirEntry(cih, "..", pin);
         iIncRefcount(cih);
 
+        /* Save and release both inodes */
+        iSave(cih);
+        iClose(cih);
+        iSave(pih);
+        iClose(pih);
+
         return 0;
     }
     catch(SOException & err)
@@ -20,6 +20,7 @@
 #include "dealers.h"
 #include "direntries.h"
 #include "freelists.h"
+#include "reserve.h"
 
 #include "syscalls.h"
 #include "probing.h"
@@ -81,8 +82,17 @@ int soMknod(const char *path, mode_t mode)
         if(!iCheckAccess(pih, W_OK))
         	throw SOException(EACCES, __FUNCTION__);
 
-        /* Allocate a new inode for the file */
-        uint32_t cin; soAllocInode(mode | S_IFREG, &cin);
+        /* The name is checked before the inode is allocated, so nothing is
+         * left behind when it is taken */
+        uint32_t ein; soGetDirEntry(pih, bn, &ein);
+        if (ein != NULL_REFERENCE)
+            throw SOException(EEXIST, __FUNCTION__);
+
+        /* Make room for the new inode, the entry and the parent */
+        jReserve(RESERVE_ENTRY + RESERVE_LISTS, 4);
+
+        /* Allocate a new inode for the file, close to its parent */
+        uint32_t cin; soAllocInode(mode | S_IFREG, &cin, pin);
         int cih = iOpen(cin);
 
         /* Add dir entry to parent */
@@ -91,6 +101,12 @@ int soMknod(const char *path, mode_t mode)
         /* Increase the file's refcount */
         iIncRefcount(cih);
 
+        /* Save and release both inodes */
+        iSave(cih);
+        iClose(cih);
+        iSave(pih);
+        iClose(pih);
+
         return 0;
     }
     catch(SOException & err)
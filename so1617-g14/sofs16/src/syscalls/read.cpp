@@ -26,6 +26,8 @@
 #include "freelists.h" /* added */
 #include "filecluster.h" /* added */
 #include "direntries.h" /* added */
+#include "wbuffer.h"
+#include "reserve.h"
 
 /*
  *  \brief Read data from an open regular file.
@@ -40,9 +42,9 @@
  *  \return 0 on success; 
  *      -errno in case of error, being errno the system error that better represents the cause of failure
  */
-int soRead(const char *path, void *buff, uint32_t count, int32_t pos)
+int soRead(const char *path, void *buff, size_t count, off_t pos)
 {
-    soProbe(229, "soRead(\"%s\", %p, %u, %u)\n", path, buff, count, pos);
+    soProbe(229, "soRead(\"%s\", %p, %zu, %jd)\n", path, buff, count, (intmax_t) pos);
 
     try
     {
@@ -50,11 +52,8 @@ int soRead(const char *path, void *buff, uint32_t count, int32_t pos)
         if(pos < 0)
             throw SOException(EINVAL, __FUNCTION__);
 
-        uint32_t cinp, BPC = soGetBPC();
-        uint32_t fcn = pos/BPC, idx = pos%BPC;
-        uint32_t fcn_last, idx_last, cih, nbytes, bytestoread;
+        uint32_t cinp, cih, BPC = soGetBPC();
         SOInode * inode;
-        char data[BPC];
 
         char* xpath = strdupa(path);
 
@@ -71,46 +70,43 @@ int soRead(const char *path, void *buff, uint32_t count, int32_t pos)
         /* Get pointer */
         inode = iGetPointer(cih);
 
-        nbytes = 0;
-        if(inode->size == 0){
+        /* Nothing to be read at or beyond the end of file */
+        if((uint64_t) pos >= inode->size){
             iClose(cih);
-            return nbytes;
-        }else if(inode->size < count){
-            fcn_last = (pos+inode->size-1)/BPC;
-            idx_last = (pos+inode->size-1)%BPC;
-            bytestoread = inode->size;
-        }else{
-            fcn_last = (pos+count-1)/BPC;
-            idx_last = (pos+count-1)%BPC;
-            bytestoread = count;
+            return 0;
         }
+        if(count > (uint64_t) (inode->size - pos))
+            count = inode->size - pos;
+
+        uint8_t *p = (uint8_t *) buff;
+        uint32_t fcn = pos/BPC, idx = pos%BPC;
+        size_t nbytes = 0;
+        char data[BPC];
 
-        for(uint32_t i = fcn; i <= fcn_last; i++){
-            
-            /* read cluster */
-            soReadFileCluster(cih, i, data);
-            
-            /* if it is the first cluster */
-            if(i == fcn){
-                if(bytestoread+idx <= BPC){
-                    memcpy(buff, data+idx, idx_last-idx+1);
-                    nbytes += idx_last-idx+1;
-                }else{
-                    memcpy(buff, data+idx, BPC-idx);
-                    nbytes += (BPC-idx);
-                }
-            /* if it is the last cluster but not the first */
-            }else if(i == fcn_last){
-                memcpy((uint8_t *)buff+nbytes, data, bytestoread-nbytes);
-                nbytes = bytestoread;
-            /* intermediate cluster */
+        while(nbytes < count){
+            size_t n = BPC - idx;
+            if(n > count - nbytes)
+                n = count - nbytes;
+
+            /* buffered data not yet flushed is newer than the disk,
+             * whole clusters go straight into the caller's buffer,
+             * only the partial ones at the edges need the bounce buffer */
+            uint8_t *wb = soWBufferLookup(cih, fcn);
+            if(wb != NULL){
+                memcpy(p+nbytes, wb+idx, n);
+            }else if(n == BPC){
+                soReadFileCluster(cih, fcn, p+nbytes);
             }else{
-                memcpy((uint8_t *)buff+nbytes, data, BPC);
-                nbytes += BPC;
+                soReadFileCluster(cih, fcn, data);
+                memcpy(p+nbytes, data+idx, n);
             }
 
+            nbytes += n;
+            fcn++;
+            idx = 0;
         }
 
+        jReserve(0, 1);
         iSave(cih);
         iClose(cih);
 
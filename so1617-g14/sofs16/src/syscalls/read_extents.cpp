@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+
+#include "syscalls.h"
+
+#include "probing.h"
+#include "exception.h"
+#include "rawdisk.h"
+#include "dealers.h"
+#include "core.h"
+#include "filecluster.h"
+#include "direntries.h"
+#include "wbuffer.h"
+
+/*
+ *  \brief Map a byte range of an open regular file onto the storage device.
+ *
+ *  \param path path to the file
+ *  \param count number of bytes to be mapped
+ *  \param pos starting [byte] position in the file data continuum
+ *  \param ext pointer to the array where the extents are to be stored
+ *  \param max number of elements of the array
+ *
+ *  \return the number of extents stored, on success; 
+ *      -errno in case of error, being errno the system error that better represents the cause of failure
+ */
+int soReadExtents(const char *path, size_t count, off_t pos, SOExtent *ext, uint32_t max)
+{
+    soProbe(237, "soReadExtents(\"%s\", %zu, %jd, %p, %u)\n", path, count, (intmax_t) pos, ext, max);
+
+    try
+    {
+        /* Check if pos is negative */
+        if(pos < 0)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        uint32_t cinp, cih, BPC = soGetBPC();
+        SOSuperBlock *sbp = sbGetPointer();
+        SOInode *inode;
+
+        char* xpath = strdupa(path);
+
+        /* Get the inode index */
+        soTraversePath(xpath, &cinp);
+
+        /* Get inode handler */
+        cih = iOpen(cinp);
+
+        /* Check access */
+        if(!iCheckAccess(cih, R_OK))
+            throw SOException(EPERM, __FUNCTION__);
+
+        /* Get pointer */
+        inode = iGetPointer(cih);
+
+        /* Clip the range at the end of file */
+        if((uint64_t) pos >= inode->size)
+            count = 0;
+        else if(count > (uint64_t) (inode->size - pos))
+            count = inode->size - pos;
+
+        uint32_t fcn = pos/BPC, idx = pos%BPC, n = 0;
+        size_t nbytes = 0;
+
+        while(nbytes < count){
+            size_t len = BPC - idx;
+            if(len > count - nbytes)
+                len = count - nbytes;
+
+            /* buffered data not yet flushed is newer than the disk, and is mapped where it is;
+             * otherwise, get the physical cluster number and its byte position in the device */
+            const uint8_t *mem = soWBufferLookup(cih, fcn);
+            off_t dpos = -1;
+            if(mem != NULL)
+                mem += idx;
+            else{
+                uint32_t cn;
+                soGetFileCluster(cih, fcn, &cn);
+                if(cn != NULL_REFERENCE)
+                    dpos = ((off_t) sbp->czstart + (off_t) cn * sbp->csize) * soGetRawBlockSize() + idx;
+            }
+
+            /* Extend the previous extent if this one follows it, otherwise start a new one */
+            SOExtent *last = (n > 0) ? &ext[n-1] : NULL;
+            bool follows = false;
+            if(last != NULL && mem != NULL)
+                follows = (last->mem != NULL && last->mem + last->size == mem);
+            else if(last != NULL && last->mem == NULL)
+                follows = (dpos == -1) ? (last->pos == -1) : (last->pos != -1 && last->pos + (off_t) last->size == dpos);
+            if(follows){
+                last->size += len;
+            }else{
+                if(n == max)
+                    break;
+                ext[n].pos = dpos;
+                ext[n].size = len;
+                ext[n].mem = mem;
+                n++;
+            }
+
+            nbytes += len;
+            fcn++;
+            idx = 0;
+        }
+
+        iClose(cih);
+
+        return n;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
@@ -45,62 +45,54 @@
  */
 int soReaddir(const char *path, void *buff, int32_t pos)
 {
-    
     soProbe(234, "soReaddir(\"%s\", %p, %u)\n", path, buff, pos);
 
     try
     {
-        uint32_t inode_parent1;
+        uint32_t in;
         uint32_t BPC = soGetBPC();
         uint32_t DPC = soGetDPC();
-        uint32_t directory;  
         SODirEntry data[DPC];
-        
-        char* xpath = strdupa(path);
-        char* bn = basename(strdupa(xpath));
-        char* dn = dirname(xpath);
-
-        soTraversePath(dn, &inode_parent1);
-        int ih = iOpen(inode_parent1);
 
-        int cluster = pos / sizeof(SODirEntry) / BPC; // guedes
-        int idx = pos / sizeof(SODirEntry) % BPC; // guedes
+        char* xpath = strdupa(path);
 
-        soGetDirEntry(ih,bn,&directory);
+        /* Get the directory inode */
+        soTraversePath(xpath, &in);
+        int ih = iOpen(in);
+        SOInode *ip = iGetPointer(ih);
 
-        //  check if directory exists
-        if (directory != NULL_REFERENCE)
+        /* Check it is a directory */
+        if (!S_ISDIR(ip->mode))
         {
-           throw SOException(ENOENT, __FUNCTION__);
+            iClose(ih);
+            throw SOException(ENOTDIR, __FUNCTION__);
         }
 
-        // Check if does not exists permission to read 
+        /* Check if exists permission to read */
         if (!iCheckAccess(ih, R_OK))
         {
-            iSave(ih);
             iClose(ih);
-            throw SOException(EPERM, __FUNCTION__);
+            throw SOException(EACCES, __FUNCTION__);
         }
-        
-        soReadFileCluster(ih, cluster, data);
 
-        if (strcmp(data[idx].name, "") == 0)
+        /* Directory entries are kept compact, so the end of file ends the listing */
+        if (pos < 0 || (uint64_t) pos >= ip->size)
         {
+            iClose(ih);
             return 0;
         }
 
-        memcpy(buff,&data[idx].name,sizeof(SODirEntry));
+        uint32_t cluster = pos / BPC;
+        uint32_t idx = (pos % BPC) / sizeof(SODirEntry);
 
-        pos += sizeof(SODirEntry);
+        soReadFileCluster(ih, cluster, data);
+        memcpy(buff, data[idx].name, SOFS16_MAX_NAME + 1);
 
-        iSave(ih);
         iClose(ih);
         return sizeof(SODirEntry);
-        
     }
     catch(SOException & err)
     {
         return -err.en;
     }
-
 }
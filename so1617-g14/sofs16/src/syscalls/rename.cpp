@@ -23,6 +23,7 @@
 #include "direntries.h" 
 #include "dealers.h" 
 #include "core.h"
+#include "reserve.h"
 
 
 /*
@@ -86,46 +87,49 @@ int soRename(const char *path, const char *newPath)
         soTraversePath(strdupa(Ndn), &inode_parent2); // Get the inode associated to the given path
         int ih2 = iOpen(inode_parent2);
 
-        // Get an entry given a name
-        soGetDirEntry(ih2, Nbn, &deleted);
-
-        // if entry exists with the same name, it will be deleted
-        if (deleted != NULL_REFERENCE)
+        // Nothing may change before every check is passed, or the parents
+        // would be left half updated
+        soGetDirEntry(ih1, bn, &renamed);
+        if (renamed == NULL_REFERENCE)
         {
-            soDeleteDirEntry(ih2, Nbn, &deleted);
+            iClose(ih1);
+            iClose(ih2);
+            throw SOException(ENOENT, __FUNCTION__);
         }
 
-        /* Check if exists permission to write */
-        if( !iCheckAccess(ih1, W_OK) || !iCheckAccess(ih2, W_OK))
+        uint32_t ih3 = iOpen(renamed); // open inode
+
+        SOInode* inp = iGetPointer(ih3); // get pointer to an open inode
+
+        /* Check if exists permission to write, in a directory moved as well */
+        if( !iCheckAccess(ih1, X_OK | W_OK) || !iCheckAccess(ih2, X_OK | W_OK) ||
+            ((inp -> mode & S_IFDIR) == S_IFDIR && !iCheckAccess(ih3, X_OK | W_OK)))
         {   
-            iSave(ih1);
-            iSave(ih2);
             iClose(ih1);
             iClose(ih2);
+            iClose(ih3);
             throw SOException(EACCES, __FUNCTION__);
         }
 
-        soDeleteDirEntry(ih1, strdupa(bn), &renamed); // Remove an entry from a parent directory
-        soAddDirEntry(ih2, Nbn, renamed); // Add a new entry to the parent directory
+        // Make room for the entries deleted and added, in both parents and in
+        // a directory moved, and for the three inodes
+        jReserve(4 * RESERVE_ENTRY + RESERVE_LISTS, 5);
 
-        uint32_t ih3 = iOpen(renamed); // open inode
+        // Get an entry given a name
+        soGetDirEntry(ih2, Nbn, &deleted);
 
-        SOInode* inp = iGetPointer(ih3); // get pointer to an open inode
+        // if entry exists with the same name, it will be deleted
+        if (deleted != NULL_REFERENCE)
+        {
+            soDeleteDirEntry(ih2, Nbn, &deleted);
+        }
+
+        soDeleteDirEntry(ih1, strdupa(bn), &renamed); // Remove an entry from a parent directory
+        soAddDirEntry(ih2, Nbn, renamed); // Add a new entry to the parent directory
 
         // if is directory, must change the . and .. entries
         if ((inp -> mode & S_IFDIR) == S_IFDIR)
         {   
-            /* Check if exists permission to write */
-            if (iCheckAccess(ih3,W_OK) != 0)
-            {
-                iSave(ih1);
-                iSave(ih2);
-                iSave(ih3);
-                iClose(ih1);
-                iClose(ih2);
-                iClose(ih3);
-                throw SOException(EACCES, __FUNCTION__);
-            }
             soDeleteDirEntry(ih3,"..", &deleted);
             soAddDirEntry(ih3, "..", inode_parent2);
             iIncRefcount(ih2); // increment, if possible, reference count of inode handler 2
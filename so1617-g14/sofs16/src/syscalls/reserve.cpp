@@ -0,0 +1,33 @@
+#include "reserve.h"
+
+#include "probing.h"
+#include "exception.h"
+#include "dealers.h"
+#include "core.h"
+#include "filecluster.h"
+
+/* ***************************************** */
+
+void soShrinkFile(int ih, uint32_t ffcn)
+{
+    soProbe(800, "soShrinkFile(%d, %u)\n", ih, ffcn);
+
+    SOInode *ip = iGetPointer(ih);
+    uint32_t BPC = soGetBPC();
+    uint32_t step = soGetRPC() - 1;
+
+    /* The last step frees whatever is left from ffcn on, even past the size */
+    uint32_t end = (ip->size + BPC - 1) / BPC;
+    do
+    {
+        uint32_t first = (end > ffcn + step) ? end - step : ffcn;
+
+        jReserve(RESERVE_STEP + RESERVE_LISTS, 3);
+        soFreeFileClusters(ih, first);
+        if (ip->size > (uint64_t) first * BPC)
+            ip->size = (uint64_t) first * BPC;
+        iSave(ih);
+
+        end = first;
+    } while (end > ffcn);
+}
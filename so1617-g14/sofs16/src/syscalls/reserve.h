@@ -0,0 +1,50 @@
+/**
+ *  \file reserve.h
+ *  \brief room the system calls make in the running transaction
+ *
+ *  A transaction is only committed between system calls, or between the
+ *  steps of a long one, each leaving the file system consistent, so that
+ *  a crash never finds one half done.
+ *  So, before changing anything, a system call, or a step, makes room,
+ *  through jReserve, for the most it may log.
+ *  The bounds below are in clusters; besides them, a system call logs
+ *  the superblock, its inodes and a block the free lists hold for it.
+ *
+ *  Freeing or allocating the clusters of a file is done in steps of up to
+ *  RPC - 1 consecutive file clusters, each one the smallest consistent change.
+ *
+ *  \remarks In case an error occurs, every function throws a SOException
+ */
+
+#ifndef __SOFS16_RESERVE__
+#define __SOFS16_RESERVE__
+
+#include <stdint.h>
+
+/** \brief an entry added to, or deleted from, a directory: two directory clusters
+ *  and the two references clusters leading to one added or freed */
+#define RESERVE_ENTRY 4
+
+/** \brief a step: the references clusters of a file covering its clusters */
+#define RESERVE_STEP 3
+
+/** \brief the free lists: two head references clusters replenished from, and the
+ *  room held for releasing, on commit, the clusters a step frees */
+#define RESERVE_LISTS 7
+
+/* ***************************************** */
+
+/**
+ * \brief Free the clusters of a file from a given position on, in steps
+ *
+ *  The file is shortened from its end, so a commit between two steps
+ *  finds it with its size cut at the clusters freed so far.
+ *
+ *  \param ih inode handler
+ *  \param ffcn first file cluster number to free
+ */
+void soShrinkFile(int ih, uint32_t ffcn);
+
+/* ***************************************** */
+
+#endif                          /* __SOFS16_RESERVE__ */
@@ -20,6 +20,7 @@
 #include "dealers.h"
 #include "direntries.h"
 #include "freelists.h"
+#include "reserve.h"
 
 #include "syscalls.h"
 #include "probing.h"
@@ -81,9 +82,17 @@ int soRmdir(const char *path)
         if(!iCheckAccess(pih, X_OK))
             throw SOException(EACCES, __FUNCTION__);
 
+        /* The directory's own entries are deleted too, once its entry is gone */
+        if(!iCheckAccess(cih, X_OK | W_OK))
+            throw SOException(EACCES, __FUNCTION__);
+
+        /* Make room for the entry, the parent and the directory's own cluster */
+        jReserve(RESERVE_ENTRY + 1 + RESERVE_LISTS, 4);
+
         /* Delete dir entries from parent */
         soDeleteDirEntry(pih, bn, NULL);
         iDecRefcount(pih);
+        iSave(pih);
 
         /* Delete dir entries from child */
         soDeleteDirEntry(cih, ".", NULL);
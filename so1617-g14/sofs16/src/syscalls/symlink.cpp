@@ -23,6 +23,7 @@
 #include "freelists.h"
 #include "dealers.h"
 #include "core.h"
+#include "reserve.h"
 
 #include "probing.h"
 #include "exception.h"
@@ -75,16 +76,28 @@ int soSymlink(const char *effPath, const char *path)
             throw SOException(EACCES, __FUNCTION__);
         }
 
+        /* The name is checked before the inode is allocated, so nothing is
+         * left behind when it is taken */
+        uint32_t ein; soGetDirEntry(spih, sbn, &ein);
+        if (ein != NULL_REFERENCE) {
+            iClose(spih);
+            throw SOException(EEXIST, __FUNCTION__);
+        }
+
+        /* Make room for the new inode, the entry, the parent and the path,
+         * which may take a single indirect references cluster */
+        uint32_t BPC = soGetBPC();
+        uint32_t lastFcn = (strlen(xeffPath)-1)/BPC;
+        jReserve(RESERVE_ENTRY + lastFcn + 2 + RESERVE_LISTS, 4);
+
         /* Allocate an inode for the symlink and get its child inode number */
-        uint32_t scin; soAllocInode(S_IFLNK | S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IWGRP | S_IXGRP | S_IROTH | S_IWOTH | S_IXOTH, &scin);
+        uint32_t scin; soAllocInode(S_IFLNK | S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IWGRP | S_IXGRP | S_IROTH | S_IWOTH | S_IXOTH, &scin, spin);
         uint32_t scih = iOpen(scin);
         SOInode *scip = iGetPointer(scih);
 
         /* Add the dir entry and write the path of the symlink */
         soAddDirEntry(spih, sbn, scin);
 
-        uint32_t BPC = soGetBPC();
-        uint32_t lastFcn = (strlen(xeffPath)-1)/BPC;
         for (uint32_t i = 0; i <= lastFcn; i++)
             soWriteFileCluster(scih, i, xeffPath + i*BPC);
 
@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/statvfs.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <utime.h>
+#include <libgen.h>
+#include <string.h>
+
+#include "syscalls.h"
+
+#include "probing.h"
+#include "exception.h"
+#include "rawdisk.h"
+#include "dealers.h"
+#include "core.h"
+#include "direntry.h"
+#include "direntries.h"
+#include "wbuffer.h"
+#include "reserve.h"
+
+/* open the inode of the given path, returning its handler */
+static int openPath(const char *path)
+{
+    char *xpath = strdupa(path);
+    uint32_t in;
+    soTraversePath(xpath, &in);
+    return iOpen(in);
+}
+
+/* ******************************************************************* */
+
+int soOpenFileSystem(const char *devname)
+{
+    soProbe(211, "soOpenFileSystem(\"%s\")\n", devname);
+
+    try
+    {
+        soOpenDealersDisk(devname);
+
+        /* A volume not properly unmounted, by a crash or because it is still
+         * mounted, has its inode table checked in full; otherwise, nothing
+         * but the superblock is read */
+        SOSuperBlock *sbp = sbGetPointer();
+        try
+        {
+            sbCheckConsistency();
+            if (sbp->mstat != PRU)
+                iCheckTableConsistency();
+        }
+        catch(SOException & err)
+        {
+            soCloseDealersDisk();
+            throw;
+        }
+
+        /* Until it is properly unmounted, the volume is marked as not being so */
+        sbp->mstat = NPRU;
+        sbSave();
+        jCommit();
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soCloseFileSystem(void)
+{
+    soProbe(212, "soCloseFileSystem()\n");
+
+    try
+    {
+        soWBufferFlushAll();
+
+        /* The mark goes in the last transaction, so it only reaches the disk with everything else */
+        sbGetPointer()->mstat = PRU;
+        jReserve(0, 1);
+        sbSave();
+        soCloseDealersDisk();
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soStatFS(const char *path, struct statvfs *st)
+{
+    soProbe(213, "soStatFS(\"%s\", %p)\n", path, st);
+
+    try
+    {
+        /* Check the path can be reached */
+        iClose(openPath(path));
+
+        SOSuperBlock *sbp = sbGetPointer();
+        memset(st, 0, sizeof(struct statvfs));
+        st->f_bsize = soGetBPC();
+        st->f_frsize = soGetBPC();
+        st->f_blocks = sbp->ctotal;
+        st->f_bfree = sbp->cfree;
+        st->f_bavail = sbp->cfree;
+        st->f_files = sbp->itotal;
+        st->f_ffree = sbp->ifree;
+        st->f_favail = sbp->ifree;
+        st->f_fsid = sbp->magic;
+        st->f_namemax = SOFS16_MAX_NAME;
+
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soStat(const char *path, struct stat *st)
+{
+    soProbe(214, "soStat(\"%s\", %p)\n", path, st);
+
+    try
+    {
+        int ih = openPath(path);
+        SOInode *ip = iGetPointer(ih);
+
+        memset(st, 0, sizeof(struct stat));
+        st->st_ino = iGetNumber(ih);
+        st->st_mode = ip->mode;
+        st->st_nlink = ip->refcount;
+        st->st_uid = ip->owner;
+        st->st_gid = ip->group;
+        st->st_size = ip->size;
+        st->st_blksize = soGetBPC();
+        st->st_blocks = (blkcnt_t) ip->csize * soGetBPC() / 512;
+        st->st_atime = ip->atime;
+        st->st_mtime = ip->mtime;
+        st->st_ctime = ip->ctime;
+
+        iClose(ih);
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soAccess(const char *path, int opRequested)
+{
+    soProbe(215, "soAccess(\"%s\", %u)\n", path, opRequested);
+
+    try
+    {
+        int ih = openPath(path);
+        bool granted = (opRequested == F_OK) || iCheckAccess(ih, opRequested);
+        iClose(ih);
+
+        if (!granted)
+            throw SOException(EACCES, __FUNCTION__);
+
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soChmod(const char *path, mode_t mode)
+{
+    soProbe(216, "soChmod(\"%s\", %u)\n", path, mode);
+
+    try
+    {
+        int ih = openPath(path);
+        SOInode *ip = iGetPointer(ih);
+
+        /* Only the owner or root may change permissions */
+        if (getuid() != 0 && getuid() != ip->owner)
+        {
+            iClose(ih);
+            throw SOException(EPERM, __FUNCTION__);
+        }
+
+        /* Permissions of symbolic links never change */
+        if (!S_ISLNK(ip->mode))
+        {
+            iSetAccess(ih, mode);
+            ip->ctime = time(NULL);
+            jReserve(0, 1);
+            iSave(ih);
+        }
+
+        iClose(ih);
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soChown(const char *path, uid_t owner, gid_t group)
+{
+    soProbe(217, "soChown(\"%s\", %u, %u)\n", path, owner, group);
+
+    try
+    {
+        int ih = openPath(path);
+        SOInode *ip = iGetPointer(ih);
+
+        /* Only root may change the owner; the owner may only change the group */
+        bool changeOwner = (owner != (uid_t) -1 && owner != ip->owner);
+        if (getuid() != 0 && (changeOwner || getuid() != ip->owner))
+        {
+            iClose(ih);
+            throw SOException(EPERM, __FUNCTION__);
+        }
+
+        if (owner != (uid_t) -1)
+            ip->owner = owner;
+        if (group != (gid_t) -1)
+            ip->group = group;
+        ip->ctime = time(NULL);
+
+        jReserve(0, 1);
+        iSave(ih);
+        iClose(ih);
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soUtime(const char *path, const struct utimbuf *times)
+{
+    soProbe(218, "soUtime(\"%s\", %p)\n", path, times);
+
+    if (times == NULL)
+        return soUtimens(path, NULL);
+
+    struct timespec tv[2];
+    tv[0].tv_sec = times->actime;
+    tv[0].tv_nsec = 0;
+    tv[1].tv_sec = times->modtime;
+    tv[1].tv_nsec = 0;
+    return soUtimens(path, tv);
+}
+
+/* ******************************************************************* */
+
+int soUtimens(const char *path, const struct timespec tv[2])
+{
+    soProbe(219, "soUtimens(\"%s\", %p)\n", path, tv);
+
+    try
+    {
+        int ih = openPath(path);
+        SOInode *ip = iGetPointer(ih);
+        time_t now = time(NULL);
+
+        /* Setting to the current time only requires write access;
+         * setting arbitrary times requires ownership */
+        bool toNow = (tv == NULL) || (tv[0].tv_nsec == UTIME_NOW && tv[1].tv_nsec == UTIME_NOW);
+        if (getuid() != 0 && getuid() != ip->owner && (!toNow || !iCheckAccess(ih, W_OK)))
+        {
+            iClose(ih);
+            throw SOException(toNow ? EACCES : EPERM, __FUNCTION__);
+        }
+
+        if (tv == NULL)
+            ip->atime = ip->mtime = now;
+        else
+        {
+            if (tv[0].tv_nsec != UTIME_OMIT)
+                ip->atime = (tv[0].tv_nsec == UTIME_NOW) ? now : tv[0].tv_sec;
+            if (tv[1].tv_nsec != UTIME_OMIT)
+                ip->mtime = (tv[1].tv_nsec == UTIME_NOW) ? now : tv[1].tv_sec;
+        }
+        ip->ctime = now;
+
+        jReserve(0, 1);
+        iSave(ih);
+        iClose(ih);
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soOpen(const char *path, int flags)
+{
+    soProbe(220, "soOpen(\"%s\", %x)\n", path, flags);
+
+    try
+    {
+        int ih = openPath(path);
+        SOInode *ip = iGetPointer(ih);
+
+        int access;
+        switch (flags & O_ACCMODE)
+        {
+            case O_RDONLY: access = R_OK; break;
+            case O_WRONLY: access = W_OK; break;
+            default:       access = R_OK | W_OK; break;
+        }
+
+        bool isDir = S_ISDIR(ip->mode);
+        bool granted = iCheckAccess(ih, access);
+        iClose(ih);
+
+        if (isDir && (access & W_OK))
+            throw SOException(EISDIR, __FUNCTION__);
+        if (!granted)
+            throw SOException(EACCES, __FUNCTION__);
+
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soClose(const char *path)
+{
+    soProbe(221, "soClose(\"%s\")\n", path);
+
+    try
+    {
+        int ih = openPath(path);
+        soWBufferFlush(ih);
+        iClose(ih);
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soFlush(const char *path)
+{
+    soProbe(238, "soFlush(\"%s\")\n", path);
+
+    try
+    {
+        int ih = openPath(path);
+        soWBufferFlush(ih);
+        iClose(ih);
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soFsync(const char *path)
+{
+    soProbe(222, "soFsync(\"%s\")\n", path);
+
+    try
+    {
+        int ih = openPath(path);
+        soWBufferFlush(ih);
+        jReserve(0, 2);
+        iSave(ih);
+        iClose(ih);
+        sbSave();
+        jCommit();
+
+        if (fsync(soGetRawDiskFd()) != 0)
+            throw SOException(errno, __FUNCTION__);
+
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soSync(void)
+{
+    soProbe(239, "soSync()\n");
+
+    try
+    {
+        jCommit();
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soOpendir(const char *path)
+{
+    soProbe(223, "soOpendir(\"%s\")\n", path);
+
+    try
+    {
+        int ih = openPath(path);
+        SOInode *ip = iGetPointer(ih);
+        bool isDir = S_ISDIR(ip->mode);
+        bool granted = iCheckAccess(ih, R_OK);
+        iClose(ih);
+
+        if (!isDir)
+            throw SOException(ENOTDIR, __FUNCTION__);
+        if (!granted)
+            throw SOException(EACCES, __FUNCTION__);
+
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
+
+/* ******************************************************************* */
+
+int soClosedir(const char *path)
+{
+    soProbe(224, "soClosedir(\"%s\")\n", path);
+
+    try
+    {
+        iClose(openPath(path));
+        return 0;
+    }
+    catch(SOException & err)
+    {
+        return -err.en;
+    }
+}
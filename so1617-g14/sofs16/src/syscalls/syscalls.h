@@ -21,10 +21,13 @@
  *      \li create a regular file with size 0
  *      \li open a regular file
  *      \li close a regular file
+ *      \li flush the buffered data of a regular file
  *      \li read data from an open regular file
+ *      \li map data of an open regular file onto the storage device
  *      \li write data into an open regular file
  *      \li truncate a regular file to a specified length
  *      \li synchronize a file's in-core state with storage device
+ *      \li commit the metadata changes made so far
  *      \li create a directory
  *      \li delete a directory
  *      \li open a directory for reading
@@ -58,6 +61,8 @@
  *
  * The rawdisk is open and, if it does not fail,
  * the three dealers are open.
+ * If the volume was not properly unmounted the last time, its inode table is checked in full;
+ * either way, it is then marked as not properly unmounted (NPRU) until it is closed.
  * This function is called by the mount operation.
  *
  *  \param devname absolute path to the Linux file that simulates the storage device
@@ -72,7 +77,8 @@ int soOpenFileSystem(const char *devname);
 /**
  *  \brief Close the sofs16 file system.
  *
- * The three dealers are closed and then the raw disk is closed.
+ * The volume is marked as properly unmounted (PRU),
+ * the three dealers are closed and then the raw disk is closed.
  * This function is called by the unmount operation.
  *
  *  \return 0 on success; 
@@ -270,6 +276,23 @@ int soClose(const char *path);
 
 /* ******************************************************************* */
 
+/**
+ *  \brief Flush the buffered data of a regular file.
+ *
+ *  Data written to a file is kept in memory, and its clusters are only allocated
+ *  when the file is flushed, synchronized or closed.
+ *  This allocates them and writes the data to the storage device,
+ *  without forcing the device to commit it, as <em>soFsync</em> does.
+ *
+ *  \param path path to the file
+ *
+ *  \return 0 on success; 
+ *      -errno in case of error, being errno the system error that better represents the cause of failure
+ */
+int soFlush(const char *path);
+
+/* ******************************************************************* */
+
 /**
  *  \brief Synchronize a file's in-core state with storage device.
  *
@@ -289,6 +312,21 @@ int soFsync(const char *path);
 
 /* ******************************************************************* */
 
+/**
+ *  \brief Commit the metadata changes made so far.
+ *
+ *  Changes to the metadata are grouped in a transaction of the journal,
+ *  which is only committed when a file is synchronized, when the journal fills up,
+ *  when the file system is closed or when this is called.
+ *  Data still in the write buffers of the files is not flushed.
+ *
+ *  \return 0 on success; 
+ *      -errno in case of error, being errno the system error that better represents the cause of failure
+ */
+int soSync(void);
+
+/* ******************************************************************* */
+
 /**
  *  \brief Open a directory for reading.
  *
@@ -412,7 +450,38 @@ int soMknod(const char *path, mode_t mode);
  *  \return 0 on success; 
  *      -errno in case of error, being errno the system error that better represents the cause of failure
  */
-int soRead(const char *path, void *buff, uint32_t count, int32_t pos);
+int soRead(const char *path, void *buff, size_t count, off_t pos);
+
+/* ******************************************************************* */
+
+/** \brief A contiguous run of file data, as seen in the storage device or in the write buffer */
+struct SOExtent
+{
+    off_t pos;              ///< byte position in the storage device; -1 for a hole (reads as zeros) or buffered data
+    size_t size;            ///< number of bytes
+    const uint8_t *mem;     ///< buffered data, not yet on the storage device; NULL if none
+};
+
+/**
+ *  \brief Map a byte range of an open regular file onto the storage device.
+ *
+ *  Instead of copying data, as <em>soRead</em> does, the byte range is described as a sequence of extents
+ *  of the storage device, physically contiguous file clusters being merged into a single extent, so it
+ *  can be read with a few large transfers.
+ *  Clusters in the write buffer are not flushed: their extents point to the buffered data instead.
+ *
+ *  The range is clipped at the end of file; the mapping is only valid while no other operation is run.
+ *
+ *  \param path path to the file
+ *  \param count number of bytes to be mapped
+ *  \param pos starting [byte] position in the file data continuum
+ *  \param ext pointer to the array where the extents are to be stored
+ *  \param max number of elements of the array; mapping stops early if it gets full
+ *
+ *  \return the number of extents stored, on success; 
+ *      -errno in case of error, being errno the system error that better represents the cause of failure
+ */
+int soReadExtents(const char *path, size_t count, off_t pos, SOExtent *ext, uint32_t max);
 
 /* ******************************************************************* */
 
@@ -431,7 +500,7 @@ int soRead(const char *path, void *buff, uint32_t count, int32_t pos);
  *  \return 0 on success; 
  *      -errno in case of error, being errno the system error that better represents the cause of failure
  */
-int soWrite(const char *path, void *buff, uint32_t count, int32_t pos);
+int soWrite(const char *path, void *buff, size_t count, off_t pos);
 
 /* ******************************************************************* */
 
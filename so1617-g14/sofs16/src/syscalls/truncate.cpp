@@ -18,8 +18,11 @@
 #include <string.h>
 
 #include "dealers.h"
+#include "core.h"
 #include "direntries.h"
 #include "filecluster.h"
+#include "wbuffer.h"
+#include "reserve.h"
 
 #include "syscalls.h"
 #include "probing.h"
@@ -38,7 +41,7 @@
  */
 int soTruncate(const char *path, off_t length)
 {
-    soProbe(231, "soTruncate(\"%s\", %u)\n", path, length);
+    soProbe(231, "soTruncate(\"%s\", %jd)\n", path, (intmax_t) length);
 
     try
     {
@@ -47,7 +50,7 @@ int soTruncate(const char *path, off_t length)
             throw SOException(EINVAL, __FUNCTION__);
 
         /* Check if the length is larger than the maximum file size */
-        if (length > soGetMaxFileSize())
+        if ((uint64_t) length > soGetMaxFileSize())
             throw SOException(EFBIG, __FUNCTION__);
 
         char *xpath = strdupa(path);
@@ -60,30 +63,37 @@ int soTruncate(const char *path, off_t length)
             throw SOException(EISDIR, __FUNCTION__);
 
         /* Check if we need to erase file contents */
-        if (length <= ip->size)
+        if ((uint64_t) length <= ip->size)
         {
             uint32_t BPC = soGetBPC();
             uint32_t fcn = length / BPC;
             uint32_t pos = length % BPC;
 
-            /* Free the exceeding clusters */
-            if (pos == 0)
-            {
-                soFreeFileClusters(ih, fcn);
-            }
-            else
-            {
-                soFreeFileClusters(ih, fcn + 1);
+            /* Buffered data must reach its clusters before they are cut */
+            soWBufferFlush(ih);
 
-                /* Zero out exceeding bytes */
-                uint8_t buf[BPC]; soReadFileCluster(ih, fcn, buf);
-                memset(buf + pos, 0x00, BPC - pos);
-                soWriteFileCluster(ih, fcn, buf);
+            /* Free the exceeding clusters, from the end, in steps that
+             * each fit in a transaction */
+            soShrinkFile(ih, (pos == 0) ? fcn : fcn + 1);
+
+            if (pos != 0)
+            {
+                /* Zero out exceeding bytes, as file data (not journaled);
+                 * a hole already reads as zeros */
+                uint32_t cn; soGetFileCluster(ih, fcn, &cn);
+                if (cn != NULL_REFERENCE)
+                {
+                    uint8_t buf[BPC]; soReadCluster(cn, buf);
+                    memset(buf + pos, 0x00, BPC - pos);
+                    soWriteClusters(cn, buf, 1);
+                }
             }
         }
 
+        jReserve(0, 1);
         ip->size = length;
         iSave(ih);
+        iClose(ih);
 
         return 0;
     }
@@ -20,6 +20,8 @@
 #include <direntries.h>
 #include <freelists.h>
 #include <filecluster.h>
+#include "wbuffer.h"
+#include "reserve.h"
 
 #include "syscalls.h"
 
@@ -116,7 +118,7 @@ int soUnlink(const char *path)
         /* Handlers */
 
         int dir_inode_handler = iOpen(dir_inp);
-        soGetDirEntry(dir_inp,bn,&file_inp);
+        soGetDirEntry(dir_inode_handler,bn,&file_inp);
         int file_inode_handler = iOpen(file_inp);
 
 
@@ -128,20 +130,35 @@ int soUnlink(const char *path)
         /* Check if file is readable and writable by user */
         if(iCheckAccess(file_inode_handler, R_OK | W_OK) == false)
             throw SOException(EACCES,__FUNCTION__);
+        /* Check if the entry can be deleted, before the file is emptied */
+        if(iCheckAccess(dir_inode_handler, X_OK | W_OK) == false)
+            throw SOException(EACCES,__FUNCTION__);
 
 
         /* Updates */
 
+        /* The last link going, the file is emptied first, in steps of its own */
+        if(file_inode -> refcount == 1){
+         soWBufferDiscard(file_inode_handler);
+         soShrinkFile(file_inode_handler,0);
+        }
+        jReserve(RESERVE_ENTRY + RESERVE_LISTS, 4);
+
         /* Update RefCount */
         iDecRefcount(file_inode_handler);
         if(file_inode -> refcount == 0){
-         soFreeFileClusters(file_inode_handler,0);
+         iSave(file_inode_handler);
+         iClose(file_inode_handler);
          soFreeInode(file_inp);
+        }else{
+         iSave(file_inode_handler);
+         iClose(file_inode_handler);
         }
         /* Delete DirEntry */
         uint32_t cinp;
         soDeleteDirEntry(dir_inode_handler,bn,&cinp);
         iSave(dir_inode_handler);
+        iClose(dir_inode_handler);
         return 0;
     }
     catch(SOException & err)
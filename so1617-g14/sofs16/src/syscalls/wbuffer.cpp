@@ -0,0 +1,301 @@
+#include "wbuffer.h"
+
+#include "probing.h"
+#include "metrics.h"
+#include "exception.h"
+#include "dealers.h"
+#include "core.h"
+#include "filecluster.h"
+#include "reserve.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* a dirty file cluster */
+struct WBCluster
+{
+    uint32_t fcn;       /* file cluster number */
+    bool reserved;      /* no cluster allocated yet, one counted in reserved */
+    uint8_t *data;      /* cluster contents */
+};
+
+/* the buffer of a file, clusters kept sorted by fcn */
+struct WBFile
+{
+    uint32_t in;        /* inode number */
+    uint32_t n;         /* number of buffered clusters */
+    WBCluster *cl;      /* room for WB_MAX_BYTES / BPC clusters, NULL if the slot is free */
+};
+
+static WBFile table[WB_MAX_FILES];
+
+/* number of clusters promised to buffered data but not yet allocated */
+static uint32_t reserved = 0;
+
+/* slot evicted next when the table is full */
+static uint32_t victim = 0;
+
+/* ***************************************** */
+
+static WBFile *findFile(uint32_t in)
+{
+    for (uint32_t i = 0; i < WB_MAX_FILES; i++)
+        if (table[i].cl != NULL && table[i].in == in)
+            return &table[i];
+    return NULL;
+}
+
+static WBFile *findFreeSlot()
+{
+    for (uint32_t i = 0; i < WB_MAX_FILES; i++)
+        if (table[i].cl == NULL)
+            return &table[i];
+    return NULL;
+}
+
+/* position of fcn in f, or where it must be inserted */
+static uint32_t findCluster(WBFile *f, uint32_t fcn)
+{
+    uint32_t lo = 0, hi = f->n;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (f->cl[mid].fcn < fcn)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* drop all clusters of f, without writing them */
+static void dropClusters(WBFile *f)
+{
+    for (uint32_t i = 0; i < f->n; i++)
+    {
+        if (f->cl[i].reserved)
+            reserved--;
+        free(f->cl[i].data);
+    }
+    f->n = 0;
+}
+
+static void releaseFile(WBFile *f)
+{
+    dropClusters(f);
+    free(f->cl);
+    f->cl = NULL;
+}
+
+/* allocate the clusters of f in file order and write them in contiguous runs;
+ * this is done in steps of up to RPC - 1 consecutive file clusters, each one
+ * fitting in a transaction, so a commit never finds a step half done */
+static void flushFile(WBFile *f, int ih)
+{
+    if (f->n == 0)
+        return;
+
+    uint32_t BPC = soGetBPC();
+    uint32_t step = soGetRPC() - 1;
+    uint32_t cn[f->n];
+
+    uint8_t *stage = NULL;
+    try
+    {
+        for (uint32_t s = 0, e; s < f->n; s = e)
+        {
+            for (e = s + 1; e < f->n && f->cl[e].fcn - f->cl[s].fcn < step; e++)
+                ;
+
+            jReserve(RESERVE_STEP + RESERVE_LISTS, 3);
+
+            /* Allocation, in one batch: each new cluster is goal-directed to follow
+             * the previous file cluster, so consecutive fcns get consecutive clusters */
+            for (uint32_t i = s; i < e; i++)
+            {
+                soGetFileCluster(ih, f->cl[i].fcn, &cn[i]);
+                if (cn[i] == NULL_REFERENCE)
+                {
+                    soAllocFileCluster(ih, f->cl[i].fcn, &cn[i]);
+                    if (f->cl[i].reserved)
+                    {
+                        f->cl[i].reserved = false;
+                        reserved--;
+                    }
+                }
+            }
+
+            /* Transfer, one write per physically contiguous run */
+            for (uint32_t i = s, j; i < e; i = j)
+            {
+                for (j = i + 1; j < e && cn[j] == cn[j-1] + 1; j++)
+                    ;
+                if (j - i == 1)
+                {
+                    soWriteClusters(cn[i], f->cl[i].data, 1);
+                    continue;
+                }
+
+                if (stage == NULL && (stage = (uint8_t *) malloc(step * BPC)) == NULL)
+                    throw SOException(ENOMEM, __FUNCTION__);
+                for (uint32_t k = i; k < j; k++)
+                    memcpy(stage + (k - i) * BPC, f->cl[k].data, BPC);
+                soWriteClusters(cn[i], stage, j - i);
+            }
+
+            iSave(ih);
+        }
+    }
+    catch (...)
+    {
+        free(stage);
+        throw;
+    }
+    free(stage);
+
+    dropClusters(f);
+}
+
+/* ***************************************** */
+
+void soWBufferWrite(int ih, uint32_t fcn, uint32_t idx, const void *buf, uint32_t n)
+{
+    soProbe(800, "soWBufferWrite(%d, %u, %u, %p, %u)\n", ih, fcn, idx, buf, n);
+
+    uint32_t in = iGetNumber(ih);
+    uint32_t BPC = soGetBPC();
+    uint32_t max = WB_MAX_BYTES / BPC;
+
+    /* Get the file's buffer, taking a free slot or evicting one if needed */
+    WBFile *f = findFile(in);
+    if (f == NULL)
+    {
+        f = findFreeSlot();
+        if (f == NULL)
+        {
+            f = &table[victim];
+            victim = (victim + 1) % WB_MAX_FILES;
+            int vih = iOpen(f->in);
+            flushFile(f, vih);
+            iClose(vih);
+            releaseFile(f);
+        }
+        if ((f->cl = (WBCluster *) malloc(max * sizeof(WBCluster))) == NULL)
+            throw SOException(ENOMEM, __FUNCTION__);
+        f->in = in;
+        f->n = 0;
+    }
+
+    uint32_t i = findCluster(f, fcn);
+    if (i == f->n || f->cl[i].fcn != fcn)
+    {
+        /* A full buffer is written out before taking new data */
+        if (f->n == max)
+        {
+            flushFile(f, ih);
+            i = 0;
+        }
+
+        uint32_t cn;
+        soGetFileCluster(ih, fcn, &cn);
+
+        /* Reserve room for a cluster still to be allocated; clusters freed
+         * in the running transaction only count as free once it is committed,
+         * which can be done here, as nothing is half changed */
+        if (cn == NULL_REFERENCE && reserved >= sbGetPointer()->cfree)
+        {
+            jCommit();
+            if (reserved >= sbGetPointer()->cfree)
+                throw SOException(ENOSPC, __FUNCTION__);
+        }
+
+        uint8_t *data = (uint8_t *) malloc(BPC);
+        if (data == NULL)
+            throw SOException(ENOMEM, __FUNCTION__);
+
+        /* Only a partially written cluster needs its previous contents */
+        if (n < BPC)
+        {
+            if (cn == NULL_REFERENCE)
+                memset(data, 0x00, BPC);
+            else
+                soReadCluster(cn, data);
+        }
+
+        memmove(&f->cl[i+1], &f->cl[i], (f->n - i) * sizeof(WBCluster));
+        f->cl[i].fcn = fcn;
+        f->cl[i].reserved = (cn == NULL_REFERENCE);
+        f->cl[i].data = data;
+        f->n++;
+        if (cn == NULL_REFERENCE)
+            reserved++;
+    }
+
+    memcpy(f->cl[i].data + idx, buf, n);
+}
+
+/* ***************************************** */
+
+uint8_t *soWBufferLookup(int ih, uint32_t fcn)
+{
+    soProbe(800, "soWBufferLookup(%d, %u)\n", ih, fcn);
+
+    WBFile *f = findFile(iGetNumber(ih));
+    if (f == NULL)
+    {
+        soCount(C_WBUFFER_MISSES);
+        return NULL;
+    }
+
+    uint32_t i = findCluster(f, fcn);
+    if (i < f->n && f->cl[i].fcn == fcn)
+    {
+        soCount(C_WBUFFER_HITS);
+        return f->cl[i].data;
+    }
+    soCount(C_WBUFFER_MISSES);
+    return NULL;
+}
+
+/* ***************************************** */
+
+void soWBufferFlush(int ih)
+{
+    soProbe(800, "soWBufferFlush(%d)\n", ih);
+
+    WBFile *f = findFile(iGetNumber(ih));
+    if (f == NULL)
+        return;
+
+    flushFile(f, ih);
+    releaseFile(f);
+}
+
+/* ***************************************** */
+
+void soWBufferFlushAll()
+{
+    soProbe(800, "soWBufferFlushAll()\n");
+
+    for (uint32_t i = 0; i < WB_MAX_FILES; i++)
+    {
+        if (table[i].cl == NULL)
+            continue;
+
+        int ih = iOpen(table[i].in);
+        soWBufferFlush(ih);
+        iClose(ih);
+    }
+}
+
+/* ***************************************** */
+
+void soWBufferDiscard(int ih)
+{
+    soProbe(800, "soWBufferDiscard(%d)\n", ih);
+
+    WBFile *f = findFile(iGetNumber(ih));
+    if (f != NULL)
+        releaseFile(f);
+}
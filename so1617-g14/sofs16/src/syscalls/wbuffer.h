@@ -0,0 +1,88 @@
+/**
+ *  \file wbuffer.h
+ *  \brief write buffers: dirty file data kept in memory until flushed
+ *
+ *  Data written to a regular file is not sent to the disk right away.
+ *  It is kept, cluster by cluster, in a buffer attached to the file's inode,
+ *  and the clusters holding it are only allocated when the buffer is flushed.
+ *  At that point the full extent of the dirty data is known, so the clusters
+ *  are allocated in file order, in batches of up to RPC - 1 file clusters,
+ *  each one fitting in a transaction, and every physically contiguous run
+ *  of a batch is written to the disk in a single transfer.
+ *
+ *  A buffer is flushed when the file is flushed, synchronized or released,
+ *  before its clusters are truncated, when it grows beyond
+ *  WB_MAX_BYTES and when the file system is closed.
+ *
+ *  Space is reserved when data is buffered, so a write that would not fit
+ *  in the disk still fails with ENOSPC at write time.
+ *
+ *  \remarks In case an error occurs, every function throws a SOException
+ */
+
+#ifndef __SOFS16_WBUFFER__
+#define __SOFS16_WBUFFER__
+
+#include <stdint.h>
+
+/** \brief maximum number of files with buffered data */
+#define WB_MAX_FILES 16
+
+/** \brief maximum number of buffered bytes per file */
+#define WB_MAX_BYTES (4U << 20)
+
+/* ***************************************** */
+
+/**
+ * \brief Buffer data to be written into a file cluster
+ *
+ *  The cluster is brought into the buffer, if it is not there yet,
+ *  and bytes <tt>[idx, idx+n[</tt> are replaced by the given data.
+ *
+ *  \param ih inode handler
+ *  \param fcn file cluster number
+ *  \param idx byte position inside the cluster
+ *  \param buf pointer to the data
+ *  \param n number of bytes
+ */
+void soWBufferWrite(int ih, uint32_t fcn, uint32_t idx, const void *buf, uint32_t n);
+
+/* ***************************************** */
+
+/**
+ * \brief Get the buffered contents of a file cluster
+ *
+ *  \param ih inode handler
+ *  \param fcn file cluster number
+ *  \return pointer to the cluster data, or NULL if it is not buffered
+ */
+uint8_t *soWBufferLookup(int ih, uint32_t fcn);
+
+/* ***************************************** */
+
+/**
+ * \brief Allocate and write to disk the buffered data of a file
+ *
+ *  \param ih inode handler
+ */
+void soWBufferFlush(int ih);
+
+/* ***************************************** */
+
+/**
+ * \brief Flush the buffered data of every file
+ */
+void soWBufferFlushAll();
+
+/* ***************************************** */
+
+/**
+ * \brief Drop the buffered data of a file, without writing it
+ *
+ *  \param ih inode handler
+ */
+void soWBufferDiscard(int ih);
+
+/* ***************************************** */
+
+#endif                          /* __SOFS16_WBUFFER__ */
@@ -26,6 +26,8 @@
 #include "freelists.h" /* added */
 #include "filecluster.h" /* added */
 #include "direntries.h" /* added */
+#include "wbuffer.h"
+#include "reserve.h"
 
 /*
  *  \brief Write data into an open regular file.
@@ -40,9 +42,9 @@
  *  \return 0 on success; 
  *      -errno in case of error, being errno the system error that better represents the cause of failure
  */
-int soWrite(const char *path, void *buff, uint32_t count, int32_t pos)
+int soWrite(const char *path, void *buff, size_t count, off_t pos)
 {
-    soProbe(230, "soWrite(\"%s\", %p, %u, %u)\n", path, buff, count, pos);
+    soProbe(230, "soWrite(\"%s\", %p, %zu, %jd)\n", path, buff, count, (intmax_t) pos);
 
     try
     {
@@ -50,11 +52,12 @@ int soWrite(const char *path, void *buff, uint32_t count, int32_t pos)
         if(pos < 0)
             throw SOException(EINVAL, __FUNCTION__);
 
-        uint32_t cinp, BPC = soGetBPC();
-        uint32_t fcn = pos/BPC, idx = pos%BPC;
-        uint32_t fcn_last, idx_last, cih, nbytes, bytestowrite;
+        /* Check if the file would grow beyond its maximum size */
+        if((uint64_t) pos + count > soGetMaxFileSize())
+            throw SOException(EFBIG, __FUNCTION__);
+
+        uint32_t cinp, cih, BPC = soGetBPC();
         SOInode *inode;
-        char data[BPC];
 
         char* xpath = strdupa(path);
 
@@ -71,41 +74,36 @@ int soWrite(const char *path, void *buff, uint32_t count, int32_t pos)
         /* Get pointer */
         inode = iGetPointer(cih);
 
-    	nbytes = 0;
-        bytestowrite = count;
-        fcn_last = (pos+count-1)/BPC;
-        idx_last = (pos+count-1)%BPC;
-
-        for(uint32_t i = fcn; i <= fcn_last; i++){
-
-            /* read cluster */
-            soReadFileCluster(cih, i, data);
-            
-            /* if it is the first cluster */
-            if(i == fcn){
-                if(count+idx <= BPC){
-                    memcpy(data+idx, buff, idx_last-idx+1);
-                    nbytes += idx_last-idx+1;
-                }else{
-                    memcpy(data+idx, buff, BPC-idx);
-                    nbytes += (BPC-idx);
-                }
-            /* if it is the last cluster but not the first */
-            }else if(i == fcn_last){
-                memcpy(data, (uint8_t *)buff+nbytes, bytestowrite-nbytes);
-                nbytes = bytestowrite;
-            /* intermediate cluster */
-            }else{
-                memcpy(data, (uint8_t *)buff+nbytes, BPC);
-                nbytes += BPC;
+        uint8_t *p = (uint8_t *) buff;
+        uint32_t fcn = pos/BPC, idx = pos%BPC;
+        size_t nbytes = 0;
+
+        while(nbytes < count){
+            size_t n = BPC - idx;
+            if(n > count - nbytes)
+                n = count - nbytes;
+
+            /* data goes to the file's write buffer; clusters are only
+             * allocated and written when the buffer is flushed.
+             * Running out of space after some data was taken is a short write */
+            try{
+                soWBufferWrite(cih, fcn, idx, p+nbytes, n);
+            }catch(SOException & err){
+                if(nbytes == 0)
+                    throw;
+                break;
             }
 
-            soWriteFileCluster(cih, i, data);
-
+            nbytes += n;
+            fcn++;
+            idx = 0;
         }
 
-        inode->size += nbytes;
+        /* Only grow the file if data was written past its end */
+        if((uint64_t) pos + nbytes > inode->size)
+            inode->size = pos + nbytes;
 
+        jReserve(0, 1);
         iSave(cih);
         iClose(cih);
 
@@ -27,7 +27,7 @@ void printBlockAsHex(void *buf, uint32_t off)
     unsigned char *byte = (unsigned char *)buf;
 
     /* print cluster */
-    for (unsigned int i = 0; i < BLOCK_SIZE; i++)
+    for (unsigned int i = 0; i < soGetRawBlockSize(); i++)
     {
         if ((i & 0x1f) == 0)
             printf("%4.4x:", i + off);
@@ -49,7 +49,7 @@ void printBlockAsAscii(void *buf, uint32_t off)
     /* print cluster */
     char line[256];             /* line to be printed */
     char *p_line = line;        /* pointer to a character in the line */
-    for (unsigned int i = 0; i < BLOCK_SIZE; i++)
+    for (unsigned int i = 0; i < soGetRawBlockSize(); i++)
     {
         if ((i & 0x1f) == 0)
         {
@@ -107,6 +107,7 @@ void printSuperBlock(void *buf)
     printf("   Magic number: 0x%0" PRIX16 "\n", sbp->magic);
     printf("   Version number: 0x%0" PRIX16 "\n", sbp->version);
     printf("   Volume name: %-s\n", sbp->name);
+    printf("   Block size: %u\n", sbp->bsize);
     printf("   Total number of blocks in the device: %u\n", sbp->ntotal);
     printf("   Properly unmounted: %s\n", (sbp->mstat == PRU) ? "yes" : "no");
 
@@ -116,17 +117,18 @@ void printSuperBlock(void *buf)
     printf("   First block of the inode table: %u\n", sbp->itstart);
     printf("   Number of blocks of the inode table: %u\n", sbp->itsize);
     printf("   Number of free inodes: %u\n", sbp->ifree);
-    printf("   Head of list of free inodes: ");
-    if (sbp->ihead == NULL_REFERENCE)
-        printf("(nil)\n");
-    else
-        printf("%" PRIu32 "\n", sbp->ihead);
+    printf("   Number of initialized blocks of the inode table: %u\n", sbp->iinit);
     printf("   Tail of list of free inodes: ");
     if (sbp->itail == NULL_REFERENCE)
         printf("(nil)\n");
     else
         printf("%" PRIu32 "\n", sbp->itail);
 
+    /* journal */
+    printf("Journal metadata:\n");
+    printf("   First block of the journal: %u\n", sbp->jstart);
+    printf("   Number of blocks of the journal: %u\n", sbp->jsize);
+
     /* cluster zone */
     printf("Data zone:\n");
     printf("   Number of blocks per cluster: %u\n", sbp->csize);
@@ -247,7 +249,7 @@ void printInode(void *buf, uint32_t in)
     printf("owner = %" PRIu32 ", group = %" PRIu32 "\n", ip->owner, ip->group);
 
     /* print file size in bytes and in clusters */
-    printf("size in bytes = %" PRIu32 ", size in clusters = %" PRIu32 "\n", ip->size, ip->csize);
+    printf("size in bytes = %" PRIu64 ", size in clusters = %" PRIu32 "\n", ip->size, ip->csize);
 
     /* decouple and print information about dates of file manipulation, 
      * if inode is in use, or about the inode references
@@ -329,7 +331,7 @@ void printBlockOfInodes(void *buf, uint32_t off)
 void printBlockOfDirents(void *buf, uint32_t off)
 {
     /* get dirents per cluster */
-    uint32_t dpb = BLOCK_SIZE / sizeof(SODirEntry);
+    uint32_t dpb = DPB;
 
     /* cast buf to appropriated type */
     SODirEntry *dir = (SODirEntry *) buf;
@@ -350,7 +352,7 @@ void printBlockOfDirents(void *buf, uint32_t off)
 void printBlockOfRefs(void *buf, uint32_t off)
 {
     /* get refs per block */
-    uint32_t rpb = BLOCK_SIZE / sizeof(uint32_t);
+    uint32_t rpb = RPB;
 
     /* cast buf to appropriated type */
     uint32_t *ref = (uint32_t *) buf;
@@ -127,7 +127,8 @@ int main(int argc, char *argv[])
     }
 
     /* process request */
-    char buf[BLOCK_SIZE];
+    uint32_t bsize = soGetRawBlockSize();
+    char buf[bsize];
     uint32_t off = 0;
     for (uint32_t i = i1; i <= i2; i++)
     {
@@ -144,11 +145,11 @@ int main(int argc, char *argv[])
         {
             case 'x':
                 printBlockAsHex(buf, off);
-                off += BLOCK_SIZE;
+                off += bsize;
                 break;
             case 'a':
                 printBlockAsAscii(buf, off);
-                off += BLOCK_SIZE;
+                off += bsize;
                 break;
             case 'i':
                 printBlockOfInodes(buf, off);
@@ -0,0 +1,193 @@
+/**
+ *  \brief Trace decoder
+ *
+ *  It prints the probing messages recorded in a binary trace, as they would
+ *  have been printed as they came, restricted to a range of depths.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <string.h>
+#include <errno.h>
+
+#include "trace.h"
+
+/*
+ * print help message
+ */
+static void printUsage(char *cmd_name)
+{
+    printf("Sinopsis: %s [OPTIONS] trace-file\n"
+           "  OPTIONS:\n"
+           "  -l lower,upper   --- show only messages with depths in the range (default: all)\n"
+           "  -t               --- prefix messages with their time, in microseconds, and thread\n"
+           "  -n               --- do not use colors\n"
+           "  -s               --- print only a summary of the trace\n"
+           "  -h               --- print this help\n", cmd_name);
+}
+
+/* the format strings of the trace, kept sorted by key */
+static SOTraceFormat *formats = NULL;
+static char **texts = NULL;
+static uint32_t nformats = 0;
+
+static const char *lookup(uint64_t key)
+{
+    uint32_t lo = 0, hi = nformats;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (formats[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < nformats && formats[lo].key == key) ? texts[lo] : NULL;
+}
+
+/* The main function */
+
+int main(int argc, char *argv[])
+{
+    char *progName = basename(argv[0]);
+
+    /* process command line options */
+    int opt;
+    uint32_t lower = 0, upper = UINT32_MAX;
+    bool times = false;
+    bool colors = true;
+    bool summary = false;
+
+    while ((opt = getopt(argc, argv, "l:tnsh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l':          /* depth range */
+            {
+                if (sscanf(optarg, "%u,%u", &lower, &upper) != 2 || upper < lower)
+                {
+                    fprintf(stderr, "%s: Bad argument to l option.\n", progName);
+                    printUsage(progName);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 't':          /* time and thread */
+            {
+                times = true;
+                break;
+            }
+            case 'n':          /* no colors */
+            {
+                colors = false;
+                break;
+            }
+            case 's':          /* summary */
+            {
+                summary = true;
+                break;
+            }
+            case 'h':
+            {
+                printUsage(progName);
+                return EXIT_SUCCESS;
+            }
+            default:
+            {
+                fprintf(stderr, "%s: Wrong option.\n", progName);
+                printUsage(progName);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    /* check existence of mandatory argument: trace file name */
+    if ((argc - optind) != 1)
+    {
+        fprintf(stderr, "%s: Wrong number of mandatory arguments.\n", progName);
+        printUsage(progName);
+        return EXIT_FAILURE;
+    }
+
+    FILE *fin = fopen(argv[optind], "r");
+    if (fin == NULL)
+    {
+        fprintf(stderr, "%s: %s: %s\n", progName, argv[optind], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* the header and the format strings */
+    SOTraceHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fin) != 1 || memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0)
+    {
+        fprintf(stderr, "%s: %s: Not a trace file\n", progName, argv[optind]);
+        return EXIT_FAILURE;
+    }
+    nformats = hdr.nformats;
+    formats = (SOTraceFormat *) malloc((nformats + 1) * sizeof(SOTraceFormat));
+    texts = (char **) malloc((nformats + 1) * sizeof(char *));
+    if (formats == NULL || texts == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", progName, strerror(ENOMEM));
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < nformats; i++)
+    {
+        if (fread(&formats[i], sizeof(SOTraceFormat), 1, fin) != 1 || formats[i].len == 0 ||
+                (texts[i] = (char *) malloc(formats[i].len)) == NULL ||
+                fread(texts[i], formats[i].len, 1, fin) != 1)
+        {
+            fprintf(stderr, "%s: %s: Truncated trace file\n", progName, argv[optind]);
+            return EXIT_FAILURE;
+        }
+        texts[i][formats[i].len - 1] = '\0';
+    }
+
+    if (summary)
+    {
+        printf("%" PRIu64 " events, from %u threads, %" PRIu64 " lost, %u format strings\n",
+                hdr.nevents, hdr.nthreads, hdr.lost, nformats);
+        return EXIT_SUCCESS;
+    }
+    if (hdr.lost > 0)
+        fprintf(stderr, "%s: %" PRIu64 " earlier events were overwritten, only the last ones of each thread are kept\n",
+                progName, hdr.lost);
+
+    /* the events, already sorted by time */
+    SOTraceEvent ev;
+    uint64_t t0 = 0;
+    for (uint64_t i = 0; i < hdr.nevents; i++)
+    {
+        if (fread(&ev, sizeof(ev), 1, fin) != 1)
+        {
+            fprintf(stderr, "%s: %s: Truncated trace file\n", progName, argv[optind]);
+            return EXIT_FAILURE;
+        }
+        if (i == 0)
+            t0 = ev.ts;
+        if (ev.depth < lower || ev.depth > upper)
+            continue;
+
+        const char *fmt = lookup(ev.fmt);
+        const char *color = (ev.flags & TRACE_COLORED) ? lookup(ev.color) : "01;34";
+        if (fmt == NULL || color == NULL)
+        {
+            fprintf(stderr, "%s: %s: Event without its format string\n", progName, argv[optind]);
+            return EXIT_FAILURE;
+        }
+
+        if (times)
+            printf("%12.3f [%u] ", (ev.ts - t0) / 1000.0, ev.tid);
+        if (colors)
+            printf("\e[%sm(%d)-->\e[0m ", color, ev.depth);
+        else
+            printf("(%d)--> ", ev.depth);
+        soPrintTraceEvent(stdout, fmt, &ev);
+    }
+
+    fclose(fin);
+    return EXIT_SUCCESS;
+}                               /* end of main */
@@ -0,0 +1,971 @@
+/**
+ *  \brief File system checker
+ *
+ *  It checks the consistency of a sofs16 volume and, if asked, repairs it.
+ *
+ *  The table of inodes is read in large chunks by several threads, each
+ *  one following the reference trees of the inodes in use it finds, while
+ *  another thread follows the list of free clusters.
+ *  What they find is gathered in bitmaps of the cluster zone and in
+ *  per-inode counters, which are only compared when every thread is done.
+ *  The directories found are then read, also in parallel, to count the
+ *  links of every inode.
+ *
+ *  Checking does not write to the device: it sees the volume as the next
+ *  mount will, with the committed transaction left in the journal, if any,
+ *  overlaid on what is read.
+ *  It can thus be run on a mounted volume, which is checked as of its last
+ *  commit; problems found that way should be confirmed by a second run.
+ *  Repairing goes through the dealers, so the volume must not be mounted: it is
+ *  refused on a volume not marked as properly unmounted, unless forced.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "probing.h"
+#include "exception.h"
+#include "rawdisk.h"
+#include "core.h"
+#include "superblock.h"
+#include "inode.h"
+#include "direntry.h"
+#include "cluster.h"
+#include "freelists.h"
+#include "filecluster.h"
+#include "direntries.h"
+#include "dealers.h"
+
+/* size of the chunks in which the table of inodes is read */
+#define SCAN_CHUNK_SIZE (1024 * 1024)
+
+/* largest number of scanning threads */
+#define MAX_SCANNERS 8
+
+/* exit status, the same as fsck's */
+#define FSCK_OK 0
+#define FSCK_CORRECTED 1
+#define FSCK_UNCORRECTED 4
+#define FSCK_ERROR 8
+
+/* state of an inode, as found by the scan */
+#define I_FREE 0
+#define I_INUSE 1
+
+/* ******************************************** */
+
+static bool quiet = false;      /* print only the summary */
+static bool report = true;      /* print problems as they are found (not when rescanning after a repair) */
+
+/* the superblock, as found when the scan starts */
+static union
+{
+    SOSuperBlock sb;
+    uint8_t block[MAX_BLOCK_SIZE];
+} b0;
+static SOSuperBlock &sb = b0.sb;
+static uint32_t bsize, BPC, RPC, DPC;
+
+/* committed transaction left in the journal, overlaid on every read */
+static uint8_t *jbuf = NULL;
+static uint32_t jn = 0;
+static uint32_t *jrefs = NULL;
+static uint8_t *jimages = NULL;
+
+/* bitmaps of the cluster zone */
+static uint32_t *usedMap = NULL;        /* referenced by some inode */
+static uint32_t *fctMap = NULL;         /* holding part of the list of free clusters */
+static uint32_t *freeMap = NULL;        /* referenced by the list of free clusters */
+
+/* per-inode findings */
+static uint8_t *state = NULL;
+static uint16_t *refcount = NULL;       /* reference count recorded in the inode */
+static uint32_t *links = NULL;          /* directory entries found referencing the inode */
+static uint32_t *csize = NULL;          /* cluster count recorded in the inode */
+static uint32_t *clusters = NULL;       /* clusters found in its reference tree */
+
+/* directories found by the scan of the table of inodes, read afterwards */
+struct Dir
+{
+    uint32_t in;
+    SOInode inode;
+};
+static Dir *dirs = NULL;
+static uint32_t ndirs = 0, maxdirs = 0;
+
+/* directory entries referencing no inode in use */
+struct Dangling
+{
+    uint32_t dir;
+    char name[SOFS16_MAX_NAME + 1];
+};
+static Dangling *dangling = NULL;
+static uint32_t ndangling = 0, maxdangling = 0;
+
+/* what a scan found */
+static struct
+{
+    uint32_t problems;          /* everything found wrong */
+    uint32_t unrepairable;      /* the part of it that cannot be repaired */
+    uint32_t ifree;             /* free inodes */
+    uint32_t cfree;             /* references in the list of free clusters */
+    uint32_t crefs;             /* clusters holding the list of free clusters */
+    bool badList;               /* the list of free clusters must be rebuilt */
+    uint32_t orphans;           /* inodes in use in no directory */
+    uint32_t badCounts;         /* inodes with a wrong reference or cluster count */
+} found;
+
+/* protects the lists above and the output */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ******************************************** */
+
+/* print help message */
+static void printUsage(char *cmd_name)
+{
+    printf("Sinopsis: %s [OPTIONS] supp-file\n"
+           "  OPTIONS:\n"
+           "  -r   --- repair the problems found (the volume must not be mounted)\n"
+           "  -f   --- repair even if the volume is not marked as properly unmounted\n"
+           "  -q   --- quiet mode: print only the summary\n"
+           "  -h   --- print this help\n", cmd_name);
+}
+
+/* print error message */
+static void printError(int errcode, char *cmd_name)
+{
+    fprintf(stderr, "%s: error #%d - %s.\n", cmd_name, errcode, strerror(errcode));
+}
+
+/* report a problem, telling whether it can be repaired */
+static void problem(bool repairable, const char *fmt, ...)
+{
+    pthread_mutex_lock(&lock);
+    found.problems++;
+    if (!repairable)
+        found.unrepairable++;
+    if (report && !quiet)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* ******************************************** */
+
+/* set bit n of a bitmap, possibly at the same time as other threads, telling whether it was already set */
+static bool testAndSet(uint32_t *map, uint32_t n)
+{
+    uint32_t mask = 1U << (n % 32);
+    return (__sync_fetch_and_or(&map[n / 32], mask) & mask) != 0;
+}
+
+static bool isSet(const uint32_t *map, uint32_t n)
+{
+    return (map[n / 32] >> (n % 32)) & 1;
+}
+
+/* read consecutive blocks, as changed by the transaction left in the journal */
+static void readBlocks(uint32_t bn, void *buf, uint32_t count)
+{
+    soReadRawCluster(bn, buf, count);
+    for (uint32_t i = 0; i < jn; i++)
+        if (jrefs[i] != NULL_BLOCK && jrefs[i] >= bn && jrefs[i] - bn < count)
+            memcpy((uint8_t *) buf + (jrefs[i] - bn) * bsize, jimages + i * bsize, bsize);
+}
+
+static void readCluster(uint32_t cn, void *buf)
+{
+    readBlocks(sb.czstart + cn * sb.csize, buf, sb.csize);
+}
+
+/* ******************************************** */
+
+/* what a scanning thread works with */
+struct Worker
+{
+    uint8_t *chunk;             /* a chunk of the table of inodes */
+    uint32_t *refs[2];          /* contents of an indirect cluster, one per level */
+    uint8_t *data;              /* contents of a data cluster */
+    uint32_t ifree;             /* free inodes found */
+};
+
+/* called for every cluster of a file; fcn is NULL_REFERENCE for the clusters holding references */
+typedef void (*ClusterFn)(Worker * w, uint32_t in, const SOInode * ip, uint32_t fcn, uint32_t cn);
+
+/* whether a non-null reference points into the cluster zone, reporting it if not and asked to */
+static bool inZone(uint32_t in, uint32_t cn, bool check)
+{
+    if (cn < sb.ctotal)
+        return true;
+    if (check)
+        problem(false, "Inode %u: reference to cluster %u, out of the cluster zone\n", in, cn);
+    return false;
+}
+
+/* go through the reference tree of an inode, in file order */
+static void walk(Worker * w, uint32_t in, const SOInode * ip, bool check, ClusterFn fn)
+{
+    for (uint32_t i = 0; i < N_DIRECT; i++)
+        if (ip->d[i] != NULL_REFERENCE && inZone(in, ip->d[i], check))
+            fn(w, in, ip, i, ip->d[i]);
+
+    for (uint32_t i = 0; i < N_INDIRECT; i++)
+    {
+        if (ip->i1[i] == NULL_REFERENCE || !inZone(in, ip->i1[i], check))
+            continue;
+        fn(w, in, ip, NULL_REFERENCE, ip->i1[i]);
+        readCluster(ip->i1[i], w->refs[0]);
+        for (uint32_t j = 0; j < RPC; j++)
+            if (w->refs[0][j] != NULL_REFERENCE && inZone(in, w->refs[0][j], check))
+                fn(w, in, ip, N_DIRECT + i * RPC + j, w->refs[0][j]);
+    }
+
+    if (ip->i2 == NULL_REFERENCE || !inZone(in, ip->i2, check))
+        return;
+    fn(w, in, ip, NULL_REFERENCE, ip->i2);
+    readCluster(ip->i2, w->refs[1]);
+    for (uint32_t i = 0; i < RPC; i++)
+    {
+        uint32_t cn = w->refs[1][i];
+        if (cn == NULL_REFERENCE || !inZone(in, cn, check))
+            continue;
+        fn(w, in, ip, NULL_REFERENCE, cn);
+        readCluster(cn, w->refs[0]);
+        for (uint32_t j = 0; j < RPC; j++)
+            if (w->refs[0][j] != NULL_REFERENCE && inZone(in, w->refs[0][j], check))
+                fn(w, in, ip, N_DIRECT + N_INDIRECT * RPC + i * RPC + j, w->refs[0][j]);
+    }
+}
+
+/* ******************************************** */
+
+/* mark a cluster as used by an inode */
+static void markCluster(Worker * w, uint32_t in, const SOInode * ip, uint32_t fcn, uint32_t cn)
+{
+    clusters[in]++;
+    if (testAndSet(usedMap, cn))
+        problem(false, "Cluster %u: used more than once, by inode %u among others\n", cn, in);
+}
+
+static void addDir(uint32_t in, const SOInode * ip)
+{
+    pthread_mutex_lock(&lock);
+    if (ndirs == maxdirs)
+    {
+        maxdirs = (maxdirs == 0) ? 64 : 2 * maxdirs;
+        Dir *p = (Dir *) realloc(dirs, maxdirs * sizeof(Dir));
+        if (p == NULL)
+        {
+            pthread_mutex_unlock(&lock);
+            throw SOException(ENOMEM, __FUNCTION__);
+        }
+        dirs = p;
+    }
+    dirs[ndirs].in = in;
+    dirs[ndirs].inode = *ip;
+    ndirs++;
+    pthread_mutex_unlock(&lock);
+}
+
+/* scan a chunk of the table of inodes */
+static void scanTable(Worker * w, uint32_t c)
+{
+    uint32_t cblocks = SCAN_CHUNK_SIZE / bsize;
+    uint32_t first = c * cblocks;
+    uint32_t count = (sb.iinit - first < cblocks) ? sb.iinit - first : cblocks;
+    readBlocks(sb.itstart + first, w->chunk, count);
+
+    SOInode *inode = (SOInode *) w->chunk;
+    for (uint32_t k = 0; k < count * IPB; k++)
+    {
+        uint32_t in = first * IPB + k;
+        SOInode *ip = &inode[k];
+        if (ip->mode & INODE_FREE)
+        {
+            w->ifree++;
+            continue;
+        }
+
+        state[in] = I_INUSE;
+        refcount[in] = ip->refcount;
+        csize[in] = ip->csize;
+        if (!S_ISREG(ip->mode) && !S_ISDIR(ip->mode) && !S_ISLNK(ip->mode))
+            problem(false, "Inode %u: unknown type (mode %06o)\n", in, ip->mode);
+
+        /* the clusters of a damaged inode are still marked, so that they are not taken as free */
+        walk(w, in, ip, true, markCluster);
+        if (clusters[in] != ip->csize)
+        {
+            problem(true, "Inode %u: cluster count %u, should be %u\n", in, ip->csize, clusters[in]);
+            __sync_fetch_and_add(&found.badCounts, 1);
+        }
+
+        if (S_ISDIR(ip->mode))
+        {
+            if (ip->size % sizeof(SODirEntry) != 0 || ip->size < 2 * sizeof(SODirEntry))
+                problem(false, "Directory %u: size %" PRIu64 " is not a whole number of entries\n", in, ip->size);
+            else
+                addDir(in, ip);
+        }
+    }
+}
+
+/* ******************************************** */
+
+static void addDangling(uint32_t dir, const char *name)
+{
+    pthread_mutex_lock(&lock);
+    if (ndangling == maxdangling)
+    {
+        maxdangling = (maxdangling == 0) ? 64 : 2 * maxdangling;
+        Dangling *p = (Dangling *) realloc(dangling, maxdangling * sizeof(Dangling));
+        if (p == NULL)
+        {
+            pthread_mutex_unlock(&lock);
+            throw SOException(ENOMEM, __FUNCTION__);
+        }
+        dangling = p;
+    }
+    dangling[ndangling].dir = dir;
+    strncpy(dangling[ndangling].name, name, SOFS16_MAX_NAME + 1);
+    ndangling++;
+    pthread_mutex_unlock(&lock);
+}
+
+/* count the links found in a data cluster of a directory */
+static void countEntries(Worker * w, uint32_t in, const SOInode * ip, uint32_t fcn, uint32_t cn)
+{
+    uint64_t n = ip->size / sizeof(SODirEntry);
+    if (fcn == NULL_REFERENCE || (uint64_t) fcn * DPC >= n)
+        return;
+
+    readCluster(cn, w->data);
+    SODirEntry *de = (SODirEntry *) w->data;
+    for (uint32_t j = 0; j < DPC && (uint64_t) fcn * DPC + j < n; j++)
+    {
+        uint32_t cin = de[j].in;
+        if (cin < sb.itotal && state[cin] == I_INUSE)
+        {
+            __sync_fetch_and_add(&links[cin], 1);
+            continue;
+        }
+
+        /* "." and ".." cannot go away */
+        de[j].name[SOFS16_MAX_NAME] = '\0';
+        bool dots = (fcn == 0 && j < 2);
+        problem(!dots, "Directory %u: entry \"%s\" references %s inode %u\n", in, de[j].name,
+                (cin < sb.itotal) ? "free" : "nonexistent", cin);
+        if (!dots)
+            addDangling(in, de[j].name);
+    }
+}
+
+static void scanDir(Worker * w, uint32_t k)
+{
+    walk(w, dirs[k].in, &dirs[k].inode, false, countEntries);
+}
+
+/* ******************************************** */
+
+/* take a reference found in the list of free clusters */
+static void markFree(uint32_t cn)
+{
+    if (cn >= sb.ctotal)
+    {
+        problem(true, "List of free clusters: reference to cluster %u, out of the cluster zone\n", cn);
+        found.badList = true;
+        return;
+    }
+    found.cfree++;
+    if (testAndSet(freeMap, cn))
+    {
+        problem(true, "Cluster %u: more than once in the list of free clusters\n", cn);
+        found.badList = true;
+    }
+}
+
+static void walkCache(const FCTRecord * rec)
+{
+    for (uint32_t k = 0, i = rec->cache.out; k < FCT_CACHE_SIZE && rec->cache.ref[i] != NULL_REFERENCE;
+            k++, i = (i + 1) % FCT_CACHE_SIZE)
+        markFree(rec->cache.ref[i]);
+}
+
+/* go through the list of free clusters: both caches and the chain of clusters from chead to ctail */
+static void walkFreeList(uint32_t *refs)
+{
+    walkCache(&sb.chead);
+    walkCache(&sb.ctail);
+
+    uint32_t cn = sb.chead.cluster_number;
+    uint32_t last = NULL_REFERENCE;
+    for (uint32_t k = 0; k < sb.crefs; k++)
+    {
+        if (cn >= sb.ctotal || testAndSet(fctMap, cn))
+        {
+            problem(true, "List of free clusters: broken after %u of its %u clusters\n", k, sb.crefs);
+            found.badList = true;
+            return;
+        }
+        found.crefs++;
+        readCluster(cn, refs);
+        for (uint32_t j = 0; j < RPC - 1; j++)
+            if (refs[j] != NULL_REFERENCE)
+                markFree(refs[j]);
+        last = cn;
+        cn = refs[RPC - 1];
+    }
+
+    if (last != sb.ctail.cluster_number && sb.crefs > 0)
+    {
+        problem(true, "List of free clusters: ends in cluster %u, not in ctail's %u\n", last,
+                sb.ctail.cluster_number);
+        found.badList = true;
+    }
+}
+
+/* ******************************************** */
+
+/* a set of tasks shared by the scanning threads */
+typedef void (*TaskFn)(Worker * w, uint32_t task);
+static struct
+{
+    TaskFn fn;
+    uint32_t ntasks;
+    uint32_t next;              /* next task to be taken */
+    int en;                     /* error of the first thread that failed, 0 if none */
+} pool;
+
+static void fail(int en)
+{
+    __sync_bool_compare_and_swap(&pool.en, 0, en);
+}
+
+/* each scanner takes the next task until none is left */
+static void *scanner(void *arg)
+{
+    Worker w;
+    w.chunk = (uint8_t *) malloc(SCAN_CHUNK_SIZE);
+    w.refs[0] = (uint32_t *) malloc(BPC);
+    w.refs[1] = (uint32_t *) malloc(BPC);
+    w.data = (uint8_t *) malloc(BPC);
+    w.ifree = 0;
+
+    if (w.chunk == NULL || w.refs[0] == NULL || w.refs[1] == NULL || w.data == NULL)
+        fail(ENOMEM);
+    else
+    {
+        try
+        {
+            uint32_t t;
+            while (pool.en == 0 && (t = __sync_fetch_and_add(&pool.next, 1)) < pool.ntasks)
+                pool.fn(&w, t);
+        }
+        catch(SOException & err)
+        {
+            fail(err.en);
+        }
+    }
+    __sync_fetch_and_add(&found.ifree, w.ifree);
+
+    free(w.chunk);
+    free(w.refs[0]);
+    free(w.refs[1]);
+    free(w.data);
+    return NULL;
+}
+
+/* the free list is followed by a thread of its own, alongside the scanners */
+static void *freeListWalker(void *arg)
+{
+    uint32_t *refs = (uint32_t *) malloc(BPC);
+    if (refs == NULL)
+    {
+        fail(ENOMEM);
+        return NULL;
+    }
+    try
+    {
+        walkFreeList(refs);
+    }
+    catch(SOException & err)
+    {
+        fail(err.en);
+    }
+    free(refs);
+    return NULL;
+}
+
+/*
+ * run a set of tasks with as many scanners as there are processors, up to MAX_SCANNERS,
+ *   plus the free list walker if asked
+ */
+static void runScanners(TaskFn fn, uint32_t ntasks, bool withFreeList)
+{
+    pool.fn = fn;
+    pool.ntasks = ntasks;
+    pool.next = 0;
+    pool.en = 0;
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t nw = (ncpu < 1) ? 1 : (ncpu > MAX_SCANNERS) ? MAX_SCANNERS : ncpu;
+    if (nw > ntasks)
+        nw = (ntasks == 0) ? 1 : ntasks;
+
+    pthread_t fl;
+    bool flStarted = withFreeList && pthread_create(&fl, NULL, freeListWalker, NULL) == 0;
+    if (withFreeList && !flStarted)
+        freeListWalker(NULL);
+
+    /* the calling thread is one of the scanners */
+    pthread_t thr[nw];
+    uint32_t started = 1;
+    for (; started < nw; started++)
+        if (pthread_create(&thr[started], NULL, scanner, NULL) != 0)
+            break;
+    scanner(NULL);
+    for (uint32_t i = 1; i < started; i++)
+        pthread_join(thr[i], NULL);
+    if (flStarted)
+        pthread_join(fl, NULL);
+
+    if (pool.en != 0)
+        throw SOException(pool.en, __FUNCTION__);
+}
+
+/* ******************************************** */
+
+/* get room for what the scans find, the superblock being known */
+static void allocScanData()
+{
+    bsize = soGetRawBlockSize();
+    BPC = sb.csize * bsize;
+    RPC = BPC / sizeof(uint32_t);
+    DPC = BPC / sizeof(SODirEntry);
+
+    size_t words = (sb.ctotal + 31) / 32;
+    usedMap = (uint32_t *) malloc(words * sizeof(uint32_t));
+    fctMap = (uint32_t *) malloc(words * sizeof(uint32_t));
+    freeMap = (uint32_t *) malloc(words * sizeof(uint32_t));
+    state = (uint8_t *) malloc(sb.itotal * sizeof(uint8_t));
+    refcount = (uint16_t *) malloc(sb.itotal * sizeof(uint16_t));
+    links = (uint32_t *) malloc(sb.itotal * sizeof(uint32_t));
+    csize = (uint32_t *) malloc(sb.itotal * sizeof(uint32_t));
+    clusters = (uint32_t *) malloc(sb.itotal * sizeof(uint32_t));
+    if (usedMap == NULL || fctMap == NULL || freeMap == NULL || state == NULL ||
+            refcount == NULL || links == NULL || csize == NULL || clusters == NULL)
+        throw SOException(ENOMEM, __FUNCTION__);
+}
+
+/* check the volume, as described by the superblock in sb */
+static void scan()
+{
+    size_t words = (sb.ctotal + 31) / 32;
+    memset(usedMap, 0, words * sizeof(uint32_t));
+    memset(fctMap, 0, words * sizeof(uint32_t));
+    memset(freeMap, 0, words * sizeof(uint32_t));
+    memset(state, I_FREE, sb.itotal * sizeof(uint8_t));
+    memset(links, 0, sb.itotal * sizeof(uint32_t));
+    memset(clusters, 0, sb.itotal * sizeof(uint32_t));
+    memset(&found, 0, sizeof(found));
+    ndirs = ndangling = 0;
+
+    /* the initialized part of the table of inodes and the list of free clusters;
+     * the inodes beyond are all free */
+    uint32_t cblocks = SCAN_CHUNK_SIZE / bsize;
+    runScanners(scanTable, (sb.iinit + cblocks - 1) / cblocks, true);
+    found.ifree += (sb.itsize - sb.iinit) * IPB;
+
+    if (state[0] != I_INUSE)
+        problem(false, "Root directory: inode 0 is not in use\n");
+
+    /* the directories, now that it is known which inodes are in use */
+    runScanners(scanDir, ndirs, false);
+
+    /* every cluster must be either in use, by a file or by the list of free clusters, or free */
+    uint32_t leaked = 0, twice = 0;
+    for (uint32_t cn = 0; cn < sb.ctotal; cn++)
+    {
+        bool inFile = isSet(usedMap, cn), inList = isSet(fctMap, cn), isFree = isSet(freeMap, cn);
+        if (inFile && inList)
+            problem(true, "Cluster %u: used by a file and by the list of free clusters\n", cn);
+        if (!inFile && !inList && !isFree)
+            leaked++;
+        else if ((inFile || inList) && isFree)
+            twice++;
+    }
+    if (leaked > 0)
+        problem(true, "%u clusters neither in use nor in the list of free clusters\n", leaked);
+    if (twice > 0)
+        problem(true, "%u clusters both in use and in the list of free clusters\n", twice);
+    if (leaked > 0 || twice > 0)
+        found.badList = true;
+
+    if (found.cfree != sb.cfree || found.crefs != sb.crefs)
+    {
+        problem(true, "Superblock: %u free clusters in %u clusters of the list, should be %u in %u\n",
+                sb.cfree, sb.crefs, found.cfree, found.crefs);
+        found.badList = true;
+    }
+    if (found.ifree != sb.ifree)
+        problem(true, "Superblock: %u free inodes, should be %u\n", sb.ifree, found.ifree);
+
+    /* every inode in use must be referenced by as many directory entries as its count says */
+    for (uint32_t in = 0; in < sb.itotal; in++)
+    {
+        if (state[in] != I_INUSE)
+            continue;
+        if (links[in] == 0 && in != 0)
+        {
+            problem(true, "Inode %u: in use, but in no directory\n", in);
+            found.orphans++;
+        }
+        else if (links[in] != refcount[in])
+        {
+            problem(true, "Inode %u: reference count %u, should be %u\n", in, refcount[in], links[in]);
+            found.badCounts++;
+        }
+    }
+}
+
+/* ******************************************** */
+
+/* open the volume for checking only, through the raw disk */
+static void openVolume(const char *devname)
+{
+    soOpenRawDisk(devname);
+    soReadRawBlock(0, b0.block);
+    if (sb.magic != MAGIC_NUMBER || sb.version != VERSION_NUMBER)
+        throw SOException(EMEDIUMTYPE, __FUNCTION__);
+    soSetRawBlockSize(sb.bsize);
+    bsize = soGetRawBlockSize();
+
+    /* the journal's location is set by mksofs, so it is known even if the superblock is in the journal */
+    jbuf = soLoadJournal(sb.jstart, sb.jsize, &jn, &jrefs, &jimages);
+    readBlocks(0, b0.block, 1);
+}
+
+/* tell whether the volume is marked as not properly unmounted, as of its last commit, without writing to it */
+static bool notProperlyUnmounted(const char *devname)
+{
+    openVolume(devname);
+    bool npru = (sb.mstat != PRU);
+    soCloseRawDisk();
+
+    free(jbuf);
+    jbuf = NULL;
+    jn = 0;
+    return npru;
+}
+
+/* take a fresh copy of the superblock of the volume open through the dealers */
+static void copySuperBlock()
+{
+    memcpy(b0.block, sbGetPointer(), sizeof(SOSuperBlock));
+}
+
+/* ******************************************** */
+
+static void removeDangling()
+{
+    for (uint32_t k = 0; k < ndangling; k++)
+    {
+        int ih = iOpen(dangling[k].dir);
+        try
+        {
+            soDeleteDirEntry(ih, dangling[k].name, NULL);
+            iSave(ih);
+        }
+        catch(SOException & err)
+        {
+            fprintf(stderr, "Directory %u: entry \"%s\" not removed (%s)\n", dangling[k].dir,
+                    dangling[k].name, strerror(err.en));
+        }
+        iClose(ih);
+    }
+}
+
+/* rebuild the list of free clusters with every cluster not used by a file, in ascending order */
+static void rebuildFreeList()
+{
+    SOSuperBlock *sbp = sbGetPointer();
+    FCTRecord *rec[2] = { &sbp->chead, &sbp->ctail };
+    for (int r = 0; r < 2; r++)
+    {
+        for (uint32_t i = 0; i < FCT_CACHE_SIZE; i++)
+            rec[r]->cache.ref[i] = NULL_REFERENCE;
+        rec[r]->cache.in = rec[r]->cache.out = 0;
+        rec[r]->cluster_number = NULL_REFERENCE;
+        rec[r]->cluster_idx = 0;
+    }
+    sbp->cfree = 0;
+    sbp->crefs = 0;
+    sbSave();
+
+    for (uint32_t cn = 0; cn < sb.ctotal; cn++)
+        if (!isSet(usedMap, cn))
+            soFreeCluster(cn);
+}
+
+/* link every inode in use found in no directory into the root directory, as "#<inode number>" */
+static void reconnectOrphans()
+{
+    uint32_t DPC = soGetDPC();
+    SODirEntry de[DPC];
+    int rih = iOpen(0);
+    for (uint32_t in = 1; in < sb.itotal; in++)
+    {
+        if (state[in] != I_INUSE || links[in] != 0)
+            continue;
+
+        char name[SOFS16_MAX_NAME + 1];
+        snprintf(name, sizeof(name), "#%u", in);
+        int ih = iOpen(in);
+        try
+        {
+            soAddDirEntry(rih, name, in);
+            iSave(rih);
+
+            /* a directory gets the root as its parent */
+            if (S_ISDIR(iGetPointer(ih)->mode))
+            {
+                soReadFileCluster(ih, 0, de);
+                if (strcmp(de[1].name, "..") == 0)
+                {
+                    de[1].in = 0;
+                    soWriteFileCluster(ih, 0, de);
+                }
+            }
+        }
+        catch(SOException & err)
+        {
+            fprintf(stderr, "Inode %u: not reconnected (%s)\n", in, strerror(err.en));
+        }
+        iClose(ih);
+    }
+    iClose(rih);
+}
+
+/* set the reference and cluster counts of every inode, and the number of free inodes, to what was found */
+static void fixCounts()
+{
+    for (uint32_t in = 0; in < sb.itotal; in++)
+    {
+        if (state[in] != I_INUSE || links[in] == 0)
+            continue;
+        if (links[in] == refcount[in] && clusters[in] == csize[in])
+            continue;
+
+        int ih = iOpen(in);
+        SOInode *ip = iGetPointer(ih);
+        ip->refcount = (links[in] > UINT16_MAX) ? UINT16_MAX : links[in];
+        ip->csize = clusters[in];
+        iSave(ih);
+        iClose(ih);
+    }
+
+    SOSuperBlock *sbp = sbGetPointer();
+    sbp->ifree = found.ifree;
+    sbSave();
+}
+
+/* repair what the last scan found, rescanning after every step that changes the directories or the free list */
+static void repair()
+{
+    report = false;
+
+    if (ndangling > 0)
+    {
+        removeDangling();
+        jCommit();
+        copySuperBlock();
+        scan();
+    }
+
+    /* before anything is allocated */
+    if (found.badList)
+    {
+        rebuildFreeList();
+        jCommit();
+        copySuperBlock();
+        scan();
+    }
+
+    if (found.orphans > 0)
+    {
+        reconnectOrphans();
+        jCommit();
+        copySuperBlock();
+        scan();
+    }
+
+    if (found.badCounts > 0 || found.ifree != sb.ifree)
+    {
+        fixCounts();
+        jCommit();
+        copySuperBlock();
+        scan();
+    }
+}
+
+/* ******************************************** */
+
+static void printSummary()
+{
+    printf("%u inodes in use, %u free; %u clusters in use, %u free\n",
+           sb.itotal - found.ifree, found.ifree, sb.ctotal - found.cfree, found.cfree);
+}
+
+/* The main function */
+int main(int argc, char *argv[])
+{
+    char *progName = basename(argv[0]);
+    bool fix = false;
+    bool force = false;
+
+    /* process command line options */
+    int opt;
+    while ((opt = getopt(argc, argv, "rfqh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':          /* repair */
+            {
+                fix = true;
+                break;
+            }
+            case 'f':          /* repair even if not properly unmounted */
+            {
+                force = true;
+                break;
+            }
+            case 'q':          /* quiet mode */
+            {
+                quiet = true;
+                break;
+            }
+            case 'h':          /* help mode */
+            {
+                printUsage(progName);
+                return FSCK_OK;
+            }
+            default:
+            {
+                fprintf(stderr, "%s: Wrong option.\n", progName);
+                printUsage(progName);
+                return FSCK_ERROR;
+            }
+        }
+    }
+
+    /* check existence of mandatory argument: storage device name */
+    if ((argc - optind) != 1)
+    {
+        fprintf(stderr, "%s: Wrong number of mandatory arguments.\n", progName);
+        printUsage(progName);
+        return FSCK_ERROR;
+    }
+    const char *devname = argv[optind];
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    int status;
+    try
+    {
+        /* repairing a mounted volume would corrupt it */
+        if (fix && notProperlyUnmounted(devname))
+        {
+            fprintf(stderr, "%s: %s is not marked as properly unmounted: it is either mounted or crashed\n",
+                    progName, devname);
+            if (!force)
+            {
+                fprintf(stderr, "%s: not repairing; unmount it, or use -f if it crashed\n", progName);
+                return FSCK_ERROR;
+            }
+        }
+
+        if (fix)
+        {
+            /* opening through the dealers replays the journal */
+            soOpenDealersDisk(devname, NULL);
+            copySuperBlock();
+        }
+        else
+            openVolume(devname);
+
+        try
+        {
+            sbCheckConsistency(&sb);
+        }
+        catch(SOException & err)
+        {
+            fprintf(stderr, "%s: %s: the superblock is inconsistent, nothing else can be checked.\n",
+                    progName, devname);
+            return FSCK_UNCORRECTED;
+        }
+        if (sb.mstat != PRU && !quiet)
+            printf("The volume is mounted, or was not properly unmounted\n");
+        if (jn > 0 && !quiet)
+            printf("The journal holds a committed transaction of %u blocks, checked as if replayed\n", jn);
+
+        allocScanData();
+        scan();
+        uint32_t problems = found.problems;
+        if (fix && problems > 0)
+            repair();
+
+        printSummary();
+        if (problems == 0)
+        {
+            printf("%s: clean\n", devname);
+            status = FSCK_OK;
+        }
+        else if (!fix)
+        {
+            printf("%s: %u problems found\n", devname, problems);
+            status = FSCK_UNCORRECTED;
+        }
+        else if (found.problems == 0)
+        {
+            printf("%s: %u problems found, all repaired\n", devname, problems);
+            status = FSCK_CORRECTED;
+        }
+        else
+        {
+            printf("%s: %u problems found, %u left\n", devname, problems, found.problems);
+            status = FSCK_UNCORRECTED;
+        }
+
+        if (fix)
+            soCloseDealersDisk();
+        else
+            soCloseRawDisk();
+    }
+    catch(SOException & err)
+    {
+        printError(err.en, progName);
+        return FSCK_ERROR;
+    }
+    free(jbuf);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!quiet)
+        printf("Checked in %.3f s.\n", (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+
+    return status;
+}
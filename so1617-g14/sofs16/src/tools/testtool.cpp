@@ -45,6 +45,9 @@ static FILE *flog = stdout;     /* log stream default */
 static FILE *fin = stdin;       /* input stream */
 static const char *devname = NULL;
 
+/* set if the latency of every command is to be measured and reported */
+static bool timing = false;
+
 static char *progName = NULL;   /* this program's basename */
 static char *progDir = NULL;    /* this program's directory */
 
@@ -59,7 +62,11 @@ static void printUsage(char *cmd_name)
            "  OPTIONS:\n"
            "  -q level --- set quiet mode (default: 0)\n"
            "  -l depth --- set log depth (default: 0,0)\n"
-           "  -h       --- print this help\n", cmd_name);
+           "  -T file  --- record the log in a binary trace file, to be read with showtrace\n"
+           "               (only the last %u events of each thread are kept)\n"
+           "  -s file  --- read the commands from a script file instead of stdin\n"
+           "  -r       --- replay mode: report ops/sec and the latency of each command at the end\n"
+           "  -h       --- print this help\n", cmd_name, TRACE_RING_EVENTS);
 }
 
 /* ******************************************** */
@@ -390,9 +397,10 @@ static void readFileCluster(void)
     iClose(ih);
 
     /* show results */
-    uint32_t csize = bpc / BLOCK_SIZE;
+    uint32_t bsize = soGetRawBlockSize();
+    uint32_t csize = bpc / bsize;
     for (uint32_t i = 0; i < csize; i++)
-        printBlockAsHex(buf + BLOCK_SIZE * i, BLOCK_SIZE * i);
+        printBlockAsHex(buf + bsize * i, bsize * i);
 }
 
 /* ******************************************** */
@@ -582,6 +590,54 @@ void traversePath()
     resultMsg("inode number = %u\n", in);
 }
 
+/* ******************************************** */
+/* fragmentation report */
+static void fragmentation(void)
+{
+    SOSuperBlock *sbp = sbGetPointer();
+    uint32_t bpc = soGetBPC();
+
+    /* count, over all inodes in use, the data clusters and the runs of contiguous ones;
+     * inodes beyond the initialized blocks of the inode table are free, and opening one would
+     * initialize the table up to it, so they are not visited */
+    uint32_t files = 0, fragmented = 0;
+    uint64_t clusters = 0, extents = 0;
+    uint32_t ilimit = sbp->iinit * IPB;
+    for (uint32_t in = 0; in < ilimit; in++)
+    {
+        int ih = iOpen(in);
+        SOInode *ip = iGetPointer(ih);
+        if ((ip->mode & INODE_FREE) == 0)
+        {
+            uint32_t nfc = (ip->size + bpc - 1) / bpc;
+            uint32_t prev = NULL_REFERENCE, fextents = 0;
+            for (uint32_t fcn = 0; fcn < nfc; fcn++)
+            {
+                uint32_t cn;
+                soGetFileCluster(ih, fcn, &cn);
+                if (cn == NULL_REFERENCE)
+                    continue;
+                if (prev == NULL_REFERENCE || cn != prev + 1)
+                    fextents++;
+                prev = cn;
+                clusters++;
+            }
+            if (fextents > 0)
+                files++;
+            if (fextents > 1)
+                fragmented++;
+            extents += fextents;
+        }
+        iClose(ih);
+    }
+
+    /* print result: the percentage of consecutive clusters of a file that are not contiguous on disk */
+    double frag = (clusters > files) ? 100.0 * (extents - files) / (clusters - files) : 0.0;
+    resultMsg("%u files with data, %u of them fragmented\n", files, fragmented);
+    resultMsg("%" PRIu64 " data clusters in %" PRIu64 " extents, fragmentation = %.2f%%\n",
+            clusters, extents, frag);
+}
+
 /* ******************************************** */
 /* get inode permissions */
 void setInodeAccess()
@@ -700,7 +756,7 @@ static handler hdl[] = {
     /* 16 */ renameDirEntry,
     /* 17 */ deleteDirEntry,
     /* 18 */ traversePath,
-    /* 19 */ notUsed,
+    /* 19 */ fragmentation,
     /* 20 */ checkInodeAccess,
     /* 21 */ setInodeAccess,
     /* 22 */ incInodeRefcount,
@@ -732,13 +788,104 @@ static void printMenu(void)
          "+-------------------------------+------------------------------+\n"
          "| 14 - get direntry             | 15 - add direntry            |\n"
          "| 16 - rename direntry          | 17 - delete direntry         |\n"
-         "| 18 - traverse path            | 19 - NOT USED                |\n"
+         "| 18 - traverse path            | 19 - fragmentation report    |\n"
          "+-------------------------------+------------------------------+\n"
          "+ 20 - check inode access       | 21 - set inode access        +\n"
          "+ 22 - inc inode refcount       | 23 - dec inode refcount      +\n"
          "+==============================================================+\n");
 }
 
+/* ******************************************** */
+/* read the next command number, skipping comment lines started by '#'
+ * returns false on end of input */
+static bool readCommand(unsigned int *cmdNumb)
+{
+    while (true)
+    {
+        int c;
+        while ((c = fgetc(fin)) == ' ' || c == '\t' || c == '\n')
+            ;
+        if (c == EOF)
+            return false;
+        if (c == '#')
+        {
+            fPurge(fin);
+            continue;
+        }
+        ungetc(c, fin);
+
+        if (fscanf(fin, "%u", cmdNumb) != 1)
+            *cmdNumb = HDL_LEN;     /* garbage, taken as an unused command */
+        fPurge(fin);
+        return true;
+    }
+}
+
+/* ******************************************** */
+/* latencies of the commands, in nanoseconds, for the replay report */
+struct Latencies
+{
+    uint64_t *ns;
+    uint32_t count;
+    uint32_t size;
+    uint64_t sum;
+};
+
+static Latencies lat[HDL_LEN];
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void addLatency(unsigned int cmdNumb, uint64_t ns)
+{
+    Latencies *lp = &lat[cmdNumb];
+    if (lp->count == lp->size)
+    {
+        uint32_t size = (lp->size == 0) ? 256 : 2 * lp->size;
+        uint64_t *p = (uint64_t *) realloc(lp->ns, size * sizeof(uint64_t));
+        if (p == NULL)
+            return;
+        lp->ns = p;
+        lp->size = size;
+    }
+    lp->ns[lp->count++] = ns;
+    lp->sum += ns;
+}
+
+static int cmpLatency(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* print the number of commands run per second and, for each command, its latency distribution */
+static void printReport(uint64_t elapsed)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 1; i < HDL_LEN; i++)
+        total += lat[i].count;
+
+    fprintf(stdout, "%" PRIu64 " commands in %.3f ms: %.1f ops/sec\n",
+            total, elapsed / 1e6, (elapsed == 0) ? 0.0 : total * 1e9 / elapsed);
+    fprintf(stdout, "%4s %8s %10s %10s %10s %10s %10s   (microseconds)\n",
+            "cmd", "count", "mean", "min", "p50", "p99", "max");
+    for (uint32_t i = 1; i < HDL_LEN; i++)
+    {
+        Latencies *lp = &lat[i];
+        if (lp->count == 0)
+            continue;
+        qsort(lp->ns, lp->count, sizeof(uint64_t), cmpLatency);
+        fprintf(stdout, "%4u %8u %10.1f %10.1f %10.1f %10.1f %10.1f\n", i, lp->count,
+                lp->sum / 1e3 / lp->count, lp->ns[0] / 1e3, lp->ns[lp->count / 2] / 1e3,
+                lp->ns[(uint64_t) lp->count * 99 / 100] / 1e3, lp->ns[lp->count - 1] / 1e3);
+        free(lp->ns);
+    }
+}
+
 /* ******************************************** */
 /* The main function */
 int main(int argc, char *argv[])
@@ -747,7 +894,7 @@ int main(int argc, char *argv[])
     progDir = dirname(argv[0]);
     /* process command line options */
     int opt;
-    while ((opt = getopt(argc, argv, "l:q:h")) != -1)
+    while ((opt = getopt(argc, argv, "l:q:T:s:rh")) != -1)
     {
         switch (opt)
         {
@@ -763,6 +910,34 @@ int main(int argc, char *argv[])
                 soSetProbeDepths(lower, higher);
                 break;
             }
+            case 'T':          /* trace file */
+            {
+                try
+                {
+                    soOpenTrace(optarg);
+                }
+                catch (SOException & err)
+                {
+                    errorMsg("%s: Can't open trace file \"%s\".\n", progName, optarg);
+                    printUsage(progName);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 's':          /* script file */
+            {
+                if ((fin = fopen(optarg, "r")) == NULL)
+                {
+                    errnoMsg(errno, "%s: Can't open script file \"%s\"", progName, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 'r':          /* replay mode */
+            {
+                timing = true;
+                break;
+            }
             case 'q':          /* quiet mode */
             {
                 quiet = atoi(optarg);
@@ -810,20 +985,19 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    /* process the command */
+    /* process the commands, until command 0 or the end of the input */
+    uint64_t start = nowNs();
     while (true)
     {
         printMenu();
         promptMsg("\nYour command: ");
         unsigned int cmdNumb;
-        scanf("%u", &cmdNumb);
-        fPurge(stdin);
-
-        if (cmdNumb == 0)
+        if (!readCommand(&cmdNumb) || cmdNumb == 0)
         {
             break;
         } else if (cmdNumb < HDL_LEN)
         {
+            uint64_t t0 = timing ? nowNs() : 0;
             try
             {
                 hdl[cmdNumb] ();
@@ -832,6 +1006,8 @@ int main(int argc, char *argv[])
             {
                 errnoMsg(err.en, err.msg);
             }
+            if (timing)
+                addLatency(cmdNumb, nowNs() - t0);
         } else
         {
             notUsed();
@@ -848,6 +1024,11 @@ int main(int argc, char *argv[])
         errnoMsg(err.en, err.msg);
     }
 
+    if (timing)
+        printReport(nowNs() - start);
+    if (fin != stdin)
+        fclose(fin);
+
     /* that's all */
     promptMsg("Bye!\n");
     return EXIT_SUCCESS;
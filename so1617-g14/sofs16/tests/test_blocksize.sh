@@ -0,0 +1,36 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Some data, spanning several clusters of any size
+head -c 300000 /dev/urandom > /tmp/sofs16data
+
+# Format with several block sizes (in bytes) and blocks per cluster,
+# up to 64 KiB clusters, and check the data survives a remount
+mkdir $mountpoint
+for bc in "512 1" "512 128" "1024 8" "4096 1" "4096 16" "65536 1"
+do
+    set -- $bc
+    echo "block size $1, $2 blocks per cluster"
+    rm -f $diskname
+    truncate -s 64M $diskname
+    $bin/mksofs -q -b $1 -c $2 $diskname
+
+    $bin/sofsmount -l 1,1000 $diskname $mountpoint
+    cp /tmp/sofs16data $mountpoint/data
+    fusermount -u $mountpoint
+
+    $bin/sofsmount -l 1,1000 $diskname $mountpoint
+    cmp $mountpoint/data /tmp/sofs16data
+    fusermount -u $mountpoint
+done
+
+# Invalid combinations must be refused
+$bin/mksofs -q -b 1000 $diskname && echo "block size 1000 accepted"
+$bin/mksofs -q -b 4096 -c 32 $diskname && echo "128 KiB clusters accepted"
+
+# Cleanup
+rm -rf $mountpoint /tmp/sofs16data
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk
+$bin/createDisk $diskname 20000
+$bin/mksofs $diskname
+
+# Grow two files at the same time, with many small appends
+head -c 1000000 /dev/urandom > /tmp/delalloc.dat
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+for f in a b
+do
+    dd if=/tmp/delalloc.dat of=$mountpoint/$f bs=512 2>/dev/null &
+done
+wait
+
+# Data read back, before and after the buffers are flushed, must be the same
+for f in a b
+do
+    cmp /tmp/delalloc.dat $mountpoint/$f && echo "$f: same"
+done
+fusermount -u $mountpoint
+$bin/sofsmount $diskname $mountpoint
+for f in a b
+do
+    cmp /tmp/delalloc.dat $mountpoint/$f && echo "$f: same after remount"
+done
+fusermount -u $mountpoint
+rm -rf $mountpoint /tmp/delalloc.dat
+
+# Clusters are only allocated at flush time, so each file should be in few extents
+fragmentation
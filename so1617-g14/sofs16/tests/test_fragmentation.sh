@@ -0,0 +1,24 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk
+$bin/createDisk $diskname 20000
+$bin/mksofs $diskname
+
+# Grow two files at the same time, a cluster at a time
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+for f in a b
+do
+    dd if=/dev/zero of=$mountpoint/$f bs=1k count=2000 oflag=sync 2>/dev/null &
+done
+wait
+fusermount -u $mountpoint
+rm -rf $mountpoint
+
+# Their clusters should mostly be in long runs, not interleaved
+fragmentation
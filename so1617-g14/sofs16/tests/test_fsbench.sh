@@ -0,0 +1,22 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Benchmark through the system calls layer, on a freshly formatted disk
+$bin/createDisk $diskname 400000
+$bin/mksofs $diskname
+$bin/fsbench -t direct $diskname > fsbench_direct.json
+
+# The same, through FUSE
+$bin/createDisk $diskname 400000
+$bin/mksofs $diskname
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+$bin/fsbench -t mounted -m $mountpoint > fsbench_mounted.json
+fusermount -u $mountpoint
+rm -rf $mountpoint
+
+cat fsbench_direct.json fsbench_mounted.json
@@ -0,0 +1,21 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk
+$bin/createDisk $diskname 1000
+$bin/mksofs $diskname
+
+# Allocate some inodes of type regular file
+alloc_inodes 20 1
+
+# Free some of them; the next allocations should reuse them,
+# without following any list of free inodes
+free_inodes 3 4 9 17
+alloc_inodes 4 1
+
+$bin/showblock -i 1-3 $diskname
+$bin/showblock -s 0 $diskname
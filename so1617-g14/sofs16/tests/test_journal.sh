@@ -0,0 +1,32 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk, with a journal
+$bin/createDisk $diskname 20000
+$bin/mksofs -j 512 $diskname
+
+# Change some metadata, make it durable with an fsync and crash the mount
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+mkdir $mountpoint/d
+for i in $(seq 1 20)
+do
+    echo $i > $mountpoint/d/f$i
+done
+mv $mountpoint/d/f1 $mountpoint/g
+rm $mountpoint/d/f2
+dd if=/dev/zero of=$mountpoint/d/f3 bs=1k count=10 conv=fsync 2>/dev/null
+pkill -9 -f "sofsmount $diskname"
+fusermount -u $mountpoint
+
+# Everything done before the fsync must be there, in a consistent file system
+$bin/sofsmount $diskname $mountpoint
+ls $mountpoint $mountpoint/d
+cat $mountpoint/g $mountpoint/d/f20
+fusermount -u $mountpoint
+rm -rf $mountpoint
+fragmentation
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create a sparse 6 GiB disk and format it with 4 KiB clusters
+rm -f $diskname
+truncate -s 6G $diskname
+$bin/mksofs -q -c 8 $diskname
+
+# Mount
+mkdir $mountpoint
+$bin/sofsmount -l 1,1000 $diskname $mountpoint
+
+# Write 1 MiB at the head and 1 MiB past the 4 GiB mark
+head -c 1048576 /dev/urandom > /tmp/sofs16chunk
+dd if=/tmp/sofs16chunk of=$mountpoint/big bs=1M conv=notrunc 2>/dev/null
+dd if=/tmp/sofs16chunk of=$mountpoint/big bs=1M seek=4100 conv=notrunc 2>/dev/null
+
+# Check the size and both chunks, remounting in between so they come from disk
+fusermount -u $mountpoint
+$bin/sofsmount -l 1,1000 $diskname $mountpoint
+size=$(stat -c %s $mountpoint/big)
+[ $size -eq $((4101 * 1048576)) ] || echo "wrong size: $size"
+cmp <(dd if=$mountpoint/big bs=1M count=1 2>/dev/null) /tmp/sofs16chunk
+cmp <(dd if=$mountpoint/big bs=1M skip=4100 2>/dev/null) /tmp/sofs16chunk
+
+# Unmount
+fusermount -u $mountpoint
+rm -rf $mountpoint /tmp/sofs16chunk
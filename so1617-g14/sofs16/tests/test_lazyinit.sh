@@ -0,0 +1,27 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk, leaving the table of inodes to be initialized on demand
+$bin/createDisk $diskname 20000
+$bin/mksofs -l -i 4000 $diskname
+
+# Use more inodes than the first block of the table holds
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+for i in $(seq 1 200)
+do
+    echo $i > $mountpoint/f$i
+done
+fusermount -u $mountpoint
+
+# The files are there after a remount, and only the used blocks were initialized
+$bin/sofsmount $diskname $mountpoint
+ls $mountpoint | wc -l
+cat $mountpoint/f1 $mountpoint/f200
+fusermount -u $mountpoint
+rm -rf $mountpoint
+$bin/showblock -s 0 $diskname | grep -i "initialized"
@@ -0,0 +1,22 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk
+$bin/createDisk $diskname 10000
+$bin/mksofs $diskname
+
+# Do some work, then read the metrics of the mounted volume
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+mkdir -p $mountpoint/a/b/c
+for i in $(seq 1 50); do echo "file $i" > $mountpoint/a/b/c/f$i; done
+cat $mountpoint/a/b/c/f* > /dev/null
+rm $mountpoint/a/b/c/f1*
+ls -la $mountpoint/.sofs-stats
+python3 -m json.tool $mountpoint/.sofs-stats | head -40
+fusermount -u $mountpoint
+rm -rf $mountpoint
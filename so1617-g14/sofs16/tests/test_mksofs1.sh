@@ -2,6 +2,20 @@
 
 source tools.sh
 
+# Compare a disk formatted by mksofs with one formatted by mksofs_bin.
+# Since format version 0x2017 (64-bit file sizes) the inode table differs from
+# the reference, since 0x2018 (block size in the superblock) so does the
+# superblock header and since 0x2019 (no list of free inodes) so do ihead and
+# itail, so only the superblock from czstart on and the cluster zone are
+# compared. Devices this small get no journal (0x201A), so the cluster zone
+# still starts where the reference puts it.
+compare()
+{
+    czstart=$(od -An -tu4 -j64 -N4 $1)
+    diff <(dd if=$1 bs=512 count=1 2>/dev/null | tail -c +65 | xxd) <(dd if=$2 bs=512 count=1 2>/dev/null | tail -c +65 | xxd)
+    diff <(dd if=$1 bs=512 skip=$czstart 2>/dev/null | xxd) <(dd if=$2 bs=512 skip=$czstart 2>/dev/null | xxd)
+}
+
 # Clean and recompile
 (cd .. && make clean && make)
 
@@ -21,25 +35,25 @@ do
     #Teste 1
     $bin/mksofs $quiet $copy1
     $bin/mksofs_bin $quiet $copy2
-    diff <(xxd $copy1) <(xxd $copy2)
+    compare $copy1 $copy2
 
     #Teste 2
     $bin/mksofs $quiet -n sofs $copy1
     $bin/mksofs_bin $quiet -n sofs $copy2
-    diff <(xxd $copy1) <(xxd $copy2)
+    compare $copy1 $copy2
 
     #Teste 3
     $bin/mksofs $quiet -n sofs -i 28 $copy1
     $bin/mksofs_bin $quiet -n sofs -i 28 $copy2
-    diff <(xxd $copy1) <(xxd $copy2)
+    compare $copy1 $copy2
 
     #Teste 4
     $bin/mksofs $quiet -n sofs -i 235 -c 3 $copy1
     $bin/mksofs_bin $quiet -n sofs -i 235 -c 3 $copy2
-    diff <(xxd $copy1) <(xxd $copy2)
+    compare $copy1 $copy2
 
     #Teste 5
     $bin/mksofs $quiet -n sofs -i 37 -c 4 -z $copy1
     $bin/mksofs_bin $quiet -n sofs -i 37 -c 4 -z $copy2
-    diff <(xxd $copy1) <(xxd $copy2)
+    compare $copy1 $copy2
 done
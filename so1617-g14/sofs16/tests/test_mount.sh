@@ -0,0 +1,35 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk, with a large table of inodes
+$bin/createDisk $diskname 200000
+$bin/mksofs -i 100000 $diskname
+
+# While mounted, the volume is marked as not properly unmounted
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+$bin/showblock -s 0 $diskname | grep "Properly unmounted"
+touch $mountpoint/a
+
+# A hole of a sparse file reads as zeros, not as whatever the device holds there
+printf 'head' | dd of=$mountpoint/sparse conv=notrunc 2>/dev/null
+printf 'tail' | dd of=$mountpoint/sparse bs=1M seek=1 conv=notrunc 2>/dev/null
+dd if=$mountpoint/sparse bs=1M count=1 2>/dev/null | cmp - <(printf 'head'; head -c $((1048576 - 4)) /dev/zero) && echo "Sparse file read OK"
+fusermount -u $mountpoint
+$bin/showblock -s 0 $diskname | grep "Properly unmounted"
+
+# A clean mount only reads the superblock; after a crash, the inode table is checked in full
+time $bin/sofsmount $diskname $mountpoint
+fusermount -u $mountpoint
+$bin/sofsmount $diskname $mountpoint
+pkill -9 -f "sofsmount $diskname"
+fusermount -u $mountpoint
+$bin/showblock -s 0 $diskname | grep "Properly unmounted"
+time $bin/sofsmount $diskname $mountpoint
+ls $mountpoint
+fusermount -u $mountpoint
+rm -rf $mountpoint
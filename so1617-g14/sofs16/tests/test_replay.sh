@@ -0,0 +1,38 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk
+$bin/createDisk $diskname 1000
+$bin/mksofs $diskname
+
+# A recorded sequence of operations: the commands of testtool, with their
+# arguments, one per line
+ops=/tmp/sofs16ops
+{
+    echo "# 20 files in the root directory, each with one cluster"
+    for i in $(seq 1 20)
+    do
+        echo -e "2\n1"
+        echo -e "15\n0\nfile$i\n$i"
+        echo -e "9\n$i\n0"
+    done
+    echo "# look them up, then remove them"
+    for i in $(seq 1 20)
+    do
+        echo -e "18\n/file$i"
+    done
+    for i in $(seq 1 20)
+    do
+        echo -e "17\n0\nfile$i"
+        echo -e "10\n$i\n0"
+        echo -e "3\n$i"
+    done
+} > $ops
+
+# Replay it in a single session
+replay $ops
+rm -f $ops
@@ -0,0 +1,33 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk, with a journal
+$bin/createDisk $diskname 5000
+$bin/mksofs $diskname
+
+# A durable file, and the rest of the disk filled but for a few clusters
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+head -c 65536 /dev/urandom > /tmp/sofs16a
+dd if=/tmp/sofs16a of=$mountpoint/a conv=fsync 2>/dev/null
+bpc=$(stat -f -c %S $mountpoint)
+free=$(stat -f -c %f $mountpoint)
+dd if=/dev/zero of=$mountpoint/fill bs=$bpc count=$((free - 12)) conv=fsync 2>/dev/null
+
+# Remove the file, write another one where its clusters are the most
+# attractive free ones, and crash before the removal is committed
+rm $mountpoint/a
+head -c 8192 /dev/urandom > $mountpoint/b
+pkill -9 -f "sofsmount $diskname"
+fusermount -u $mountpoint
+
+# The removal is undone, and the file must still hold its own data
+$bin/sofsmount $diskname $mountpoint
+cmp /tmp/sofs16a $mountpoint/a && echo "Removed file intact after the crash"
+fusermount -u $mountpoint
+$bin/sofsck $diskname
+rm -rf $mountpoint /tmp/sofs16a
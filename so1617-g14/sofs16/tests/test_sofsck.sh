@@ -0,0 +1,41 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk
+$bin/createDisk $diskname 20000
+$bin/mksofs $diskname
+
+# Fill in some directories and files, and check the volume after a clean unmount
+mkdir $mountpoint
+$bin/sofsmount $diskname $mountpoint
+for d in $(seq 1 5)
+do
+    mkdir $mountpoint/d$d
+    for i in $(seq 1 20)
+    do
+        dd if=/dev/urandom of=$mountpoint/d$d/f$i bs=1k count=$((i * 10)) 2>/dev/null
+    done
+done
+ln $mountpoint/d1/f1 $mountpoint/l1
+rm $mountpoint/d2/f2
+fusermount -u $mountpoint
+$bin/sofsck $diskname
+
+# Check it while mounted, and after a crash, when the journal may hold a committed transaction
+$bin/sofsmount $diskname $mountpoint
+mkdir $mountpoint/d6
+dd if=/dev/zero of=$mountpoint/d6/f bs=1k count=100 conv=fsync 2>/dev/null
+$bin/sofsck $diskname
+pkill -9 -f "sofsmount $diskname"
+fusermount -u $mountpoint
+rm -rf $mountpoint
+$bin/sofsck $diskname
+
+# Repair is refused on a volume not properly unmounted, unless forced;
+# it replays the journal first, so it must find nothing to do
+$bin/sofsck -r $diskname
+$bin/sofsck -r -f $diskname
@@ -0,0 +1,25 @@
+#!/bin/bash
+
+source tools.sh
+
+# Clean and recompile
+(cd .. && make clean && make)
+
+# Create and format disk
+$bin/createDisk $diskname 10000
+$bin/mksofs $diskname
+
+# Record every probing message of a session in a binary trace
+mkdir $mountpoint
+$bin/sofsmount -l 0,1000 -T trace.bin $diskname $mountpoint
+mkdir $mountpoint/dir
+echo "hello" > $mountpoint/dir/file
+cat $mountpoint/dir/file
+fusermount -u $mountpoint
+sleep 1
+
+# Decode it: everything, then only the system calls, with their times and threads
+$bin/showtrace -s trace.bin
+$bin/showtrace trace.bin | tail -20
+$bin/showtrace -t -l 211,239 trace.bin
+rm -rf $mountpoint trace.bin
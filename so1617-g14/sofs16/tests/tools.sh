@@ -5,14 +5,17 @@ diskname="/tmp/sofs16disk"
 mountpoint="/tmp/sofs16mnt"
 testtool_flags="-l 1,1000"
 
+# The loops below feed all their commands to a single testtool session,
+# which ends with its input, so the disk is opened only once
+
 # Allocate $1 inodes of type $2
 # alloc_inodes 10 1
 alloc_inodes()
 {
     for i in $(seq 1 $1)
     do
-        echo -e "2\n$2\n0\n" | $bin/testtool $diskname $testtool_flags
-    done
+        echo -e "2\n$2"
+    done | $bin/testtool $diskname $testtool_flags
 }
 
 # Frees given inodes
@@ -21,8 +24,8 @@ free_inodes()
 {
     for i in $*
     do
-        echo -e "3\n$i\n0\n" | $bin/testtool $diskname $testtool_flags
-    done
+        echo -e "3\n$i"
+    done | $bin/testtool $diskname $testtool_flags
 }
 
 # Allocates $1 clusters
@@ -31,8 +34,8 @@ alloc_clusters()
 {
     for i in $(seq 1 $1)
     do
-        echo -e "4\n0\n" | $bin/testtool $diskname $testtool_flags
-    done
+        echo "4"
+    done | $bin/testtool $diskname $testtool_flags
 }
 
 # Frees given clusters
@@ -41,8 +44,8 @@ free_clusters()
 {
     for i in $*
     do
-        echo -e "5\n$i\n0\n" | $bin/testtool $diskname $testtool_flags
-    done
+        echo -e "5\n$i"
+    done | $bin/testtool $diskname $testtool_flags
 }
 
 # Replenish head cache
@@ -112,3 +115,18 @@ traverse_path()
 {
     echo -e "18\n$1\n0\n" | $bin/testtool $diskname $testtool_flags
 }
+
+# Report fragmentation of the files' clusters
+# fragmentation
+fragmentation()
+{
+    echo -e "19\n0\n" | $bin/testtool $diskname $testtool_flags
+}
+
+# Run the testtool commands in script $1, one per line, in a single session,
+# reporting ops/sec and the latency of each command
+# replay ops.txt
+replay()
+{
+    $bin/testtool -q 1 -r -s $1 $diskname
+}